@@ -0,0 +1,98 @@
+/*
+ * CalcMySky - a simulator of light scattering in planetary atmospheres
+ * Copyright © 2025 Ruslan Kabatsayev
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335, USA.
+ */
+
+/* Packs a computed model directory into a single bundle file, which the renderer can load instead of the directory.
+ */
+
+#include <iostream>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFileInfo>
+#include <QFile>
+
+#include "config.h"
+#include "../common/util.hpp"
+#include "../common/ModelBundle.hpp"
+#include "../common/ModelManifest.hpp"
+
+int main(int argc, char** argv)
+{
+    [[maybe_unused]] UTF8Console utf8console;
+
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("calcmysky-bundle");
+    app.setApplicationVersion(PROJECT_VERSION);
+
+    try
+    {
+        QCommandLineParser parser;
+        parser.setApplicationDescription("Pack a model computed by calcmysky into a single bundle file");
+        parser.addHelpOption();
+        parser.addVersionOption();
+        const QCommandLineOption outOpt("out","Bundle file to write","file");
+        parser.addOption(outOpt);
+        parser.addPositionalArgument("model-dir", "Directory of the model", "dir");
+        parser.process(app);
+
+        const auto args=parser.positionalArguments();
+        if(args.size()!=1 || !parser.isSet(outOpt))
+            parser.showHelp(1);
+        const auto modelDir=args[0];
+        const auto outFile=parser.value(outOpt);
+
+        if(!QFileInfo(modelDir).isDir())
+        {
+            std::cerr << "\"" << modelDir << "\" is not a directory\n";
+            throw MustQuit{};
+        }
+        // Models computed before the manifest was introduced can be bundled too
+        if(!QFile::exists(modelDir+"/"+MODEL_MANIFEST_FILENAME))
+        {
+            std::cerr << "Writing model manifest... ";
+            if(const auto error=writeModelManifest(modelDir); !error.isEmpty())
+            {
+                std::cerr << "failed: " << error << "\n";
+                throw MustQuit{};
+            }
+            std::cerr << "done\n";
+        }
+
+        std::cerr << "Writing bundle \"" << outFile << "\"... ";
+        if(const auto error=writeModelBundle(modelDir, outFile); !error.isEmpty())
+        {
+            std::cerr << "failed: " << error << "\n";
+            throw MustQuit{};
+        }
+        std::cerr << "done\n";
+    }
+    catch(ShowMySky::Error const& ex)
+    {
+        std::cerr << QObject::tr("Error: %1\n").arg(ex.what());
+        return 1;
+    }
+    catch(MustQuit& ex)
+    {
+        return ex.exitCode;
+    }
+    catch(std::exception const& ex)
+    {
+        std::cerr << "Fatal error: " << QString::fromLocal8Bit(ex.what()) << '\n';
+        return 111;
+    }
+}
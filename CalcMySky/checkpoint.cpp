@@ -0,0 +1,354 @@
+/*
+ * CalcMySky - a simulator of light scattering in planetary atmospheres
+ * Copyright © 2025 Ruslan Kabatsayev
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335, USA.
+ */
+
+#include "checkpoint.hpp"
+
+#include <set>
+#include <memory>
+#include <cstdint>
+#include <iostream>
+#include <QCryptographicHash>
+#include <QTextStream>
+#include <QFile>
+#include <QDir>
+
+#include "data.hpp"
+#include "util.hpp"
+#include "interpolation-guides.hpp"
+
+namespace
+{
+
+constexpr char journalHeader[]="# CalcMySky checkpoint journal";
+constexpr char configKey[]="config ";
+constexpr char stageFinishedKey[]="done ";
+
+bool checkpointingEnabled=false;
+bool stateRestored=false;
+std::set<std::pair<unsigned/*texIndex*/, std::string/*stage*/>> finishedStages;
+// Number of entries in the journal. Its parity selects the state directory to save to, so that
+// the state of the last journaled stage is never overwritten before a new entry is appended.
+unsigned numStagesFinished=0;
+
+struct SavedTexture
+{
+    TextureId id;
+    GLenum target;
+    const char* fileName;
+};
+const SavedTexture texturesToSave[]={
+                                     {TEX_TRANSMITTANCE, GL_TEXTURE_2D, "transmittance.f32"},
+                                     {TEX_IRRADIANCE, GL_TEXTURE_2D, "irradiance.f32"},
+                                     {TEX_DELTA_IRRADIANCE, GL_TEXTURE_2D, "delta-irradiance.f32"},
+                                     {TEX_DELTA_SCATTERING, GL_TEXTURE_3D, "delta-scattering.f32"},
+                                     {TEX_MULTIPLE_SCATTERING, GL_TEXTURE_3D, "multiple-scattering.f32"},
+                                     {TEX_LIGHT_POLLUTION_SCATTERING_LUMINANCE, GL_TEXTURE_2D, "light-pollution-luminance.f32"},
+                                    };
+constexpr char edsAccumulatorFileName[]="eclipsed-double-scattering-accumulator.f32";
+
+QString checkpointDir() { return QString::fromStdString(atmo.textureOutputDir)+"/checkpoint"; }
+QString journalPath() { return checkpointDir()+"/journal"; }
+QString stateDir(const unsigned journalEntryIndex) { return checkpointDir()+"/state"+QString::number(journalEntryIndex%2); }
+QString accumulatedSingleScatteringFileName(QString const& scattererName)
+{
+    return "accumulated-single-scattering-"+scattererName+".f32";
+}
+
+QString configurationHash()
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(atmo.descriptionFileText.toUtf8());
+    hash.addData(QByteArray::number(opts.saveResultAsRadiance));
+    hash.addData(QByteArray::number(opts.dbgNoEDSTextures));
+    hash.addData(QByteArray::number(opts.textureSavePrecision));
+    hash.addData(QByteArray::number(opts.firstWLSet));
+    hash.addData(QByteArray::number(opts.lastWLSet));
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+void writeStateFile(QString const& path, std::vector<int32_t> const& sizes, const void* data, const size_t dataSize)
+{
+    QFile out(path);
+    if(!out.open(QFile::WriteOnly))
+    {
+        std::cerr << "failed to open \"" << path << "\": " << out.errorString() << "\n";
+        throw MustQuit{};
+    }
+    out.write(reinterpret_cast<const char*>(sizes.data()), sizes.size()*sizeof sizes[0]);
+    out.write(static_cast<const char*>(data), dataSize);
+    out.close();
+    if(out.error())
+    {
+        std::cerr << "failed to write \"" << path << "\": " << out.errorString() << "\n";
+        throw MustQuit{};
+    }
+}
+
+// Returns an empty array if the file doesn't exist
+std::unique_ptr<GLfloat[]> readStateFile(QString const& path, std::vector<int32_t>& sizes)
+{
+    QFile in(path);
+    if(!in.exists()) return {};
+    if(!in.open(QFile::ReadOnly))
+    {
+        std::cerr << "failed to open \"" << path << "\": " << in.errorString() << "\n";
+        throw MustQuit{};
+    }
+    const qint64 headerSize=sizes.size()*sizeof sizes[0];
+    if(in.read(reinterpret_cast<char*>(sizes.data()), headerSize) != headerSize)
+    {
+        std::cerr << "failed to read header of \"" << path << "\": " << in.errorString() << "\n";
+        throw MustQuit{};
+    }
+    qint64 subpixelCount=4;
+    for(const auto s : sizes)
+        subpixelCount *= s;
+    const qint64 dataSize=subpixelCount*sizeof(GLfloat);
+    if(in.size() != headerSize+dataSize)
+    {
+        std::cerr << "size of \"" << path << "\" doesn't match its header\n";
+        throw MustQuit{};
+    }
+    std::unique_ptr<GLfloat[]> data(new GLfloat[subpixelCount]);
+    if(in.read(reinterpret_cast<char*>(data.get()), dataSize) != dataSize)
+    {
+        std::cerr << "failed to read \"" << path << "\": " << in.errorString() << "\n";
+        throw MustQuit{};
+    }
+    return data;
+}
+
+void saveTextureState(const GLenum target, const GLuint texture, QString const& path)
+{
+    gl.glActiveTexture(GL_TEXTURE0);
+    gl.glBindTexture(target,texture);
+    std::vector<int32_t> sizes{1,1,1};
+    gl.glGetTexLevelParameteriv(target,0,GL_TEXTURE_WIDTH,&sizes[0]);
+    gl.glGetTexLevelParameteriv(target,0,GL_TEXTURE_HEIGHT,&sizes[1]);
+    if(target==GL_TEXTURE_3D)
+        gl.glGetTexLevelParameteriv(target,0,GL_TEXTURE_DEPTH,&sizes[2]);
+    // Some accumulators get their storage only when first used, nothing to save then
+    if(sizes[0]==0) return;
+
+    const auto subpixelCount=4*size_t(sizes[0])*sizes[1]*sizes[2];
+    const std::unique_ptr<GLfloat[]> subpixels(new GLfloat[subpixelCount]);
+    gl.glGetTexImage(target, 0, GL_RGBA, GL_FLOAT, subpixels.get());
+    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
+    {
+        std::cerr << "GL error in saveTextureState() after glGetTexImage() call: " << openglErrorString(err) << "\n";
+        throw MustQuit{};
+    }
+    writeStateFile(path, sizes, subpixels.get(), subpixelCount*sizeof subpixels[0]);
+}
+
+bool restoreTextureState(const GLenum target, const GLuint texture, QString const& path)
+{
+    std::vector<int32_t> sizes{1,1,1};
+    const auto subpixels=readStateFile(path, sizes);
+    if(!subpixels) return false;
+
+    gl.glActiveTexture(GL_TEXTURE0);
+    gl.glBindTexture(target,texture);
+    if(target==GL_TEXTURE_3D)
+        gl.glTexImage3D(target,0,GL_RGBA32F,sizes[0],sizes[1],sizes[2],0,GL_RGBA,GL_FLOAT,subpixels.get());
+    else
+        gl.glTexImage2D(target,0,GL_RGBA32F,sizes[0],sizes[1],0,GL_RGBA,GL_FLOAT,subpixels.get());
+    gl.glBindTexture(target,0);
+    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
+    {
+        std::cerr << "GL error in restoreTextureState(): " << openglErrorString(err) << "\n";
+        throw MustQuit{};
+    }
+    return true;
+}
+
+void saveState(QString const& dir)
+{
+    QDir(dir).removeRecursively();
+    createDirs(dir.toStdString());
+
+    for(const auto& tex : texturesToSave)
+        saveTextureState(tex.target, textures[tex.id], dir+"/"+tex.fileName);
+    for(const auto& [scattererName, texture] : accumulatedSingleScatteringTextures)
+        saveTextureState(GL_TEXTURE_3D, texture, dir+"/"+accumulatedSingleScatteringFileName(scattererName));
+
+    const auto& eds=eclipsedDoubleScatteringAccumulatorTexture;
+    if(!eds.empty())
+    {
+        writeStateFile(dir+"/"+edsAccumulatorFileName, {int32_t(eds.size())},
+                       eds.data(), eds.size()*sizeof eds[0]);
+    }
+}
+
+void restoreState(QString const& dir)
+{
+    std::cerr << indentOutput() << "Restoring intermediate data saved in the previous run... ";
+
+    for(const auto& tex : texturesToSave)
+        restoreTextureState(tex.target, textures[tex.id], dir+"/"+tex.fileName);
+    for(const auto& scatterer : atmo.scatterers)
+    {
+        const auto path=dir+"/"+accumulatedSingleScatteringFileName(scatterer.name);
+        if(!QFile::exists(path)) continue;
+        auto& texture=accumulatedSingleScatteringTextures[scatterer.name];
+        if(!texture)
+            texture=createAccumulatorTexture3D();
+        restoreTextureState(GL_TEXTURE_3D, texture, path);
+    }
+
+    std::vector<int32_t> sizes{0};
+    if(const auto data=readStateFile(dir+"/"+edsAccumulatorFileName, sizes))
+    {
+        const auto begin=reinterpret_cast<const glm::vec4*>(data.get());
+        eclipsedDoubleScatteringAccumulatorTexture.assign(begin, begin+sizes[0]);
+    }
+
+    std::cerr << "done\n";
+}
+
+void startNewJournal(QString const& configHash)
+{
+    QDir(checkpointDir()).removeRecursively();
+    createDirs(checkpointDir().toStdString());
+
+    QFile file(journalPath());
+    if(!file.open(QFile::WriteOnly))
+    {
+        std::cerr << "Failed to create checkpoint journal \"" << journalPath() << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    QTextStream out(&file);
+    out << journalHeader << "\n" << configKey << configHash << "\n";
+    out.flush();
+    file.close();
+    if(file.error())
+    {
+        std::cerr << "Failed to write checkpoint journal \"" << journalPath() << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+}
+
+}
+
+void initCheckpointJournal()
+{
+    // Without textures nothing expensive is computed, so there's nothing to resume
+    if(opts.dbgNoSaveTextures) return;
+    checkpointingEnabled=true;
+
+    const auto configHash=configurationHash();
+    if(!opts.resume)
+    {
+        startNewJournal(configHash);
+        return;
+    }
+
+    QFile file(journalPath());
+    if(!file.exists())
+    {
+        std::cerr << "No checkpoint journal found in the output directory, starting from scratch\n";
+        startNewJournal(configHash);
+        return;
+    }
+    if(!file.open(QFile::ReadOnly))
+    {
+        std::cerr << "Failed to open checkpoint journal \"" << journalPath() << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    QTextStream in(&file);
+    if(in.readLine() != journalHeader)
+    {
+        std::cerr << "Bad checkpoint journal header in \"" << journalPath() << "\"\n";
+        throw MustQuit{};
+    }
+    if(in.readLine() != QString(configKey)+configHash)
+    {
+        std::cerr << "Checkpoint journal was written for a different atmosphere description or options, refusing to resume\n";
+        throw MustQuit{};
+    }
+    for(auto line=in.readLine(); !line.isNull(); line=in.readLine())
+    {
+        // A line may be truncated if we were killed while appending it, so a bad line ends the journal
+        if(!line.startsWith(stageFinishedKey)) break;
+        const auto texIndexEnd=line.indexOf(' ', sizeof stageFinishedKey - 1);
+        if(texIndexEnd<0) break;
+        bool ok=false;
+        const auto texIndex=line.mid(sizeof stageFinishedKey - 1, texIndexEnd-(sizeof stageFinishedKey - 1)).toUInt(&ok);
+        if(!ok) break;
+        finishedStages.emplace(texIndex, line.mid(texIndexEnd+1).toStdString());
+        ++numStagesFinished;
+    }
+    std::cerr << "Resuming computation: " << numStagesFinished << " stages were finished in a previous run\n";
+    if(!numStagesFinished)
+        startNewJournal(configHash);
+}
+
+bool stageDoneInPreviousRun(const unsigned texIndex, std::string const& stage)
+{
+    if(!checkpointingEnabled) return false;
+
+    if(finishedStages.count({texIndex, stage}))
+    {
+        std::cerr << indentOutput() << "Skipping " << stage << ": finished in a previous run\n";
+        return true;
+    }
+    if(numStagesFinished && !stateRestored)
+        restoreState(stateDir(numStagesFinished-1));
+    stateRestored=true;
+    return false;
+}
+
+void markStageFinished(const unsigned texIndex, std::string const& stage)
+{
+    // Report failures, in particular NaNs, at the end of the stage that produced them
+    checkTextureSaving();
+    if(!checkpointingEnabled) return;
+
+    // The outputs of the stage must be on disk before we declare it finished
+    waitForTextureSaving();
+    waitForInterpolationGuides();
+
+    std::cerr << indentOutput() << "Saving checkpoint after " << stage << "... ";
+    saveState(stateDir(numStagesFinished));
+
+    QFile file(journalPath());
+    if(!file.open(QFile::Append))
+    {
+        std::cerr << "failed to open checkpoint journal: " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    QTextStream out(&file);
+    out << stageFinishedKey << texIndex << ' ' << QString::fromStdString(stage) << "\n";
+    out.flush();
+    file.close();
+    if(file.error())
+    {
+        std::cerr << "failed to write checkpoint journal: " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    finishedStages.emplace(texIndex, stage);
+    ++numStagesFinished;
+    std::cerr << "done\n";
+}
+
+void removeCheckpoints()
+{
+    if(!checkpointingEnabled) return;
+    QDir(checkpointDir()).removeRecursively();
+}
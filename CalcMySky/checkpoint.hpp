@@ -0,0 +1,41 @@
+/*
+ * CalcMySky - a simulator of light scattering in planetary atmospheres
+ * Copyright © 2025 Ruslan Kabatsayev
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335, USA.
+ */
+
+#ifndef INCLUDE_ONCE_0B5F3342_F6AD_4A93_854D_28CE3A4E335B
+#define INCLUDE_ONCE_0B5F3342_F6AD_4A93_854D_28CE3A4E335B
+
+#include <string>
+
+/* The computation of a production-sized model can take many hours. To avoid losing all the work
+ * on a crash, we keep a journal of finished stages in the output directory, and after each stage
+ * save the GPU- and CPU-resident intermediate data needed to continue. With --resume, the stages
+ * recorded in the journal are skipped and the state saved after the last of them is restored.
+ */
+
+// Must be called after the output directory has been created and the command line handled
+void initCheckpointJournal();
+// Returns true if the stage has been completed in a previous run and should be skipped. If it
+// hasn't, and it's the first such stage in this run, the saved intermediate data are restored.
+bool stageDoneInPreviousRun(unsigned texIndex, std::string const& stage);
+// Saves the intermediate data and records the stage as finished in the journal
+void markStageFinished(unsigned texIndex, std::string const& stage);
+// Removes the journal and saved intermediate data after a successful completion
+void removeCheckpoints();
+
+#endif
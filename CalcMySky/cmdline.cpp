@@ -191,8 +191,16 @@ void handleCmdLine()
     const QCommandLineOption openglDebug("opengl-debug","Install a GL_KHR_debug message callback and print all the messages from OpenGL");
     const QCommandLineOption openglDebugFull("opengl-debug-full","Like --opengl-debug, but don't hide notification-level messages");
     const QCommandLineOption printOpenGLInfoAndQuit("opengl-info","Print OpenGL info and quit");
+    const QCommandLineOption noProgramBinaryCacheOpt("no-program-cache","Always compile shader programs from source instead of reusing cached binaries");
     const QCommandLineOption textureOutputDirOpt("out-dir","Directory for the textures computed","output directory",".");
     const QCommandLineOption saveResultAsRadianceOpt("radiance","Save result as radiance instead of XYZW components");
+    const QCommandLineOption wlSetsOpt("wlsets","Only compute wavelength sets from A to B inclusive, counting from 0 as in the output file names. "
+                                                 "Unless --radiance is given, the XYZW outputs will then be partial sums, to be combined by calcmysky-merge.","A-B");
+    const QCommandLineOption resumeOpt("resume","Resume an interrupted computation from the checkpoint journal in the output directory");
+    const QCommandLineOption backgroundGuidesOpt("background-guides","Generate interpolation guides in background threads, overlapping with the GPU work of the next wavelength set");
+    const QCommandLineOption gpuGuidesOpt("gpu-guides","Generate interpolation guides on the GPU, without reading the scattering textures back for them");
+    const QCommandLineOption compressTexturesOpt("compress-textures","Save 4D textures in a compressed format, which lets the renderer decompress only the altitude slices it needs");
+    const QCommandLineOption storageOpt("storage","Storage format of scattering and light pollution textures: f32 (default) or f16. Transmittance and irradiance are always saved as f32.","format");
     const QCommandLineOption textureSavePrecisionOpt("texture-save-precision","Number of bits of precision when saving 3D textures, from 1 to 24. Smaller number improves compressibility. Too small destroys fidelity.","bits");
     const QCommandLineOption dbgNoSaveTexturesOpt("no-save-tex","Don't save textures, only save shaders and other fast-to-compute data; don't run the long 4D "
                                                                 "textures computations (for debugging)");
@@ -208,10 +216,17 @@ void handleCmdLine()
                         versionOpt,
                         textureOutputDirOpt,
                         saveResultAsRadianceOpt,
+                        resumeOpt,
+                        wlSetsOpt,
+                        compressTexturesOpt,
+                        backgroundGuidesOpt,
+                        gpuGuidesOpt,
+                        storageOpt,
                         textureSavePrecisionOpt,
                         dbgNoEDSTexturesOpt,
                         dbgNoSaveTexturesOpt,
                         printOpenGLInfoAndQuit,
+                        noProgramBinaryCacheOpt,
                         openglDebug,
                         openglDebugFull,
                         dbgSaveGroundIrradianceOpt,
@@ -248,6 +263,14 @@ void handleCmdLine()
         opts.dbgNoEDSTextures=true;
     if(parser.isSet(saveResultAsRadianceOpt))
         opts.saveResultAsRadiance=true;
+    if(parser.isSet(resumeOpt))
+        opts.resume=true;
+    if(parser.isSet(compressTexturesOpt))
+        opts.compressTextures=true;
+    if(parser.isSet(backgroundGuidesOpt))
+        opts.backgroundInterpolationGuides=true;
+    if(parser.isSet(gpuGuidesOpt))
+        opts.gpuInterpolationGuides=true;
     if(parser.isSet(dbgSaveGroundIrradianceOpt))
         opts.dbgSaveGroundIrradiance=true;
     if(parser.isSet(dbgSaveScatDensityOrder2FromGroundOpt))
@@ -266,6 +289,21 @@ void handleCmdLine()
         opts.openglDebugFull=true;
     if(parser.isSet(printOpenGLInfoAndQuit))
         opts.printOpenGLInfoAndQuit=true;
+    if(parser.isSet(noProgramBinaryCacheOpt))
+        opts.noProgramBinaryCache=true;
+    if(parser.isSet(storageOpt))
+    {
+        const auto storage=parser.value(storageOpt);
+        if(storage=="f16")
+        {
+            opts.halfFloatStorage=true;
+        }
+        else if(storage!="f32")
+        {
+            std::cerr << "Unknown storage format \"" << storage << "\", must be f32 or f16\n";
+            throw MustQuit{};
+        }
+    }
     if(parser.isSet(textureSavePrecisionOpt))
     {
         bool ok=false;
@@ -298,4 +336,22 @@ void handleCmdLine()
         showHelp(std::cerr, options, positionalArgument.first);
         throw MustQuit{};
     }
+
+    opts.lastWLSet=atmo.allWavelengths.size()-1;
+    if(parser.isSet(wlSetsOpt))
+    {
+        const auto match=QRegularExpression("^([0-9]+)(?:-([0-9]+))?$").match(parser.value(wlSetsOpt));
+        if(!match.hasMatch())
+        {
+            std::cerr << "Failed to parse wavelength set range\n";
+            throw MustQuit{};
+        }
+        opts.firstWLSet=match.captured(1).toUInt();
+        opts.lastWLSet=match.captured(2).isEmpty() ? opts.firstWLSet : match.captured(2).toUInt();
+        if(opts.firstWLSet > opts.lastWLSet || opts.lastWLSet >= atmo.allWavelengths.size())
+        {
+            std::cerr << "Wavelength set range must be within 0-" << atmo.allWavelengths.size()-1 << "\n";
+            throw MustQuit{};
+        }
+    }
 }
@@ -38,5 +38,9 @@ constexpr char COMPUTE_ECLIPSED_DOUBLE_SCATTERING_FILENAME[]="compute-eclipsed-d
 constexpr char SINGLE_SCATTERING_ECLIPSED_FILENAME[]="single-scattering-eclipsed.frag";
 constexpr char DOUBLE_SCATTERING_ECLIPSED_FILENAME[]="double-scattering-eclipsed.frag";
 constexpr char COMPUTE_INDIRECT_IRRADIANCE_FILENAME[]="compute-indirect-irradiance.frag";
+// Written into output directory of a run limited by --wlsets, read by calcmysky-merge
+constexpr char PARTIAL_WLSET_RANGE_FILENAME[]="partial-wlset-range";
+// Written into output directory of a run with --storage=f16
+constexpr char HALF_FLOAT_REPORT_FILENAME[]="f16-validation-report";
 
 #endif
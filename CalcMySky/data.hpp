@@ -24,6 +24,7 @@
 #include <map>
 #include <cmath>
 #include <array>
+#include <climits>
 #include <vector>
 #include <memory>
 #include <QOpenGLShader>
@@ -43,7 +44,6 @@ enum FBOId
     FBO_DELTA_SCATTERING,
     FBO_SINGLE_SCATTERING,
     FBO_MULTIPLE_SCATTERING,
-    FBO_ECLIPSED_DOUBLE_SCATTERING,
     FBO_LIGHT_POLLUTION,
 
     FBO_COUNT
@@ -57,7 +57,6 @@ enum TextureId
     TEX_DELTA_SCATTERING,
     TEX_MULTIPLE_SCATTERING,
     TEX_DELTA_SCATTERING_DENSITY,
-    TEX_ECLIPSED_DOUBLE_SCATTERING,
     TEX_LIGHT_POLLUTION_SCATTERING,
     TEX_LIGHT_POLLUTION_DELTA_SCATTERING,
     TEX_LIGHT_POLLUTION_SCATTERING_LUMINANCE,
@@ -68,14 +67,25 @@ enum TextureId
 inline GLuint textures[TEX_COUNT];
 // Accumulation of radiance to yield luminance
 inline std::map<QString/*scatterer name*/, GLuint> accumulatedSingleScatteringTextures;
+inline std::vector<glm::vec4> eclipsedDoubleScatteringAccumulatorTexture;
 
 struct Options
 {
     unsigned textureSavePrecision = 0; // 0 means not reduced
+    // Range of wavelength sets to compute, inclusive. If it doesn't cover all the sets,
+    // luminance outputs are partial sums, to be merged by calcmysky-merge.
+    unsigned firstWLSet = 0;
+    unsigned lastWLSet = UINT_MAX;
     bool openglDebug=false;
     bool openglDebugFull=false;
     bool printOpenGLInfoAndQuit=false;
+    bool noProgramBinaryCache=false;
     bool saveResultAsRadiance=false;
+    bool compressTextures=false;
+    bool halfFloatStorage=false;
+    bool resume=false;
+    bool backgroundInterpolationGuides=false;
+    bool gpuInterpolationGuides=false;
     bool dbgNoSaveTextures=false;
     bool dbgNoEDSTextures=false;
     bool dbgSaveGroundIrradiance=false;
@@ -88,4 +98,9 @@ struct Options
 inline Options opts;
 inline AtmosphereParameters atmo;
 
+inline bool computingPartialWLSetRange()
+{
+    return opts.firstWLSet!=0 || opts.lastWLSet+1!=atmo.allWavelengths.size();
+}
+
 #endif
@@ -22,6 +22,7 @@
 #include <iostream>
 #include "util.hpp"
 #include "data.hpp"
+#include "program-binary-cache.hpp"
 
 void initBuffers()
 {
@@ -69,8 +70,6 @@ void initTexturesAndFramebuffers()
         setupTexture(tex,width,height,depth);
     }
     setupTexture(TEX_MULTIPLE_SCATTERING,width,height,depth);
-    // XXX: keep in sync with its use in GLSL computeDoubleScatteringEclipsedDensitySample() and EclipsedDoubleScatteringPrecomputer's constructor
-    setupTexture(TEX_ECLIPSED_DOUBLE_SCATTERING, atmo.eclipseAngularIntegrationPoints, atmo.radialIntegrationPoints);
 
     setupTexture(TEX_LIGHT_POLLUTION_SCATTERING           , atmo.lightPollutionTextureSize[0], atmo.lightPollutionTextureSize[1]);
     setupTexture(TEX_LIGHT_POLLUTION_DELTA_SCATTERING     , atmo.lightPollutionTextureSize[0], atmo.lightPollutionTextureSize[1]);
@@ -145,6 +144,7 @@ std::pair<std::unique_ptr<QOffscreenSurface>, std::unique_ptr<QOpenGLContext>> i
 
     if(opts.openglDebug || opts.openglDebugFull)
         setupDebugPrintCallback(*context, opts.openglDebugFull);
+    initProgramBinaryCache(*context);
     initBuffers();
     initTexturesAndFramebuffers();
     checkLimits();
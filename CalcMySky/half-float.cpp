@@ -0,0 +1,217 @@
+/*
+ * CalcMySky - a simulator of light scattering in planetary atmospheres
+ * Copyright © 2025 Ruslan Kabatsayev
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335, USA.
+ */
+
+#include "util.hpp"
+
+#include <mutex>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <utility>
+#include <QTextStream>
+#include <QFileInfo>
+#include <QFile>
+#include <QDir>
+
+#include "const.hpp"
+
+namespace
+{
+
+struct HalfFloatConversionError
+{
+    std::string name;
+    std::string path;
+    float maxRelativeError;
+    size_t overflowCount;  // finite values converted to infinities
+    size_t underflowCount; // nonzero values converted to zeros
+    size_t denormalCount;  // nonzero values converted to half-float denormals
+    size_t valueCount;
+};
+std::mutex halfFloatReportMutex;
+std::vector<HalfFloatConversionError> halfFloatReport;
+
+const QString maxRelativeErrorMarker=": max relative error ";
+const QString overflowMarker=" values overflowed";
+const QString underflowMarker=" values underflowed to zero";
+const QString denormalMarker=" values became denormal";
+
+// The smallest positive normal half float, 2^-14
+constexpr float minNormalHalfFloat=6.103515625e-5f;
+
+}
+
+std::unique_ptr<qfloat16[]> convertToHalfFloat(const std::string_view name, const std::string_view path,
+                                                const GLfloat*const data, const size_t count)
+{
+    std::unique_ptr<qfloat16[]> halfData(new qfloat16[count]);
+    qFloatToFloat16(halfData.get(), data, count);
+
+    // Values that overflowed, underflowed or became denormal are only counted, so that the maximum relative
+    // error characterizes the values that remain in the range of normal half floats
+    float maxRelativeError=0;
+    size_t overflowCount=0, underflowCount=0, denormalCount=0;
+    for(size_t i=0; i<count; ++i)
+    {
+        const float original=data[i], converted=halfData[i];
+        if(std::isnan(original) || original==0)
+            continue;
+        if(std::isinf(converted) && !std::isinf(original))
+        {
+            ++overflowCount;
+            continue;
+        }
+        if(converted==0)
+        {
+            ++underflowCount;
+            continue;
+        }
+        if(std::abs(converted) < minNormalHalfFloat)
+        {
+            ++denormalCount;
+            continue;
+        }
+        maxRelativeError=std::max(maxRelativeError, std::abs(converted-original)/std::abs(original));
+    }
+
+    std::lock_guard lock(halfFloatReportMutex);
+    halfFloatReport.push_back({std::string(name), std::string(path), maxRelativeError,
+                               overflowCount, underflowCount, denormalCount, count});
+    return halfData;
+}
+
+void loadHalfFloatValidationReport(std::string const& outputDir)
+{
+    const auto path=outputDir+"/"+HALF_FLOAT_REPORT_FILENAME;
+    QFile file(QString::fromStdString(path));
+    if(!file.open(QFile::ReadOnly))
+    {
+        std::cerr << "Failed to open \"" << path << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+
+    std::lock_guard lock(halfFloatReportMutex);
+    for(auto line=QString::fromUtf8(file.readLine()); !line.isEmpty(); line=QString::fromUtf8(file.readLine()))
+    {
+        line=line.trimmed();
+        if(line.isEmpty() || line.startsWith('#'))
+            continue;
+        // Format: <path>: max relative error <error>[, <count> of <valueCount> values <what happened>]...
+        const auto markerPos=line.lastIndexOf(maxRelativeErrorMarker);
+        if(markerPos<0)
+        {
+            std::cerr << "Bad line in \"" << path << "\": " << line << "\n";
+            throw MustQuit{};
+        }
+        HalfFloatConversionError entry{"texture", line.left(markerPos).toStdString(), 0, 0, 0, 0, 0};
+        const auto fields=line.mid(markerPos+maxRelativeErrorMarker.size()).split(", ");
+        bool ok=true;
+        entry.maxRelativeError=fields[0].toFloat(&ok);
+        for(int n=1; ok && n<fields.size(); ++n)
+        {
+            const auto& field=fields[n];
+            const std::pair<QString const&, size_t&> counters[]={{overflowMarker, entry.overflowCount},
+                                                                  {underflowMarker, entry.underflowCount},
+                                                                  {denormalMarker, entry.denormalCount}};
+            const auto counter=std::find_if(std::begin(counters), std::end(counters),
+                                            [&field](auto const& c){ return field.endsWith(c.first); });
+            if(counter==std::end(counters))
+            {
+                ok=false;
+                break;
+            }
+            const auto counts=field.chopped(counter->first.size()).split(" of ");
+            ok=counts.size()==2;
+            if(ok) counter->second=counts[0].toULongLong(&ok);
+            if(ok) entry.valueCount=counts[1].toULongLong(&ok);
+        }
+        if(!ok)
+        {
+            std::cerr << "Failed to parse line in \"" << path << "\": " << line << "\n";
+            throw MustQuit{};
+        }
+        halfFloatReport.push_back(std::move(entry));
+    }
+}
+
+void saveHalfFloatValidationReport(std::string const& outputDir)
+{
+    const auto path=outputDir+"/"+HALF_FLOAT_REPORT_FILENAME;
+    std::cerr << "Writing half-float validation report to \"" << path << "\"... ";
+    QFile file(QString::fromStdString(path));
+    if(!file.open(QFile::WriteOnly))
+    {
+        std::cerr << "failed to open file: " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+
+    std::lock_guard lock(halfFloatReportMutex);
+    const HalfFloatConversionError* worst=nullptr;
+    size_t totalOverflowCount=0, totalUnderflowCount=0, totalDenormalCount=0;
+    const QDir dir(QString::fromStdString(outputDir));
+    QTextStream out(&file);
+    out << "# Maximum relative error of conversion of saved textures to half floats, excluding the values that\n"
+           "# overflowed, underflowed to zero or became denormal, which are counted separately\n";
+    for(const auto& entry : halfFloatReport)
+    {
+        // Paths are relative to the output directory, so that the entries remain valid when calcmysky-merge copies them
+        const auto entryPath=QString::fromStdString(entry.path);
+        out << (QFileInfo(entryPath).isRelative() ? entryPath : dir.relativeFilePath(entryPath))
+            << maxRelativeErrorMarker << entry.maxRelativeError;
+        if(entry.overflowCount)
+            out << ", " << entry.overflowCount << " of " << entry.valueCount << overflowMarker;
+        if(entry.underflowCount)
+            out << ", " << entry.underflowCount << " of " << entry.valueCount << underflowMarker;
+        if(entry.denormalCount)
+            out << ", " << entry.denormalCount << " of " << entry.valueCount << denormalMarker;
+        out << "\n";
+        if(!worst || entry.maxRelativeError > worst->maxRelativeError)
+            worst=&entry;
+        totalOverflowCount += entry.overflowCount;
+        totalUnderflowCount += entry.underflowCount;
+        totalDenormalCount += entry.denormalCount;
+    }
+    out.flush();
+    file.close();
+    if(file.error())
+    {
+        std::cerr << "failed to write file: " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    std::cerr << "done\n";
+
+    if(worst)
+    {
+        OutputIndentIncrease incr;
+        std::cerr << indentOutput() << "Largest relative error is " << worst->maxRelativeError << " in " << worst->name
+                  << " \"" << worst->path << "\"\n";
+    }
+    if(totalOverflowCount)
+    {
+        std::cerr << "*** WARNING: " << totalOverflowCount << " values were too large for half-float storage and "
+                     "were saved as infinities, see the report for details\n";
+    }
+    if(totalUnderflowCount || totalDenormalCount)
+    {
+        std::cerr << "*** WARNING: " << totalUnderflowCount << " nonzero values were too small for half-float storage and "
+                     "were saved as zeros, and " << totalDenormalCount << " were saved as denormals with reduced precision, "
+                     "see the report for details\n";
+    }
+}
@@ -0,0 +1,691 @@
+/*
+ * CalcMySky - a simulator of light scattering in planetary atmospheres
+ * Copyright © 2025 Ruslan Kabatsayev
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335, USA.
+ */
+
+#include "interpolation-guides-gpu.hpp"
+#include <deque>
+#include <limits>
+#include <cassert>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <type_traits>
+#include <glm/glm.hpp>
+#include <QFile>
+#include <QOpenGLFunctions_3_3_Core>
+#include "util.hpp"
+
+namespace
+{
+
+const char*const vertexShaderSrc=1+R"(
+#version 330
+layout(location=0) in vec4 vertex;
+void main()
+{
+    gl_Position = vertex;
+}
+)";
+
+// Sends the quad to the altitude layer being rendered
+const char*const geometryShaderSrc=1+R"(
+#version 330
+layout(triangles) in;
+layout(triangle_strip, max_vertices=3) out;
+uniform int layer;
+void main()
+{
+    for(int i=0; i<3; ++i)
+    {
+        gl_Position=gl_in[i].gl_Position;
+        gl_Layer=layer;
+        EmitVertex();
+    }
+    EndPrimitive();
+}
+)";
+
+/* The data are a set of 2D subslices of each altitude layer of the scattering texture. A subslice consists of
+ * numRows rows of numCols columns, the columns being the VZA points starting from colOffset. The other index
+ * selects the subslice in the layer: it's the SZA index when the rows go along dotViewSun, and vice versa.
+ *
+ * The functions below mirror those in interpolation-guides.cpp, see the comments there.
+ */
+const char commonSrc[]=R"(
+uniform sampler3D scatteringTexture;
+uniform int dVSLayerCount;
+uniform int colOffset;
+uniform int numCols;
+uniform int numRows;
+uniform bool rowsAlongSZA;
+uniform int layer;
+
+float value(const int other, const int row, const int col)
+{
+    int y = rowsAlongSZA ? other + row*dVSLayerCount : row + other*dVSLayerCount;
+    return texelFetch(scatteringTexture, ivec3(colOffset+col, y, layer), 0)[1];
+}
+)";
+
+/* Output: (position of the maximum, minimum value, number of maxima to warn about, 0) for each row; x is the row,
+ * y is the other index. Like the CPU version, only the rows along dotViewSun are checked for multiple maxima,
+ * because the rows along SZA consist of the same data, and only two maxima not separated by a single-point dip
+ * are reported. The signs of differences of the values are found by comparisons, which, unlike the subtractions
+ * done by the CPU version, give the same results even if the GPU flushes denormals to zero.
+ */
+const char rowStatsSrc[]=R"(
+out vec4 stats;
+
+const int NO_AVERAGING=-1;
+
+// Value with the point at averagedPos replaced by the mean of its neighbors
+float rowValue(const int other, const int row, const int col, const int averagedPos)
+{
+    if(col == averagedPos)
+        return (value(other,row,col-1) + value(other,row,col+1)) / 2.;
+    return value(other,row,col);
+}
+
+int diffSign(const float prev, const float next)
+{
+    return next > prev ? 1 : next < prev ? -1 : 0;
+}
+
+int countMaxima(const int other, const int row, const int averagedPos)
+{
+    if(numCols < 2) return 1;
+
+    int numMaxima = 0;
+    float prev = rowValue(other,row,0,averagedPos);
+    float curr = rowValue(other,row,1,averagedPos);
+    int diff = diffSign(prev, curr);
+    if(diff < 0)
+        ++numMaxima;
+    for(int col = 2; col < numCols; ++col)
+    {
+        prev = curr;
+        curr = rowValue(other,row,col,averagedPos);
+        int newDiff = diffSign(prev, curr);
+        if(diff > 0 && newDiff < 0)
+            ++numMaxima;
+        diff = newDiff;
+    }
+    if(diff > 0)
+        ++numMaxima;
+    return numMaxima;
+}
+
+bool minimumIsSinglePoint(const int other, const int row)
+{
+    int minimumPos = -1;
+    for(int col = 1; col < numCols-1; ++col)
+    {
+        if(value(other,row,col-1) > value(other,row,col) && value(other,row,col) < value(other,row,col+1))
+        {
+            minimumPos = col;
+            break;
+        }
+    }
+    if(minimumPos < 0)
+        return false;
+    return countMaxima(other,row,minimumPos) < countMaxima(other,row,NO_AVERAGING);
+}
+
+void main()
+{
+    int row=int(gl_FragCoord.x);
+    int other=int(gl_FragCoord.y);
+    float minValue=value(other,row,0);
+    float maxValue=minValue;
+    int maxPos=0;
+    for(int col=1; col<numCols; ++col)
+    {
+        float v=value(other,row,col);
+        if(v < minValue)
+            minValue=v;
+        // Like std::minmax_element(), take the last of equal maxima
+        if(!(v < maxValue))
+        {
+            maxValue=v;
+            maxPos=col;
+        }
+    }
+
+    int maximaToReport=0;
+    if(!rowsAlongSZA)
+    {
+        int numMaxima=countMaxima(other,row,NO_AVERAGING);
+        if(numMaxima == 2 && !minimumIsSinglePoint(other,row))
+            maximaToReport=numMaxima;
+    }
+    stats=vec4(maxPos, minValue, maximaToReport, 0);
+}
+)";
+
+// Output: (top-down guide target, bottom-up guide target) for each column; x is the column,
+// y is originRow+other*(numRows-1)
+const char guideTargetsSrc[]=R"(
+uniform sampler3D rowStats;
+out vec4 targets;
+
+const int ROW_ABOVE=-1, ROW_BELOW=+1;
+const int DIR_UP=+1, DIR_DOWN=-1;
+const float POINT_NOT_FOUND=-1.;
+
+int maxPosition(const int other, const int row)
+{
+    return int(texelFetch(rowStats, ivec3(row, other, layer), 0).x);
+}
+
+float interpolateN(const float N0, const float N1, const float valN0, const float valN1, const float value)
+{
+    return N0+(N1-N0)*(value-valN0)/(valN1-valN0);
+}
+
+float findIntersection(const int other, const int row, const float globalMinValue, const float rowMaxValue,
+                       const float targetValue, const int startingPosition, const int dir)
+{
+    float valueAtStartPos = (value(other,row,startingPosition) - globalMinValue) / (rowMaxValue - globalMinValue);
+    bool wantGrowing = targetValue > valueAtStartPos;
+    int endN = dir==DIR_DOWN ? 0 : numCols-1;
+    for(int n = startingPosition; n != endN; n += dir)
+    {
+        float valN  = (value(other,row,n    ) - globalMinValue) / (rowMaxValue - globalMinValue);
+        float valN1 = (value(other,row,n+dir) - globalMinValue) / (rowMaxValue - globalMinValue);
+        if(wantGrowing ? valN1 >= targetValue : valN1 <= targetValue)
+            return interpolateN(n, n+dir, valN, valN1, targetValue);
+    }
+    return POINT_NOT_FOUND;
+}
+
+float guideTarget(const int other, const int originRow, const int currCol, const float globalMin, const int targetRowDir)
+{
+    int currRow = targetRowDir==ROW_BELOW ? originRow : originRow+1;
+    int nextRow = currRow + targetRowDir;
+    int currRowMaxPos = maxPosition(other, currRow);
+    int nextRowMaxPos = maxPosition(other, nextRow);
+    float currRowMax = value(other, currRow, currRowMaxPos);
+    float nextRowMax = value(other, nextRow, nextRowMaxPos);
+
+    float currValue = value(other, currRow, currCol);
+    int dirInRow = currCol > currRowMaxPos ? DIR_UP : DIR_DOWN;
+    if(currRowMax - globalMin == 0 || nextRowMax - globalMin == 0)
+        return float(currCol);
+    float currRowNormalizedValue = (           currValue           - globalMin) / (currRowMax - globalMin);
+    float nextRowNormalizedValue = (value(other, nextRow, currCol) - globalMin) / (nextRowMax - globalMin);
+    if(currRowNormalizedValue == nextRowNormalizedValue)
+        return float(currCol);
+    float colInNextRow = findIntersection(other, nextRow, globalMin, nextRowMax, currRowNormalizedValue,
+                                          nextRowMaxPos, dirInRow);
+    if(colInNextRow == POINT_NOT_FOUND)
+        colInNextRow = float(dirInRow==DIR_UP ? numCols-1 : 0);
+    return colInNextRow;
+}
+
+void main()
+{
+    int col=int(gl_FragCoord.x);
+    int originRow=int(gl_FragCoord.y) % (numRows-1);
+    int other=int(gl_FragCoord.y) / (numRows-1);
+
+    float globalMin=texelFetch(rowStats, ivec3(0, other, layer), 0).y;
+    for(int row=1; row<numRows; ++row)
+        globalMin=min(globalMin, texelFetch(rowStats, ivec3(row, other, layer), 0).y);
+
+    targets=vec4(guideTarget(other, originRow, col, globalMin, ROW_BELOW),
+                 guideTarget(other, originRow, col, globalMin, ROW_ABOVE),
+                 0, 0);
+}
+)";
+
+// Output: the angles in the layout of the guides file
+const char anglesSrc[]=R"(
+uniform sampler3D guideTargets;
+uniform int vzaPointCount;
+out int angle;
+
+const int DIR_UP=+1, DIR_DOWN=-1;
+const int POINT_NOT_FOUND=-1;
+
+struct GuideBetweenRows
+{
+    int origin;
+    float target;
+    float valueInTheMiddle;
+};
+
+float guideTarget(const int other, const int row, const int col, const bool topDown)
+{
+    vec2 targets=texelFetch(guideTargets, ivec3(col, row+other*(numRows-1), layer), 0).xy;
+    return topDown ? targets.x : targets.y;
+}
+
+GuideBetweenRows findNearestGuideBetweenRows(const int other, const int row, const float col,
+                                             const bool topDown, const int searchDir)
+{
+    int startPos = searchDir==DIR_UP ?    0      : numCols-1;
+    int   endPos = searchDir==DIR_UP ? numCols-1 :    -1    ;
+    for(int pos = startPos; pos != endPos; pos += searchDir)
+    {
+        float target = guideTarget(other, row, pos, topDown);
+        // In the middle between rows the top-down and bottom-up guides have the same formula
+        float guideValue = (target-pos)*0.5+pos;
+        if(searchDir==DIR_UP ? guideValue >= col : guideValue <= col)
+            return GuideBetweenRows(pos, target, guideValue);
+    }
+    return GuideBetweenRows(POINT_NOT_FOUND, float(POINT_NOT_FOUND), 0.);
+}
+
+float calcAngle(const GuideBetweenRows guide, const bool topDown)
+{
+    return atan(topDown ? guide.target-float(guide.origin) : float(guide.origin)-guide.target);
+}
+
+void main()
+{
+    int x=int(gl_FragCoord.x);
+    int y=int(gl_FragCoord.y);
+    int col = x % vzaPointCount - colOffset;
+    int row   = rowsAlongSZA ? y : x / vzaPointCount;
+    int other = rowsAlongSZA ? x / vzaPointCount : y;
+    if(col < 0 || col >= numCols)
+    {
+        angle=0;
+        return;
+    }
+
+    GuideBetweenRows guideAboveTD = findNearestGuideBetweenRows(other, row, col, true , DIR_UP);
+    GuideBetweenRows guideBelowTD = findNearestGuideBetweenRows(other, row, col, true , DIR_DOWN);
+    GuideBetweenRows guideAboveBU = findNearestGuideBetweenRows(other, row, col, false, DIR_UP);
+    GuideBetweenRows guideBelowBU = findNearestGuideBetweenRows(other, row, col, false, DIR_DOWN);
+
+    float guideAngleAbove;
+    if(guideAboveTD.origin == POINT_NOT_FOUND)
+        guideAngleAbove = calcAngle(guideAboveBU, false);
+    else if(guideAboveBU.origin == POINT_NOT_FOUND)
+        guideAngleAbove = calcAngle(guideAboveTD, true);
+    else if(guideAboveTD.valueInTheMiddle < guideAboveBU.valueInTheMiddle)
+        guideAngleAbove = calcAngle(guideAboveTD, true);
+    else
+        guideAngleAbove = calcAngle(guideAboveBU, false);
+
+    float guideAngleBelow;
+    if(guideBelowTD.origin == POINT_NOT_FOUND)
+        guideAngleBelow = calcAngle(guideBelowBU, false);
+    else if(guideBelowBU.origin == POINT_NOT_FOUND)
+        guideAngleBelow = calcAngle(guideBelowTD, true);
+    else if(guideBelowTD.valueInTheMiddle > guideBelowBU.valueInTheMiddle)
+        guideAngleBelow = calcAngle(guideBelowTD, true);
+    else
+        guideAngleBelow = calcAngle(guideBelowBU, false);
+
+    const float anglesTypeMax=32767.;
+    const float PI=3.14159265358979324;
+    float scaled = anglesTypeMax/(PI/2) * 0.5*(guideAngleAbove+guideAngleBelow);
+    // Rounding half away from zero, like std::lround()
+    angle = int(sign(scaled)*floor(abs(scaled)+0.5));
+}
+)";
+
+std::unique_ptr<QOpenGLShaderProgram> makeProgram(const char*const mainSrc, const char*const description)
+{
+    auto program=std::make_unique<QOpenGLShaderProgram>();
+    const auto fragSrc=QString("#version 330\n")+commonSrc+mainSrc;
+    if(!program->addShaderFromSourceCode(QOpenGLShader::Vertex, vertexShaderSrc) ||
+       !program->addShaderFromSourceCode(QOpenGLShader::Geometry, geometryShaderSrc) ||
+       !program->addShaderFromSourceCode(QOpenGLShader::Fragment, fragSrc) ||
+       !program->link())
+    {
+        throw std::runtime_error(std::string("Failed to build ")+description+" shader program: "+program->log().toStdString());
+    }
+    return program;
+}
+
+}
+
+InterpolationGuidesGPUGenerator::InterpolationGuidesGPUGenerator(QOpenGLFunctions_3_3_Core& gl)
+    : gl(gl)
+    , rowStatsProgram(makeProgram(rowStatsSrc, "interpolation guides row statistics"))
+    , guideTargetsProgram(makeProgram(guideTargetsSrc, "interpolation guide targets"))
+    , anglesProgram(makeProgram(anglesSrc, "interpolation guide angles"))
+{
+    gl.glGenFramebuffers(1, &fbo);
+    gl.glGenTextures(1, &rowStatsTexture);
+    gl.glGenTextures(1, &guideTargetsTexture);
+    gl.glGenTextures(1, &anglesTexture);
+
+    gl.glGenSamplers(1, &sampler);
+    gl.glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    gl.glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    GLint oldVAO=-1;
+    gl.glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &oldVAO);
+    gl.glGenVertexArrays(1, &vao);
+    gl.glBindVertexArray(vao);
+    gl.glGenBuffers(1, &vbo);
+    gl.glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    const GLfloat vertices[]=
+    {
+        -1, -1,
+         1, -1,
+        -1,  1,
+         1,  1,
+    };
+    gl.glBufferData(GL_ARRAY_BUFFER, sizeof vertices, vertices, GL_STATIC_DRAW);
+    constexpr GLuint attribIndex=0;
+    constexpr int coordsPerVertex=2;
+    gl.glVertexAttribPointer(attribIndex, coordsPerVertex, GL_FLOAT, false, 0, 0);
+    gl.glEnableVertexAttribArray(attribIndex);
+    gl.glBindVertexArray(oldVAO);
+}
+
+InterpolationGuidesGPUGenerator::~InterpolationGuidesGPUGenerator()
+{
+    gl.glDeleteTextures(1, &rowStatsTexture);
+    gl.glDeleteTextures(1, &guideTargetsTexture);
+    gl.glDeleteTextures(1, &anglesTexture);
+    gl.glDeleteSamplers(1, &sampler);
+    gl.glDeleteFramebuffers(1, &fbo);
+    gl.glDeleteVertexArrays(1, &vao);
+    gl.glDeleteBuffers(1, &vbo);
+}
+
+namespace
+{
+
+struct TextureSizes
+{
+    int numCols, numRows, numOthers;
+    int anglesWidth, anglesHeight;
+};
+
+TextureSizes textureSizes(std::vector<int> const& sizes, const bool rowsAlongSZA)
+{
+    const auto szaLayerCount = sizes[2];
+    const auto dVSLayerCount = sizes[1];
+    const auto vzaPointCount = sizes[0];
+    TextureSizes ts;
+    ts.numCols   = vzaPointCount/2 - 1; // the zenith point and the points below the horizon are skipped
+    ts.numRows   = rowsAlongSZA ? szaLayerCount : dVSLayerCount;
+    ts.numOthers = rowsAlongSZA ? dVSLayerCount : szaLayerCount;
+    // Guides represent points between rows, so there's one less of them than rows
+    ts.anglesWidth  = rowsAlongSZA ? dVSLayerCount*vzaPointCount : (dVSLayerCount-1)*vzaPointCount;
+    ts.anglesHeight = rowsAlongSZA ? szaLayerCount-1 : szaLayerCount;
+    return ts;
+}
+
+}
+
+bool InterpolationGuidesGPUGenerator::canGenerate(QOpenGLFunctions_3_3_Core& gl, std::vector<int> const& sizes)
+{
+    assert(sizes.size()==4);
+    GLint max3DTexSize=0;
+    gl.glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &max3DTexSize);
+    for(const bool rowsAlongSZA : {false, true})
+    {
+        const auto ts=textureSizes(sizes, rowsAlongSZA);
+        if(std::max({ts.anglesWidth, ts.anglesHeight, ts.numRows, ts.numOthers, (ts.numRows-1)*ts.numOthers, sizes[3]}) > max3DTexSize)
+            return false;
+    }
+    return true;
+}
+
+std::vector<int16_t> InterpolationGuidesGPUGenerator::generate(const GLuint scatteringTexture, std::vector<int> const& sizes,
+                                                               const Dimensions dimensions, std::ostream& warnings)
+{
+    assert(sizes.size()==4);
+    if(!canGenerate(gl, sizes))
+        throw std::runtime_error("Interpolation guides textures would exceed maximum 3D texture size");
+
+    const auto altLayerCount = sizes[3];
+    const auto dVSLayerCount = sizes[1];
+    const auto vzaPointCount = sizes[0];
+    const auto colOffset = vzaPointCount/2 + 1; // +1 skips zenith point, because it may have an extraneous maximum
+
+    const bool rowsAlongSZA = dimensions==Dimensions::VZA_SZA;
+    const auto ts = textureSizes(sizes, rowsAlongSZA);
+    const auto numCols = ts.numCols, numRows = ts.numRows, numOthers = ts.numOthers;
+    const auto anglesWidth = ts.anglesWidth, anglesHeight = ts.anglesHeight;
+
+    GLint oldVAO=-1;
+    gl.glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &oldVAO);
+    GLint oldProgram=-1;
+    gl.glGetIntegerv(GL_CURRENT_PROGRAM, &oldProgram);
+    GLint oldViewport[4];
+    gl.glGetIntegerv(GL_VIEWPORT, oldViewport);
+    GLint oldDrawFBO=-1, oldReadFBO=-1;
+    gl.glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &oldDrawFBO);
+    gl.glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &oldReadFBO);
+    GLint oldPackAlignment=4;
+    gl.glGetIntegerv(GL_PACK_ALIGNMENT, &oldPackAlignment);
+    GLint oldPackBuffer=0;
+    gl.glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &oldPackBuffer);
+    const bool blendWasEnabled=gl.glIsEnabled(GL_BLEND);
+    gl.glDisable(GL_BLEND);
+
+    constexpr GLint scatteringTexUnit=0, rowStatsTexUnit=1, guideTargetsTexUnit=2;
+    const auto allocate=[this](const GLuint tex, const GLenum internalFormat, const GLenum format, const GLenum type,
+                               const int width, const int height, const int depth)
+    {
+        gl.glBindTexture(GL_TEXTURE_3D, tex);
+        gl.glTexImage3D(GL_TEXTURE_3D,0,internalFormat,width,height,depth,0,format,type,nullptr);
+        gl.glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        gl.glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    };
+    gl.glActiveTexture(GL_TEXTURE0+guideTargetsTexUnit);
+    allocate(guideTargetsTexture, GL_RG32F, GL_RG, GL_FLOAT, numCols, (numRows-1)*numOthers, altLayerCount);
+    gl.glBindSampler(guideTargetsTexUnit, sampler);
+    gl.glActiveTexture(GL_TEXTURE0+rowStatsTexUnit);
+    allocate(rowStatsTexture, GL_RGBA32F, GL_RGBA, GL_FLOAT, numRows, numOthers, altLayerCount);
+    gl.glBindSampler(rowStatsTexUnit, sampler);
+    gl.glActiveTexture(GL_TEXTURE0+scatteringTexUnit);
+    // The angles texture is only a render target, so it doesn't need a unit of its own
+    allocate(anglesTexture, GL_R16I, GL_RED_INTEGER, GL_SHORT, anglesWidth, anglesHeight, altLayerCount);
+    gl.glBindTexture(GL_TEXTURE_3D, scatteringTexture);
+    gl.glBindSampler(scatteringTexUnit, sampler);
+
+    gl.glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    gl.glBindVertexArray(vao);
+    gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    gl.glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    const auto restoreState=[&]
+    {
+        gl.glPixelStorei(GL_PACK_ALIGNMENT, oldPackAlignment);
+        gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, oldPackBuffer);
+        for(const auto unit : {scatteringTexUnit, rowStatsTexUnit, guideTargetsTexUnit})
+        {
+            gl.glBindSampler(unit, 0);
+            gl.glActiveTexture(GL_TEXTURE0+unit);
+            gl.glBindTexture(GL_TEXTURE_3D, 0);
+        }
+        gl.glBindVertexArray(oldVAO);
+        gl.glViewport(oldViewport[0], oldViewport[1], oldViewport[2], oldViewport[3]);
+        gl.glBindFramebuffer(GL_DRAW_FRAMEBUFFER, oldDrawFBO);
+        gl.glBindFramebuffer(GL_READ_FRAMEBUFFER, oldReadFBO);
+        gl.glUseProgram(oldProgram);
+        if(blendWasEnabled)
+            gl.glEnable(GL_BLEND);
+    };
+
+    // Like render3DTexLayers() in main.cpp, the layers are drawn one at a time, each followed by a fence, so that
+    // no single command runs for long enough to trigger a GPU watchdog on large textures, and the command queue
+    // doesn't grow unboundedly. Owning the fences lets them be deleted if we throw with some layers in flight.
+    constexpr size_t maxLayersInFlight=4;
+    struct FenceDeleter { QOpenGLFunctions_3_3_Core& gl; void operator()(const GLsync fence) const { gl.glDeleteSync(fence); } };
+    std::deque<std::unique_ptr<std::remove_pointer_t<GLsync>, FenceDeleter>> fences;
+    const auto waitForLayers=[&](const size_t maxFencesToLeave)
+    {
+        while(fences.size() > maxFencesToLeave)
+        {
+            const auto status=gl.glClientWaitSync(fences.front().get(), GL_SYNC_FLUSH_COMMANDS_BIT,
+                                                  std::numeric_limits<GLuint64>::max());
+            if(status==GL_WAIT_FAILED)
+                throw std::runtime_error("glClientWaitSync() failed while generating interpolation guides: "+
+                                         openglErrorString(gl.glGetError()));
+            fences.pop_front();
+        }
+    };
+
+    const auto render=[&](QOpenGLShaderProgram& program, const GLuint target, const int width, const int height)
+    {
+        gl.glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target, 0);
+        if(gl.glCheckFramebufferStatus(GL_FRAMEBUFFER)!=GL_FRAMEBUFFER_COMPLETE)
+            throw std::runtime_error("Framebuffer for interpolation guides generation is incomplete");
+        gl.glViewport(0,0,width,height);
+        program.bind();
+        program.setUniformValue("scatteringTexture", scatteringTexUnit);
+        program.setUniformValue("rowStats", rowStatsTexUnit);
+        program.setUniformValue("guideTargets", guideTargetsTexUnit);
+        program.setUniformValue("dVSLayerCount", dVSLayerCount);
+        program.setUniformValue("vzaPointCount", vzaPointCount);
+        program.setUniformValue("colOffset", colOffset);
+        program.setUniformValue("numCols", numCols);
+        program.setUniformValue("numRows", numRows);
+        program.setUniformValue("rowsAlongSZA", rowsAlongSZA);
+        for(GLint layer=0; layer<altLayerCount; ++layer)
+        {
+            program.setUniformValue("layer", layer);
+            gl.glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+            fences.emplace_back(gl.glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), FenceDeleter{gl});
+            waitForLayers(maxLayersInFlight);
+        }
+    };
+
+    std::vector<int16_t> angles(size_t(anglesWidth)*anglesHeight*altLayerCount);
+    try
+    {
+        render(*rowStatsProgram, rowStatsTexture, numRows, numOthers);
+        if(!rowsAlongSZA)
+            reportMultipleMaxima(scatteringTexture, sizes, warnings);
+        render(*guideTargetsProgram, guideTargetsTexture, numCols, (numRows-1)*numOthers);
+        render(*anglesProgram, anglesTexture, anglesWidth, anglesHeight);
+        waitForLayers(0);
+
+        gl.glBindTexture(GL_TEXTURE_3D, anglesTexture);
+        gl.glGetTexImage(GL_TEXTURE_3D, 0, GL_RED_INTEGER, GL_SHORT, angles.data());
+    }
+    catch(...)
+    {
+        restoreState();
+        throw;
+    }
+    restoreState();
+
+    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
+        throw std::runtime_error("OpenGL error while generating interpolation guides: "+openglErrorString(err));
+
+    return angles;
+}
+
+// Preconditions: row statistics have been rendered for the rows along dotViewSun, the framebuffer is bound,
+// GL_PACK_ALIGNMENT is 1 and no GL_PIXEL_PACK_BUFFER is bound.
+// Clobbers: color attachment of the framebuffer
+void InterpolationGuidesGPUGenerator::reportMultipleMaxima(const GLuint scatteringTexture, std::vector<int> const& sizes,
+                                                           std::ostream& warnings)
+{
+    const auto altLayerCount = sizes[3];
+    const auto szaLayerCount = sizes[2];
+    const auto dVSLayerCount = sizes[1];
+    const auto vzaPointCount = sizes[0];
+    const auto colOffset = vzaPointCount/2 + 1;
+    const auto numCols = vzaPointCount/2 - 1;
+
+    // The statistics are small, unlike the scattering texture, whose rows are only read back if they are to be reported
+    std::vector<glm::vec4> stats(size_t(dVSLayerCount)*szaLayerCount*altLayerCount);
+    // The active unit is the one the following passes sample the scattering texture from, so keep its binding
+    GLint oldTexture=0;
+    gl.glGetIntegerv(GL_TEXTURE_BINDING_3D, &oldTexture);
+    gl.glBindTexture(GL_TEXTURE_3D, rowStatsTexture);
+    gl.glGetTexImage(GL_TEXTURE_3D, 0, GL_RGBA, GL_FLOAT, stats.data());
+    gl.glBindTexture(GL_TEXTURE_3D, oldTexture);
+
+    std::vector<glm::vec4> rowData(numCols);
+    for(int altIndex=0; altIndex<altLayerCount; ++altIndex)
+    {
+        for(int szaIndex=0; szaIndex<szaLayerCount; ++szaIndex)
+        {
+            for(int row=0; row<dVSLayerCount; ++row)
+            {
+                const auto numMaxima = int(stats[(size_t(altIndex)*szaLayerCount+szaIndex)*dVSLayerCount+row][2]);
+                if(!numMaxima) continue;
+
+                gl.glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, scatteringTexture, 0, altIndex);
+                gl.glReadPixels(colOffset, row + szaIndex*dVSLayerCount, numCols, 1, GL_RGBA, GL_FLOAT, rowData.data());
+                // Same format as in the CPU version
+                warnings << "\nwarning: " << numMaxima << " maxima instead of supported 1 in row " << row
+                         << " at altitude index " << altIndex << ", SZA index " << szaIndex << ".\n";
+                warnings << "Row data:\n";
+                for(int c = 0; c < numCols; ++c)
+                    warnings << rowData[c][1] << (c==numCols-1 ? "\n" : ",");
+            }
+        }
+    }
+}
+
+void generateInterpolationGuidesForScatteringTextureOnGPU(QOpenGLFunctions_3_3_Core& gl, const std::string_view filePath,
+                                                          const GLuint scatteringTexture, std::vector<int> const& sizes)
+{
+    std::cerr << indentOutput() << "Generating interpolation guides on GPU:\n";
+    const auto filePathQt = QByteArray::fromRawData(filePath.data(), filePath.size());
+    const std::string_view ext = ".f32";
+    if(!filePathQt.endsWith(ext.data()))
+    {
+        std::cerr << "wrong input filename extension\n";
+        throw MustQuit{};
+    }
+
+    InterpolationGuidesGPUGenerator generator(gl);
+    using Dimensions = InterpolationGuidesGPUGenerator::Dimensions;
+    for(const auto dimensions : {Dimensions::VZA_dotViewSun, Dimensions::VZA_SZA})
+    {
+        OutputIndentIncrease incr;
+        const bool rowsAlongSZA = dimensions==Dimensions::VZA_SZA;
+        std::cerr << indentOutput() << "Generating interpolation guides for "
+                  << (rowsAlongSZA ? "VZA-SZA" : "VZA-dotViewSun") << " dimensions... ";
+        const auto angles = generator.generate(scatteringTexture, sizes, dimensions, std::cerr);
+        std::cerr << "done\n";
+
+        const auto outputFilePath = filePathQt.left(filePathQt.size() - ext.size()) +
+                                        (rowsAlongSZA ? "-dims02.guides2d" : "-dims01.guides2d");
+        std::cerr << indentOutput() << "Saving interpolation guides to \"" << outputFilePath.toStdString() << "\"... ";
+        QFile out(outputFilePath);
+        if(!out.open(QFile::WriteOnly))
+        {
+            std::cerr << "failed to open interpolation guides file for writing: " << out.errorString().toStdString() << "\n";
+            throw MustQuit{};
+        }
+        // Guides represent points between rows, so there's one less of them than rows.
+        const uint16_t outputSizes[4] = {uint16_t(sizes[0]), uint16_t(sizes[1]-!rowsAlongSZA),
+                                         uint16_t(sizes[2]-rowsAlongSZA), uint16_t(sizes[3])};
+        const qint64 dataSize = angles.size()*sizeof angles[0];
+        if(out.write(reinterpret_cast<const char*>(outputSizes), sizeof outputSizes) != sizeof outputSizes ||
+           out.write(reinterpret_cast<const char*>(angles.data()), dataSize) != dataSize)
+        {
+            std::cerr << "failed to write file: " << out.errorString().toStdString() << "\n";
+            throw MustQuit{};
+        }
+        out.close();
+        if(out.error())
+        {
+            std::cerr << "failed to write file: " << out.errorString().toStdString() << "\n";
+            throw MustQuit{};
+        }
+        std::cerr << "done\n";
+    }
+}
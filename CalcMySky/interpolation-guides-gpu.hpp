@@ -0,0 +1,82 @@
+/*
+ * CalcMySky - a simulator of light scattering in planetary atmospheres
+ * Copyright © 2025 Ruslan Kabatsayev
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335, USA.
+ */
+
+#ifndef INCLUDE_ONCE_5C0E2B7D_93A4_4F61_8D2E_6B1F7A0C4E59
+#define INCLUDE_ONCE_5C0E2B7D_93A4_4F61_8D2E_6B1F7A0C4E59
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <iosfwd>
+#include <string_view>
+#include <QOpenGLShaderProgram>
+
+class QOpenGLFunctions_3_3_Core;
+
+/* Generates the interpolation guides for a scattering texture on the GPU, from the 3D texture where the
+ * scattering has been computed, so that the texture doesn't have to be read back. The CPU implementation
+ * in interpolation-guides.cpp is the reference, and this one follows it step by step:
+ *   1. for each row: the position of its maximum and its minimum value,
+ *   2. for each column in each pair of neighboring rows: the top-down and bottom-up guide targets,
+ *   3. for each column between each pair of rows: the angle from the nearest guides.
+ * Each step is a draw call per altitude layer. The first step also finds the rows with multiple maxima,
+ * which are reported with the same warnings as by the CPU version.
+ */
+class InterpolationGuidesGPUGenerator
+{
+    QOpenGLFunctions_3_3_Core& gl;
+    std::unique_ptr<QOpenGLShaderProgram> rowStatsProgram, guideTargetsProgram, anglesProgram;
+    GLuint fbo = 0;
+    GLuint sampler = 0;
+    GLuint rowStatsTexture = 0, guideTargetsTexture = 0, anglesTexture = 0;
+    GLuint vbo = 0, vao = 0;
+
+    void reportMultipleMaxima(GLuint scatteringTexture, std::vector<int> const& sizes, std::ostream& warnings);
+public:
+    enum class Dimensions
+    {
+        VZA_dotViewSun, // the guides saved to *-dims01.guides2d
+        VZA_SZA,        // the guides saved to *-dims02.guides2d
+    };
+
+    // Clobbers: GL_ARRAY_BUFFER_BINDING
+    explicit InterpolationGuidesGPUGenerator(QOpenGLFunctions_3_3_Core&);
+    ~InterpolationGuidesGPUGenerator();
+
+    // Whether the intermediate textures for a scattering texture of these sizes fit into GL_MAX_3D_TEXTURE_SIZE
+    static bool canGenerate(QOpenGLFunctions_3_3_Core&, std::vector<int> const& sizes);
+
+    /* Preconditions:
+     *   * scatteringTexture is a GL_TEXTURE_3D, laid out as the 4D scattering textures of calcmysky,
+     *     with the sizes given in the same order as to generateInterpolationGuidesForScatteringTexture()
+     *   * canGenerate() returns true for the sizes
+     * Returns the angles in the same order as they are saved in the guides file, without the header.
+     * Warnings about rows with multiple maxima are written to warnings for Dimensions::VZA_dotViewSun.
+     * Clobbers: GL_ACTIVE_TEXTURE, GL_TEXTURE_BINDING_3D of units 0, 1 and 2
+     */
+    std::vector<int16_t> generate(GLuint scatteringTexture, std::vector<int> const& sizes, Dimensions dimensions,
+                                  std::ostream& warnings);
+};
+
+// Generates and saves the same files as generateInterpolationGuidesForScatteringTexture(), using InterpolationGuidesGPUGenerator.
+// Precondition: InterpolationGuidesGPUGenerator::canGenerate() returns true for the sizes.
+void generateInterpolationGuidesForScatteringTextureOnGPU(QOpenGLFunctions_3_3_Core& gl, std::string_view filePath,
+                                                          GLuint scatteringTexture, std::vector<int> const& sizes);
+
+#endif
@@ -19,8 +19,14 @@
 
 #include "interpolation-guides.hpp"
 #include <cmath>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <thread>
 #include <vector>
 #include <limits>
+#include <optional>
+#include <algorithm>
 #include <sstream>
 #include <iostream>
 #include <QFile>
@@ -309,7 +315,7 @@ float calcAngle(const int guideOrigin, const float guideTarget, const GuideType
 void generateInterpolationGuides2D(glm::vec4 const*const data,
                                    const unsigned width, const unsigned height, const unsigned rowStride, int16_t* angles,
                                    const int altIndex, const int secondDimIndex, const char*const secondDimName,
-                                   const bool needCheckForMultipleMaxima)
+                                   const bool needCheckForMultipleMaxima, std::ostream& warnings)
 {
     if(width==0 || height==0)
     {
@@ -331,12 +337,12 @@ void generateInterpolationGuides2D(glm::vec4 const*const data,
                 // One single-pixel dip usually doesn't create much problems, so don't report this case of multiple maxima.
                 if(numMaxima == 2 && !minimumIsSinglePoint(rowData,numCols))
                 {
-                    std::cerr << "\nwarning: " << numMaxima << " maxima instead of supported 1 in row " << row
-                              << " at altitude index " << altIndex << ", " << secondDimName << " index " << secondDimIndex
-                              << ".\n";
-                    std::cerr << "Row data:\n";
+                    warnings << "\nwarning: " << numMaxima << " maxima instead of supported 1 in row " << row
+                             << " at altitude index " << altIndex << ", " << secondDimName << " index " << secondDimIndex
+                             << ".\n";
+                    warnings << "Row data:\n";
                     for(int c = 0; c < numCols; ++c)
-                        std::cerr << v2v(rowData[c]) << (c==numCols-1 ? "\n" : ",");
+                        warnings << v2v(rowData[c]) << (c==numCols-1 ? "\n" : ",");
                 }
             }
         }
@@ -405,15 +411,58 @@ void generateInterpolationGuides2D(glm::vec4 const*const data,
     }
 }
 
-void generateInterpolationGuidesForScatteringTexture(const std::string_view filePath, std::vector<glm::vec4> const& pixels,
-                                                     std::vector<int> const& sizes)
+namespace
 {
-    std::cerr << indentOutput() << "Generating interpolation guides:\n";
+
+/* The altitude layers are independent, so they are computed by worker threads. They are passed to writeLayer()
+ * in the order of altitude, each as soon as it and all the preceding ones are done, so that the output doesn't
+ * depend on the scheduling.
+ */
+template<typename ComputeLayer, typename WriteLayer>
+void processAltitudeLayersInParallel(const int altLayerCount, ComputeLayer const& computeLayer, WriteLayer const& writeLayer)
+{
+    std::vector<std::promise<void>> layersDone(altLayerCount);
+    std::atomic<int> nextLayer{0};
+    const auto work = [&]
+    {
+        for(int altIndex; (altIndex = nextLayer++) < altLayerCount;)
+        {
+            try
+            {
+                computeLayer(altIndex);
+                layersDone[altIndex].set_value();
+            }
+            catch(...)
+            {
+                // The layers preceding this one have already been taken, so they will be finished, while
+                // the following ones are abandoned, since the failure will be reported before them.
+                nextLayer = altLayerCount;
+                layersDone[altIndex].set_exception(std::current_exception());
+            }
+        }
+    };
+    const int workerCount = std::clamp(int(std::thread::hardware_concurrency()), 1, altLayerCount);
+    std::vector<std::future<void>> workers;
+    for(int n = 0; n < workerCount; ++n)
+        workers.push_back(std::async(std::launch::async, work));
+
+    for(int altIndex = 0; altIndex < altLayerCount; ++altIndex)
+    {
+        layersDone[altIndex].get_future().get();
+        writeLayer(altIndex);
+    }
+}
+
+void generateInterpolationGuides(const std::string_view filePath, std::vector<glm::vec4> const& pixels,
+                                 std::vector<int> const& sizes, std::ostream& log, std::string const& indent,
+                                 const bool showProgress)
+{
+    log << indent << "Generating interpolation guides:\n";
     const auto filePathQt = QByteArray::fromRawData(filePath.data(), filePath.size());
     const std::string_view ext = ".f32";
     if(!filePathQt.endsWith(ext.data()))
     {
-        std::cerr << "wrong input filename extension\n";
+        log << "wrong input filename extension\n";
         throw MustQuit{};
     }
 
@@ -421,16 +470,52 @@ void generateInterpolationGuidesForScatteringTexture(const std::string_view file
     const auto szaLayerCount = sizes[2];
     const auto dVSLayerCount = sizes[1];
     const auto vzaPointCount = sizes[0];
+    const auto aboveHorizonHalfSpaceOffset = vzaPointCount/2 + 1; // +1 skips zenith point, because it may have an extraneous maximum
+    const auto aboveHorizonHalfSpaceSize = vzaPointCount/2 - 1;   // -1 takes into account the +1 in the offset
+    const auto subIndent = indent+' ';
+
+    // Per-layer warnings are collected separately and printed in the order of layers
+    std::vector<std::ostringstream> layerWarnings(altLayerCount);
+    std::vector<std::vector<int16_t>> layerAngles(altLayerCount);
+    const auto writeLayers = [&](QFile& out)
+    {
+        return [&](const int altIndex)
+        {
+            log << layerWarnings[altIndex].str();
+            layerWarnings[altIndex] = {};
+
+            auto& angles = layerAngles[altIndex];
+            out.write(reinterpret_cast<const char*>(angles.data()), angles.size()*sizeof angles[0]);
+            angles = {};
+
+            if(showProgress)
+            {
+                std::ostringstream ss;
+                ss << altIndex+1 << " of " << altLayerCount << " layers done ";
+                // Print the status, and then reset cursor position so that the next status overwrites it
+                const auto statusWidth = ss.tellp();
+                log << ss.str() << std::string(statusWidth, '\b') << std::flush;
+            }
+        };
+    };
+    const auto clearProgress = [&]
+    {
+        if(!showProgress) return;
+        std::ostringstream ss;
+        ss << altLayerCount << " of " << altLayerCount << " layers done ";
+        const auto statusWidth = ss.tellp();
+        log << std::string(statusWidth, ' ') << std::string(statusWidth, '\b');
+    };
+
     // Handle dimensions VZA-dotViewSun
     {
-        OutputIndentIncrease incr;
-        std::cerr << indentOutput() << "Generating interpolation guides for VZA-dotViewSun dimensions... ";
+        log << subIndent << "Generating interpolation guides for VZA-dotViewSun dimensions... ";
 
         const auto outputFilePath = filePathQt.left(filePathQt.size() - ext.size()) + "-dims01.guides2d";
         QFile out(outputFilePath);
         if(!out.open(QFile::WriteOnly))
         {
-            std::cerr << "failed to open interpolation guides file for writing: " << out.errorString().toStdString() << "\n";
+            log << "failed to open interpolation guides file for writing: " << out.errorString().toStdString() << "\n";
             throw MustQuit{};
         }
         {
@@ -438,58 +523,49 @@ void generateInterpolationGuidesForScatteringTexture(const std::string_view file
             uint16_t outputSizes[4] = {uint16_t(sizes[0]), uint16_t(sizes[1]-1), uint16_t(sizes[2]), uint16_t(sizes[3])};
             if(out.write(reinterpret_cast<const char*>(outputSizes), sizeof outputSizes) != sizeof outputSizes)
             {
-                std::cerr << "failed to write interpolation guides header: " << out.errorString().toStdString() << "\n";
+                log << "failed to write interpolation guides header: " << out.errorString().toStdString() << "\n";
                 throw MustQuit{};
             }
         }
 
-        uint16_t rowStride = vzaPointCount, height = dVSLayerCount;
-        std::vector<int16_t> angles(rowStride*(height-1));
-        for(int altIndex = 0; altIndex < altLayerCount; ++altIndex)
+        const uint16_t rowStride = vzaPointCount, height = dVSLayerCount;
+        const auto subsliceSize = rowStride*(height-1);
+        processAltitudeLayersInParallel(altLayerCount, [&](const int altIndex)
         {
-            std::ostringstream ss;
-            ss << altIndex << " of " << altLayerCount << " layers done ";
-            std::cerr << ss.str();
-
+            auto& angles = layerAngles[altIndex];
+            angles.assign(szaLayerCount*subsliceSize, 0);
             for(int szaIndex = 0; szaIndex < szaLayerCount; ++szaIndex)
             {
                 const int altSliceOffset = altIndex*szaLayerCount*dVSLayerCount*vzaPointCount;
                 const int szaSubsliceOffset = szaIndex*vzaPointCount*dVSLayerCount;
-                const int aboveHorizonHalfSpaceOffset = vzaPointCount/2 + 1; // +1 skips zenith point, because it may have an extraneous maximum
-                const int aboveHorizonHalfSpaceSize = vzaPointCount/2 - 1;   // -1 takes into account the +1 in the offset
-                std::fill(angles.begin(), angles.end(), 0.f);
                 generateInterpolationGuides2D(&pixels[altSliceOffset + szaSubsliceOffset + aboveHorizonHalfSpaceOffset],
                                               aboveHorizonHalfSpaceSize, height, rowStride,
-                                              angles.data()+aboveHorizonHalfSpaceOffset, altIndex, szaIndex, "SZA", true);
-                out.write(reinterpret_cast<const char*>(angles.data()), angles.size()*sizeof angles[0]);
+                                              angles.data() + szaIndex*subsliceSize + aboveHorizonHalfSpaceOffset,
+                                              altIndex, szaIndex, "SZA", true, layerWarnings[altIndex]);
             }
+        }, writeLayers(out));
+        clearProgress();
 
-            // Clear previous status and reset cursor position
-            const auto statusWidth=ss.tellp();
-            std::cerr << std::string(statusWidth, '\b') << std::string(statusWidth, ' ')
-                      << std::string(statusWidth, '\b');
-        }
-        std::cerr << "done\n";
-        std::cerr << indentOutput() << "Saving interpolation guides to \"" << outputFilePath.toStdString() << "\"... ";
+        log << "done\n";
+        log << subIndent << "Saving interpolation guides to \"" << outputFilePath.toStdString() << "\"... ";
 
         out.close();
         if(out.error())
         {
-            std::cerr << "failed to write file: " << out.errorString().toStdString() << "\n";
+            log << "failed to write file: " << out.errorString().toStdString() << "\n";
             throw MustQuit{};
         }
-        std::cerr << "done\n";
+        log << "done\n";
     }
     // Handle dimensions VZA-SZA
     {
-        OutputIndentIncrease incr;
-        std::cerr << indentOutput() << "Generating interpolation guides for VZA-SZA dimensions... ";
+        log << subIndent << "Generating interpolation guides for VZA-SZA dimensions... ";
 
         const auto outputFilePath = filePathQt.left(filePathQt.size() - ext.size()) + "-dims02.guides2d";
         QFile out(outputFilePath);
         if(!out.open(QFile::WriteOnly))
         {
-            std::cerr << "failed to open interpolation guides file for writing: " << out.errorString().toStdString() << "\n";
+            log << "failed to open interpolation guides file for writing: " << out.errorString().toStdString() << "\n";
             throw MustQuit{};
         }
         {
@@ -497,47 +573,78 @@ void generateInterpolationGuidesForScatteringTexture(const std::string_view file
             uint16_t outputSizes[4] = {uint16_t(sizes[0]), uint16_t(sizes[1]), uint16_t(sizes[2]-1), uint16_t(sizes[3])};
             if(out.write(reinterpret_cast<const char*>(outputSizes), sizeof outputSizes) != sizeof outputSizes)
             {
-                std::cerr << "failed to write interpolation guides header: " << out.errorString().toStdString() << "\n";
+                log << "failed to write interpolation guides header: " << out.errorString().toStdString() << "\n";
                 throw MustQuit{};
             }
         }
 
-        uint16_t rowStride = vzaPointCount*dVSLayerCount, height = szaLayerCount;
-        std::vector<int16_t> angles(rowStride*(height-1));
-        for(int altIndex = 0; altIndex < altLayerCount; ++altIndex)
+        const uint16_t rowStride = vzaPointCount*dVSLayerCount, height = szaLayerCount;
+        processAltitudeLayersInParallel(altLayerCount, [&](const int altIndex)
         {
-            std::ostringstream ss;
-            ss << altIndex << " of " << altLayerCount << " layers done ";
-            std::cerr << ss.str();
-
-            std::fill(angles.begin(), angles.end(), 0.f);
+            auto& angles = layerAngles[altIndex];
+            angles.assign(rowStride*(height-1), 0);
             for(int dVSIndex = 0; dVSIndex < dVSLayerCount; ++dVSIndex)
             {
                 const int altSliceOffset = altIndex*szaLayerCount*dVSLayerCount*vzaPointCount;
                 const int dVSSubsliceOffset = vzaPointCount*dVSIndex;
-                const int aboveHorizonHalfSpaceOffset = vzaPointCount/2 + 1; // +1 skips zenith point, because it may have an extraneous maximum
-                const int aboveHorizonHalfSpaceSize = vzaPointCount/2 - 1;   // -1 takes into account the +1 in the offset
                 generateInterpolationGuides2D(&pixels[altSliceOffset + dVSSubsliceOffset + aboveHorizonHalfSpaceOffset],
                                               aboveHorizonHalfSpaceSize, height, rowStride,
                                               angles.data() + dVSSubsliceOffset + aboveHorizonHalfSpaceOffset,
-                                              altIndex, dVSIndex, "dotViewSun", false/*same rows, no need to recheck*/);
+                                              altIndex, dVSIndex, "dotViewSun", false/*same rows, no need to recheck*/,
+                                              layerWarnings[altIndex]);
             }
-            out.write(reinterpret_cast<const char*>(angles.data()), angles.size()*sizeof angles[0]);
+        }, writeLayers(out));
+        clearProgress();
 
-            // Clear previous status and reset cursor position
-            const auto statusWidth=ss.tellp();
-            std::cerr << std::string(statusWidth, '\b') << std::string(statusWidth, ' ')
-                      << std::string(statusWidth, '\b');
-        }
-        std::cerr << "done\n";
-        std::cerr << indentOutput() << "Saving interpolation guides to \"" << outputFilePath.toStdString() << "\"... ";
+        log << "done\n";
+        log << subIndent << "Saving interpolation guides to \"" << outputFilePath.toStdString() << "\"... ";
 
         out.close();
         if(out.error())
         {
-            std::cerr << "failed to write file: " << out.errorString().toStdString() << "\n";
+            log << "failed to write file: " << out.errorString().toStdString() << "\n";
             throw MustQuit{};
         }
-        std::cerr << "done\n";
+        log << "done\n";
     }
 }
+
+struct BackgroundGuidesJob
+{
+    std::future<void> done;
+    std::shared_ptr<std::ostringstream> log;
+};
+std::optional<BackgroundGuidesJob> backgroundGuidesJob;
+
+}
+
+void generateInterpolationGuidesForScatteringTexture(const std::string_view filePath, std::vector<glm::vec4> const& pixels,
+                                                     std::vector<int> const& sizes)
+{
+    generateInterpolationGuides(filePath, pixels, sizes, std::cerr, indentOutput(), true);
+}
+
+void startGeneratingInterpolationGuidesForScatteringTexture(const std::string_view filePath, std::vector<glm::vec4>&& pixels,
+                                                            std::vector<int> const& sizes)
+{
+    // Only one job is kept in flight to bound the memory held by the texture data
+    waitForInterpolationGuides();
+
+    std::cerr << indentOutput() << "Interpolation guides for \"" << filePath << "\" will be generated in background\n";
+    auto log = std::make_shared<std::ostringstream>();
+    auto done = std::async(std::launch::async,
+                           [filePath=std::string(filePath), pixels=std::move(pixels), sizes, log, indent=indentOutput()]
+                           { generateInterpolationGuides(filePath, pixels, sizes, *log, indent, false); });
+    backgroundGuidesJob = BackgroundGuidesJob{std::move(done), std::move(log)};
+}
+
+void waitForInterpolationGuides()
+{
+    if(!backgroundGuidesJob) return;
+    auto job = std::move(*backgroundGuidesJob);
+    backgroundGuidesJob.reset();
+
+    job.done.wait();
+    std::cerr << job.log->str();
+    job.done.get(); // rethrows the failure, if any
+}
@@ -27,3 +27,9 @@ void generateInterpolationGuides2D(glm::vec4 const* data, unsigned vecIndex,
 void generateInterpolationGuidesForScatteringTexture(std::string_view filePath,
                                                      std::vector<glm::vec4> const& pixels,
                                                      std::vector<int> const& sizes);
+// Generates the guides in a background thread. The previous background generation, if any, is waited for first.
+void startGeneratingInterpolationGuidesForScatteringTexture(std::string_view filePath,
+                                                            std::vector<glm::vec4>&& pixels,
+                                                            std::vector<int> const& sizes);
+// Waits for the background generation of guides to finish and prints its log, throws MustQuit if it failed
+void waitForInterpolationGuides();
@@ -21,8 +21,11 @@
 #include <iterator>
 #include <sstream>
 #include <complex>
+#include <deque>
+#include <limits>
 #include <memory>
 #include <random>
+#include <type_traits>
 #include <chrono>
 #include <cmath>
 #include <map>
@@ -41,16 +44,17 @@
 #include "glinit.hpp"
 #include "cmdline.hpp"
 #include "shaders.hpp"
+#include "checkpoint.hpp"
 #include "interpolation-guides.hpp"
+#include "interpolation-guides-gpu.hpp"
 #include "../common/EclipsedDoubleScatteringPrecomputer.hpp"
-#include "../common/TextureAverageComputer.hpp"
+#include "../common/ModelManifest.hpp"
 #include "../common/timing.hpp"
 
 QOpenGLFunctions_3_3_Core gl;
 using glm::ivec2;
 using glm::vec2;
 using glm::vec4;
-std::vector<glm::vec4> eclipsedDoubleScatteringAccumulatorTexture;
 
 static const QString currentPhaseFunctionStub = "vec4 currentPhaseFunction(float dotViewSun) { return vec4(3.4028235e38); }\n";
 
@@ -94,22 +98,64 @@ void render3DTexLayers(QOpenGLShaderProgram& program, const std::string_view wha
     }
 
     std::cerr << indentOutput() << whatIsBeingDone << "... ";
+
+    // Layers are submitted back to back, and each is followed by a fence, which lets us know how many
+    // of them have been finished without stalling the pipeline. We only block when too many layers are
+    // in flight, to keep the command queue from growing unboundedly.
+    constexpr size_t maxLayersInFlight=4;
+    constexpr auto minStatusUpdateInterval=std::chrono::milliseconds(100);
+    // Owning the fences lets them be deleted when we quit on an error with some layers still in flight
+    struct FenceDeleter { void operator()(const GLsync fence) const { gl.glDeleteSync(fence); } };
+    std::deque<std::unique_ptr<std::remove_pointer_t<GLsync>, FenceDeleter>> fences;
+    GLsizei layersDone=0;
+    std::streamoff statusWidth=0;
+    auto lastStatusUpdateTime=std::chrono::steady_clock::now();
+    const auto clearStatus=[&statusWidth]
+    {
+        // Clear previous status and reset cursor position
+        std::cerr << std::string(statusWidth, '\b') << std::string(statusWidth, ' ')
+                  << std::string(statusWidth, '\b');
+        statusWidth=0;
+    };
+    const auto collectFinishedLayers=[&fences,&layersDone](const size_t maxFencesToLeave)
+    {
+        while(!fences.empty())
+        {
+            const bool mustWait = fences.size() > maxFencesToLeave;
+            const auto timeout = mustWait ? std::numeric_limits<GLuint64>::max() : 0;
+            const auto status=gl.glClientWaitSync(fences.front().get(), GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+            if(status==GL_TIMEOUT_EXPIRED)
+                return;
+            if(status==GL_WAIT_FAILED)
+            {
+                std::cerr << "glClientWaitSync() FAILED in render3DTexLayers(): " << openglErrorString(gl.glGetError()) << "\n";
+                throw MustQuit{};
+            }
+            fences.pop_front();
+            ++layersDone;
+        }
+    };
     for(GLsizei layer=0; layer<atmo.scatTexDepth(); ++layer)
     {
-        std::ostringstream ss;
-        ss << layer << " of " << atmo.scatTexDepth() << " layers done ";
-        std::cerr << ss.str();
-
         program.setUniformValue("layer",layer);
         renderQuad();
-        gl.glFinish();
-        OPENGL_DEBUG_CHECK_ERROR("glFinish() FAILED in render3DTexLayers()");
+        fences.emplace_back(gl.glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+        OPENGL_DEBUG_CHECK_ERROR("glFenceSync() FAILED in render3DTexLayers()");
 
-        // Clear previous status and reset cursor position
-        const auto statusWidth=ss.tellp();
-        std::cerr << std::string(statusWidth, '\b') << std::string(statusWidth, ' ')
-                  << std::string(statusWidth, '\b');
+        collectFinishedLayers(maxLayersInFlight);
+
+        if(const auto now=std::chrono::steady_clock::now(); now-lastStatusUpdateTime >= minStatusUpdateInterval)
+        {
+            clearStatus();
+            std::ostringstream ss;
+            ss << layersDone << " of " << atmo.scatTexDepth() << " layers done ";
+            std::cerr << ss.str();
+            statusWidth=ss.tellp();
+            lastStatusUpdateTime=now;
+        }
     }
+    collectFinishedLayers(0);
+    clearStatus();
     if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
     {
         std::cerr << "FAILED: " << openglErrorString(err) << "\n";
@@ -486,6 +532,31 @@ void saveLightPollutionRenderingShader(const unsigned texIndex)
 }
 
 
+// Decides whether the guides for a texture of these sizes are generated on the GPU. If --gpu-guides can't be
+// honored, the guides are generated on the CPU instead, so the texture data must be read back for them.
+bool generateInterpolationGuidesOnGPU(std::vector<int> const& sizes)
+{
+    if(!opts.gpuInterpolationGuides)
+        return false;
+    if(InterpolationGuidesGPUGenerator::canGenerate(gl, sizes))
+        return true;
+    std::cerr << indentOutput() << "*** WARNING: the scattering texture is too large for generation of interpolation "
+                                   "guides on the GPU, they will be generated on the CPU\n";
+    return false;
+}
+
+// The data are only used by the CPU implementation, the GPU one reads the texture directly
+void generateInterpolationGuides(std::string const& filePath, const GLuint texture, std::vector<glm::vec4>&& data,
+                                 std::vector<int> const& sizes, const bool onGPU)
+{
+    if(onGPU)
+        generateInterpolationGuidesForScatteringTextureOnGPU(gl, filePath, texture, sizes);
+    else if(opts.backgroundInterpolationGuides)
+        startGeneratingInterpolationGuidesForScatteringTexture(filePath, std::move(data), sizes);
+    else
+        generateInterpolationGuidesForScatteringTexture(filePath, data, sizes);
+}
+
 void accumulateSingleScattering(const unsigned texIndex, AtmosphereParameters::Scatterer const& scatterer)
 {
     gl.glBlendFunc(GL_ONE, GL_ONE);
@@ -493,13 +564,7 @@ void accumulateSingleScattering(const unsigned texIndex, AtmosphereParameters::S
     auto& targetTexture=accumulatedSingleScatteringTextures[scatterer.name];
     if(!targetTexture)
     {
-        gl.glGenTextures(1, &targetTexture);
-        gl.glBindTexture(GL_TEXTURE_3D,targetTexture);
-        gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
-        gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
-        gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
-        gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_R,GL_CLAMP_TO_EDGE);
-        setupTexture(targetTexture, atmo.scatTexWidth(),atmo.scatTexHeight(),atmo.scatTexDepth());
+        targetTexture=createAccumulatorTexture3D();
         gl.glDisable(GL_BLEND);
     }
     gl.glBindFramebuffer(GL_FRAMEBUFFER,fbos[FBO_SINGLE_SCATTERING]);
@@ -518,15 +583,18 @@ void accumulateSingleScattering(const unsigned texIndex, AtmosphereParameters::S
     gl.glDisable(GL_BLEND);
     gl.glBindFramebuffer(GL_FRAMEBUFFER,0);
 
-    if(texIndex+1==atmo.allWavelengths.size())
+    if(texIndex==opts.lastWLSet)
     {
         const auto filePath = atmo.textureOutputDir+"/single-scattering/"+scatterer.name.toStdString()+"-xyzw.f32";
         const std::vector<int> sizes{atmo.scatteringTextureSize[0], atmo.scatteringTextureSize[1],
                                      atmo.scatteringTextureSize[2], atmo.scatteringTextureSize[3]};
-        const auto data = saveTexture(GL_TEXTURE_3D,targetTexture, "single scattering texture",
-                                      filePath, sizes, ReturnTextureData{true});
-        if(scatterer.needsInterpolationGuides && !opts.dbgNoSaveTextures)
-            generateInterpolationGuidesForScatteringTexture(filePath, data, sizes);
+        // Guides for a partial sum would be wrong, calcmysky-merge will generate them from the full one
+        const bool needGuides = scatterer.needsInterpolationGuides && !opts.dbgNoSaveTextures && !computingPartialWLSetRange();
+        const bool guidesOnGPU = needGuides && generateInterpolationGuidesOnGPU(sizes);
+        auto data = saveTexture(GL_TEXTURE_3D,targetTexture, "single scattering texture",
+                                filePath, sizes, ReturnTextureData{needGuides && !guidesOnGPU});
+        if(needGuides)
+            generateInterpolationGuides(filePath, targetTexture, std::move(data), sizes, guidesOnGPU);
     }
 }
 
@@ -562,10 +630,12 @@ void computeSingleScattering(const unsigned texIndex, AtmosphereParameters::Scat
                                 "/"+scatterer.name.toStdString()+".f32";
         const std::vector<int> sizes{atmo.scatteringTextureSize[0], atmo.scatteringTextureSize[1],
                                      atmo.scatteringTextureSize[2], atmo.scatteringTextureSize[3]};
-        const auto data = saveTexture(GL_TEXTURE_3D,textures[TEX_DELTA_SCATTERING], "single scattering texture",
-                                      filePath, sizes, ReturnTextureData{true});
-        if(scatterer.needsInterpolationGuides && !opts.dbgNoSaveTextures)
-            generateInterpolationGuidesForScatteringTexture(filePath, data, sizes);
+        const bool needGuides = scatterer.needsInterpolationGuides && !opts.dbgNoSaveTextures;
+        const bool guidesOnGPU = needGuides && generateInterpolationGuidesOnGPU(sizes);
+        auto data = saveTexture(GL_TEXTURE_3D,textures[TEX_DELTA_SCATTERING], "single scattering texture",
+                                filePath, sizes, ReturnTextureData{needGuides && !guidesOnGPU});
+        if(needGuides)
+            generateInterpolationGuides(filePath, textures[TEX_DELTA_SCATTERING], std::move(data), sizes, guidesOnGPU);
         break;
     }
     case PhaseFunctionType::Achromatic:
@@ -765,7 +835,7 @@ void accumulateMultipleScattering(const unsigned scatteringOrder, const unsigned
     // Now it's time to do this by only holding the accumulator and delta scattering texture in VRAM.
     gl.glActiveTexture(GL_TEXTURE0);
     gl.glBlendFunc(GL_ONE, GL_ONE);
-    if(scatteringOrder>2 || (texIndex>0 && !opts.saveResultAsRadiance))
+    if(scatteringOrder>2 || (texIndex>opts.firstWLSet && !opts.saveResultAsRadiance))
         gl.glEnable(GL_BLEND);
     else
         gl.glDisable(GL_BLEND);
@@ -792,7 +862,7 @@ void accumulateMultipleScattering(const unsigned scatteringOrder, const unsigned
                     atmo.textureOutputDir+"/multiple-scattering-to-order"+std::to_string(scatteringOrder)+"-wlset"+std::to_string(texIndex)+".f32",
                     {atmo.scatteringTextureSize[0], atmo.scatteringTextureSize[1], atmo.scatteringTextureSize[2], atmo.scatteringTextureSize[3]});
     }
-    if(scatteringOrder==atmo.scatteringOrdersToCompute && (texIndex+1==atmo.allWavelengths.size() || opts.saveResultAsRadiance))
+    if(scatteringOrder==atmo.scatteringOrdersToCompute && (texIndex==opts.lastWLSet || opts.saveResultAsRadiance))
     {
         const auto filename = opts.saveResultAsRadiance ?
             atmo.textureOutputDir+"/multiple-scattering-wlset"+std::to_string(texIndex)+".f32" :
@@ -838,6 +908,7 @@ void computeMultipleScattering(const unsigned texIndex)
 {
     // Due to interleaving of calculations of first scattering for each scatterer with the
     // second-order scattering density and irradiance we have to do this iteration separately.
+    if(!stageDoneInPreviousRun(texIndex, "scattering orders 1 and 2"))
     {
         std::cerr << indentOutput() << "Working on scattering orders 1 and 2:\n";
         OutputIndentIncrease incr;
@@ -847,15 +918,27 @@ void computeMultipleScattering(const unsigned texIndex)
         {
             computeMultipleScatteringFromDensity(2,texIndex);
         }
+        markStageFinished(texIndex, "scattering orders 1 and 2");
+    }
+    else
+    {
+        // Higher orders don't depend on the scatterer-specific sources set up for single scattering,
+        // but they still need the generic ones that the skipped stage would have left behind.
+        virtualSourceFiles[DENSITIES_SHADER_FILENAME]=makeScattererDensityFunctionsSrc();
+        virtualSourceFiles[PHASE_FUNCTIONS_SHADER_FILENAME]=makePhaseFunctionsSrc()+currentPhaseFunctionStub;
     }
     for(unsigned scatteringOrder=3; scatteringOrder<=atmo.scatteringOrdersToCompute; ++scatteringOrder)
     {
+        const auto stage="scattering order "+std::to_string(scatteringOrder);
+        if(stageDoneInPreviousRun(texIndex, stage)) continue;
+
         std::cerr << indentOutput() << "Working on scattering order " << scatteringOrder << ":\n";
         OutputIndentIncrease incr;
 
         computeScatteringDensity(scatteringOrder,texIndex);
         computeIndirectIrradiance(scatteringOrder,texIndex);
         computeMultipleScatteringFromDensity(scatteringOrder,texIndex);
+        markStageFinished(texIndex, stage);
     }
 }
 
@@ -924,9 +1007,6 @@ void computeEclipsedDoubleScattering(const unsigned texIndex)
     const unsigned texSizeBySZA = atmo.eclipsedDoubleScatteringTextureSize[2];
     const unsigned texSizeByAltitude = atmo.eclipsedDoubleScatteringTextureSize[3];
 
-    gl.glBindFramebuffer(GL_FRAMEBUFFER, fbos[FBO_ECLIPSED_DOUBLE_SCATTERING]);
-    gl.glFramebufferTexture(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,textures[TEX_ECLIPSED_DOUBLE_SCATTERING],0);
-    checkFramebufferStatus("framebuffer for eclipsed double scattering");
     program->bind();
     int unusedTextureUnitNum=0;
     setUniformTexture(*program,GL_TEXTURE_2D,TEX_TRANSMITTANCE,unusedTextureUnitNum++,"transmittanceTexture");
@@ -937,6 +1017,13 @@ void computeEclipsedDoubleScattering(const unsigned texIndex)
 	gl.glBindVertexArray(vao);
     std::vector<glm::vec4> dataToSave;
     size_t numPointsPerSet=0;
+    // The samples are collected one step behind, so that the GPU computes the next ones while we wait for the previous
+    bool samplesPending=false;
+    const auto collectSamples=[&]
+    {
+        precomputer.finishComputingRadianceOnCoarseGrid();
+        numPointsPerSet = precomputer.appendCoarseGridSamplesTo(dataToSave);
+    };
     for(unsigned altIndex=0; altIndex<texSizeByAltitude; ++altIndex)
     {
         // Using the same encoding for altitude as in scatteringTex4DCoordsToTexVars()
@@ -954,9 +1041,11 @@ void computeEclipsedDoubleScattering(const unsigned texIndex)
             const double cosSunZenithAngle=unitRangeTexCoordToCosSZA(float(szaIndex)/(texSizeBySZA-1));
             const double sunZenithAngle=acos(cosSunZenithAngle);
 
-            precomputer.computeRadianceOnCoarseGrid(*program, textures[TEX_ECLIPSED_DOUBLE_SCATTERING], unusedTextureUnitNum,
-                                                    cameraAltitude, sunZenithAngle, sunZenithAngle, 0, atmo.earthMoonDistance);
-            numPointsPerSet = precomputer.appendCoarseGridSamplesTo(dataToSave);
+            precomputer.startComputingRadianceOnCoarseGrid(*program, unusedTextureUnitNum, cameraAltitude,
+                                                           sunZenithAngle, sunZenithAngle, 0, atmo.earthMoonDistance);
+            if(samplesPending)
+                collectSamples();
+            samplesPending=true;
 
             // Clear previous status and reset cursor position
             const auto statusWidth=ss.tellp();
@@ -964,6 +1053,8 @@ void computeEclipsedDoubleScattering(const unsigned texIndex)
                       << std::string(statusWidth, '\b');
         }
     }
+    if(samplesPending)
+        collectSamples();
 	gl.glBindVertexArray(0);
 
     const auto time1=std::chrono::steady_clock::now();
@@ -974,7 +1065,7 @@ void computeEclipsedDoubleScattering(const unsigned texIndex)
         std::cerr << indentOutput() << "Blending eclipsed double scattering texture into accumulator... ";
         const auto time0=std::chrono::steady_clock::now();
         const auto rad2lum = radianceToLuminance(texIndex, atmo.allWavelengths);
-        if(texIndex == 0)
+        if(texIndex == opts.firstWLSet)
         {
             // Initialize the accumulator with the first layer...
             eclipsedDoubleScatteringAccumulatorTexture = std::move(dataToSave);
@@ -994,7 +1085,7 @@ void computeEclipsedDoubleScattering(const unsigned texIndex)
         std::cerr << "done in " << formatDeltaTime(time0, time1) << "\n";
     }
 
-    if(opts.saveResultAsRadiance || texIndex+1 == atmo.allWavelengths.size())
+    if(opts.saveResultAsRadiance || texIndex == opts.lastWLSet)
     {
         const auto path = atmo.textureOutputDir+"/eclipsed-double-scattering" +
                           (opts.saveResultAsRadiance ? "-wlset"+std::to_string(texIndex) : "-xyzw") +
@@ -1009,9 +1100,18 @@ void computeEclipsedDoubleScattering(const unsigned texIndex)
         for(const uint16_t size : {numPointsPerSet})
             out.write(reinterpret_cast<const char*>(&size), sizeof size);
         auto& texture = opts.saveResultAsRadiance ? dataToSave : eclipsedDoubleScatteringAccumulatorTexture;
-        if(opts.textureSavePrecision)
+        const bool partialSum = isPartialXYZWSum(path);
+        if(opts.textureSavePrecision && !partialSum)
             roundTexData(&texture[0][0], 4*texture.size(), opts.textureSavePrecision);
-        out.write(reinterpret_cast<const char*>(texture.data()), texture.size()*sizeof texture[0]);
+        if(opts.halfFloatStorage && !partialSum)
+        {
+            const auto halfData=convertToHalfFloat("eclipsed double scattering texture", path, &texture[0][0], 4*texture.size());
+            out.write(reinterpret_cast<const char*>(halfData.get()), 4*texture.size()*sizeof halfData[0]);
+        }
+        else
+        {
+            out.write(reinterpret_cast<const char*>(texture.data()), texture.size()*sizeof texture[0]);
+        }
         out.close();
         if(out.error())
         {
@@ -1111,7 +1211,7 @@ void computeLightPollutionMultipleScattering(const unsigned texIndex)
 void accumulateLightPollutionLuminanceTexture(const unsigned texIndex)
 {
     const auto tex = TEX_LIGHT_POLLUTION_SCATTERING_LUMINANCE;
-    if(texIndex==0)
+    if(texIndex==opts.firstWLSet)
     {
         setupTexture(tex, atmo.lightPollutionTextureSize[0], atmo.lightPollutionTextureSize[1]);
     }
@@ -1133,11 +1233,12 @@ void accumulateLightPollutionLuminanceTexture(const unsigned texIndex)
     program->setUniformValue("radianceToLuminance", toQMatrix(radianceToLuminance(texIndex, atmo.allWavelengths)));
     renderQuad();
 
-    if(texIndex+1==atmo.allWavelengths.size())
+    if(texIndex==opts.lastWLSet)
     {
         saveTexture(GL_TEXTURE_2D,textures[TEX_LIGHT_POLLUTION_SCATTERING_LUMINANCE],"light pollution texture",
                     atmo.textureOutputDir+"/light-pollution-xyzw.f32",
-                    {atmo.lightPollutionTextureSize[0], atmo.lightPollutionTextureSize[1]});
+                    {atmo.lightPollutionTextureSize[0], atmo.lightPollutionTextureSize[1]},
+                    ReturnTextureData{false}, AllowHalfFloat{true});
     }
 
     gl.glDisable(GL_BLEND);
@@ -1215,6 +1316,8 @@ int main(int argc, char** argv)
             for(unsigned texIndex=0; texIndex<atmo.allWavelengths.size(); ++texIndex)
                 createDirs(atmo.textureOutputDir+"/shaders/light-pollution/"+std::to_string(texIndex));
 
+        // A manifest left from a previous run would describe the files that are about to be overwritten
+        QFile::remove((atmo.textureOutputDir+"/"+MODEL_MANIFEST_FILENAME).c_str());
         {
             std::cerr << "Writing parameters to output description file...";
             const auto target=atmo.textureOutputDir+"/params.atmo";
@@ -1245,14 +1348,41 @@ int main(int argc, char** argv)
             }
             std::cerr << " done\n";
         }
+        if(const auto target=atmo.textureOutputDir+"/"+PARTIAL_WLSET_RANGE_FILENAME; computingPartialWLSetRange())
+        {
+            std::cerr << "Writing partial wavelength set range to \"" << target << "\"...";
+            QFile file(target.c_str());
+            if(!file.open(QFile::WriteOnly))
+            {
+                std::cerr << " FAILED to open: " << file.errorString() << "\n";
+                throw MustQuit{};
+            }
+            QTextStream out(&file);
+            out << "first: " << opts.firstWLSet << "\n";
+            out << "last: " << opts.lastWLSet << "\n";
+            out << "count: " << atmo.allWavelengths.size() << "\n";
+            out << "texture save precision: " << opts.textureSavePrecision << "\n";
+            out << "half float storage: " << opts.halfFloatStorage << "\n";
+            out.flush();
+            file.close();
+            if(file.error())
+            {
+                std::cerr << " FAILED to write: " << file.errorString() << "\n";
+                throw MustQuit{};
+            }
+            std::cerr << " done\n";
+        }
+        else
+        {
+            // Don't let a marker from a previous partial run into the same directory confuse calcmysky-merge
+            QFile::remove(target.c_str());
+        }
 
-        const auto timeBegin=std::chrono::steady_clock::now();
+        initCheckpointJournal();
 
-        // Initialize texture averager before anything to make it emit possible
-        // warnings not mixing them into computation status reports.
-        TextureAverageComputer{gl, 10, 10, GL_RGBA32F, 0};
+        const auto timeBegin=std::chrono::steady_clock::now();
 
-        for(unsigned texIndex=0;texIndex<atmo.allWavelengths.size();++texIndex)
+        for(unsigned texIndex=opts.firstWLSet;texIndex<=opts.lastWLSet;++texIndex)
         {
             std::cerr << "Working on wavelengths " << atmo.allWavelengths[texIndex][0] << ", "
                                                    << atmo.allWavelengths[texIndex][1] << ", "
@@ -1276,23 +1406,36 @@ int main(int argc, char** argv)
                 std::cerr << indentOutput() << "Computing parts of scattering order 1:\n";
                 OutputIndentIncrease incr;
 
-                computeTransmittance(texIndex);
+                if(!stageDoneInPreviousRun(texIndex, "transmittance"))
+                {
+                    computeTransmittance(texIndex);
+                    markStageFinished(texIndex, "transmittance");
+                }
                 // We'll use ground irradiance to take into account the contribution of light scattered by the ground to the
                 // sky color. Irradiance will also be needed when we want to draw the ground itself.
-                computeDirectGroundIrradiance(texIndex);
+                if(!stageDoneInPreviousRun(texIndex, "direct ground irradiance"))
+                {
+                    computeDirectGroundIrradiance(texIndex);
+                    markStageFinished(texIndex, "direct ground irradiance");
+                }
             }
 
-            computeLightPollutionSingleScattering(texIndex);
-            computeLightPollutionMultipleScattering(texIndex);
-            if(opts.saveResultAsRadiance)
-            {
-                saveTexture(GL_TEXTURE_2D,textures[TEX_LIGHT_POLLUTION_SCATTERING],"light pollution texture",
-                            atmo.textureOutputDir+"/light-pollution-wlset"+std::to_string(texIndex)+".f32",
-                            {atmo.lightPollutionTextureSize[0], atmo.lightPollutionTextureSize[1]});
-            }
-            else
+            if(!stageDoneInPreviousRun(texIndex, "light pollution"))
             {
-                accumulateLightPollutionLuminanceTexture(texIndex);
+                computeLightPollutionSingleScattering(texIndex);
+                computeLightPollutionMultipleScattering(texIndex);
+                if(opts.saveResultAsRadiance)
+                {
+                    saveTexture(GL_TEXTURE_2D,textures[TEX_LIGHT_POLLUTION_SCATTERING],"light pollution texture",
+                                atmo.textureOutputDir+"/light-pollution-wlset"+std::to_string(texIndex)+".f32",
+                                {atmo.lightPollutionTextureSize[0], atmo.lightPollutionTextureSize[1]},
+                                ReturnTextureData{false}, AllowHalfFloat{true});
+                }
+                else
+                {
+                    accumulateLightPollutionLuminanceTexture(texIndex);
+                }
+                markStageFinished(texIndex, "light pollution");
             }
             saveLightPollutionRenderingShader(texIndex);
 
@@ -1303,8 +1446,11 @@ int main(int argc, char** argv)
                 saveEclipsedDoubleScatteringRenderingShader(texIndex);
             }
 
-            computeEclipsedDoubleScattering(texIndex);
-
+            if(!stageDoneInPreviousRun(texIndex, "eclipsed double scattering"))
+            {
+                computeEclipsedDoubleScattering(texIndex);
+                markStageFinished(texIndex, "eclipsed double scattering");
+            }
         }
         if(!opts.saveResultAsRadiance)
         {
@@ -1312,6 +1458,23 @@ int main(int argc, char** argv)
             saveEclipsedDoubleScatteringRenderingShader(-1);
         }
 
+        waitForTextureSaving();
+        waitForInterpolationGuides();
+        if(opts.halfFloatStorage && !opts.dbgNoSaveTextures)
+            saveHalfFloatValidationReport(atmo.textureOutputDir);
+        removeCheckpoints();
+        // Outputs of runs limited by --wlsets get their manifest when merged
+        if(!computingPartialWLSetRange())
+        {
+            std::cerr << "Writing model manifest...";
+            if(const auto error=writeModelManifest(QString::fromStdString(atmo.textureOutputDir)); !error.isEmpty())
+            {
+                std::cerr << " FAILED: " << error << "\n";
+                throw MustQuit{};
+            }
+            std::cerr << " done\n";
+        }
+
         const auto timeEnd=std::chrono::steady_clock::now();
         std::cerr << "Finished in " << formatDeltaTime(timeBegin, timeEnd) << "\n";
     }
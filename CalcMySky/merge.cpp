@@ -0,0 +1,447 @@
+/*
+ * CalcMySky - a simulator of light scattering in planetary atmospheres
+ * Copyright © 2025 Ruslan Kabatsayev
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335, USA.
+ */
+
+/* Merges outputs of calcmysky runs limited to subranges of wavelength sets (option --wlsets)
+ * into a complete model: per-wavelength-set files are copied, while the partial sums of XYZW
+ * textures are added together. Interpolation guides for the XYZW single scattering textures
+ * depend on the full sum, so they are generated here.
+ */
+
+#include <memory>
+#include <vector>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QFile>
+#include <QDir>
+
+#include "config.h"
+#include "const.hpp"
+#include "util.hpp"
+#include "interpolation-guides.hpp"
+#include "../common/AtmosphereParameters.hpp"
+#include "../common/CompressedTexture.hpp"
+#include "../common/ModelManifest.hpp"
+
+namespace
+{
+
+struct PartialOutput
+{
+    QString dir;
+    unsigned firstWLSet=0, lastWLSet=0, wlSetCount=0;
+    unsigned textureSavePrecision=0;
+    bool halfFloatStorage=false;
+};
+
+PartialOutput readPartialOutputInfo(QString const& dir)
+{
+    const auto path=dir+"/"+PARTIAL_WLSET_RANGE_FILENAME;
+    QFile file(path);
+    if(!file.open(QFile::ReadOnly))
+    {
+        std::cerr << "Failed to open \"" << path << "\": " << file.errorString()
+                  << "\nIs \"" << dir << "\" an output directory of calcmysky run with --wlsets?\n";
+        throw MustQuit{};
+    }
+    PartialOutput output;
+    output.dir=dir;
+    bool haveFirst=false, haveLast=false, haveCount=false;
+    for(auto line=QString::fromUtf8(file.readLine()); !line.isEmpty(); line=QString::fromUtf8(file.readLine()))
+    {
+        const auto keyValue=line.trimmed().split(": ");
+        if(keyValue.size()!=2)
+        {
+            std::cerr << "Bad line in \"" << path << "\": " << line.trimmed() << "\n";
+            throw MustQuit{};
+        }
+        bool ok=false;
+        const auto value=keyValue[1].toUInt(&ok);
+        if(!ok)
+        {
+            std::cerr << "Failed to parse value in \"" << path << "\": " << line.trimmed() << "\n";
+            throw MustQuit{};
+        }
+        if(keyValue[0]=="first") { output.firstWLSet=value; haveFirst=true; }
+        else if(keyValue[0]=="last") { output.lastWLSet=value; haveLast=true; }
+        else if(keyValue[0]=="count") { output.wlSetCount=value; haveCount=true; }
+        else if(keyValue[0]=="texture save precision") output.textureSavePrecision=value;
+        else if(keyValue[0]=="half float storage") output.halfFloatStorage=value;
+    }
+    if(!haveFirst || !haveLast || !haveCount)
+    {
+        std::cerr << "Incomplete wavelength set range in \"" << path << "\"\n";
+        throw MustQuit{};
+    }
+    return output;
+}
+
+QByteArray readFile(QString const& path)
+{
+    QFile file(path);
+    if(!file.open(QFile::ReadOnly))
+    {
+        std::cerr << "Failed to open \"" << path << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    auto data=file.readAll();
+    if(file.error())
+    {
+        std::cerr << "Failed to read \"" << path << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    return data;
+}
+
+bool isXYZWTexture(QString const& relativePath)
+{
+    return relativePath.endsWith("-xyzw.f32");
+}
+
+// Number of uint16 dimensions in the header of an XYZW texture file
+int headerDimensionCount(QString const& relativePath)
+{
+    if(relativePath=="eclipsed-double-scattering-xyzw.f32")
+        return 1; // Number of coarse grid points per set, see computeEclipsedDoubleScattering()
+    if(relativePath=="light-pollution-xyzw.f32")
+        return 2;
+    return 4;
+}
+
+// Adds pixels stored as float32 RGBA to the sum
+void addPixels(const char*const data, const size_t pixelCount, glm::vec4*const sum)
+{
+    for(size_t i=0; i<pixelCount; ++i)
+    {
+        glm::vec4 pixel;
+        std::memcpy(&pixel, data+i*sizeof pixel, sizeof pixel);
+        sum[i] += pixel;
+    }
+}
+
+void copyFile(QString const& source, QString const& target)
+{
+    QDir().mkpath(QFileInfo(target).path());
+    QFile::remove(target);
+    if(!QFile::copy(source, target))
+    {
+        std::cerr << "Failed to copy \"" << source << "\" to \"" << target << "\"\n";
+        throw MustQuit{};
+    }
+}
+
+std::vector<glm::vec4> sumTextures(std::vector<PartialOutput> const& inputs, QString const& relativePath,
+                                   QString const& outDir, std::vector<int>& sizes)
+{
+    const auto outPath=outDir+"/"+relativePath;
+    std::cerr << "Summing partial textures into \"" << outPath << "\"... ";
+
+    const qint64 headerSize=headerDimensionCount(relativePath)*sizeof(uint16_t);
+    // The partial sums are saved unrounded as float32 regardless of --storage, see isPartialXYZWSum()
+    const size_t pixelSize=sizeof(glm::vec4);
+    std::vector<glm::vec4> sum;
+    bool compressed=false;
+    for(const auto& input : inputs)
+    {
+        const auto path=input.dir+"/"+relativePath;
+        QFile file(path);
+        if(!file.open(QFile::ReadOnly))
+        {
+            std::cerr << "failed to open \"" << path << "\": " << file.errorString() << "\n";
+            throw MustQuit{};
+        }
+        const bool first = &input==&inputs.front();
+
+        if(isCompressedTexture(file))
+        {
+            const auto mappedData=file.map(0, file.size());
+            if(!mappedData)
+            {
+                std::cerr << "failed to map \"" << path << "\" into memory: " << file.errorString() << "\n";
+                throw MustQuit{};
+            }
+            const CompressedTextureReader reader(mappedData, file.size(), path);
+            if(reader.pixelSize()!=pixelSize)
+            {
+                std::cerr << "unexpected pixel size " << reader.pixelSize() << " in \"" << path << "\"\n";
+                throw MustQuit{};
+            }
+            if(first)
+            {
+                sizes=reader.sizes();
+                sum.resize(reader.sliceCount()*reader.sliceByteSize()/pixelSize);
+            }
+            else if(reader.sizes()!=sizes)
+            {
+                std::cerr << "dimensions of \"" << path << "\" don't match those of the other partial outputs\n";
+                throw MustQuit{};
+            }
+            std::vector<char> slice(reader.sliceByteSize());
+            const size_t slicePixelCount=slice.size()/pixelSize;
+            for(size_t n=0; n<reader.sliceCount(); ++n)
+            {
+                reader.readSlice(n, slice.data());
+                addPixels(slice.data(), slicePixelCount, &sum[n*slicePixelCount]);
+            }
+            compressed=true;
+            continue;
+        }
+
+        const auto header=file.read(headerSize);
+        if(header.size()!=headerSize || (file.size()-headerSize) % pixelSize)
+        {
+            std::cerr << "bad size of \"" << path << "\"\n";
+            throw MustQuit{};
+        }
+        std::vector<int> thisSizes;
+        for(int i=0; i<header.size()/int(sizeof(uint16_t)); ++i)
+        {
+            uint16_t size;
+            std::memcpy(&size, header.constData()+i*sizeof size, sizeof size);
+            thisSizes.push_back(size);
+        }
+        if(first)
+        {
+            sizes=thisSizes;
+            sum.resize((file.size()-headerSize)/pixelSize);
+        }
+        else if(thisSizes!=sizes || size_t(file.size()-headerSize)!=sum.size()*pixelSize)
+        {
+            std::cerr << "dimensions of \"" << path << "\" don't match those of the other partial outputs\n";
+            throw MustQuit{};
+        }
+
+        // Read in chunks to avoid holding another copy of a possibly huge texture in memory
+        const size_t chunkPixelCount=std::min(sum.size(), size_t(1)<<20);
+        std::vector<char> chunk(chunkPixelCount*pixelSize);
+        for(size_t pos=0; pos<sum.size(); pos+=chunkPixelCount)
+        {
+            const auto count=std::min(chunkPixelCount, sum.size()-pos);
+            const qint64 sizeToRead=count*pixelSize;
+            if(file.read(chunk.data(), sizeToRead) != sizeToRead)
+            {
+                std::cerr << "failed to read \"" << path << "\": " << file.errorString() << "\n";
+                throw MustQuit{};
+            }
+            addPixels(chunk.data(), count, &sum[pos]);
+        }
+    }
+
+    // Rounding is done the same way as calcmysky does it: light pollution texture is 2D, so it's not rounded
+    if(inputs.front().textureSavePrecision && relativePath!="light-pollution-xyzw.f32")
+        roundTexData(&sum[0][0], 4*sum.size(), inputs.front().textureSavePrecision);
+
+    QFile out(outPath);
+    if(!out.open(QFile::WriteOnly))
+    {
+        std::cerr << "failed to open file: " << out.errorString() << "\n";
+        throw MustQuit{};
+    }
+    std::unique_ptr<qfloat16[]> halfSum;
+    const char* dataToWrite=reinterpret_cast<const char*>(sum.data());
+    size_t outPixelSize=pixelSize;
+    if(inputs.front().halfFloatStorage)
+    {
+        halfSum=convertToHalfFloat("merged texture", outPath.toStdString(), &sum[0][0], 4*sum.size());
+        dataToWrite=reinterpret_cast<const char*>(halfSum.get());
+        outPixelSize=4*sizeof halfSum[0];
+    }
+    if(compressed)
+    {
+        if(const auto error=writeCompressedTexture(out, dataToWrite, sizes, outPixelSize, outPixelSize/4); !error.isEmpty())
+        {
+            std::cerr << "failed to write compressed texture: " << error << "\n";
+            throw MustQuit{};
+        }
+    }
+    else
+    {
+        for(const uint16_t size : sizes)
+            out.write(reinterpret_cast<const char*>(&size), sizeof size);
+        out.write(dataToWrite, sum.size()*outPixelSize);
+    }
+    out.close();
+    if(out.error())
+    {
+        std::cerr << "failed to write file: " << out.errorString() << "\n";
+        throw MustQuit{};
+    }
+    std::cerr << "done\n";
+
+    return sum;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    [[maybe_unused]] UTF8Console utf8console;
+
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("calcmysky-merge");
+    app.setApplicationVersion(PROJECT_VERSION);
+
+    try
+    {
+        QCommandLineParser parser;
+        parser.setApplicationDescription("Merge outputs of calcmysky runs made with --wlsets into a complete model");
+        parser.addHelpOption();
+        parser.addVersionOption();
+        const QCommandLineOption outDirOpt("out-dir","Directory for the merged model","output directory");
+        parser.addOption(outDirOpt);
+        parser.addPositionalArgument("partial-output-dirs", "Output directories of the partial runs", "dir...");
+        parser.process(app);
+
+        const auto inputDirs=parser.positionalArguments();
+        if(inputDirs.isEmpty() || !parser.isSet(outDirOpt))
+            parser.showHelp(1);
+        const auto outDir=parser.value(outDirOpt);
+
+        std::vector<PartialOutput> inputs;
+        for(const auto& dir : inputDirs)
+        {
+            if(QFileInfo(dir).canonicalFilePath()==QFileInfo(outDir).canonicalFilePath())
+            {
+                std::cerr << "Output directory must differ from the partial output directories\n";
+                throw MustQuit{};
+            }
+            inputs.emplace_back(readPartialOutputInfo(dir));
+        }
+        std::sort(inputs.begin(), inputs.end(), [](auto const& a, auto const& b){ return a.firstWLSet < b.firstWLSet; });
+
+        // Check that the ranges exactly cover all the wavelength sets. Ordering by the range also makes
+        // the sums accumulate in the same order as they would in a single calcmysky run.
+        unsigned nextWLSet=0;
+        for(const auto& input : inputs)
+        {
+            if(input.firstWLSet!=nextWLSet)
+            {
+                std::cerr << "Wavelength sets " << (input.firstWLSet<nextWLSet ? "overlap" : "are missing")
+                          << " before set " << input.firstWLSet << " in \"" << input.dir << "\"\n";
+                throw MustQuit{};
+            }
+            if(input.wlSetCount!=inputs.front().wlSetCount || input.textureSavePrecision!=inputs.front().textureSavePrecision ||
+               input.halfFloatStorage!=inputs.front().halfFloatStorage)
+            {
+                std::cerr << "Partial output \"" << input.dir << "\" was computed with different settings than \""
+                          << inputs.front().dir << "\"\n";
+                throw MustQuit{};
+            }
+            nextWLSet=input.lastWLSet+1;
+        }
+        if(nextWLSet!=inputs.front().wlSetCount)
+        {
+            std::cerr << "Wavelength sets from " << nextWLSet << " to " << inputs.front().wlSetCount-1 << " are missing\n";
+            throw MustQuit{};
+        }
+
+        const auto params=readFile(inputs.front().dir+"/params.atmo");
+        for(const auto& input : inputs)
+        {
+            if(readFile(input.dir+"/params.atmo")!=params)
+            {
+                std::cerr << "\"" << input.dir << "/params.atmo\" differs from \"" << inputs.front().dir << "/params.atmo\"\n";
+                throw MustQuit{};
+            }
+        }
+
+        if(!QDir().mkpath(outDir))
+        {
+            std::cerr << "Failed to create directory \"" << outDir << "\"\n";
+            throw MustQuit{};
+        }
+
+        std::vector<QString> xyzwTextures;
+        for(const auto& input : inputs)
+        {
+            std::cerr << "Copying per-wavelength-set data from \"" << input.dir << "\"... ";
+            const QDir inputDir(input.dir);
+            for(QDirIterator it(input.dir, QDir::Files, QDirIterator::Subdirectories); it.hasNext();)
+            {
+                const auto path=it.next();
+                const auto relativePath=inputDir.relativeFilePath(path);
+                // The half-float validation reports of the partial runs are combined into the merged one below
+                if(relativePath==PARTIAL_WLSET_RANGE_FILENAME || relativePath==HALF_FLOAT_REPORT_FILENAME ||
+                   relativePath==MODEL_MANIFEST_FILENAME || relativePath.startsWith("checkpoint/"))
+                    continue;
+                if(isXYZWTexture(relativePath))
+                {
+                    if(&input==&inputs.front())
+                        xyzwTextures.push_back(relativePath);
+                    continue;
+                }
+                copyFile(path, outDir+"/"+relativePath);
+            }
+            std::cerr << "done\n";
+            if(input.halfFloatStorage)
+                loadHalfFloatValidationReport(input.dir.toStdString());
+        }
+
+        AtmosphereParameters atmo;
+        atmo.parse(outDir+"/params.atmo", AtmosphereParameters::ForceNoEDSTextures{false}, AtmosphereParameters::SkipSpectra{true});
+        for(const auto& relativePath : xyzwTextures)
+        {
+            std::vector<int> sizes;
+            const auto data=sumTextures(inputs, relativePath, outDir, sizes);
+            for(const auto& scatterer : atmo.scatterers)
+            {
+                if(scatterer.needsInterpolationGuides &&
+                   relativePath=="single-scattering/"+scatterer.name+"-xyzw.f32")
+                {
+                    generateInterpolationGuidesForScatteringTexture((outDir+"/"+relativePath).toStdString(), data, sizes);
+                }
+            }
+        }
+
+        if(inputs.front().halfFloatStorage)
+            saveHalfFloatValidationReport(outDir.toStdString());
+
+        std::cerr << "Writing model manifest... ";
+        if(const auto error=writeModelManifest(outDir); !error.isEmpty())
+        {
+            std::cerr << "failed: " << error << "\n";
+            throw MustQuit{};
+        }
+        std::cerr << "done\n";
+        std::cerr << "Merged " << inputs.size() << " partial outputs into \"" << outDir << "\"\n";
+    }
+    catch(ParsingError const& ex)
+    {
+        std::cerr << ex.what() << "\n";
+        return 1;
+    }
+    catch(ShowMySky::Error const& ex)
+    {
+        std::cerr << QObject::tr("Error: %1\n").arg(ex.what());
+        return 1;
+    }
+    catch(MustQuit& ex)
+    {
+        return ex.exitCode;
+    }
+    catch(std::exception const& ex)
+    {
+        std::cerr << "Fatal error: " << QString::fromLocal8Bit(ex.what()) << '\n';
+        return 111;
+    }
+}
@@ -0,0 +1,207 @@
+/*
+ * CalcMySky - a simulator of light scattering in planetary atmospheres
+ * Copyright © 2025 Ruslan Kabatsayev
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335, USA.
+ */
+
+#include "program-binary-cache.hpp"
+
+#include <map>
+#include <cstring>
+#include <iostream>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QOpenGLFunctions>
+#include <QOpenGLContext>
+#include <QSaveFile>
+#include <QFile>
+#include <QDir>
+
+#include "data.hpp"
+#include "util.hpp"
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+# define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+# define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+# define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+namespace
+{
+
+// These functions are not in OpenGL 3.3 core, they come from GL_ARB_get_program_binary (core since 4.1)
+using GetProgramBinaryFunc = void (QOPENGLF_APIENTRYP)(GLuint program, GLsizei bufSize, GLsizei* length,
+                                                      GLenum* binaryFormat, void* binary);
+using ProgramBinaryFunc = void (QOPENGLF_APIENTRYP)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+using ProgramParameteriFunc = void (QOPENGLF_APIENTRYP)(GLuint program, GLenum pname, GLint value);
+GetProgramBinaryFunc glGetProgramBinary;
+ProgramBinaryFunc glProgramBinary;
+ProgramParameteriFunc glProgramParameteri;
+
+bool cacheEnabled=false;
+QByteArray implementationId;
+QString diskCacheDir;
+
+struct ProgramBinary
+{
+    GLenum format;
+    QByteArray data;
+};
+std::map<QByteArray, ProgramBinary> memoryCache;
+
+QString diskCacheFilePath(QByteArray const& key)
+{
+    return diskCacheDir+"/"+QString::fromLatin1(key)+".bin";
+}
+
+bool readFromDisk(QByteArray const& key, ProgramBinary& binary)
+{
+    if(diskCacheDir.isEmpty()) return false;
+    QFile file(diskCacheFilePath(key));
+    if(!file.open(QFile::ReadOnly)) return false;
+    const auto contents=file.readAll();
+    if(file.error() || size_t(contents.size()) <= sizeof binary.format)
+        return false;
+    std::memcpy(&binary.format, contents.constData(), sizeof binary.format);
+    binary.data=contents.mid(sizeof binary.format);
+    return true;
+}
+
+void writeToDisk(QByteArray const& key, ProgramBinary const& binary)
+{
+    if(diskCacheDir.isEmpty()) return;
+    // Failures are not fatal: we'll just have to compile the program again next time
+    QSaveFile file(diskCacheFilePath(key));
+    if(!file.open(QFile::WriteOnly)) return;
+    file.write(reinterpret_cast<const char*>(&binary.format), sizeof binary.format);
+    file.write(binary.data);
+    file.commit();
+}
+
+}
+
+void initProgramBinaryCache(QOpenGLContext& context)
+{
+    if(opts.noProgramBinaryCache) return;
+
+    const auto version=context.format().version();
+    if(version < qMakePair(4,1) && !context.hasExtension("GL_ARB_get_program_binary"))
+        return;
+    glGetProgramBinary=reinterpret_cast<GetProgramBinaryFunc>(context.getProcAddress("glGetProgramBinary"));
+    glProgramBinary=reinterpret_cast<ProgramBinaryFunc>(context.getProcAddress("glProgramBinary"));
+    glProgramParameteri=reinterpret_cast<ProgramParameteriFunc>(context.getProcAddress("glProgramParameteri"));
+    if(!glGetProgramBinary || !glProgramBinary || !glProgramParameteri)
+        return;
+
+    GLint numFormats=0;
+    gl.glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+    if(numFormats<=0)
+        return;
+
+    // Binaries are only valid for the implementation that produced them, so it's a part of the key
+    implementationId = QByteArray(reinterpret_cast<const char*>(gl.glGetString(GL_VENDOR)))+'\n'+
+                       QByteArray(reinterpret_cast<const char*>(gl.glGetString(GL_RENDERER)))+'\n'+
+                       QByteArray(reinterpret_cast<const char*>(gl.glGetString(GL_VERSION)))+'\n';
+
+    diskCacheDir=QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if(!diskCacheDir.isEmpty())
+    {
+        diskCacheDir += "/program-binaries";
+        if(!QDir().mkpath(diskCacheDir))
+        {
+            std::cerr << "Warning: failed to create program binary cache directory \"" << diskCacheDir
+                      << "\", the cache will only be kept in memory\n";
+            diskCacheDir.clear();
+        }
+    }
+    cacheEnabled=true;
+}
+
+QByteArray programBinaryCacheKey(std::vector<ProcessedShaderSource> const& sources)
+{
+    if(!cacheEnabled) return {};
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(implementationId);
+    for(const auto& src : sources)
+    {
+        hash.addData(QByteArray::number(int(src.type)));
+        hash.addData("\n", 1);
+        const auto bytes=src.source.toUtf8();
+        // Length prefix makes the boundaries between the sources unambiguous
+        hash.addData(QByteArray::number(bytes.size()));
+        hash.addData("\n", 1);
+        hash.addData(bytes);
+    }
+    return hash.result().toHex();
+}
+
+bool loadCachedProgramBinary(QByteArray const& key, const GLuint program)
+{
+    if(!cacheEnabled) return false;
+
+    auto it=memoryCache.find(key);
+    if(it==memoryCache.end())
+    {
+        ProgramBinary binary;
+        if(!readFromDisk(key, binary))
+            return false;
+        it=memoryCache.emplace(key, std::move(binary)).first;
+    }
+
+    const auto& binary=it->second;
+    glProgramBinary(program, binary.format, binary.data.constData(), binary.data.size());
+    GLint linked=GL_FALSE;
+    gl.glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if(linked) return true;
+
+    // The driver may reject binaries e.g. after its update, so forget this one and let the caller compile from source
+    while(gl.glGetError()!=GL_NO_ERROR);
+    memoryCache.erase(it);
+    if(!diskCacheDir.isEmpty())
+        QFile::remove(diskCacheFilePath(key));
+    return false;
+}
+
+void prepareProgramForCaching(const GLuint program)
+{
+    if(!cacheEnabled) return;
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+void cacheProgramBinary(QByteArray const& key, const GLuint program)
+{
+    if(!cacheEnabled) return;
+
+    GLint length=0;
+    gl.glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length<=0) return;
+
+    ProgramBinary binary;
+    binary.data.resize(length);
+    GLsizei actualLength=0;
+    glGetProgramBinary(program, length, &actualLength, &binary.format, binary.data.data());
+    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR || actualLength<=0)
+        return;
+    binary.data.resize(actualLength);
+
+    writeToDisk(key, binary);
+    memoryCache[key]=std::move(binary);
+}
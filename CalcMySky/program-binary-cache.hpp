@@ -0,0 +1,51 @@
+/*
+ * CalcMySky - a simulator of light scattering in planetary atmospheres
+ * Copyright © 2025 Ruslan Kabatsayev
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335, USA.
+ */
+
+#ifndef INCLUDE_ONCE_C72B246A_546E_4B6C_A463_91305E344877
+#define INCLUDE_ONCE_C72B246A_546E_4B6C_A463_91305E344877
+
+#include <vector>
+#include <QByteArray>
+#include <QOpenGLShader>
+
+class QOpenGLContext;
+
+/* Cache of linked shader program binaries, so that the programs differing only by the file they
+ * are instantiated for don't need to be recompiled. The key is a hash of fully processed sources of
+ * all the shaders of the program, together with the identity of the OpenGL implementation. The
+ * binaries are kept in memory during the run and on disk for subsequent runs.
+ */
+
+struct ProcessedShaderSource
+{
+    QOpenGLShader::ShaderType type;
+    QString description;
+    QString source;
+};
+
+// Must be called with the context current. Disables the cache if the implementation can't provide program binaries.
+void initProgramBinaryCache(QOpenGLContext& context);
+QByteArray programBinaryCacheKey(std::vector<ProcessedShaderSource> const& sources);
+// Returns false if there's no binary for the key, or if the driver has rejected it
+bool loadCachedProgramBinary(QByteArray const& key, GLuint program);
+// Must be called before linking the program whose binary is to be cached
+void prepareProgramForCaching(GLuint program);
+void cacheProgramBinary(QByteArray const& key, GLuint program);
+
+#endif
@@ -29,6 +29,7 @@
 
 #include "data.hpp"
 #include "util.hpp"
+#include "program-binary-cache.hpp"
 
 #include "config.h"
 
@@ -266,14 +267,15 @@ void defineDisabledDefinitions(QString& source)
     }
 }
 
-std::unique_ptr<QOpenGLShader> compileShader(QOpenGLShader::ShaderType type, QString source, QString const& description,
-                                             QString* processedSource = nullptr)
+QString processShaderSource(QString source, QString const& description)
 {
-    auto shader=std::make_unique<QOpenGLShader>(type);
     defineDisabledDefinitions(source);
-    source=withHeadersIncluded(source, description);
-    if(processedSource)
-        *processedSource = source;
+    return withHeadersIncluded(source, description);
+}
+
+std::unique_ptr<QOpenGLShader> compileShader(QOpenGLShader::ShaderType type, QString const& source, QString const& description)
+{
+    auto shader=std::make_unique<QOpenGLShader>(type);
     if(!shader->compileSourceCode(source))
     {
         std::cerr << "Failed to compile " << description.toStdString() << ":\n"
@@ -303,9 +305,6 @@ std::unique_ptr<QOpenGLShader> compileShader(QOpenGLShader::ShaderType type, QSt
     return shader;
 }
 
-std::unique_ptr<QOpenGLShader> compileShader(QOpenGLShader::ShaderType type, QString const& filename, QString* processedSource = nullptr)
-{ return compileShader(type, getShaderSrc(filename), filename, processedSource); }
-
 QString withHeadersIncluded(QString src, QString const& filename)
 {
     QTextStream srcStream(&src);
@@ -393,31 +392,42 @@ std::unique_ptr<QOpenGLShaderProgram> compileShaderProgram(QString const& mainSr
     auto shaderFileNames=getShaderFileNamesToLinkWith(mainSrcFileName);
     shaderFileNames.insert(mainSrcFileName);
 
-    std::vector<std::unique_ptr<QOpenGLShader>> shaders;
+    std::vector<ProcessedShaderSource> sources;
     for(const auto& filename : shaderFileNames)
     {
-        QString processedSource;
-        shaders.emplace_back(compileShader(QOpenGLShader::Fragment, filename, &processedSource));
-        program->addShader(shaders.back().get());
+        sources.push_back({QOpenGLShader::Fragment, filename, processShaderSource(getShaderSrc(filename), filename)});
         if(sourcesToSave)
-            sourcesToSave->push_back({filename, processedSource});
+            sourcesToSave->push_back({filename, sources.back().source});
     }
+    sources.push_back({QOpenGLShader::Vertex, "shader.vert", processShaderSource(getShaderSrc("shader.vert"), "shader.vert")});
+    if(useGeomShader)
+        sources.push_back({QOpenGLShader::Geometry, "shader.geom", processShaderSource(getShaderSrc("shader.geom"), "shader.geom")});
 
-    shaders.emplace_back(compileShader(QOpenGLShader::Vertex, "shader.vert"));
-    program->addShader(shaders.back().get());
+    if(!program->create())
+    {
+        std::cerr << "Failed to create " << description << "\n";
+        throw MustQuit{};
+    }
+    const auto cacheKey=programBinaryCacheKey(sources);
+    // With no shaders added, link() only checks the link status set by the loaded binary
+    if(loadCachedProgramBinary(cacheKey, program->programId()) && program->link())
+        return program;
 
-    if(useGeomShader)
+    std::vector<std::unique_ptr<QOpenGLShader>> shaders;
+    for(const auto& src : sources)
     {
-        shaders.emplace_back(compileShader(QOpenGLShader::Geometry, "shader.geom"));
+        shaders.emplace_back(compileShader(src.type, src.source, src.description));
         program->addShader(shaders.back().get());
     }
 
+    prepareProgramForCaching(program->programId());
     if(!program->link())
     {
         // Qt prints linking errors to stderr, so don't print them again
         std::cerr << "Failed to link " << description << "\n";
         throw MustQuit{};
     }
+    cacheProgramBinary(cacheKey, program->programId());
     return program;
 }
 
@@ -19,13 +19,22 @@
 
 #include "util.hpp"
 
+#include <deque>
+#include <mutex>
+#include <algorithm>
+#include <limits>
+#include <thread>
 #include <memory>
 #include <cstring>
 #include <iostream>
 #include <filesystem>
+#include <condition_variable>
 #include <QFile>
+#include <QOpenGLContext>
 
 #include "data.hpp"
+#include "const.hpp"
+#include "../common/CompressedTexture.hpp"
 
 void createDirs(std::string const& path)
 {
@@ -75,9 +84,249 @@ void qtMessageHandler(const QtMsgType type, QMessageLogContext const&, QString c
     }
 }
 
+namespace
+{
+
+struct TextureToWrite
+{
+    std::unique_ptr<GLfloat[]> subpixels;
+    size_t subpixelCount;
+    std::string name;
+    std::string path;
+    std::vector<int> sizes;
+    bool needRounding;
+    bool halfFloat;
+};
+
+// Returns an error message on failure, empty string on success. May be called from the writer thread, so must not throw.
+std::string writeTexture(TextureToWrite const& tex)
+{
+    unsigned nanCount = 0;
+    for(size_t i = 0; i < tex.subpixelCount; ++i)
+    {
+        if(std::isnan(tex.subpixels[i]))
+        {
+            ++nanCount;
+        }
+    }
+    if(tex.needRounding)
+    {
+        roundTexData(tex.subpixels.get(), tex.subpixelCount, opts.textureSavePrecision);
+    }
+
+    const char* dataToWrite=reinterpret_cast<const char*>(tex.subpixels.get());
+    size_t subpixelSize=sizeof tex.subpixels[0];
+    std::unique_ptr<qfloat16[]> halfSubpixels;
+    if(tex.halfFloat)
+    {
+        halfSubpixels=convertToHalfFloat(tex.name, tex.path, tex.subpixels.get(), tex.subpixelCount);
+        dataToWrite=reinterpret_cast<const char*>(halfSubpixels.get());
+        subpixelSize=sizeof halfSubpixels[0];
+    }
+
+    QFile out(QString::fromStdString(tex.path));
+    if(!out.open(QFile::WriteOnly))
+        return "failed to open file: " + out.errorString().toStdString();
+    if(opts.compressTextures && tex.sizes.size()==4)
+    {
+        const auto error=writeCompressedTexture(out, dataToWrite, tex.sizes, 4*subpixelSize, subpixelSize);
+        if(!error.isEmpty())
+            return "failed to write compressed texture: " + error.toStdString();
+    }
+    else
+    {
+        for(const uint16_t s : tex.sizes)
+            out.write(reinterpret_cast<const char*>(&s), sizeof s);
+        out.write(dataToWrite, tex.subpixelCount*subpixelSize);
+    }
+    out.close();
+    if(out.error())
+        return "failed to write file: " + out.errorString().toStdString();
+    if(nanCount)
+    {
+        return std::to_string(nanCount) + " NaN entries out of " + std::to_string(tex.subpixelCount) + " detected while saving " + tex.name +
+               "\nThe texture was saved for diagnostics, further computation is useless.";
+    }
+    return {};
+}
+
+/* Saving of textures is done in two steps to avoid stalling the GPU. First, a readback into a pixel buffer
+ * object is issued, followed by a fence. When the fence is signaled, the data are copied from the PBO on the
+ * GL thread, and then NaN check, rounding and writing to disk are done by a separate thread, while the GL
+ * thread submits the next stage of computations.
+ */
+class TextureWriter
+{
+    std::mutex mutex;
+    std::condition_variable queueChanged;
+    std::deque<TextureToWrite> queue;
+    std::string error;
+    unsigned jobsInProgress=0;
+    bool mustStop=false;
+    std::thread thread;
+
+    // Limits the memory consumed by textures waiting to be written
+    static constexpr unsigned maxQueueLength=2;
+
+    void run()
+    {
+        std::unique_lock lock(mutex);
+        while(true)
+        {
+            queueChanged.wait(lock, [this]{ return mustStop || !queue.empty(); });
+            if(queue.empty()) return; // mustStop is set, and everything has been written
+
+            auto tex=std::move(queue.front());
+            queue.pop_front();
+            ++jobsInProgress;
+            queueChanged.notify_all();
+
+            lock.unlock();
+            auto newError=writeTexture(tex);
+            tex.subpixels.reset();
+            lock.lock();
+
+            --jobsInProgress;
+            if(!newError.empty() && error.empty())
+                error="Error while saving " + tex.name + " to \"" + tex.path + "\": " + newError;
+            queueChanged.notify_all();
+        }
+    }
+public:
+    TextureWriter()
+        : thread([this]{ run(); })
+    {
+    }
+    ~TextureWriter()
+    {
+        {
+            std::lock_guard lock(mutex);
+            mustStop=true;
+        }
+        queueChanged.notify_all();
+        thread.join();
+    }
+    void enqueue(TextureToWrite&& tex)
+    {
+        std::unique_lock lock(mutex);
+        queueChanged.wait(lock, [this]{ return queue.size() < maxQueueLength; });
+        queue.emplace_back(std::move(tex));
+        queueChanged.notify_all();
+    }
+    void waitForCompletion()
+    {
+        std::unique_lock lock(mutex);
+        queueChanged.wait(lock, [this]{ return queue.empty() && !jobsInProgress; });
+    }
+    void throwIfFailed()
+    {
+        std::lock_guard lock(mutex);
+        if(error.empty()) return;
+        std::cerr << "\n" << error << "\n";
+        throw MustQuit{};
+    }
+};
+
+TextureWriter& textureWriter()
+{
+    static TextureWriter writer;
+    return writer;
+}
+
+// Owns the pixel buffer and the fence of a readback, so that they are released on the error paths too
+struct PendingReadback
+{
+    GLuint pbo=0;
+    GLsync fence=nullptr;
+    TextureToWrite tex;
+
+    explicit PendingReadback(TextureToWrite&& tex)
+        : tex(std::move(tex))
+    {
+        gl.glGenBuffers(1, &pbo);
+    }
+    PendingReadback(PendingReadback const&)=delete;
+    PendingReadback& operator=(PendingReadback const&)=delete;
+    ~PendingReadback()
+    {
+        // The readbacks left at exit are destroyed after the context
+        if(!QOpenGLContext::currentContext()) return;
+        if(fence) gl.glDeleteSync(fence);
+        gl.glDeleteBuffers(1, &pbo);
+    }
+};
+std::deque<PendingReadback> pendingReadbacks;
+// Each pixel buffer is as large as the texture, so, like the queue of the writer thread, the readbacks are limited
+constexpr unsigned maxReadbacksInFlight=2;
+
+// Releases the buffers of all the readbacks when the computation is aborted
+void discardPendingReadbacks()
+{
+    pendingReadbacks.clear();
+}
+
+DEFINE_EXPLICIT_BOOL(WaitForGPU);
+// Returns false if the oldest readback hasn't completed yet
+bool processOldestReadback(const WaitForGPU waitForGPU)
+{
+    auto& readback=pendingReadbacks.front();
+    const GLuint64 timeout = waitForGPU ? std::numeric_limits<GLuint64>::max() : 0;
+    const auto status=gl.glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+    if(status==GL_TIMEOUT_EXPIRED)
+        return false;
+    if(status==GL_WAIT_FAILED)
+    {
+        std::cerr << "glClientWaitSync() failed while waiting for readback of " << readback.tex.name << "\n";
+        discardPendingReadbacks();
+        throw MustQuit{};
+    }
+
+    auto& tex=readback.tex;
+    const auto byteCount=tex.subpixelCount*sizeof tex.subpixels[0];
+    gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+    const auto mapped=gl.glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, byteCount, GL_MAP_READ_BIT);
+    if(!mapped)
+    {
+        std::cerr << "Failed to map pixel buffer for " << tex.name << ": " << openglErrorString(gl.glGetError()) << "\n";
+        gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        discardPendingReadbacks();
+        throw MustQuit{};
+    }
+    tex.subpixels.reset(new GLfloat[tex.subpixelCount]);
+    std::memcpy(tex.subpixels.get(), mapped, byteCount);
+    gl.glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    auto texToWrite=std::move(tex);
+    pendingReadbacks.pop_front();
+    textureWriter().enqueue(std::move(texToWrite));
+    return true;
+}
+
+void processPendingReadbacks(const WaitForGPU waitForGPU)
+{
+    while(!pendingReadbacks.empty() && processOldestReadback(waitForGPU))
+        ;
+}
+
+}
+
+void waitForTextureSaving()
+{
+    processPendingReadbacks(WaitForGPU{true});
+    textureWriter().waitForCompletion();
+    textureWriter().throwIfFailed();
+}
+
+void checkTextureSaving()
+{
+    processPendingReadbacks(WaitForGPU{false});
+    textureWriter().throwIfFailed();
+}
+
 std::vector<glm::vec4> saveTexture(const GLenum target, const GLuint texture, const std::string_view name,
                                    const std::string_view path, std::vector<int> const& sizes,
-                                   const ReturnTextureData returnTexData)
+                                   const ReturnTextureData returnTexData, const AllowHalfFloat allowHalfFloat)
 {
     if(opts.dbgNoSaveTextures)
     {
@@ -85,6 +334,8 @@ std::vector<glm::vec4> saveTexture(const GLenum target, const GLuint texture, co
         return {};
     }
 
+    checkTextureSaving();
+
     std::cerr << indentOutput() << "Saving " << name << " to \"" << path << "\"... ";
     if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
     {
@@ -122,54 +373,51 @@ std::vector<glm::vec4> saveTexture(const GLenum target, const GLuint texture, co
         }
     }
 
-    const auto subpixelCount = 4*pixelCount;
-    const std::unique_ptr<GLfloat[]> subpixels(new GLfloat[subpixelCount]);
-    gl.glGetTexImage(target, 0, GL_RGBA, GL_FLOAT, subpixels.get());
-    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
-    {
-        std::cerr << "GL error in saveTexture() after glGetTexImage() call: " << openglErrorString(err) << "\n";
-        throw MustQuit{};
-    }
+    TextureToWrite tex;
+    tex.subpixelCount = 4*pixelCount;
+    tex.name = name;
+    tex.path = path;
+    tex.sizes = sizes;
+    const bool partialSum = isPartialXYZWSum(path);
+    tex.needRounding = target==GL_TEXTURE_3D && opts.textureSavePrecision && !partialSum;
+    tex.halfFloat = opts.halfFloatStorage && (target==GL_TEXTURE_3D || allowHalfFloat) && !partialSum;
 
-    unsigned nanCount = 0;
-    for(size_t i = 0; i < subpixelCount; ++i)
+    if(!returnTexData)
     {
-        if(std::isnan(subpixels[i]))
+        while(pendingReadbacks.size() >= maxReadbacksInFlight)
+            processOldestReadback(WaitForGPU{true});
+
+        auto& readback=pendingReadbacks.emplace_back(std::move(tex));
+        gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+        gl.glBufferData(GL_PIXEL_PACK_BUFFER, readback.tex.subpixelCount*sizeof(GLfloat), nullptr, GL_STREAM_READ);
+        gl.glGetTexImage(target, 0, GL_RGBA, GL_FLOAT, nullptr);
+        gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
         {
-            ++nanCount;
+            std::cerr << "GL error in saveTexture() after glGetTexImage() call: " << openglErrorString(err) << "\n";
+            discardPendingReadbacks();
+            throw MustQuit{};
         }
-    }
-    std::vector<glm::vec4> dataToReturn;
-    if(returnTexData)
-    {
-        static_assert(std::is_trivially_copyable_v<glm::vec4>);
-        dataToReturn.assign(reinterpret_cast<const glm::vec4*>(subpixels.get()),
-                            reinterpret_cast<const glm::vec4*>(subpixels.get()+subpixelCount));
-    }
-    if(target==GL_TEXTURE_3D && opts.textureSavePrecision)
-    {
-        roundTexData(subpixels.get(), subpixelCount, opts.textureSavePrecision);
+        readback.fence=gl.glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        std::cerr << "queued\n";
+        return {};
     }
 
-    QFile out(QByteArray::fromRawData(path.data(), path.size()));
-    if(!out.open(QFile::WriteOnly))
-    {
-        std::cerr << "failed to open file: " << out.errorString().toStdString() << "\n";
-        throw MustQuit{};
-    }
-    for(const uint16_t s : sizes)
-        out.write(reinterpret_cast<const char*>(&s), sizeof s);
-    out.write(reinterpret_cast<const char*>(subpixels.get()), subpixelCount*sizeof subpixels[0]);
-    out.close();
-    if(out.error())
+    // The caller needs the data right now, so there's no point in asynchronous readback
+    tex.subpixels.reset(new GLfloat[tex.subpixelCount]);
+    gl.glGetTexImage(target, 0, GL_RGBA, GL_FLOAT, tex.subpixels.get());
+    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
     {
-        std::cerr << "failed to write file: " << out.errorString().toStdString() << "\n";
+        std::cerr << "GL error in saveTexture() after glGetTexImage() call: " << openglErrorString(err) << "\n";
         throw MustQuit{};
     }
-    if(nanCount)
+
+    static_assert(std::is_trivially_copyable_v<glm::vec4>);
+    std::vector<glm::vec4> dataToReturn(reinterpret_cast<const glm::vec4*>(tex.subpixels.get()),
+                                        reinterpret_cast<const glm::vec4*>(tex.subpixels.get()+tex.subpixelCount));
+    if(const auto error=writeTexture(tex); !error.empty())
     {
-        std::cerr << nanCount << " NaN entries out of " << subpixelCount << " detected while saving " << name << "\n";
-        std::cerr << "The texture was saved for diagnostics, further computation is useless.\n";
+        std::cerr << error << "\n";
         throw MustQuit{};
     }
     std::cerr << "done\n";
@@ -214,6 +462,19 @@ void setupTexture(const GLuint texture, const GLsizei width, const GLsizei heigh
 void setupTexture(TextureId id, const GLsizei width, const GLsizei height, const GLsizei depth)
 { setupTexture(textures[id],width,height,depth); }
 
+GLuint createAccumulatorTexture3D()
+{
+    GLuint texture;
+    gl.glGenTextures(1, &texture);
+    gl.glBindTexture(GL_TEXTURE_3D,texture);
+    gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+    gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+    gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+    gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_R,GL_CLAMP_TO_EDGE);
+    setupTexture(texture, atmo.scatTexWidth(),atmo.scatTexHeight(),atmo.scatTexDepth());
+    return texture;
+}
+
 // ------------------------------------ KHR_debug support ----------------------------------------
 #ifdef GL_DEBUG_OUTPUT
 
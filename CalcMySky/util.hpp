@@ -20,10 +20,12 @@
 #ifndef INCLUDE_ONCE_C49956E1_F7B6_4759_8745_711BBDFE6FE7
 #define INCLUDE_ONCE_C49956E1_F7B6_4759_8745_711BBDFE6FE7
 
+#include <memory>
 #include <string>
 #include <iostream>
 #include <string_view>
 #include <QVector4D>
+#include <QFloat16>
 #include <QOpenGLFunctions_3_3_Core>
 #include <glm/glm.hpp>
 #include "data.hpp"
@@ -54,6 +56,7 @@ void setupDebugPrintCallback(QOpenGLContext& context, bool needFullDebugOutput);
 void setupTexture(TextureId id, GLsizei width, GLsizei height);
 void setupTexture(TextureId id, GLsizei width, GLsizei height, GLsizei depth);
 void setupTexture(GLuint tex, GLsizei width, GLsizei height, GLsizei depth);
+GLuint createAccumulatorTexture3D();
 inline void setUniformTexture(QOpenGLShaderProgram& program, GLenum target, GLuint texture, GLint sampler, const char* uniformName)
 {
     gl.glActiveTexture(GL_TEXTURE0+sampler);
@@ -72,8 +75,32 @@ void renderQuad();
 inline void checkFramebufferStatus(const char*const fboDescription) { return checkFramebufferStatus(gl, fboDescription); }
 void qtMessageHandler(const QtMsgType type, QMessageLogContext const&, QString const& message);
 DEFINE_EXPLICIT_BOOL(ReturnTextureData);
+DEFINE_EXPLICIT_BOOL(AllowHalfFloat);
+// Unless the data are requested to be returned, the texture is written to disk asynchronously.
+// With --storage=f16, 3D textures are saved as half floats, while 2D ones only if allowHalfFloat is set.
 std::vector<glm::vec4> saveTexture(GLenum target, GLuint texture, std::string_view name, std::string_view path,
-                                   std::vector<int> const& sizes, ReturnTextureData=ReturnTextureData{false});
+                                   std::vector<int> const& sizes, ReturnTextureData=ReturnTextureData{false},
+                                   AllowHalfFloat=AllowHalfFloat{false});
+// Waits until all the textures passed to saveTexture() are written, throws MustQuit if any of them failed
+void waitForTextureSaving();
+// Doesn't wait, but throws MustQuit if any of the textures already processed failed, e.g. due to NaNs
+void checkTextureSaving();
+// Converts the data to half floats, recording the conversion error for the validation report. Thread-safe.
+std::unique_ptr<qfloat16[]> convertToHalfFloat(std::string_view name, std::string_view path, const GLfloat* data, size_t count);
+// Writes maximum relative error of conversion to half floats for each texture saved into the output directory,
+// together with the numbers of values that overflowed, underflowed to zero or became denormal
+void saveHalfFloatValidationReport(std::string const& outputDir);
+// Reads the report from the output directory of another run, so that its entries get into the next report written
+void loadHalfFloatValidationReport(std::string const& outputDir);
+/* XYZW textures of a run with --wlsets are partial sums, to be added by calcmysky-merge. They are saved as
+ * unrounded float32, so that the precision is only reduced once, in the merged texture.
+ */
+inline bool isPartialXYZWSum(const std::string_view path)
+{
+    constexpr std::string_view suffix="-xyzw.f32";
+    return computingPartialWLSetRange() && path.size()>=suffix.size() &&
+           path.substr(path.size()-suffix.size())==suffix;
+}
 void createDirs(std::string const& path);
 
 class OutputIndentIncrease
@@ -22,19 +22,27 @@
 #include <set>
 #include <cmath>
 #include <array>
+#include <atomic>
+#include <thread>
 #include <vector>
 #include <cstring>
 #include <cassert>
 #include <iterator>
 #include <iostream>
+#include <algorithm>
 #include <filesystem>
+#include <QDir>
 #include <QFile>
+#include <QFileInfo>
 #include <QDebug>
+#include <QFloat16>
 #include <QRegularExpression>
 
 #include "util.hpp"
 #include "../common/const.hpp"
 #include "../common/util.hpp"
+#include "../common/CompressedTexture.hpp"
+#include "../common/ModelBundle.hpp"
 #include "../common/EclipsedDoubleScatteringPrecomputer.hpp"
 #include "api/ShowMySky/Settings.hpp"
 
@@ -43,11 +51,23 @@ namespace fs=std::filesystem;
 namespace
 {
 
+// How far ahead in time the altitude of the camera is extrapolated to decide which slices to prefetch
+constexpr double altitudePrefetchLookaheadSeconds = 2;
+
 auto newTex(QOpenGLTexture::Target target)
 {
     return std::make_unique<QOpenGLTexture>(target);
 }
 
+// Makes the OS read the pages of a mapped file range, if they aren't in memory yet
+void touchPages(const uchar*const begin, const uchar*const end)
+{
+    for(auto p = begin; p < end; p += 4096)
+    {
+        [[maybe_unused]] volatile uchar byte = *p;
+    }
+}
+
 void oglDebugMessageInsert([[maybe_unused]] const char*const message)
 {
 #if defined GL_DEBUG_OUTPUT && !defined NDEBUG
@@ -86,64 +106,66 @@ public:
 
 }
 
-void AtmosphereRenderer::loadEclipsedDoubleScatteringTexture(QString const& path, const float altitudeCoord)
+auto AtmosphereRenderer::prepareEclipsedDoubleScatteringTexture(QString const& path, const float altitudeCoord) -> PreparedTexture
 {
     auto log=qDebug().nospace();
 
-    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
-    {
-        throw DataLoadError{QObject::tr("GL error on entry to loadEclipsedDoubleScatteringTexture(\"%1\"): %2")
-                            .arg(path).arg(openglErrorString(err).c_str())};
-    }
-    log << "Loading texture from " << path << "... ";
-    QFile file(path);
-    if(!file.open(QFile::ReadOnly))
-        throw DataLoadError{QObject::tr("Failed to open file \"%1\": %2").arg(path).arg(file.errorString())};
+    log << "Reading texture from " << path << "... ";
+    auto& file=mapTextureFile(path);
 
     uint16_t numPointsPerSet;
-    {
-        const qint64 sizeToRead=sizeof numPointsPerSet;
-        if(file.read(reinterpret_cast<char*>(&numPointsPerSet), sizeToRead) != sizeToRead)
-        {
-            throw DataLoadError{QObject::tr("Failed to read header from file \"%1\": %2")
-                                .arg(path).arg(file.errorString())};
-        }
-    }
+    if(file.size < qint64(sizeof numPointsPerSet))
+        throw DataLoadError{QObject::tr("Failed to read header from file \"%1\": file is too short").arg(path)};
+    std::memcpy(&numPointsPerSet, file.data, sizeof numPointsPerSet);
+    const qint64 headerSize = sizeof numPointsPerSet;
+
     const auto texSizeByViewAzimuth = params_.eclipsedDoubleScatteringTextureSize[0];
     const auto texSizeByViewElevation = params_.eclipsedDoubleScatteringTextureSize[1];
     const auto texSizeBySZA = params_.eclipsedDoubleScatteringTextureSize[2];
     const auto texSizeByAltitude = params_.eclipsedDoubleScatteringTextureSize[3];
-    EclipsedDoubleScatteringPrecomputer precomputer(gl, params_, texSizeByViewAzimuth, texSizeByViewElevation, texSizeBySZA, 2);
-
-    const auto altTexIndex = altitudeCoord==1 ? numAltIntervalsIn4DTexture_-1 : altitudeCoord*numAltIntervalsIn4DTexture_;
-    const int floorAltIndex = std::floor(altTexIndex);
-    const auto fractAltIndex = altTexIndex-floorAltIndex;
-    const auto maxAltIndex = floorAltIndex+1;
-
-    std::vector<glm::vec4> data(numPointsPerSet*texSizeBySZA*2);
-
-    const auto sliceByteSize = numPointsPerSet*sizeof data[0];
-    const auto fileReadOffset = uint64_t(sliceByteSize)*texSizeBySZA*floorAltIndex;
-    const qint64 absoluteOffset=file.pos()+fileReadOffset;
-    log << "skipping to offset " << absoluteOffset << "... ";
-    if(!file.seek(absoluteOffset))
-    {
-        throw DataLoadError{QObject::tr("Failed to seek to offset %1 in file \"%2\": %3")
-            .arg(absoluteOffset).arg(path).arg(file.errorString())};
-    }
-
-    const qint64 sizeToRead = data.size()*sizeof data[0];
-    if(file.read(reinterpret_cast<char*>(data.data()), sizeToRead) != sizeToRead)
-    {
-        throw DataLoadError{QObject::tr("Failed to read data from file \"%1\": %2")
-            .arg(path).arg(file.errorString())};
-    }
-
-    size_t readOffset = 0;
-    for(int altIndex=floorAltIndex; altIndex<=maxAltIndex; ++altIndex)
-    {
-        for(int szaIndex=0; szaIndex<texSizeBySZA; ++szaIndex)
+    const auto [floorAltIndex, fractAltIndex] = altitudeSlicePosition(altitudeCoord, texSizeByAltitude-1);
+
+    std::vector<glm::vec4> samples(numPointsPerSet*texSizeBySZA*2);
+
+    // The samples may be stored as half floats, this is detected from the data size
+    const bool halfFloat = headerSize + uint64_t(numPointsPerSet)*texSizeBySZA*texSizeByAltitude*4*sizeof(qfloat16) == uint64_t(file.size);
+    const size_t pixelSize = halfFloat ? 4*sizeof(qfloat16) : sizeof samples[0];
+    if(halfFloat)
+        log << "half-float data... ";
+
+    const auto sliceByteSize = numPointsPerSet*pixelSize;
+    file.firstSliceOffset = headerSize;
+    file.sliceByteSize = qint64(sliceByteSize)*texSizeBySZA;
+    const auto absoluteOffset = headerSize + uint64_t(sliceByteSize)*texSizeBySZA*floorAltIndex;
+    const auto sizeToRead = samples.size()*pixelSize;
+    if(absoluteOffset + sizeToRead > uint64_t(file.size))
+    {
+        throw DataLoadError{QObject::tr("Failed to read data from file \"%1\": requested %2 bytes at offset %3, but file size is %4 bytes")
+                            .arg(path).arg(sizeToRead).arg(absoluteOffset).arg(file.size)};
+    }
+    verifySlices(file, path, floorAltIndex, 2);
+    log << "reading from offset " << absoluteOffset << "... ";
+    // The data in the file are only 2-byte aligned, so can't be used in place as vec4
+    if(halfFloat)
+        qFloatFromFloat16(&samples[0][0], reinterpret_cast<const qfloat16*>(file.data + absoluteOffset), 4*samples.size());
+    else
+        std::memcpy(samples.data(), file.data + absoluteOffset, sizeToRead);
+
+    // The (altitude, SZA) cells are reconstructed independently, so they are distributed among worker threads, each
+    // with its own precomputer as scratch state. A worker's precomputer holds a single cell, which is then copied to
+    // its place in the slices.
+    const size_t cellSize = texSizeByViewAzimuth * texSizeByViewElevation;
+    const size_t altSliceSize = cellSize * texSizeBySZA;
+    std::vector<glm::vec4> slices(altSliceSize*2);
+    const unsigned cellCount = 2*texSizeBySZA;
+    std::atomic<unsigned> nextCell{0};
+    const auto reconstructCells = [&, floorAltIndex=floorAltIndex]
+    {
+        EclipsedDoubleScatteringPrecomputer precomputer(params_, texSizeByViewAzimuth, texSizeByViewElevation, 1, 1);
+        for(unsigned cell; (cell = nextCell++) < cellCount;)
         {
+            // The cells are stored in the same order as the samples: altitude-major, then SZA
+            const int altIndex = floorAltIndex + cell/texSizeBySZA;
             // Using the same encoding for altitude as in scatteringTex4DCoordsToTexVars()
             const float distToHorizon = float(altIndex)/(texSizeByAltitude-1)*params_.lengthOfHorizRayFromGroundToBorderOfAtmo;
             // Rounding errors can result in altitude>max, breaking the code after this calculation, so we have to clamp.
@@ -151,238 +173,560 @@ void AtmosphereRenderer::loadEclipsedDoubleScatteringTexture(QString const& path
             const float cameraAltitude = std::clamp(float(sqrt(sqr(distToHorizon)+sqr(params_.earthRadius))-params_.earthRadius),
                                                     1.f, params_.atmosphereHeight-1);
 
-            precomputer.loadCoarseGridSamples(cameraAltitude, data.data()+readOffset, numPointsPerSet);
-            precomputer.generateTextureFromCoarseGridData(altIndex-floorAltIndex, szaIndex, cameraAltitude);
-            readOffset += numPointsPerSet;
+            precomputer.loadCoarseGridSamples(cameraAltitude, samples.data()+size_t(cell)*numPointsPerSet, numPointsPerSet);
+            precomputer.generateTextureFromCoarseGridData(0, 0, cameraAltitude);
+            std::copy(precomputer.texture().begin(), precomputer.texture().end(), slices.begin()+cell*cellSize);
+        }
+    };
+    // This thread is already counted among the loading threads, so only the free ones can be taken for helpers.
+    // When many tasks are being prepared, there are none, and the cells are reconstructed by this thread alone.
+    const unsigned helperCount = takeFreeLoadingThreads(cellCount-1);
+    try
+    {
+        std::vector<std::future<void>> workers;
+        for(unsigned n = 0; n < helperCount; ++n)
+            workers.push_back(std::async(std::launch::async, reconstructCells));
+        reconstructCells(); // this thread is a worker too
+        for(auto& worker : workers)
+            worker.get();
+    }
+    catch(...)
+    {
+        // The workers have finished by now: destruction of their futures waits for them
+        loadingThreadsInUse_ -= helperCount;
+        throw;
+    }
+    loadingThreadsInUse_ -= helperCount;
+
+    PreparedTexture texture;
+    texture.target = GL_TEXTURE_3D;
+    texture.internalFormat = halfFloat ? GL_RGBA16F : GL_RGBA32F;
+    texture.format = GL_RGBA;
+    texture.type = GL_FLOAT;
+    texture.width = texSizeByViewAzimuth;
+    texture.height = texSizeByViewElevation;
+    texture.depth = texSizeBySZA;
+    if(stackedAltitudeSlices_)
+    {
+        // Both slices are uploaded, stacked along the SZA dimension, and the shaders interpolate between them
+        texture.depth *= 2;
+        texture.buffer.resize(slices.size()*sizeof slices[0]);
+        std::memcpy(texture.buffer.data(), slices.data(), texture.buffer.size());
+    }
+    else
+    {
+        texture.buffer.resize(altSliceSize*sizeof slices[0]);
+        const auto interpolatedSlice = reinterpret_cast<glm::vec4*>(texture.buffer.data());
+        for(size_t n = 0; n < altSliceSize; ++n)
+        {
+            const auto interpolated = slices[n] + fractAltIndex * (slices[n+altSliceSize] - slices[n]);
+            if(std::isnan(interpolated.x))
+            {
+                std::cerr << "NaN computed from " << slices[n].x << " and " << slices[n+altSliceSize].x << " (n = " << n << ")\n";
+            }
+            interpolatedSlice[n] = interpolated;
         }
     }
+    texture.pixels = texture.buffer.data();
 
-    const size_t altSliceSize = texSizeByViewAzimuth * texSizeByViewElevation * texSizeBySZA;
-    auto texture = precomputer.texture();
-    assert(texture.size() == altSliceSize*2);
+    log << "done";
+    return texture;
+}
+
+auto AtmosphereRenderer::mapTextureFile(QString const& path) -> MappedFile&
+{
+    const std::lock_guard lock(textureFilesMutex_);
+
+    if(const auto it=mappedTextureFiles_.find(path); it!=mappedTextureFiles_.end())
+        return it->second;
+
+    MappedFile mapped;
+    if(bundle_)
+    {
+        // The whole bundle is already mapped, the file is just a part of it
+        const auto entry=bundle_->find(relativeDataPath(path));
+        if(!entry)
+            throw DataLoadError{QObject::tr("File \"%1\" is missing from the model bundle").arg(path)};
+        mapped.data=bundle_->data(*entry);
+        mapped.size=entry->size;
+    }
+    else
+    {
+        mapped.file=std::make_unique<QFile>(path);
+        auto& file=*mapped.file;
+        if(!file.open(QFile::ReadOnly))
+            throw DataLoadError{QObject::tr("Failed to open file \"%1\": %2").arg(path).arg(file.errorString())};
+        mapped.size=file.size();
+        mapped.data=file.map(0, mapped.size);
+        if(!mapped.data)
+            throw DataLoadError{QObject::tr("Failed to map file \"%1\" into memory: %2").arg(path).arg(file.errorString())};
+    }
 
-    for(size_t n = 0; n < altSliceSize; ++n)
+    if(manifest_)
     {
-        const auto interpolated = texture[n] + fractAltIndex * (texture[n+altSliceSize] - texture[n]);
-        if(std::isnan(interpolated.x))
+        mapped.manifestEntry=manifest_->find(relativeDataPath(path));
+        if(!mapped.manifestEntry)
+            throw DataLoadError{QObject::tr("File \"%1\" is not listed in the model manifest").arg(path)};
+        if(mapped.manifestEntry->size != mapped.size)
         {
-            std::cerr << "NaN computed from " << texture[n].x << " and " << texture[n+altSliceSize].x << " (n = " << n << ")\n";
+            throw DataLoadError{QObject::tr("Size of file \"%1\" (%2 bytes) differs from that in the model manifest (%3 bytes)")
+                                .arg(path).arg(mapped.size).arg(mapped.manifestEntry->size)};
         }
-        texture[n] = interpolated;
+        mapped.verifiedSlices.resize(mapped.manifestEntry->sliceChecksums.size());
     }
+    return mappedTextureFiles_.emplace(path, std::move(mapped)).first->second;
+}
 
-    gl.glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F, texSizeByViewAzimuth, texSizeByViewElevation, texSizeBySZA,
-                    0, GL_RGBA, GL_FLOAT, texture.data());
+void AtmosphereRenderer::verifySlices(MappedFile& file, QString const& path, const int firstSlice, const int sliceCount)
+{
+    const auto*const entry=file.manifestEntry;
+    if(!entry || entry->compressed)
+        return;
+    if(entry->sliceByteSize != file.sliceByteSize || entry->firstSliceOffset != file.firstSliceOffset)
+        throw DataLoadError{QObject::tr("Layout of file \"%1\" differs from that in the model manifest").arg(path)};
 
-    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
+    // Each slice is checked only once, so that altitude changes don't pay for this again and again
+    for(int n=firstSlice; n<firstSlice+sliceCount; ++n)
     {
-        throw DataLoadError{QObject::tr("GL error in loadEclipsedDoubleScatteringTexture(\"%1\") after glTexImage3D() call: %2")
-                            .arg(path).arg(openglErrorString(err).c_str())};
+        if(size_t(n) >= entry->sliceChecksums.size())
+            throw DataLoadError{QObject::tr("Slice %1 of file \"%2\" is missing from the model manifest").arg(n).arg(path)};
+        if(file.verifiedSlices[n])
+            continue;
+        const auto slice=reinterpret_cast<const char*>(file.data + file.firstSliceOffset + n*file.sliceByteSize);
+        if(crc32(slice, file.sliceByteSize) != entry->sliceChecksums[n])
+            throw DataLoadError{QObject::tr("Checksum mismatch in altitude slice %1 of file \"%2\"").arg(n).arg(path)};
+        file.verifiedSlices[n]=true;
     }
+}
 
-    log << "done";
+QString AtmosphereRenderer::relativeDataPath(QString const& path) const
+{
+    // pathToData_ may be a bundle file rather than a directory, but it's only used as a prefix here
+    return QDir(pathToData_).relativeFilePath(path);
 }
 
-void AtmosphereRenderer::loadTexture4D(QString const& path, const float altitudeCoord, Texture4DType texType)
+bool AtmosphereRenderer::dataExists(QString const& path) const
 {
-    auto log=qDebug().nospace();
+    if(!manifest_)
+        return QFile::exists(path);
+    return manifest_->contains(relativeDataPath(path));
+}
 
-    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
+void AtmosphereRenderer::addShaderDirectory(QOpenGLShaderProgram& program, QString const& dir)
+{
+    if(!bundle_)
     {
-        throw DataLoadError{QObject::tr("GL error on entry to loadTexture4D(\"%1\"): %2")
-                            .arg(path).arg(openglErrorString(err).c_str())};
+        for(const auto& shaderFile : fs::directory_iterator(fs::u8path(dir.toStdString())))
+            addShaderFile(program, QOpenGLShader::Fragment, shaderFile.path());
+        return;
     }
-    log << "Loading texture from " << path << "... ";
-    QFile file(path);
-    if(!file.open(QFile::ReadOnly))
-        throw DataLoadError{QObject::tr("Failed to open file \"%1\": %2").arg(path).arg(file.errorString())};
 
-    uint16_t sizes[4];
+    const auto files=bundle_->filesInDirectory(relativeDataPath(dir));
+    if(files.empty())
+        throw DataLoadError{QObject::tr("Directory \"%1\" is missing from the model bundle").arg(dir)};
+    for(const auto*const entry : files)
     {
-        const qint64 sizeToRead=sizeof sizes;
-        if(file.read(reinterpret_cast<char*>(sizes), sizeToRead) != sizeToRead)
-        {
-            throw DataLoadError{QObject::tr("Failed to read header from file \"%1\": %2")
-                                .arg(path).arg(file.errorString())};
-        }
+        const auto source=QByteArray(reinterpret_cast<const char*>(bundle_->data(*entry)), entry->size);
+        addShaderCode(program, QOpenGLShader::Fragment, QObject::tr("shader file \"%1\" from model bundle").arg(entry->path), source);
     }
-    log << "dimensions from header: " << sizes[0] << "×" << sizes[1] << "×" << sizes[2] << "×" << sizes[3] << "... ";
+}
 
-    const size_t subpixelsPerPixel = texType==Texture4DType::InterpolationGuides ? 1 : 4;
-    const size_t subpixelSize = texType==Texture4DType::InterpolationGuides ? sizeof(GLshort) : sizeof(GLfloat);
-    const size_t pixelSize = subpixelsPerPixel*subpixelSize;
-    const qint64 expectedFileSize = file.pos() + pixelSize*uint64_t(sizes[0])*sizes[1]*sizes[2]*sizes[3];
-    if(expectedFileSize != file.size())
+void AtmosphereRenderer::openModel()
+{
+    // The bundle and the manifest are reopened on each data loading, since they may have been regenerated
+    bundle_.reset();
+    manifest_.reset();
+    if(QFileInfo(pathToData_).isFile())
+    {
+        bundle_=std::make_unique<ModelBundle>(pathToData_);
+        const auto entry=bundle_->find(MODEL_MANIFEST_FILENAME);
+        if(!entry)
+            throw DataLoadError{QObject::tr("Model bundle \"%1\" has no manifest").arg(pathToData_)};
+        const auto data=QByteArray::fromRawData(reinterpret_cast<const char*>(bundle_->data(*entry)), entry->size);
+        manifest_=readModelManifest(data, pathToData_+"/"+MODEL_MANIFEST_FILENAME);
+    }
+    else if(const auto manifestPath=pathToData_+"/"+MODEL_MANIFEST_FILENAME; QFile::exists(manifestPath))
     {
-        throw DataLoadError{QObject::tr("Size of file \"%1\" (%2 bytes) doesn't match image dimensions %3×%4×%5×%6 from file header.\nThe expected size is %7 bytes.")
-                            .arg(path).arg(file.size()).arg(sizes[0]).arg(sizes[1]).arg(sizes[2]).arg(sizes[3]).arg(expectedFileSize)};
+        manifest_=readModelManifest(manifestPath);
     }
+}
 
-    numAltIntervalsIn4DTexture_ = sizes[3]-1;
-    const auto altTexIndex = altitudeCoord==1 ? numAltIntervalsIn4DTexture_-1 : altitudeCoord*numAltIntervalsIn4DTexture_;
-    const auto floorAltIndex = std::floor(altTexIndex);
-    const auto fractAltIndex = altTexIndex-floorAltIndex;
+auto AtmosphereRenderer::prepareTexture4D(QString const& path, const float altitudeCoord, Texture4DType texType) -> PreparedTexture
+{
+    auto log=qDebug().nospace();
 
-    const auto readOffset = pixelSize*uint64_t(sizes[0])*sizes[1]*sizes[2]*uint64_t(floorAltIndex);
-    sizes[3]=2;
-    const qint64 sizeToRead = pixelSize*uint64_t(sizes[0])*sizes[1]*sizes[2]*sizes[3];
+    log << "Reading texture from " << path << "... ";
+    auto& file=mapTextureFile(path);
 
-    const std::unique_ptr<char[]> data(new char[sizeToRead]);
+    const size_t subpixelsPerPixel = texType==Texture4DType::InterpolationGuides ? 1 : 4;
+    size_t subpixelSize = texType==Texture4DType::InterpolationGuides ? sizeof(GLshort) : sizeof(GLfloat);
+    size_t pixelSize = subpixelsPerPixel*subpixelSize;
+    // Scattering textures may be stored as half floats, this is detected from the data size
+    bool halfFloat = false;
+    const auto switchToHalfFloat = [&]
+    {
+        halfFloat = true;
+        subpixelSize = sizeof(qfloat16);
+        pixelSize = subpixelsPerPixel*subpixelSize;
+        log << "half-float data... ";
+    };
 
-    const qint64 absoluteOffset=file.pos()+readOffset;
-    log << "skipping to offset " << absoluteOffset << "... ";
-    if(!file.seek(absoluteOffset))
-    {
-        throw DataLoadError{QObject::tr("Failed to seek to offset %1 in file \"%2\": %3")
-                            .arg(absoluteOffset).arg(path).arg(file.errorString())};
+    uint16_t sizes[4];
+    const auto& compressedTexture = file.compressedReader;
+    const uchar* uncompressedData = nullptr;
+    if(isCompressedTexture(file.data, file.size))
+    {
+        if(!compressedTexture)
+            file.compressedReader = std::make_shared<const CompressedTextureReader>(file.data, file.size, path);
+        const auto& compressedSizes = compressedTexture->sizes();
+        if(texType == Texture4DType::ScatteringTexture && compressedTexture->pixelSize() == subpixelsPerPixel*sizeof(qfloat16))
+            switchToHalfFloat();
+        if(compressedSizes.size() != 4 || compressedTexture->pixelSize() != pixelSize)
+        {
+            throw DataLoadError{QObject::tr("Compressed texture file \"%1\" has unexpected layout: %2 dimensions, pixel size %3 bytes.\n"
+                                            "Expected 4 dimensions, pixel size %4 bytes.")
+                                .arg(path).arg(compressedSizes.size()).arg(compressedTexture->pixelSize()).arg(pixelSize)};
+        }
+        std::copy(compressedSizes.begin(), compressedSizes.end(), sizes);
+        log << "compressed, dimensions from header: " << sizes[0] << "×" << sizes[1] << "×" << sizes[2] << "×" << sizes[3] << "... ";
     }
-    const auto actuallyRead=file.read(data.get(), sizeToRead);
-    if(actuallyRead != sizeToRead)
+    else
     {
-        const auto error = actuallyRead==-1 ? QObject::tr("Failed to read texture data from file \"%1\": %2").arg(path).arg(file.errorString())
-                                            : QObject::tr("Failed to read texture data from file \"%1\": requested %2 bytes, read %3").arg(path).arg(sizeToRead).arg(actuallyRead);
-        throw DataLoadError{error};
+        if(file.size < qint64(sizeof sizes))
+            throw DataLoadError{QObject::tr("Failed to read header from file \"%1\": file is too short").arg(path)};
+        std::memcpy(sizes, file.data, sizeof sizes);
+        uncompressedData = file.data + sizeof sizes;
+        log << "dimensions from header: " << sizes[0] << "×" << sizes[1] << "×" << sizes[2] << "×" << sizes[3] << "... ";
+
+        const auto pixelCount = uint64_t(sizes[0])*sizes[1]*sizes[2]*sizes[3];
+        if(texType == Texture4DType::ScatteringTexture && sizeof sizes + subpixelsPerPixel*sizeof(qfloat16)*pixelCount == uint64_t(file.size))
+            switchToHalfFloat();
+        const qint64 expectedFileSize = sizeof sizes + pixelSize*pixelCount;
+        if(expectedFileSize != file.size)
+        {
+            throw DataLoadError{QObject::tr("Size of file \"%1\" (%2 bytes) doesn't match image dimensions %3×%4×%5×%6 from file header.\nThe expected size is %7 bytes.")
+                                .arg(path).arg(file.size).arg(sizes[0]).arg(sizes[1]).arg(sizes[2]).arg(sizes[3]).arg(expectedFileSize)};
+        }
     }
 
+    PreparedTexture texture;
+    texture.numAltIntervals = sizes[3]-1;
+    const auto [floorAltIndex, fractAltIndex] = altitudeSlicePosition(altitudeCoord, texture.numAltIntervals);
+
     const auto altSliceSize = size_t(sizes[0])*sizes[1]*sizes[2];
+    const auto sliceByteSize = pixelSize*altSliceSize;
+    std::vector<char> decompressedSlices;
+    const char* lowerSlice;
+    if(compressedTexture)
+    {
+        // Only the two slices we interpolate between are decompressed
+        decompressedSlices.resize(2*sliceByteSize);
+        if(takePrefetchedSlices(path, floorAltIndex, decompressedSlices))
+        {
+            log << "using prefetched altitude slices " << floorAltIndex << " and " << floorAltIndex+1 << "... ";
+        }
+        else
+        {
+            log << "decompressing altitude slices " << floorAltIndex << " and " << floorAltIndex+1 << "... ";
+            compressedTexture->readSlice(size_t(floorAltIndex), decompressedSlices.data());
+            compressedTexture->readSlice(size_t(floorAltIndex)+1, decompressedSlices.data()+sliceByteSize);
+        }
+        lowerSlice = decompressedSlices.data();
+    }
+    else
+    {
+        file.firstSliceOffset = sizeof sizes;
+        file.sliceByteSize = sliceByteSize;
+        verifySlices(file, path, floorAltIndex, 2);
+        const auto readOffset = sliceByteSize*uint64_t(floorAltIndex);
+        log << "reading from offset " << sizeof sizes + readOffset << "... ";
+        lowerSlice = reinterpret_cast<const char*>(uncompressedData) + readOffset;
+    }
+    const char*const upperSlice = lowerSlice + sliceByteSize;
+
+    texture.target = GL_TEXTURE_3D;
+    texture.width = sizes[0];
+    texture.height = sizes[1];
+    texture.depth = sizes[2];
+    if(texType == Texture4DType::InterpolationGuides)
+    {
+        texture.internalFormat = GL_R16_SNORM;
+        texture.format = GL_RED;
+        texture.type = GL_SHORT;
+    }
+    else
+    {
+        texture.internalFormat = halfFloat ? GL_RGBA16F : GL_RGBA32F;
+        texture.format = GL_RGBA;
+        texture.type = halfFloat ? GL_HALF_FLOAT : GL_FLOAT;
+    }
+
+    if(stackedAltitudeSlices_)
+    {
+        // The two slices are contiguous in the data, so they are uploaded as is, stacked along the
+        // last dimension of the 3D texture, and the shaders interpolate between them.
+        texture.depth *= 2;
+        if(compressedTexture)
+        {
+            texture.buffer.swap(decompressedSlices);
+            texture.pixels = texture.buffer.data();
+        }
+        else
+        {
+            // The upload will read directly from the mapping, so make sure it won't wait for the disk
+            touchPages(reinterpret_cast<const uchar*>(lowerSlice), reinterpret_cast<const uchar*>(upperSlice + sliceByteSize));
+            texture.pixels = lowerSlice;
+        }
+        log << "done";
+        return texture;
+    }
+
+    texture.buffer.resize(sliceByteSize);
+    char*const texData = texture.buffer.data();
+    texture.pixels = texData;
     if(texType == Texture4DType::InterpolationGuides)
     {
-        std::unique_ptr<int16_t[]> texData(new int16_t[altSliceSize]);
         for(size_t n = 0; n < altSliceSize; ++n)
         {
             int16_t lower, upper;
             assert(sizeof lower == pixelSize);
-            std::memcpy(&lower, data.get() + n * pixelSize, pixelSize);
-            std::memcpy(&upper, data.get() + (n+altSliceSize) * pixelSize, pixelSize);
-            texData[n] = lower + fractAltIndex*(upper-lower);
+            std::memcpy(&lower, lowerSlice + n * pixelSize, pixelSize);
+            std::memcpy(&upper, upperSlice + n * pixelSize, pixelSize);
+            const int16_t interpolated = lower + fractAltIndex*(upper-lower);
+            std::memcpy(texData + n * pixelSize, &interpolated, pixelSize);
+        }
+    }
+    else if(halfFloat)
+    {
+        const auto subpixelCount = subpixelsPerPixel*altSliceSize;
+        for(size_t n = 0; n < subpixelCount; ++n)
+        {
+            qfloat16 lower, upper;
+            std::memcpy(&lower, lowerSlice + n * subpixelSize, subpixelSize);
+            std::memcpy(&upper, upperSlice + n * subpixelSize, subpixelSize);
+            const qfloat16 interpolated(float(lower) + fractAltIndex*(float(upper)-float(lower)));
+            std::memcpy(texData + n * subpixelSize, &interpolated, subpixelSize);
         }
-        gl.glTexImage3D(GL_TEXTURE_3D, 0, GL_R16_SNORM, sizes[0], sizes[1], sizes[2], 0, GL_RED, GL_SHORT, texData.get());
     }
     else
     {
-        std::unique_ptr<glm::vec4[]> texData(new glm::vec4[altSliceSize]);
         for(size_t n = 0; n < altSliceSize; ++n)
         {
             glm::vec4 lower, upper;
             assert(sizeof lower == pixelSize);
-            std::memcpy(&lower, data.get() + n * pixelSize, pixelSize);
-            std::memcpy(&upper, data.get() + (n+altSliceSize) * pixelSize, pixelSize);
-            texData[n] = lower + fractAltIndex*(upper-lower);
+            std::memcpy(&lower, lowerSlice + n * pixelSize, pixelSize);
+            std::memcpy(&upper, upperSlice + n * pixelSize, pixelSize);
+            const glm::vec4 interpolated = lower + fractAltIndex*(upper-lower);
+            std::memcpy(texData + n * pixelSize, &interpolated, pixelSize);
         }
-        gl.glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F, sizes[0], sizes[1], sizes[2], 0, GL_RGBA, GL_FLOAT, texData.get());
-    }
-    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
-    {
-        throw DataLoadError{QObject::tr("GL error in loadTexture4D(\"%1\") after glTexImage3D() call: %2")
-                            .arg(path).arg(openglErrorString(err).c_str())};
     }
 
     log << "done";
+    return texture;
 }
 
-glm::ivec2 AtmosphereRenderer::loadTexture2D(QString const& path)
+auto AtmosphereRenderer::prepareTexture2D(QString const& path) -> PreparedTexture
 {
     auto log=qDebug().nospace();
 
-    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
-    {
-        throw DataLoadError{QObject::tr("GL error on entry to loadTexture2D(\"%1\"): %2")
-                            .arg(path).arg(openglErrorString(err).c_str())};
-    }
-    log << "Loading texture from " << path << "... ";
-    QFile file(path);
-    if(!file.open(QFile::ReadOnly))
-        throw DataLoadError{QObject::tr("Failed to open file \"%1\": %2").arg(path).arg(file.errorString())};
+    log << "Reading texture from " << path << "... ";
+    auto& file=mapTextureFile(path);
 
     uint16_t sizes[2];
-    {
-        const qint64 sizeToRead=sizeof sizes;
-        if(file.read(reinterpret_cast<char*>(sizes), sizeToRead) != sizeToRead)
-        {
-            throw DataLoadError{QObject::tr("Failed to read header from file \"%1\": %2")
-                                .arg(path).arg(file.errorString())};
-        }
-    }
+    if(file.size < qint64(sizeof sizes))
+        throw DataLoadError{QObject::tr("Failed to read header from file \"%1\": file is too short").arg(path)};
+    std::memcpy(sizes, file.data, sizeof sizes);
     const auto subpixelCount = 4*uint64_t(sizes[0])*sizes[1];
     log << "dimensions from header: " << sizes[0] << "×" << sizes[1] << "... ";
 
-    if(const qint64 expectedFileSize = subpixelCount*sizeof(GLfloat)+file.pos();
-       expectedFileSize != file.size())
+    // The texture may be stored as half floats, this is detected from the data size
+    const bool halfFloat = subpixelCount*sizeof(qfloat16)+sizeof sizes == uint64_t(file.size);
+    const size_t subpixelSize = halfFloat ? sizeof(qfloat16) : sizeof(GLfloat);
+    if(halfFloat)
+        log << "half-float data... ";
+    if(const qint64 expectedFileSize = subpixelCount*subpixelSize+sizeof sizes;
+       expectedFileSize != file.size)
     {
         throw DataLoadError{QObject::tr("Size of file \"%1\" (%2 bytes) doesn't match image dimensions %3×%4 from file header.\nThe expected size is %5 bytes.")
-                            .arg(path).arg(file.size()).arg(sizes[0]).arg(sizes[1]).arg(expectedFileSize)};
+                            .arg(path).arg(file.size).arg(sizes[0]).arg(sizes[1]).arg(expectedFileSize)};
+    }
+    // These textures are read whole, so the checksum of the whole file is checked
+    if(file.manifestEntry && crc32(reinterpret_cast<const char*>(file.data), file.size) != file.manifestEntry->checksum)
+        throw DataLoadError{QObject::tr("Checksum of file \"%1\" differs from that in the model manifest").arg(path)};
+
+    PreparedTexture texture;
+    texture.target = GL_TEXTURE_2D;
+    texture.internalFormat = halfFloat ? GL_RGBA16F : GL_RGBA32F;
+    texture.format = GL_RGBA;
+    texture.type = halfFloat ? GL_HALF_FLOAT : GL_FLOAT;
+    texture.width = sizes[0];
+    texture.height = sizes[1];
+    texture.buffer.resize(subpixelCount*subpixelSize);
+    texture.pixels = texture.buffer.data();
+    std::memcpy(texture.buffer.data(), file.data + sizeof sizes, texture.buffer.size());
+    log << "done";
+    return texture;
+}
+
+void AtmosphereRenderer::uploadTexture(PreparedTexture const& texture, QString const& path)
+{
+    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
+    {
+        throw DataLoadError{QObject::tr("GL error on entry to uploadTexture(\"%1\"): %2")
+                            .arg(path).arg(openglErrorString(err).c_str())};
     }
 
-    const std::unique_ptr<GLfloat[]> subpixels(new GLfloat[subpixelCount]);
+    if(texture.target == GL_TEXTURE_2D)
     {
-        const qint64 sizeToRead=subpixelCount*sizeof subpixels[0];
-        const auto actuallyRead=file.read(reinterpret_cast<char*>(subpixels.get()), sizeToRead);
-        if(actuallyRead != sizeToRead)
-        {
-            const auto error = actuallyRead==-1 ? QObject::tr("Failed to read texture data from file \"%1\": %2").arg(path).arg(file.errorString())
-                                                : QObject::tr("Failed to read texture data from file \"%1\": requested %2 bytes, read %3").arg(path).arg(sizeToRead).arg(actuallyRead);
-            throw DataLoadError{error};
-        }
+        gl.glTexImage2D(GL_TEXTURE_2D, 0, texture.internalFormat, texture.width, texture.height,
+                        0, texture.format, texture.type, texture.pixels);
+    }
+    else
+    {
+        gl.glTexImage3D(GL_TEXTURE_3D, 0, texture.internalFormat, texture.width, texture.height, texture.depth,
+                        0, texture.format, texture.type, texture.pixels);
     }
-    gl.glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA32F,sizes[0],sizes[1],0,GL_RGBA,GL_FLOAT,subpixels.get());
     if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
     {
-        throw DataLoadError{QObject::tr("GL error in loadTexture2D(\"%1\") after glTexImage2D() call: %2")
-                            .arg(path).arg(openglErrorString(err).c_str())};
+        throw DataLoadError{QObject::tr("GL error in uploadTexture(\"%1\") after glTexImage%2D() call: %3")
+                            .arg(path).arg(texture.target == GL_TEXTURE_2D ? 2 : 3).arg(openglErrorString(err).c_str())};
     }
-    log << "done";
-    return {sizes[0], sizes[1]};
+
+    if(texture.numAltIntervals >= 0)
+        numAltIntervalsIn4DTexture_ = texture.numAltIntervals;
 }
 
-void AtmosphereRenderer::loadTextures(const CountStepsOnly countStepsOnly)
+void AtmosphereRenderer::addLoadingTask(std::function<void()> run)
 {
-    OGL_TRACE();
+    loadingTasks_.push_back({{}, std::move(run)});
+}
 
-    while(gl.glGetError()!=GL_NO_ERROR);
+void AtmosphereRenderer::addLoadingTask(std::function<void()> prepare, std::function<void()> run)
+{
+    loadingTasks_.push_back({std::move(prepare), std::move(run)});
+}
 
-    if(!countStepsOnly)
-        gl.glActiveTexture(GL_TEXTURE0);
+void AtmosphereRenderer::addTextureLoadingTask(std::function<PreparedTexture()> prepare,
+                                               std::function<void(PreparedTexture const&)> upload)
+{
+    // The prepared data are shared by the two parts of the task, and are freed when the task is destroyed
+    const auto texture=std::make_shared<PreparedTexture>();
+    addLoadingTask([texture, prepare=std::move(prepare)]{ *texture=prepare(); },
+                   [texture, upload=std::move(upload)]{ upload(*texture); });
+}
 
-    for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
+unsigned AtmosphereRenderer::takeFreeLoadingThreads(const unsigned maxCount)
+{
+    auto inUse = loadingThreadsInUse_.load();
+    unsigned count;
+    do
     {
-        if(countStepsOnly)
+        count = inUse < maxLoadingThreads_ ? std::min(maxCount, maxLoadingThreads_-inUse) : 0;
+    }
+    while(count && !loadingThreadsInUse_.compare_exchange_weak(inUse, inUse+count));
+    return count;
+}
+
+void AtmosphereRenderer::startLoadingTasksPreparation()
+{
+    // The number of tasks prepared ahead is limited to bound the memory taken by the prepared data
+    const unsigned maxTasksPreparedAhead = maxLoadingThreads_;
+    unsigned numTasksPrepared = 0;
+    for(auto& task : loadingTasks_)
+    {
+        if(numTasksPrepared == maxTasksPreparedAhead)
+            break;
+        if(task.prepare)
         {
-            ++totalLoadingStepsToDo_;
-            continue;
+            if(!task.prepared.valid())
+            {
+                task.prepared = std::async(std::launch::async, [this, prepare=task.prepare]
+                {
+                    ++loadingThreadsInUse_;
+                    try
+                    {
+                        prepare();
+                    }
+                    catch(...)
+                    {
+                        --loadingThreadsInUse_;
+                        throw;
+                    }
+                    --loadingThreadsInUse_;
+                });
+            }
+            ++numTasksPrepared;
         }
-        if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
-            continue;
-
-        auto& tex=*transmittanceTextures_.emplace_back(newTex(QOpenGLTexture::Target2D));
-        tex.setMinificationFilter(QOpenGLTexture::Linear);
-        tex.setWrapMode(QOpenGLTexture::ClampToEdge);
-        tex.bind();
-        loadTexture2D(QString("%1/transmittance-wlset%2.f32").arg(pathToData_).arg(wlSetIndex));
-        ++loadingStepsDone_; return;
+        if(task.preparationBarrier)
+            break;
     }
+}
+
+void AtmosphereRenderer::runNextLoadingTask()
+{
+    if(loadingTasks_.empty()) return;
+
+    startLoadingTasksPreparation();
+    auto task=std::move(loadingTasks_.front());
+    loadingTasks_.pop_front();
+    if(task.prepared.valid())
+        task.prepared.get(); // rethrows the exception if prepare() failed
+    task.run();
+    ++loadingStepsDone_;
+    // Whatever has been loaded may be an input of the precomputations
+    invalidateEclipsePrecomputations();
+
+    // Let the workers prepare the next tasks while the application is busy with its own work between the steps
+    startLoadingTasksPreparation();
+}
+
+void AtmosphereRenderer::planTexturesLoading()
+{
+    addLoadingTask([this]
+    {
+        while(gl.glGetError()!=GL_NO_ERROR);
+        gl.glActiveTexture(GL_TEXTURE0);
+    });
 
     for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
     {
-        if(countStepsOnly)
+        const auto filename=QString("%1/transmittance-wlset%2.f32").arg(pathToData_).arg(wlSetIndex);
+        addTextureLoadingTask([this, filename]{ return prepareTexture2D(filename); },
+                              [this, filename](PreparedTexture const& data)
         {
-            ++totalLoadingStepsToDo_;
-            continue;
-        }
-        if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
-            continue;
+            auto& tex=*transmittanceTextures_.emplace_back(newTex(QOpenGLTexture::Target2D));
+            tex.setMinificationFilter(QOpenGLTexture::Linear);
+            tex.setWrapMode(QOpenGLTexture::ClampToEdge);
+            tex.bind();
+            uploadTexture(data, filename);
+        });
+    }
 
-        auto& tex=*irradianceTextures_.emplace_back(newTex(QOpenGLTexture::Target2D));
-        tex.setMinificationFilter(QOpenGLTexture::Linear);
-        tex.setWrapMode(QOpenGLTexture::ClampToEdge);
-        tex.bind();
-        loadTexture2D(QString("%1/irradiance-wlset%2.f32").arg(pathToData_).arg(wlSetIndex));
-        ++loadingStepsDone_; return;
+    for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
+    {
+        const auto filename=QString("%1/irradiance-wlset%2.f32").arg(pathToData_).arg(wlSetIndex);
+        addTextureLoadingTask([this, filename]{ return prepareTexture2D(filename); },
+                              [this, filename](PreparedTexture const& data)
+        {
+            auto& tex=*irradianceTextures_.emplace_back(newTex(QOpenGLTexture::Target2D));
+            tex.setMinificationFilter(QOpenGLTexture::Linear);
+            tex.setWrapMode(QOpenGLTexture::ClampToEdge);
+            tex.bind();
+            uploadTexture(data, filename);
+        });
     }
 
+    addLoadingTask([this]
+    {
+        // Multiple scattering shaders always sample a scattering texture, so the
+        // uniform can't have been optimized out if the shaders support stacking.
+        stackedAltitudeSlices_ = !multipleScatteringPrograms_.empty() &&
+                                 multipleScatteringPrograms_.front()->uniformLocation("altitudeSliceFraction") >= 0;
+    });
+    // Preparation of the scattering textures depends on whether the slices are stacked
+    loadingTasks_.back().preparationBarrier=true;
     altCoordToLoad_=altitudeUnitRangeTexCoord();
-    reloadScatteringTextures(countStepsOnly);
-
-    assert(gl.glGetError()==GL_NO_ERROR);
+    planScatteringTexturesReloading();
 }
 
 double AtmosphereRenderer::altitudeUnitRangeTexCoord() const
@@ -393,154 +737,272 @@ double AtmosphereRenderer::altitudeUnitRangeTexCoord() const
     return std::sqrt(h*(h+2*R) / ( H*(H+2*R) ));
 }
 
-void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStepsOnly)
+auto AtmosphereRenderer::altitudeSlicePosition(const double altitudeCoord, const int numAltIntervals) -> AltitudeSlicePosition
 {
-    const auto texFilter = tools_->textureFilteringEnabled() ? QOpenGLTexture::Linear : QOpenGLTexture::Nearest;
-    const auto altCoord = altCoordToLoad_;
+    const double altTexIndex = altitudeCoord*numAltIntervals;
+    const int lowerSliceIndex = std::clamp(int(std::floor(altTexIndex)), 0, numAltIntervals-1);
+    return {lowerSliceIndex, float(altTexIndex-lowerSliceIndex)};
+}
+
+auto AtmosphereRenderer::altitudeSlicePosition(const double altitudeCoord) const -> AltitudeSlicePosition
+{
+    return altitudeSlicePosition(altitudeCoord, numAltIntervalsIn4DTexture_);
+}
+
+void AtmosphereRenderer::swapAltitudeIntervalTextures(AltitudeIntervalTextures& textures)
+{
+    eclipsedDoubleScatteringTextures_.swap(textures.eclipsedDoubleScattering);
+    multipleScatteringTextures_.swap(textures.multipleScattering);
+    singleScatteringTextures_.swap(textures.singleScattering);
+    singleScatteringInterpolationGuidesTextures01_.swap(textures.singleScatteringInterpolationGuides01);
+    singleScatteringInterpolationGuidesTextures02_.swap(textures.singleScatteringInterpolationGuides02);
+}
+
+bool AtmosphereRenderer::switchToCachedAltitudeInterval(const double altitudeCoord)
+{
+    // Without stacked slices the textures are interpolated for a particular altitude, so can't be reused
+    if(!stackedAltitudeSlices_)
+        return false;
+
+    if(loadedAltitudeInterval_ >= 0)
+    {
+        AltitudeIntervalTextures textures;
+        swapAltitudeIntervalTextures(textures);
+        altitudeIntervalCache_.emplace_front(loadedAltitudeInterval_, std::move(textures));
+        loadedAltitudeInterval_ = -1;
+    }
+
+    const int interval = altitudeSlicePosition(altitudeCoord).lowerSliceIndex;
+    const auto it = std::find_if(altitudeIntervalCache_.begin(), altitudeIntervalCache_.end(),
+                                 [interval](auto const& entry){ return entry.first == interval; });
+    const bool found = it != altitudeIntervalCache_.end();
+    if(found)
+    {
+        qDebug().nospace() << "Using cached textures for altitude slices " << interval << " and " << interval+1;
+        swapAltitudeIntervalTextures(it->second);
+        altitudeIntervalCache_.erase(it);
+        loadedAltitudeInterval_ = interval;
+    }
+
+    while(altitudeIntervalCache_.size() > tools_->altitudeIntervalCacheSize())
+        altitudeIntervalCache_.pop_back();
 
-    if(countStepsOnly)
+    return found;
+}
+
+void AtmosphereRenderer::prefetchAltitudeSlices(const double altitudeCoord)
+{
+    using namespace std::chrono;
+
+    const auto now = steady_clock::now();
+    if(altitudeCoord != lastAltitudeCoord_)
     {
-        ++totalLoadingStepsToDo_;
+        const double dt = duration<double>(now - lastAltitudeChangeTime_).count();
+        if(lastAltitudeCoord_ >= 0 && dt > 0)
+            altitudeCoordVelocity_ = (altitudeCoord - lastAltitudeCoord_) / dt;
+        lastAltitudeCoord_ = altitudeCoord;
+        lastAltitudeChangeTime_ = now;
     }
-    else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
+    else if(duration<double>(now - lastAltitudeChangeTime_).count() > altitudePrefetchLookaheadSeconds)
     {
-        multipleScatteringTextures_.clear();
-        ++loadingStepsDone_; return;
+        altitudeCoordVelocity_ = 0;
     }
-    if(const auto filename=pathToData_+"/multiple-scattering-xyzw.f32"; QFile::exists(filename))
+
+    if(altitudeCoordVelocity_ == 0 || mappedTextureFiles_.empty())
+        return;
+
+    const auto predictedCoord = std::clamp(altitudeCoord + altitudeCoordVelocity_*altitudePrefetchLookaheadSeconds, 0., 1.);
+    const int interval = altitudeSlicePosition(predictedCoord).lowerSliceIndex;
+    if(interval == altitudeSlicePosition(altitudeCoord).lowerSliceIndex)
+        return;
+    if(stackedAltitudeSlices_ && std::any_of(altitudeIntervalCache_.begin(), altitudeIntervalCache_.end(),
+                                             [interval](auto const& entry){ return entry.first == interval; }))
+        return;
+    if(prefetch_)
+    {
+        if(prefetch_->lowerSliceIndex == interval)
+            return;
+        // Don't stall rendering waiting for an outdated prefetch to finish, just try again on the next frame
+        if(prefetch_->done.wait_for(seconds(0)) != std::future_status::ready)
+            return;
+    }
+
+    struct Source
+    {
+        QString path;
+        const uchar* data;
+        qint64 size;
+        qint64 firstSliceOffset;
+        qint64 sliceByteSize;
+        std::shared_ptr<const CompressedTextureReader> compressedReader;
+    };
+    std::vector<Source> sources;
+    for(const auto& [path, file] : mappedTextureFiles_)
+    {
+        if(file.compressedReader || file.firstSliceOffset >= 0)
+            sources.push_back({path, file.data, file.size, file.firstSliceOffset, file.sliceByteSize, file.compressedReader});
+    }
+
+    // The prefetch is optional, so if all the loading threads are busy, just try again on the next frame
+    if(!takeFreeLoadingThreads(1))
+        return;
+
+    qDebug().nospace() << "Prefetching altitude slices " << interval << " and " << interval+1;
+    prefetch_ = std::make_unique<AltitudeSlicesPrefetch>();
+    prefetch_->lowerSliceIndex = interval;
+    prefetch_->done = std::async(std::launch::async, [sources=std::move(sources), interval,
+                                                      &decompressedSlices=prefetch_->decompressedSlices,
+                                                      &loadingThreadsInUse=loadingThreadsInUse_]
     {
-        if(countStepsOnly)
+        for(const auto& src : sources)
         {
-            ++totalLoadingStepsToDo_;
+            try
+            {
+                if(src.compressedReader)
+                {
+                    const auto sliceByteSize = src.compressedReader->sliceByteSize();
+                    if(size_t(interval)+1 >= src.compressedReader->sliceCount())
+                        continue;
+                    std::vector<char> slices(2*sliceByteSize);
+                    src.compressedReader->readSlice(interval, slices.data());
+                    src.compressedReader->readSlice(interval+1, slices.data()+sliceByteSize);
+                    decompressedSlices.emplace(src.path, std::move(slices));
+                }
+                else
+                {
+                    // Touch each page of the slices, so that the upload on the GL thread doesn't have to wait for the disk
+                    const auto begin = src.firstSliceOffset + interval*src.sliceByteSize;
+                    const auto end = std::min(begin + 2*src.sliceByteSize, src.size);
+                    touchPages(src.data + begin, src.data + end);
+                }
+            }
+            catch(...)
+            {
+                // Errors will be reported if the data are actually loaded
+            }
         }
-        else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
+        --loadingThreadsInUse;
+    });
+}
+
+bool AtmosphereRenderer::takePrefetchedSlices(QString const& path, const int lowerSliceIndex, std::vector<char>& output)
+{
+    const std::lock_guard lock(textureFilesMutex_);
+
+    if(!prefetch_ || prefetch_->lowerSliceIndex != lowerSliceIndex)
+        return false;
+
+    // The prefetcher is already working on the slices we need, so waiting for it is not slower than decompressing them here
+    prefetch_->done.wait();
+    const auto it = prefetch_->decompressedSlices.find(path);
+    if(it == prefetch_->decompressedSlices.end() || it->second.size() != output.size())
+        return false;
+    output.swap(it->second);
+    prefetch_->decompressedSlices.erase(it);
+    return true;
+}
+
+void AtmosphereRenderer::planScatteringTexturesReloading()
+{
+    const auto texFilter = tools_->textureFilteringEnabled() ? QOpenGLTexture::Linear : QOpenGLTexture::Nearest;
+    const auto altCoord = altCoordToLoad_;
+
+    addLoadingTask([this]{ multipleScatteringTextures_.clear(); });
+    if(const auto filename=pathToData_+"/multiple-scattering-xyzw.f32"; dataExists(filename))
+    {
+        addTextureLoadingTask([this, filename, altCoord]{ return prepareTexture4D(filename, altCoord); },
+                              [this, texFilter, filename](PreparedTexture const& data)
         {
             auto& tex=*multipleScatteringTextures_.emplace_back(newTex(QOpenGLTexture::Target3D));
             tex.setMinificationFilter(texFilter);
             tex.setMagnificationFilter(texFilter);
             tex.setWrapMode(QOpenGLTexture::ClampToEdge);
             tex.bind();
-            loadTexture4D(filename, altCoord);
-            ++loadingStepsDone_; return;
-        }
+            uploadTexture(data, filename);
+        });
     }
     else
     {
         for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
         {
-            if(countStepsOnly)
+            const auto filename=QString("%1/multiple-scattering-wlset%2.f32").arg(pathToData_).arg(wlSetIndex);
+            addTextureLoadingTask([this, filename, altCoord]{ return prepareTexture4D(filename, altCoord); },
+                                  [this, texFilter, filename](PreparedTexture const& data)
             {
-                ++totalLoadingStepsToDo_;
-                continue;
-            }
-            if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
-                continue;
-
-            auto& tex=*multipleScatteringTextures_.emplace_back(newTex(QOpenGLTexture::Target3D));
-            tex.setMinificationFilter(texFilter);
-            tex.setMagnificationFilter(texFilter);
-            tex.setWrapMode(QOpenGLTexture::ClampToEdge);
-            tex.bind();
-            loadTexture4D(QString("%1/multiple-scattering-wlset%2.f32").arg(pathToData_).arg(wlSetIndex), altCoord);
-            ++loadingStepsDone_; return;
+                auto& tex=*multipleScatteringTextures_.emplace_back(newTex(QOpenGLTexture::Target3D));
+                tex.setMinificationFilter(texFilter);
+                tex.setMagnificationFilter(texFilter);
+                tex.setWrapMode(QOpenGLTexture::ClampToEdge);
+                tex.bind();
+                uploadTexture(data, filename);
+            });
         }
     }
 
-    if(countStepsOnly)
-    {
-        ++totalLoadingStepsToDo_;
-    }
-    else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
-    {
-        singleScatteringTextures_.clear();
-        ++loadingStepsDone_; return;
-    }
-
-    if(countStepsOnly)
-    {
-        ++totalLoadingStepsToDo_;
-    }
-    else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
+    addLoadingTask([this]{ singleScatteringTextures_.clear(); });
+    addLoadingTask([this]
     {
         singleScatteringInterpolationGuidesTextures01_.clear();
         singleScatteringInterpolationGuidesTextures02_.clear();
-        ++loadingStepsDone_; return;
-    }
+    });
 
     for(const auto& scatterer : params_.scatterers)
     {
-        auto& texturesPerWLSet=singleScatteringTextures_[scatterer.name];
         switch(scatterer.phaseFunctionType)
         {
         case PhaseFunctionType::General:
         {
             for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
             {
-                if(countStepsOnly)
+                const auto filename=QString("%1/single-scattering/%2/%3.f32").arg(pathToData_).arg(wlSetIndex).arg(scatterer.name);
+                addTextureLoadingTask([this, filename, altCoord]{ return prepareTexture4D(filename, altCoord); },
+                                      [this, texFilter, name=scatterer.name, filename](PreparedTexture const& data)
                 {
-                    ++totalLoadingStepsToDo_;
-                    continue;
-                }
-                if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
-                    continue;
-
-                auto& texture=*texturesPerWLSet.emplace_back(newTex(QOpenGLTexture::Target3D));
-                texture.setMinificationFilter(texFilter);
-                texture.setMagnificationFilter(texFilter);
-                texture.setWrapMode(QOpenGLTexture::ClampToEdge);
-                texture.bind();
-                loadTexture4D(QString("%1/single-scattering/%2/%3.f32").arg(pathToData_).arg(wlSetIndex).arg(scatterer.name), altCoord);
-                ++loadingStepsDone_; return;
+                    auto& texture=*singleScatteringTextures_[name].emplace_back(newTex(QOpenGLTexture::Target3D));
+                    texture.setMinificationFilter(texFilter);
+                    texture.setMagnificationFilter(texFilter);
+                    texture.setWrapMode(QOpenGLTexture::ClampToEdge);
+                    texture.bind();
+                    uploadTexture(data, filename);
+                });
             }
             for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
             {
                 const auto filename=QString("%1/single-scattering/%2/%3-dims01.guides2d").arg(pathToData_).arg(wlSetIndex).arg(scatterer.name);
-                if(QFile::exists(filename))
+                if(dataExists(filename))
                 {
-                    if(countStepsOnly)
-                    {
-                        ++totalLoadingStepsToDo_;
-                    }
-                    else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
+                    addTextureLoadingTask([this, filename, altCoord]{ return prepareTexture4D(filename, altCoord, Texture4DType::InterpolationGuides); },
+                                          [this, name=scatterer.name, filename](PreparedTexture const& data)
                     {
-                        auto& guidesPerWLSet=singleScatteringInterpolationGuidesTextures01_[scatterer.name];
+                        auto& guidesPerWLSet=singleScatteringInterpolationGuidesTextures01_[name];
                         auto& tex=*guidesPerWLSet.emplace_back(newTex(QOpenGLTexture::Target3D));
                         tex.setMinificationFilter(QOpenGLTexture::Linear);
                         tex.setMagnificationFilter(QOpenGLTexture::Linear);
                         tex.setWrapMode(QOpenGLTexture::ClampToEdge);
                         tex.bind();
-                        loadTexture4D(filename, altCoord, Texture4DType::InterpolationGuides);
-                        ++loadingStepsDone_; return;
-                    }
+                        uploadTexture(data, filename);
+                    });
                 }
             }
             for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
             {
                 const auto filename=QString("%1/single-scattering/%2/%3-dims02.guides2d").arg(pathToData_).arg(wlSetIndex).arg(scatterer.name);
-                if(QFile::exists(filename))
+                if(dataExists(filename))
                 {
-                    if(countStepsOnly)
-                    {
-                        ++totalLoadingStepsToDo_;
-                    }
-                    else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
+                    addTextureLoadingTask([this, filename, altCoord]{ return prepareTexture4D(filename, altCoord, Texture4DType::InterpolationGuides); },
+                                          [this, name=scatterer.name, filename](PreparedTexture const& data)
                     {
-                        auto& guidesPerWLSet=singleScatteringInterpolationGuidesTextures02_[scatterer.name];
+                        auto& guidesPerWLSet=singleScatteringInterpolationGuidesTextures02_[name];
                         auto& tex=*guidesPerWLSet.emplace_back(newTex(QOpenGLTexture::Target3D));
                         tex.setMinificationFilter(QOpenGLTexture::Linear);
                         tex.setMagnificationFilter(QOpenGLTexture::Linear);
                         tex.setWrapMode(QOpenGLTexture::ClampToEdge);
                         tex.bind();
-                        loadTexture4D(filename, altCoord, Texture4DType::InterpolationGuides);
-                        ++loadingStepsDone_; return;
-                    }
+                        uploadTexture(data, filename);
+                    });
                 }
             }
-            if(countStepsOnly)
-            {
-                ++totalLoadingStepsToDo_;
-            }
-            else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
+            addLoadingTask([this]
             {
                 if(singleScatteringInterpolationGuidesTextures02_.size() != singleScatteringInterpolationGuidesTextures01_.size())
                 {
@@ -550,71 +1012,55 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
                     singleScatteringInterpolationGuidesTextures01_.clear();
                     singleScatteringInterpolationGuidesTextures02_.clear();
                 }
-                ++loadingStepsDone_; return;
-            }
+            });
             break;
         }
         case PhaseFunctionType::Smooth:
         case PhaseFunctionType::Achromatic:
         {
-            if(countStepsOnly)
+            const auto filename=QString("%1/single-scattering/%2-xyzw.f32").arg(pathToData_).arg(scatterer.name);
+            addTextureLoadingTask([this, filename, altCoord]{ return prepareTexture4D(filename, altCoord); },
+                                  [this, texFilter, name=scatterer.name, filename](PreparedTexture const& data)
             {
-                ++totalLoadingStepsToDo_;
-            }
-            else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
-            {
-                auto& texture=*texturesPerWLSet.emplace_back(newTex(QOpenGLTexture::Target3D));
+                auto& texture=*singleScatteringTextures_[name].emplace_back(newTex(QOpenGLTexture::Target3D));
                 texture.setMinificationFilter(texFilter);
                 texture.setMagnificationFilter(texFilter);
                 texture.setWrapMode(QOpenGLTexture::ClampToEdge);
                 texture.bind();
-                loadTexture4D(QString("%1/single-scattering/%2-xyzw.f32").arg(pathToData_).arg(scatterer.name), altCoord);
-                ++loadingStepsDone_; return;
-            }
+                uploadTexture(data, filename);
+            });
 
             const auto guidesFilename01 = QString("%1/single-scattering/%2-xyzw-dims01.guides2d").arg(pathToData_).arg(scatterer.name);
-            if(QFile::exists(guidesFilename01))
+            if(dataExists(guidesFilename01))
             {
-                if(countStepsOnly)
+                addTextureLoadingTask([this, guidesFilename01, altCoord]{ return prepareTexture4D(guidesFilename01, altCoord, Texture4DType::InterpolationGuides); },
+                                      [this, name=scatterer.name, guidesFilename01](PreparedTexture const& data)
                 {
-                    ++totalLoadingStepsToDo_;
-                }
-                else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
-                {
-                    auto& guidesPerWLSet=singleScatteringInterpolationGuidesTextures01_[scatterer.name];
+                    auto& guidesPerWLSet=singleScatteringInterpolationGuidesTextures01_[name];
                     auto& texture=*guidesPerWLSet.emplace_back(newTex(QOpenGLTexture::Target3D));
                     texture.setMinificationFilter(QOpenGLTexture::Linear);
                     texture.setMagnificationFilter(QOpenGLTexture::Linear);
                     texture.setWrapMode(QOpenGLTexture::ClampToEdge);
                     texture.bind();
-                    loadTexture4D(guidesFilename01, altCoord, Texture4DType::InterpolationGuides);
-                    ++loadingStepsDone_; return;
-                }
+                    uploadTexture(data, guidesFilename01);
+                });
             }
             const auto guidesFilename02 = QString("%1/single-scattering/%2-xyzw-dims02.guides2d").arg(pathToData_).arg(scatterer.name);
-            if(QFile::exists(guidesFilename02))
+            if(dataExists(guidesFilename02))
             {
-                if(countStepsOnly)
-                {
-                    ++totalLoadingStepsToDo_;
-                }
-                else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
+                addTextureLoadingTask([this, guidesFilename02, altCoord]{ return prepareTexture4D(guidesFilename02, altCoord, Texture4DType::InterpolationGuides); },
+                                      [this, name=scatterer.name, guidesFilename02](PreparedTexture const& data)
                 {
-                    auto& guidesPerWLSet=singleScatteringInterpolationGuidesTextures02_[scatterer.name];
+                    auto& guidesPerWLSet=singleScatteringInterpolationGuidesTextures02_[name];
                     auto& texture=*guidesPerWLSet.emplace_back(newTex(QOpenGLTexture::Target3D));
                     texture.setMinificationFilter(QOpenGLTexture::Linear);
                     texture.setMagnificationFilter(QOpenGLTexture::Linear);
                     texture.setWrapMode(QOpenGLTexture::ClampToEdge);
                     texture.bind();
-                    loadTexture4D(guidesFilename02, altCoord, Texture4DType::InterpolationGuides);
-                    ++loadingStepsDone_; return;
-                }
-            }
-            if(countStepsOnly)
-            {
-                ++totalLoadingStepsToDo_;
+                    uploadTexture(data, guidesFilename02);
+                });
             }
-            else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
+            addLoadingTask([this]
             {
                 if(singleScatteringInterpolationGuidesTextures02_.size() != singleScatteringInterpolationGuidesTextures01_.size())
                 {
@@ -626,31 +1072,19 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
                     singleScatteringInterpolationGuidesTextures01_.clear();
                     singleScatteringInterpolationGuidesTextures02_.clear();
                 }
-                ++loadingStepsDone_; return;
-            }
+            });
             break;
         }
         }
     }
 
-    if(countStepsOnly)
-    {
-        ++totalLoadingStepsToDo_;
-    }
-    else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
-    {
-        eclipsedDoubleScatteringTextures_.clear();
-        ++loadingStepsDone_; return;
-    }
+    addLoadingTask([this]{ eclipsedDoubleScatteringTextures_.clear(); });
     if(!params_.noEclipsedDoubleScatteringTextures)
     {
-        if(const auto filename=pathToData_+"/eclipsed-double-scattering-xyzw.f32"; QFile::exists(filename))
+        if(const auto filename=pathToData_+"/eclipsed-double-scattering-xyzw.f32"; dataExists(filename))
         {
-            if(countStepsOnly)
-            {
-                ++totalLoadingStepsToDo_;
-            }
-            else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
+            addTextureLoadingTask([this, filename, altCoord]{ return prepareEclipsedDoubleScatteringTexture(filename, altCoord); },
+                                  [this, texFilter, filename](PreparedTexture const& data)
             {
                 auto& texture=*eclipsedDoubleScatteringTextures_.emplace_back(newTex(QOpenGLTexture::Target3D));
                 texture.setMinificationFilter(texFilter);
@@ -663,129 +1097,85 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
                 texture.setWrapMode(QOpenGLTexture::DirectionR, QOpenGLTexture::ClampToEdge);
 
                 texture.bind();
-                loadEclipsedDoubleScatteringTexture(QString("%1/eclipsed-double-scattering-xyzw.f32")
-                                                     .arg(pathToData_), altCoord);
-
-                ++loadingStepsDone_; return;
-            }
+                uploadTexture(data, filename);
+            });
         }
         else
         {
             for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
             {
-                if(countStepsOnly)
-                {
-                    ++totalLoadingStepsToDo_;
-                    continue;
-                }
-                if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
-                    continue;
-
-                auto& texture=*eclipsedDoubleScatteringTextures_.emplace_back(newTex(QOpenGLTexture::Target3D));
-                texture.setMinificationFilter(texFilter);
-                texture.setMagnificationFilter(texFilter);
-                // relative azimuth
-                texture.setWrapMode(QOpenGLTexture::DirectionS, QOpenGLTexture::Repeat);
-                // VZA
-                texture.setWrapMode(QOpenGLTexture::DirectionT, QOpenGLTexture::ClampToEdge);
-                // SZA
-                texture.setWrapMode(QOpenGLTexture::DirectionR, QOpenGLTexture::ClampToEdge);
-
-                texture.bind();
-                loadEclipsedDoubleScatteringTexture(QString("%1/eclipsed-double-scattering-wlset%2.f32")
-                                                     .arg(pathToData_).arg(wlSetIndex), altCoord);
-
-                ++loadingStepsDone_; return;
-            }
-        }
-    }
-
-    if(countStepsOnly)
-    {
-        ++totalLoadingStepsToDo_;
-    }
-    else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
-    {
-        eclipsedDoubleScatteringPrecomputationTargetTextures_.clear();
-        ++loadingStepsDone_; return;
-    }
-    for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
-    {
-        if(countStepsOnly)
-        {
-            ++totalLoadingStepsToDo_;
-            continue;
-        }
-        if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
-            continue;
-
-        auto& tex=*eclipsedDoubleScatteringPrecomputationTargetTextures_.emplace_back(newTex(QOpenGLTexture::Target3D));
-        // relative azimuth
-        tex.setWrapMode(QOpenGLTexture::DirectionS, QOpenGLTexture::Repeat);
-        // cosVZA
-        tex.setWrapMode(QOpenGLTexture::DirectionT, QOpenGLTexture::ClampToEdge);
-        // dummy dimension
-        tex.setWrapMode(QOpenGLTexture::DirectionR, QOpenGLTexture::Repeat);
+                const auto filename=QString("%1/eclipsed-double-scattering-wlset%2.f32").arg(pathToData_).arg(wlSetIndex);
+                addTextureLoadingTask([this, filename, altCoord]{ return prepareEclipsedDoubleScatteringTexture(filename, altCoord); },
+                                      [this, texFilter, filename](PreparedTexture const& data)
+                {
+                    auto& texture=*eclipsedDoubleScatteringTextures_.emplace_back(newTex(QOpenGLTexture::Target3D));
+                    texture.setMinificationFilter(texFilter);
+                    texture.setMagnificationFilter(texFilter);
+                    // relative azimuth
+                    texture.setWrapMode(QOpenGLTexture::DirectionS, QOpenGLTexture::Repeat);
+                    // VZA
+                    texture.setWrapMode(QOpenGLTexture::DirectionT, QOpenGLTexture::ClampToEdge);
+                    // SZA
+                    texture.setWrapMode(QOpenGLTexture::DirectionR, QOpenGLTexture::ClampToEdge);
 
-        ++loadingStepsDone_; return;
+                    texture.bind();
+                    uploadTexture(data, filename);
+                });
+            }
+        }
     }
 
-    if(countStepsOnly)
-    {
-        ++totalLoadingStepsToDo_;
-    }
-    else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
+    addLoadingTask([this]{ eclipsedDoubleScatteringPrecomputationTargetTextures_.clear(); });
+    for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
     {
-        lightPollutionTextures_.clear();
-        ++loadingStepsDone_; return;
+        addLoadingTask([this]
+        {
+            auto& tex=*eclipsedDoubleScatteringPrecomputationTargetTextures_.emplace_back(newTex(QOpenGLTexture::Target3D));
+            // relative azimuth
+            tex.setWrapMode(QOpenGLTexture::DirectionS, QOpenGLTexture::Repeat);
+            // cosVZA
+            tex.setWrapMode(QOpenGLTexture::DirectionT, QOpenGLTexture::ClampToEdge);
+            // dummy dimension
+            tex.setWrapMode(QOpenGLTexture::DirectionR, QOpenGLTexture::Repeat);
+        });
     }
-    if(const auto filename=pathToData_+"/light-pollution-xyzw.f32"; QFile::exists(filename))
+
+    addLoadingTask([this]{ lightPollutionTextures_.clear(); });
+    if(const auto filename=pathToData_+"/light-pollution-xyzw.f32"; dataExists(filename))
     {
-        if(countStepsOnly)
-        {
-            ++totalLoadingStepsToDo_;
-        }
-        else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
+        addTextureLoadingTask([this, filename]{ return prepareTexture2D(filename); },
+                              [this, texFilter, filename](PreparedTexture const& data)
         {
             auto& tex=*lightPollutionTextures_.emplace_back(newTex(QOpenGLTexture::Target2D));
             tex.setMinificationFilter(texFilter);
             tex.setMagnificationFilter(texFilter);
             tex.setWrapMode(QOpenGLTexture::ClampToEdge);
             tex.bind();
-            loadTexture2D(filename);
-            ++loadingStepsDone_; return;
-        }
+            uploadTexture(data, filename);
+        });
     }
     else
     {
         for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
         {
-            if(countStepsOnly)
+            const auto filename=QString("%1/light-pollution-wlset%2.f32").arg(pathToData_).arg(wlSetIndex);
+            addTextureLoadingTask([this, filename]{ return prepareTexture2D(filename); },
+                                  [this, texFilter, filename](PreparedTexture const& data)
             {
-                ++totalLoadingStepsToDo_;
-                continue;
-            }
-            if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
-                continue;
-
-            auto& tex=*lightPollutionTextures_.emplace_back(newTex(QOpenGLTexture::Target2D));
-            tex.setMinificationFilter(texFilter);
-            tex.setMagnificationFilter(texFilter);
-            tex.setWrapMode(QOpenGLTexture::ClampToEdge);
-            tex.bind();
-            loadTexture2D(QString("%1/light-pollution-wlset%2.f32").arg(pathToData_).arg(wlSetIndex));
-            ++loadingStepsDone_; return;
+                auto& tex=*lightPollutionTextures_.emplace_back(newTex(QOpenGLTexture::Target2D));
+                tex.setMinificationFilter(texFilter);
+                tex.setMagnificationFilter(texFilter);
+                tex.setWrapMode(QOpenGLTexture::ClampToEdge);
+                tex.bind();
+                uploadTexture(data, filename);
+            });
         }
     }
 }
 
-void AtmosphereRenderer::loadShaders(const CountStepsOnly countStepsOnly)
+void AtmosphereRenderer::planShadersLoading()
 {
-    if(countStepsOnly)
-    {
-        ++totalLoadingStepsToDo_;
-    }
-    else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
+    addLoadingTask([this]
     {
         viewDirVertShader_.reset(new QOpenGLShader(QOpenGLShader::Vertex));
         viewDirFragShader_.reset(new QOpenGLShader(QOpenGLShader::Fragment));
@@ -793,183 +1183,126 @@ void AtmosphereRenderer::loadShaders(const CountStepsOnly countStepsOnly)
             throw DataLoadError{QObject::tr("Failed to compile view direction vertex shader:\n%2").arg(viewDirVertShader_->log())};
         if(!viewDirFragShader_->compileSourceCode(viewDirFragShaderSrc_))
             throw DataLoadError{QObject::tr("Failed to compile view direction fragment shader:\n%2").arg(viewDirFragShader_->log())};
-        ++loadingStepsDone_; return;
-    }
+    });
 
-    if(countStepsOnly)
-    {
-        ++totalLoadingStepsToDo_;
-
-        // Dummy values so that the loop below doesn't index empty vector
-        singleScatteringPrograms_.clear();
-        for(int renderMode=0; renderMode<SSRM_COUNT; ++renderMode)
-            singleScatteringPrograms_.emplace_back(std::make_unique<std::map<QString,std::vector<ShaderProgPtr>>>());
-    }
-    else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
+    addLoadingTask([this]
     {
         singleScatteringPrograms_.clear();
         for(int renderMode=0; renderMode<SSRM_COUNT; ++renderMode)
             singleScatteringPrograms_.emplace_back(std::make_unique<std::map<QString,std::vector<ShaderProgPtr>>>());
-
-        ++loadingStepsDone_; return;
-    }
+    });
     for(int renderMode=0; renderMode<SSRM_COUNT; ++renderMode)
     {
-        auto& programsPerScatterer=*singleScatteringPrograms_[renderMode];
-
         for(const auto& scatterer : params_.scatterers)
         {
-            auto& programs=programsPerScatterer[scatterer.name];
             if(scatterer.phaseFunctionType==PhaseFunctionType::General || renderMode==SSRM_ON_THE_FLY)
             {
                 for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
                 {
-                    if(countStepsOnly)
+                    addLoadingTask([this, renderMode, wlSetIndex, name=scatterer.name]
                     {
-                        ++totalLoadingStepsToDo_;
-                        continue;
-                    }
-                    if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
-                        continue;
-
-                    const auto scatDir=QString("%1/shaders/single-scattering/%2/%3/%4").arg(pathToData_)
-                                                                                       .arg(singleScatteringRenderModeNames[renderMode])
-                                                                                       .arg(wlSetIndex)
-                                                                                       .arg(scatterer.name);
+                        const auto scatDir=QString("%1/shaders/single-scattering/%2/%3/%4").arg(pathToData_)
+                                                                                           .arg(singleScatteringRenderModeNames[renderMode])
+                                                                                           .arg(wlSetIndex)
+                                                                                           .arg(name);
+                        qDebug().nospace() << "Loading shaders from " << scatDir << "...";
+                        auto& programs=(*singleScatteringPrograms_[renderMode])[name];
+                        auto& program=*programs.emplace_back(std::make_unique<QOpenGLShaderProgram>());
+
+                        addShaderDirectory(program, scatDir);
+
+                        program.addShader(viewDirFragShader_.get());
+                        program.addShader(viewDirVertShader_.get());
+                        for(const auto& b : viewDirBindAttribLocations_)
+                            program.bindAttributeLocation(b.first.c_str(), b.second);
+
+                        link(program, QObject::tr("shader program for scatterer \"%1\"").arg(name));
+                    });
+                }
+            }
+            else
+            {
+                addLoadingTask([this, renderMode, name=scatterer.name]
+                {
+                    const auto scatDir=QString("%1/shaders/single-scattering/%2/%3").arg(pathToData_)
+                                                                                    .arg(singleScatteringRenderModeNames[renderMode])
+                                                                                    .arg(name);
                     qDebug().nospace() << "Loading shaders from " << scatDir << "...";
+                    auto& programs=(*singleScatteringPrograms_[renderMode])[name];
                     auto& program=*programs.emplace_back(std::make_unique<QOpenGLShaderProgram>());
-
-                    for(const auto& shaderFile : fs::directory_iterator(fs::u8path(scatDir.toStdString())))
-                        addShaderFile(program,QOpenGLShader::Fragment,shaderFile.path());
+                    addShaderDirectory(program, scatDir);
 
                     program.addShader(viewDirFragShader_.get());
                     program.addShader(viewDirVertShader_.get());
                     for(const auto& b : viewDirBindAttribLocations_)
                         program.bindAttributeLocation(b.first.c_str(), b.second);
 
-                    link(program, QObject::tr("shader program for scatterer \"%1\"").arg(scatterer.name));
-                    ++loadingStepsDone_; return;
-                }
-            }
-            else
-            {
-                if(countStepsOnly)
-                {
-                    ++totalLoadingStepsToDo_;
-                    continue;
-                }
-                if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
-                    continue;
-
-                const auto scatDir=QString("%1/shaders/single-scattering/%2/%3").arg(pathToData_)
-                                                                                .arg(singleScatteringRenderModeNames[renderMode])
-                                                                                .arg(scatterer.name);
-                qDebug().nospace() << "Loading shaders from " << scatDir << "...";
-                auto& program=*programs.emplace_back(std::make_unique<QOpenGLShaderProgram>());
-                for(const auto& shaderFile : fs::directory_iterator(fs::u8path(scatDir.toStdString())))
-                    addShaderFile(program,QOpenGLShader::Fragment,shaderFile.path());
-
-                program.addShader(viewDirFragShader_.get());
-                program.addShader(viewDirVertShader_.get());
-                for(const auto& b : viewDirBindAttribLocations_)
-                    program.bindAttributeLocation(b.first.c_str(), b.second);
-
-                link(program, QObject::tr("shader program for scatterer \"%1\"").arg(scatterer.name));
-                ++loadingStepsDone_; return;
+                    link(program, QObject::tr("shader program for scatterer \"%1\"").arg(name));
+                });
             }
         }
     }
 
-    if(countStepsOnly)
-    {
-        ++totalLoadingStepsToDo_;
-
-        // Dummy values so that the loop below doesn't index empty vector
-        eclipsedSingleScatteringPrograms_.clear();
-        for(int renderMode=SSRM_ON_THE_FLY; renderMode<SSRM_COUNT; ++renderMode)
-            eclipsedSingleScatteringPrograms_.emplace_back(std::make_unique<ScatteringProgramsMap>());
-    }
-    else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
+    addLoadingTask([this]
     {
         eclipsedSingleScatteringPrograms_.clear();
         for(int renderMode=SSRM_ON_THE_FLY; renderMode<SSRM_COUNT; ++renderMode)
             eclipsedSingleScatteringPrograms_.emplace_back(std::make_unique<ScatteringProgramsMap>());
-
-        ++loadingStepsDone_; return;
-    }
+    });
     for(int renderMode=SSRM_ON_THE_FLY; renderMode<SSRM_COUNT; ++renderMode)
     {
-        auto& programsPerScatterer=*eclipsedSingleScatteringPrograms_[renderMode];
-
         for(const auto& scatterer : params_.scatterers)
         {
-            auto& programs=programsPerScatterer[scatterer.name];
             if(scatterer.phaseFunctionType==PhaseFunctionType::General || renderMode==SSRM_ON_THE_FLY)
             {
                 for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
                 {
-                    if(countStepsOnly)
+                    addLoadingTask([this, renderMode, wlSetIndex, name=scatterer.name]
                     {
-                        ++totalLoadingStepsToDo_;
-                        continue;
-                    }
-                    if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
-                        continue;
-
-                    const auto scatDir=QString("%1/shaders/single-scattering-eclipsed/%2/%3/%4").arg(pathToData_)
-                                                                                                .arg(singleScatteringRenderModeNames[renderMode])
-                                                                                                .arg(wlSetIndex)
-                                                                                                .arg(scatterer.name);
-                    qDebug().nospace() << "Loading shaders from " << scatDir << "...";
-                    auto& program=*programs.emplace_back(std::make_unique<QOpenGLShaderProgram>());
+                        const auto scatDir=QString("%1/shaders/single-scattering-eclipsed/%2/%3/%4").arg(pathToData_)
+                                                                                                    .arg(singleScatteringRenderModeNames[renderMode])
+                                                                                                    .arg(wlSetIndex)
+                                                                                                    .arg(name);
+                        qDebug().nospace() << "Loading shaders from " << scatDir << "...";
+                        auto& programs=(*eclipsedSingleScatteringPrograms_[renderMode])[name];
+                        auto& program=*programs.emplace_back(std::make_unique<QOpenGLShaderProgram>());
 
-                    for(const auto& shaderFile : fs::directory_iterator(fs::u8path(scatDir.toStdString())))
-                        addShaderFile(program,QOpenGLShader::Fragment,shaderFile.path());
+                        addShaderDirectory(program, scatDir);
 
-                    program.addShader(viewDirFragShader_.get());
-                    program.addShader(viewDirVertShader_.get());
-                    for(const auto& b : viewDirBindAttribLocations_)
-                        program.bindAttributeLocation(b.first.c_str(), b.second);
+                        program.addShader(viewDirFragShader_.get());
+                        program.addShader(viewDirVertShader_.get());
+                        for(const auto& b : viewDirBindAttribLocations_)
+                            program.bindAttributeLocation(b.first.c_str(), b.second);
 
-                    link(program, QObject::tr("shader program for scatterer \"%1\"").arg(scatterer.name));
-                    ++loadingStepsDone_; return;
+                        link(program, QObject::tr("shader program for scatterer \"%1\"").arg(name));
+                    });
                 }
             }
             else
             {
-                if(countStepsOnly)
+                addLoadingTask([this, renderMode, name=scatterer.name]
                 {
-                    ++totalLoadingStepsToDo_;
-                    continue;
-                }
-                if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
-                    continue;
-
-                const auto scatDir=QString("%1/shaders/single-scattering-eclipsed/%2/%3").arg(pathToData_)
-                                                                                            .arg(singleScatteringRenderModeNames[renderMode])
-                                                                                            .arg(scatterer.name);
-                qDebug().nospace() << "Loading shaders from " << scatDir << "...";
-                auto& program=*programs.emplace_back(std::make_unique<QOpenGLShaderProgram>());
+                    const auto scatDir=QString("%1/shaders/single-scattering-eclipsed/%2/%3").arg(pathToData_)
+                                                                                                .arg(singleScatteringRenderModeNames[renderMode])
+                                                                                                .arg(name);
+                    qDebug().nospace() << "Loading shaders from " << scatDir << "...";
+                    auto& programs=(*eclipsedSingleScatteringPrograms_[renderMode])[name];
+                    auto& program=*programs.emplace_back(std::make_unique<QOpenGLShaderProgram>());
 
-                for(const auto& shaderFile : fs::directory_iterator(fs::u8path(scatDir.toStdString())))
-                    addShaderFile(program,QOpenGLShader::Fragment,shaderFile.path());
+                    addShaderDirectory(program, scatDir);
 
-                program.addShader(viewDirFragShader_.get());
-                program.addShader(viewDirVertShader_.get());
-                for(const auto& b : viewDirBindAttribLocations_)
-                    program.bindAttributeLocation(b.first.c_str(), b.second);
+                    program.addShader(viewDirFragShader_.get());
+                    program.addShader(viewDirVertShader_.get());
+                    for(const auto& b : viewDirBindAttribLocations_)
+                        program.bindAttributeLocation(b.first.c_str(), b.second);
 
-                link(program, QObject::tr("shader program for scatterer \"%1\"").arg(scatterer.name));
-                ++loadingStepsDone_; return;
+                    link(program, QObject::tr("shader program for scatterer \"%1\"").arg(name));
+                });
             }
         }
     }
 
-    if(countStepsOnly)
-    {
-        ++totalLoadingStepsToDo_;
-    }
-    else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
+    addLoadingTask([this]
     {
         static constexpr const char* precomputationProgramsVertShaderSrc=1+R"(
 #version 330
@@ -985,102 +1318,63 @@ void main()
         if(!precomputationProgramsVertShader_->compileSourceCode(precomputationProgramsVertShaderSrc))
             throw DataLoadError{QObject::tr("Failed to compile vertex shader for on-the-fly precomputation of eclipsed scattering:\n%2")
                                     .arg(precomputationProgramsVertShader_->log())};
-        ++loadingStepsDone_; return;
-    }
-
-    if(countStepsOnly)
-    {
-        ++totalLoadingStepsToDo_;
+    });
 
-        // Dummy value to avoid dereferencing null pointer in the loop below
-        eclipsedSingleScatteringPrecomputationPrograms_=std::make_unique<ScatteringProgramsMap>();
-    }
-    else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
-    {
-        eclipsedSingleScatteringPrecomputationPrograms_=std::make_unique<ScatteringProgramsMap>();
-        ++loadingStepsDone_; return;
-    }
+    addLoadingTask([this]{ eclipsedSingleScatteringPrecomputationPrograms_=std::make_unique<ScatteringProgramsMap>(); });
     for(const auto& scatterer : params_.scatterers)
     {
-        auto& programs=(*eclipsedSingleScatteringPrecomputationPrograms_)[scatterer.name];
         for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
         {
-            if(countStepsOnly)
+            addLoadingTask([this, wlSetIndex, name=scatterer.name]
             {
-                ++totalLoadingStepsToDo_;
-                continue;
-            }
-            if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
-                continue;
-
-            const auto scatDir=QString("%1/shaders/single-scattering-eclipsed/precomputation/%3/%4").arg(pathToData_)
-                                                                                                    .arg(wlSetIndex)
-                                                                                                    .arg(scatterer.name);
-            qDebug().nospace() << "Loading shaders from " << scatDir << "...";
-            auto& program=*programs.emplace_back(std::make_unique<QOpenGLShaderProgram>());
+                const auto scatDir=QString("%1/shaders/single-scattering-eclipsed/precomputation/%3/%4").arg(pathToData_)
+                                                                                                        .arg(wlSetIndex)
+                                                                                                        .arg(name);
+                qDebug().nospace() << "Loading shaders from " << scatDir << "...";
+                auto& programs=(*eclipsedSingleScatteringPrecomputationPrograms_)[name];
+                auto& program=*programs.emplace_back(std::make_unique<QOpenGLShaderProgram>());
 
-            for(const auto& shaderFile : fs::directory_iterator(fs::u8path(scatDir.toStdString())))
-                addShaderFile(program,QOpenGLShader::Fragment,shaderFile.path());
+                addShaderDirectory(program, scatDir);
 
-            program.addShader(precomputationProgramsVertShader_.get());
+                program.addShader(precomputationProgramsVertShader_.get());
 
-            link(program, QObject::tr("shader program for scatterer \"%1\"").arg(scatterer.name));
-            ++loadingStepsDone_; return;
+                link(program, QObject::tr("shader program for scatterer \"%1\"").arg(name));
+            });
         }
     }
 
     // Precomputed rendering (with approximate mixing, since textures contain only the data for fully-centered eclipse)
-    if(countStepsOnly)
-    {
-        ++totalLoadingStepsToDo_;
-    }
-    else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
-    {
-        eclipsedDoubleScatteringPrecomputedPrograms_.clear();
-        ++loadingStepsDone_; return;
-    }
-    if(QFile::exists(pathToData_+"/shaders/double-scattering-eclipsed/precomputed/0/"))
+    addLoadingTask([this]{ eclipsedDoubleScatteringPrecomputedPrograms_.clear(); });
+    if(dataExists(pathToData_+"/shaders/double-scattering-eclipsed/precomputed/0/"))
     {
         for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
         {
-            if(countStepsOnly)
+            addLoadingTask([this, wlSetIndex]
             {
-                ++totalLoadingStepsToDo_;
-                continue;
-            }
-            if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
-                continue;
-
-            const auto scatDir=QString("%1/shaders/double-scattering-eclipsed/precomputed/%2").arg(pathToData_).arg(wlSetIndex);
-            qDebug().nospace() << "Loading shaders from " << scatDir << "...";
-            auto& program=*eclipsedDoubleScatteringPrecomputedPrograms_.emplace_back(std::make_unique<QOpenGLShaderProgram>());
+                const auto scatDir=QString("%1/shaders/double-scattering-eclipsed/precomputed/%2").arg(pathToData_).arg(wlSetIndex);
+                qDebug().nospace() << "Loading shaders from " << scatDir << "...";
+                auto& program=*eclipsedDoubleScatteringPrecomputedPrograms_.emplace_back(std::make_unique<QOpenGLShaderProgram>());
 
-            for(const auto& shaderFile : fs::directory_iterator(fs::u8path(scatDir.toStdString())))
-                addShaderFile(program,QOpenGLShader::Fragment,shaderFile.path());
+                addShaderDirectory(program, scatDir);
 
-            program.addShader(viewDirFragShader_.get());
-            program.addShader(viewDirVertShader_.get());
-            for(const auto& b : viewDirBindAttribLocations_)
-                program.bindAttributeLocation(b.first.c_str(), b.second);
+                program.addShader(viewDirFragShader_.get());
+                program.addShader(viewDirVertShader_.get());
+                for(const auto& b : viewDirBindAttribLocations_)
+                    program.bindAttributeLocation(b.first.c_str(), b.second);
 
-            link(program, QObject::tr("precomputed eclipsed double scattering shader program"));
-            ++loadingStepsDone_; return;
+                link(program, QObject::tr("precomputed eclipsed double scattering shader program"));
+            });
         }
     }
     else
     {
-        if(countStepsOnly)
-        {
-            ++totalLoadingStepsToDo_;
-        }
-        else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
+        addLoadingTask([this]
         {
             const auto scatDir=QString("%1/shaders/double-scattering-eclipsed/precomputed").arg(pathToData_);
             qDebug().nospace() << "Loading shaders from " << scatDir << "...";
             auto& program=*eclipsedDoubleScatteringPrecomputedPrograms_.emplace_back(std::make_unique<QOpenGLShaderProgram>());
 
-            for(const auto& shaderFile : fs::directory_iterator(fs::u8path(scatDir.toStdString())))
-                addShaderFile(program,QOpenGLShader::Fragment,shaderFile.path());
+            addShaderDirectory(program, scatDir);
 
             program.addShader(viewDirFragShader_.get());
             program.addShader(viewDirVertShader_.get());
@@ -1088,168 +1382,97 @@ void main()
                 program.bindAttributeLocation(b.first.c_str(), b.second);
 
             link(program, QObject::tr("precomputed eclipsed double scattering shader program"));
-            ++loadingStepsDone_; return;
-        }
+        });
     }
 
     // Rendering with on-the-fly precomputation, useful as a reference on slower machines, and as the production mode on very fast ones
-    if(countStepsOnly)
-    {
-        ++totalLoadingStepsToDo_;
-    }
-    else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
-    {
-        eclipsedDoubleScatteringPrecomputationPrograms_.clear();
-        ++loadingStepsDone_; return;
-    }
+    addLoadingTask([this]{ eclipsedDoubleScatteringPrecomputationPrograms_.clear(); });
     for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
     {
-        if(countStepsOnly)
+        addLoadingTask([this, wlSetIndex]
         {
-            ++totalLoadingStepsToDo_;
-            continue;
-        }
-        if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
-            continue;
-
-        const auto scatDir=QString("%1/shaders/double-scattering-eclipsed/precomputation/%2").arg(pathToData_).arg(wlSetIndex);
-        qDebug().nospace() << "Loading shaders from " << scatDir << "...";
-        auto& program=*eclipsedDoubleScatteringPrecomputationPrograms_.emplace_back(std::make_unique<QOpenGLShaderProgram>());
+            const auto scatDir=QString("%1/shaders/double-scattering-eclipsed/precomputation/%2").arg(pathToData_).arg(wlSetIndex);
+            qDebug().nospace() << "Loading shaders from " << scatDir << "...";
+            auto& program=*eclipsedDoubleScatteringPrecomputationPrograms_.emplace_back(std::make_unique<QOpenGLShaderProgram>());
 
-        for(const auto& shaderFile : fs::directory_iterator(fs::u8path(scatDir.toStdString())))
-            addShaderFile(program,QOpenGLShader::Fragment,shaderFile.path());
+            addShaderDirectory(program, scatDir);
 
-        program.addShader(precomputationProgramsVertShader_.get());
+            program.addShader(precomputationProgramsVertShader_.get());
 
-        link(program, QObject::tr("on-the-fly eclipsed double scattering shader program"));
-        ++loadingStepsDone_; return;
+            link(program, QObject::tr("on-the-fly eclipsed double scattering shader program"));
+        });
     }
 
-    if(countStepsOnly)
-    {
-        ++totalLoadingStepsToDo_;
-    }
-    else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
-    {
-        multipleScatteringPrograms_.clear();
-        ++loadingStepsDone_; return;
-    }
-    if(QFile::exists(pathToData_+"/shaders/multiple-scattering/0/"))
+    addLoadingTask([this]{ multipleScatteringPrograms_.clear(); });
+    if(dataExists(pathToData_+"/shaders/multiple-scattering/0/"))
     {
         for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
         {
-            if(countStepsOnly)
+            addLoadingTask([this, wlSetIndex]
             {
-                ++totalLoadingStepsToDo_;
-                continue;
-            }
-            if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
-                continue;
-
-            auto& program=*multipleScatteringPrograms_.emplace_back(std::make_unique<QOpenGLShaderProgram>());
-            const auto wlDir=QString("%1/shaders/multiple-scattering/%2").arg(pathToData_).arg(wlSetIndex);
-            qDebug().nospace() << "Loading shaders from " << wlDir << "...";
-            for(const auto& shaderFile : fs::directory_iterator(fs::u8path(wlDir.toStdString())))
-                addShaderFile(program, QOpenGLShader::Fragment, shaderFile.path());
-            program.addShader(viewDirFragShader_.get());
-            program.addShader(viewDirVertShader_.get());
-            for(const auto& b : viewDirBindAttribLocations_)
-                program.bindAttributeLocation(b.first.c_str(), b.second);
-            link(program, QObject::tr("multiple scattering shader program"));
-            ++loadingStepsDone_; return;
+                auto& program=*multipleScatteringPrograms_.emplace_back(std::make_unique<QOpenGLShaderProgram>());
+                const auto wlDir=QString("%1/shaders/multiple-scattering/%2").arg(pathToData_).arg(wlSetIndex);
+                qDebug().nospace() << "Loading shaders from " << wlDir << "...";
+                addShaderDirectory(program, wlDir);
+                program.addShader(viewDirFragShader_.get());
+                program.addShader(viewDirVertShader_.get());
+                for(const auto& b : viewDirBindAttribLocations_)
+                    program.bindAttributeLocation(b.first.c_str(), b.second);
+                link(program, QObject::tr("multiple scattering shader program"));
+            });
         }
     }
     else
     {
-        if(countStepsOnly)
-        {
-            ++totalLoadingStepsToDo_;
-        }
-        else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
+        addLoadingTask([this]
         {
             auto& program=*multipleScatteringPrograms_.emplace_back(std::make_unique<QOpenGLShaderProgram>());
             const auto wlDir=pathToData_+"/shaders/multiple-scattering/";
             qDebug().nospace() << "Loading shaders from " << wlDir << "...";
-            for(const auto& shaderFile : fs::directory_iterator(fs::u8path(wlDir.toStdString())))
-                addShaderFile(program, QOpenGLShader::Fragment, shaderFile.path());
+            addShaderDirectory(program, wlDir);
             program.addShader(viewDirFragShader_.get());
             program.addShader(viewDirVertShader_.get());
             for(const auto& b : viewDirBindAttribLocations_)
                 program.bindAttributeLocation(b.first.c_str(), b.second);
             link(program, QObject::tr("multiple scattering shader program"));
-            ++loadingStepsDone_; return;
-        }
+        });
     }
 
-    if(countStepsOnly)
-    {
-        ++totalLoadingStepsToDo_;
-    }
-    else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
-    {
-        zeroOrderScatteringPrograms_.clear();
-        ++loadingStepsDone_; return;
-    }
+    addLoadingTask([this]{ zeroOrderScatteringPrograms_.clear(); });
     for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
     {
-        if(countStepsOnly)
+        addLoadingTask([this, wlSetIndex]
         {
-            ++totalLoadingStepsToDo_;
-            continue;
-        }
-        if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
-            continue;
-
-        auto& program=*zeroOrderScatteringPrograms_.emplace_back(std::make_unique<QOpenGLShaderProgram>());
-        const auto wlDir=QString("%1/shaders/zero-order-scattering/%2").arg(pathToData_).arg(wlSetIndex);
-        qDebug().nospace() << "Loading shaders from " << wlDir << "...";
-        for(const auto& shaderFile : fs::directory_iterator(fs::u8path(wlDir.toStdString())))
-            addShaderFile(program, QOpenGLShader::Fragment, shaderFile.path());
-        program.addShader(viewDirFragShader_.get());
-        program.addShader(viewDirVertShader_.get());
-        for(const auto& b : viewDirBindAttribLocations_)
-            program.bindAttributeLocation(b.first.c_str(), b.second);
-        link(program, QObject::tr("zero-order scattering shader program"));
-        ++loadingStepsDone_; return;
+            auto& program=*zeroOrderScatteringPrograms_.emplace_back(std::make_unique<QOpenGLShaderProgram>());
+            const auto wlDir=QString("%1/shaders/zero-order-scattering/%2").arg(pathToData_).arg(wlSetIndex);
+            qDebug().nospace() << "Loading shaders from " << wlDir << "...";
+            addShaderDirectory(program, wlDir);
+            program.addShader(viewDirFragShader_.get());
+            program.addShader(viewDirVertShader_.get());
+            for(const auto& b : viewDirBindAttribLocations_)
+                program.bindAttributeLocation(b.first.c_str(), b.second);
+            link(program, QObject::tr("zero-order scattering shader program"));
+        });
     }
 
-    if(countStepsOnly)
-    {
-        ++totalLoadingStepsToDo_;
-    }
-    else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
-    {
-        eclipsedZeroOrderScatteringPrograms_.clear();
-        ++loadingStepsDone_; return;
-    }
+    addLoadingTask([this]{ eclipsedZeroOrderScatteringPrograms_.clear(); });
     for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
     {
-        if(countStepsOnly)
+        addLoadingTask([this, wlSetIndex]
         {
-            ++totalLoadingStepsToDo_;
-            continue;
-        }
-        if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
-            continue;
-
-        auto& program=*eclipsedZeroOrderScatteringPrograms_.emplace_back(std::make_unique<QOpenGLShaderProgram>());
-        const auto wlDir=QString("%1/shaders/eclipsed-zero-order-scattering/%2").arg(pathToData_).arg(wlSetIndex);
-        qDebug().nospace() << "Loading shaders from " << wlDir << "...";
-        for(const auto& shaderFile : fs::directory_iterator(fs::u8path(wlDir.toStdString())))
-            addShaderFile(program, QOpenGLShader::Fragment, shaderFile.path());
-        program.addShader(viewDirFragShader_.get());
-        program.addShader(viewDirVertShader_.get());
-        for(const auto& b : viewDirBindAttribLocations_)
-            program.bindAttributeLocation(b.first.c_str(), b.second);
-        link(program, QObject::tr("eclipsed zero-order scattering shader program"));
-        ++loadingStepsDone_; return;
+            auto& program=*eclipsedZeroOrderScatteringPrograms_.emplace_back(std::make_unique<QOpenGLShaderProgram>());
+            const auto wlDir=QString("%1/shaders/eclipsed-zero-order-scattering/%2").arg(pathToData_).arg(wlSetIndex);
+            qDebug().nospace() << "Loading shaders from " << wlDir << "...";
+            addShaderDirectory(program, wlDir);
+            program.addShader(viewDirFragShader_.get());
+            program.addShader(viewDirVertShader_.get());
+            for(const auto& b : viewDirBindAttribLocations_)
+                program.bindAttributeLocation(b.first.c_str(), b.second);
+            link(program, QObject::tr("eclipsed zero-order scattering shader program"));
+        });
     }
 
-    if(countStepsOnly)
-    {
-        ++totalLoadingStepsToDo_;
-    }
-    else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
+    addLoadingTask([this]
     {
         viewDirectionGetterProgram_=std::make_unique<QOpenGLShaderProgram>();
         auto& program=*viewDirectionGetterProgram_;
@@ -1270,63 +1493,41 @@ void main()
 }
 )");
         link(program, QObject::tr("view direction getter shader program"));
-        ++loadingStepsDone_; return;
-    }
+    });
 
-    if(countStepsOnly)
-    {
-        ++totalLoadingStepsToDo_;
-    }
-    else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
-    {
-        lightPollutionPrograms_.clear();
-        ++loadingStepsDone_; return;
-    }
-    if(QFile::exists(pathToData_+"/shaders/light-pollution/0/"))
+    addLoadingTask([this]{ lightPollutionPrograms_.clear(); });
+    if(dataExists(pathToData_+"/shaders/light-pollution/0/"))
     {
         for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
         {
-            if(countStepsOnly)
+            addLoadingTask([this, wlSetIndex]
             {
-                ++totalLoadingStepsToDo_;
-                continue;
-            }
-            if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
-                continue;
-
-            auto& program=*lightPollutionPrograms_.emplace_back(std::make_unique<QOpenGLShaderProgram>());
-            const auto wlDir=QString("%1/shaders/light-pollution/%2").arg(pathToData_).arg(wlSetIndex);
-            qDebug().nospace() << "Loading shaders from " << wlDir << "...";
-            for(const auto& shaderFile : fs::directory_iterator(fs::u8path(wlDir.toStdString())))
-                addShaderFile(program, QOpenGLShader::Fragment, shaderFile.path());
-            program.addShader(viewDirFragShader_.get());
-            program.addShader(viewDirVertShader_.get());
-            for(const auto& b : viewDirBindAttribLocations_)
-                program.bindAttributeLocation(b.first.c_str(), b.second);
-            link(program, QObject::tr("light pollution shader program"));
-            ++loadingStepsDone_; return;
+                auto& program=*lightPollutionPrograms_.emplace_back(std::make_unique<QOpenGLShaderProgram>());
+                const auto wlDir=QString("%1/shaders/light-pollution/%2").arg(pathToData_).arg(wlSetIndex);
+                qDebug().nospace() << "Loading shaders from " << wlDir << "...";
+                addShaderDirectory(program, wlDir);
+                program.addShader(viewDirFragShader_.get());
+                program.addShader(viewDirVertShader_.get());
+                for(const auto& b : viewDirBindAttribLocations_)
+                    program.bindAttributeLocation(b.first.c_str(), b.second);
+                link(program, QObject::tr("light pollution shader program"));
+            });
         }
     }
     else
     {
-        if(countStepsOnly)
-        {
-            ++totalLoadingStepsToDo_;
-        }
-        else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
+        addLoadingTask([this]
         {
             auto& program=*lightPollutionPrograms_.emplace_back(std::make_unique<QOpenGLShaderProgram>());
             const auto wlDir=pathToData_+"/shaders/light-pollution/";
             qDebug().nospace() << "Loading shaders from " << wlDir << "...";
-            for(const auto& shaderFile : fs::directory_iterator(fs::u8path(wlDir.toStdString())))
-                addShaderFile(program, QOpenGLShader::Fragment, shaderFile.path());
+            addShaderDirectory(program, wlDir);
             program.addShader(viewDirFragShader_.get());
             program.addShader(viewDirVertShader_.get());
             for(const auto& b : viewDirBindAttribLocations_)
                 program.bindAttributeLocation(b.first.c_str(), b.second);
             link(program, QObject::tr("light pollution shader program"));
-            ++loadingStepsDone_; return;
-        }
+        });
     }
 }
 
@@ -1454,6 +1655,7 @@ void AtmosphereRenderer::setSolarSpectrum(std::vector<float> const& solarIrradia
         const auto origIrrad = toQVector(params_.solarIrradianceAtTOA[n]);
         solarIrradianceFixup_.emplace_back(newIrrad/origIrrad);
     }
+    invalidateEclipsePrecomputations();
 }
 
 void AtmosphereRenderer::resetSolarSpectrum()
@@ -1555,8 +1757,14 @@ void AtmosphereRenderer::precomputeEclipsedSingleScattering()
 {
     OGL_TRACE();
 
+    const auto key=eclipsePrecomputationKey(false);
+    if(eclipsedSingleScatteringPrecomputedFor_ == key)
+    {
+        ++skippedEclipsePrecomputations_;
+        return;
+    }
+
     gl.glBindVertexArray(vao_);
-    // TODO: avoid redoing it if Sun elevation and Moon elevation and relative azimuth haven't changed
     for(const auto& scatterer : params_.scatterers)
     {
         auto& textures=eclipsedSingleScatteringPrecomputationTextures_[scatterer.name];
@@ -1588,6 +1796,7 @@ void AtmosphereRenderer::precomputeEclipsedSingleScattering()
     gl.glBindVertexArray(0);
     gl.glBindFramebuffer(GL_FRAMEBUFFER,luminanceRadianceFBO_);
     gl.glEnablei(GL_BLEND, 0);
+    eclipsedSingleScatteringPrecomputedFor_=key;
 }
 
 void AtmosphereRenderer::renderSingleScattering()
@@ -1694,6 +1903,8 @@ void AtmosphereRenderer::renderSingleScattering()
                         tex.bind(0);
                         prog.setUniformValue("scatteringTexture", 0);
                     }
+                    prog.setUniformValue("stackedAltitudeSlices", stackedAltitudeSlices_);
+                    prog.setUniformValue("altitudeSliceFraction", altitudeSlicePosition(altCoordToLoad_).fraction);
 
                     bool guides01Loaded = false, guides02Loaded = false;
                     {
@@ -1739,6 +1950,8 @@ void AtmosphereRenderer::renderSingleScattering()
                 tex.bind(0);
             }
             prog.setUniformValue("scatteringTexture", 0);
+            prog.setUniformValue("stackedAltitudeSlices", stackedAltitudeSlices_);
+            prog.setUniformValue("altitudeSliceFraction", altitudeSlicePosition(altCoordToLoad_).fraction);
             prog.setUniformValue("pseudoMirrorSkyBelowHorizon", tools_->pseudoMirrorEnabled());
 
             bool guides01Loaded = false, guides02Loaded = false;
@@ -1787,15 +2000,40 @@ void AtmosphereRenderer::renderSingleScattering()
     }
 }
 
+auto AtmosphereRenderer::eclipsePrecomputationKey(const bool luminance) const -> EclipsePrecomputationKey
+{
+    // The steps are far below anything visible in the results, but large enough that a setting
+    // reproduced with a rounding error doesn't trigger recomputation
+    constexpr double angleStep=1e-6; // rad
+    const auto quantize=[](const double value, const double step){ return std::llround(value/step); };
+    return {{quantize(tools_->altitude(), 1e-3),
+             quantize(tools_->sunZenithAngle(), angleStep),
+             quantize(tools_->moonZenithAngle(), angleStep),
+             quantize(tools_->moonAzimuth() - tools_->sunAzimuth(), angleStep),
+             quantize(tools_->earthMoonDistance(), 1),
+             quantize(tools_->sunAngularRadius(), 1e-9)},
+            luminance};
+}
+
+void AtmosphereRenderer::invalidateEclipsePrecomputations()
+{
+    eclipsedSingleScatteringPrecomputedFor_.reset();
+    eclipsedDoubleScatteringPrecomputedFor_.reset();
+}
+
 void AtmosphereRenderer::precomputeEclipsedDoubleScattering()
 {
-    // TODO: avoid redoing it if Sun elevation and Moon elevation and relative azimuth haven't changed
+    const bool renderingNeedsLuminance = !canGrabRadiance();
+    const auto key=eclipsePrecomputationKey(renderingNeedsLuminance);
+    // Camera orientation, field of view, exposure etc. don't affect the results, so most frames can reuse them
+    if(eclipsedDoubleScatteringPrecomputedFor_ == key)
+    {
+        ++skippedEclipsePrecomputations_;
+        return;
+    }
 
-    gl.glBindFramebuffer(GL_FRAMEBUFFER, eclipseDoubleScatteringPrecomputationFBO_);
     gl.glDisablei(GL_BLEND, 0);
     gl.glBindVertexArray(vao_);
-    const bool renderingNeedsLuminance = !canGrabRadiance();
-    std::unique_ptr<EclipsedDoubleScatteringPrecomputer> precompAccumulator;
     for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
     {
         auto& prog=*eclipsedDoubleScatteringPrecomputationPrograms_[wlSetIndex];
@@ -1806,31 +2044,30 @@ void AtmosphereRenderer::precomputeEclipsedDoubleScattering()
         prog.setUniformValue("solarIrradianceFixup", solarIrradianceFixup_[wlSetIndex]);
         prog.setUniformValue("sunAngularRadius", float(tools_->sunAngularRadius()));
 
-        auto precomputer = std::make_unique<EclipsedDoubleScatteringPrecomputer>(gl,
-                                                        params_,
-                                                        params_.eclipsedDoubleScatteringTextureSize[0],
-                                                        params_.eclipsedDoubleScatteringTextureSize[1], 1, 1);
-        precomputer->computeRadianceOnCoarseGrid(prog, eclipsedDoubleScatteringPrecomputationScratchTexture_->textureId(),
-                                                 unusedTextureUnitNum, tools_->altitude(), tools_->sunZenithAngle(),
+        auto& precomputer = eclipsedDoubleScatteringPrecomputer_;
+        precomputer->computeRadianceOnCoarseGrid(prog, unusedTextureUnitNum, tools_->altitude(), tools_->sunZenithAngle(),
                                                  tools_->moonZenithAngle(), tools_->moonAzimuth() - tools_->sunAzimuth(),
                                                  tools_->earthMoonDistance());
         if(renderingNeedsLuminance)
         {
             const auto rad2lum = radianceToLuminance(wlSetIndex, params_.allWavelengths);
+            auto& accumulator = eclipsedDoubleScatteringAccumulator_;
             if(wlSetIndex==0)
             {
-                precompAccumulator = std::move(precomputer);
-                precompAccumulator->convertRadianceToLuminance(rad2lum);
+                // The samples just computed become the initial contents of the accumulator, and the
+                // old accumulator will receive the samples for the next wavelength sets.
+                std::swap(accumulator, precomputer);
+                accumulator->convertRadianceToLuminance(rad2lum);
             }
             else
             {
-                precompAccumulator->accumulateLuminance(*precomputer, rad2lum);
+                accumulator->accumulateLuminance(*precomputer, rad2lum);
             }
         }
 
         if(!renderingNeedsLuminance || wlSetIndex+1 == params_.allWavelengths.size())
         {
-            auto& generator = renderingNeedsLuminance ? *precompAccumulator : *precomputer;
+            auto& generator = renderingNeedsLuminance ? *eclipsedDoubleScatteringAccumulator_ : *precomputer;
             generator.generateTextureFromCoarseGridData(0, 0, tools_->altitude());
             eclipsedDoubleScatteringPrecomputationTargetTextures_[renderingNeedsLuminance ? 0 : wlSetIndex]->bind();
             gl.glTexImage3D(GL_TEXTURE_3D,0,GL_RGBA32F,
@@ -1841,6 +2078,7 @@ void AtmosphereRenderer::precomputeEclipsedDoubleScattering()
     gl.glBindVertexArray(0);
     gl.glBindFramebuffer(GL_FRAMEBUFFER,luminanceRadianceFBO_);
     gl.glEnablei(GL_BLEND, 0);
+    eclipsedDoubleScatteringPrecomputedFor_=key;
 }
 
 void AtmosphereRenderer::renderMultipleScattering()
@@ -1875,6 +2113,7 @@ void AtmosphereRenderer::renderMultipleScattering()
                 prog.setUniformValue("eclipsedDoubleScatteringTexture", 0);
                 prog.setUniformValue("eclipsedDoubleScatteringTextureSize", QVector3D(params_.eclipsedDoubleScatteringTextureSize[0],
                                                                                       params_.eclipsedDoubleScatteringTextureSize[1], 1));
+                prog.setUniformValue("stackedAltitudeSlices", false);
             }
             else
             {
@@ -1887,6 +2126,8 @@ void AtmosphereRenderer::renderMultipleScattering()
                 prog.setUniformValue("eclipsedDoubleScatteringTexture", 0);
 
                 prog.setUniformValue("eclipsedDoubleScatteringTextureSize", toQVector(glm::vec3(params_.eclipsedDoubleScatteringTextureSize)));
+                prog.setUniformValue("stackedAltitudeSlices", stackedAltitudeSlices_);
+                prog.setUniformValue("altitudeSliceFraction", altitudeSlicePosition(altCoordToLoad_).fraction);
             }
             drawSurface(prog);
         }
@@ -1911,6 +2152,8 @@ void AtmosphereRenderer::renderMultipleScattering()
             tex.setMagnificationFilter(texFilter);
             tex.bind(0);
             prog.setUniformValue("scatteringTexture", 0);
+            prog.setUniformValue("stackedAltitudeSlices", stackedAltitudeSlices_);
+            prog.setUniformValue("altitudeSliceFraction", altitudeSlicePosition(altCoordToLoad_).fraction);
             drawSurface(prog);
         }
     }
@@ -1954,6 +2197,17 @@ int AtmosphereRenderer::initPreparationToDraw()
     if(state_ != State::ReadyToRender) return -1;
 
     const auto altCoord=altitudeUnitRangeTexCoord();
+    prefetchAltitudeSlices(altCoord);
+    if(altCoord != altCoordToLoad_ && stackedAltitudeSlices_ &&
+       altitudeSlicePosition(altCoord).lowerSliceIndex == altitudeSlicePosition(altCoordToLoad_).lowerSliceIndex)
+    {
+        // The loaded slices still bracket the altitude, only the interpolation fraction changes
+        altCoordToLoad_ = altCoord;
+    }
+    if(altCoord != altCoordToLoad_ && switchToCachedAltitudeInterval(altCoord))
+    {
+        altCoordToLoad_ = altCoord;
+    }
     if(altCoord != altCoordToLoad_)
     {
         [[maybe_unused]] OGLTrace t("reloading textures");
@@ -1962,8 +2216,9 @@ int AtmosphereRenderer::initPreparationToDraw()
         state_ = State::ReloadingTextures;
         currentActivity_=QObject::tr("Reloading textures due to altitude change...");
         loadingStepsDone_=0;
-        totalLoadingStepsToDo_=0;
-        reloadScatteringTextures(CountStepsOnly{true});
+        loadingTasks_.clear();
+        planScatteringTexturesReloading();
+        totalLoadingStepsToDo_=loadingTasks_.size();
     }
 
     return totalLoadingStepsToDo_;
@@ -1977,6 +2232,12 @@ auto AtmosphereRenderer::stepPreparationToDraw() -> LoadingStatus
         return {0, -1};
 
     const auto altCoord=altitudeUnitRangeTexCoord();
+    if(altCoord != altCoordToLoad_ && stackedAltitudeSlices_ &&
+       altitudeSlicePosition(altCoord).lowerSliceIndex == altitudeSlicePosition(altCoordToLoad_).lowerSliceIndex)
+    {
+        // The slices being loaded bracket the new altitude too, so there's no need to restart
+        altCoordToLoad_ = altCoord;
+    }
     if(altCoord != altCoordToLoad_)
     {
         std::cerr << "While we were reloading textures, the requested altitude changed again "
@@ -1984,13 +2245,19 @@ auto AtmosphereRenderer::stepPreparationToDraw() -> LoadingStatus
                   << "). Restarting the reloading process\n";
         finalizeLoading();
         initPreparationToDraw();
+        // The textures for the new altitude may have been found in the cache
+        if(state_ != State::ReloadingTextures)
+            return {0, 0};
     }
 
-    currentLoadingIterationStepCounter_=0;
-    reloadScatteringTextures(CountStepsOnly{false});
+    runNextLoadingTask();
 
-    if(loadingStepsDone_ == totalLoadingStepsToDo_)
+    if(loadingTasks_.empty())
+    {
+        if(stackedAltitudeSlices_)
+            loadedAltitudeInterval_ = altitudeSlicePosition(altCoordToLoad_).lowerSliceIndex;
         finalizeLoading();
+    }
 
     return {loadingStepsDone_, totalLoadingStepsToDo_};
 }
@@ -2074,6 +2341,7 @@ void AtmosphereRenderer::setupRenderTarget()
 
     gl.glGenFramebuffers(1,&eclipseSingleScatteringPrecomputationFBO_);
     eclipsedSingleScatteringPrecomputationTextures_.clear();
+    invalidateEclipsePrecomputations();
     for(const auto& scatterer : params_.scatterers)
     {
         auto& textures=eclipsedSingleScatteringPrecomputationTextures_[scatterer.name];
@@ -2096,17 +2364,13 @@ void AtmosphereRenderer::setupRenderTarget()
         }
     }
 
-    gl.glGenFramebuffers(1,&eclipseDoubleScatteringPrecomputationFBO_);
-    eclipsedDoubleScatteringPrecomputationScratchTexture_=newTex(QOpenGLTexture::Target2D);
-    eclipsedDoubleScatteringPrecomputationScratchTexture_->create();
-    eclipsedDoubleScatteringPrecomputationScratchTexture_->bind();
-    gl.glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA32F,
-                    params_.eclipseAngularIntegrationPoints, params_.radialIntegrationPoints,
-                    0,GL_RGBA,GL_UNSIGNED_BYTE,nullptr);
-    gl.glBindFramebuffer(GL_DRAW_FRAMEBUFFER, eclipseDoubleScatteringPrecomputationFBO_);
-    gl.glFramebufferTexture(GL_DRAW_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,eclipsedDoubleScatteringPrecomputationScratchTexture_->textureId(),0);
-    checkFramebufferStatus(gl, "Eclipsed double scattering precomputation FBO");
-    gl.glBindFramebuffer(GL_DRAW_FRAMEBUFFER, origFBO);
+    // The precomputers have their own render targets
+    for(auto* precomputer : {&eclipsedDoubleScatteringPrecomputer_, &eclipsedDoubleScatteringAccumulator_})
+    {
+        *precomputer = std::make_unique<EclipsedDoubleScatteringPrecomputer>(gl, params_,
+                                                                             params_.eclipsedDoubleScatteringTextureSize[0],
+                                                                             params_.eclipsedDoubleScatteringTextureSize[1], 1, 1);
+    }
 
     GLint viewport[4];
     gl.glGetIntegerv(GL_VIEWPORT, viewport);
@@ -2122,7 +2386,12 @@ AtmosphereRenderer::AtmosphereRenderer(QOpenGLFunctions_3_3_Core& gl, QString co
     , pathToData_(pathToData)
     , luminanceRenderTargetTexture_(QOpenGLTexture::Target2D)
 {
-    params_.parse(pathToData + "/params.atmo", AtmosphereParameters::ForceNoEDSTextures{false}, AtmosphereParameters::SkipSpectra{true});
+    openModel();
+    // The manifest has the parameters already parsed, as well as the list of the files we may need to load
+    if(manifest_)
+        params_.deserialize(manifest_->parameters);
+    else
+        params_.parse(pathToData + "/params.atmo", AtmosphereParameters::ForceNoEDSTextures{false}, AtmosphereParameters::SkipSpectra{true});
     resetSolarSpectrum();
 }
 
@@ -2140,8 +2409,16 @@ int AtmosphereRenderer::initDataLoading(QByteArray viewDirVertShaderSrc, QByteAr
         currentActivity_=QObject::tr("Loading textures and shaders...");
         loadingStepsDone_=0;
         totalLoadingStepsToDo_=0;
+        loadingTasks_.clear();
 
         clearResources();
+        altitudeIntervalCache_.clear();
+        loadedAltitudeInterval_ = -1;
+        // The prefetcher reads from the mapped files, so it must finish before they are unmapped
+        prefetch_.reset();
+        // The files may have been regenerated since they were mapped
+        mappedTextureFiles_.clear();
+        openModel();
 
         viewDirVertShaderSrc_=std::move(viewDirVertShaderSrc);
         viewDirFragShaderSrc_=std::move(viewDirFragShaderSrc);
@@ -2150,8 +2427,9 @@ int AtmosphereRenderer::initDataLoading(QByteArray viewDirVertShaderSrc, QByteAr
         for(const auto& scatterer : params_.scatterers)
             scatterersEnabledStates_[scatterer.name]=true;
 
-        loadShaders(CountStepsOnly{true});
-        loadTextures(CountStepsOnly{true});
+        planShadersLoading();
+        planTexturesLoading();
+        totalLoadingStepsToDo_=loadingTasks_.size();
     }
     catch(std::exception const& ex)
     {
@@ -2224,14 +2502,9 @@ auto AtmosphereRenderer::stepDataLoading() -> LoadingStatus
 
     try
     {
-        currentLoadingIterationStepCounter_=0;
+        runNextLoadingTask();
 
-        const auto stepsDoneBeforeShaders = loadingStepsDone_;
-        loadShaders(CountStepsOnly{false});
-        if(loadingStepsDone_ == stepsDoneBeforeShaders) // proceed only if previous function has nothing left to do
-            loadTextures(CountStepsOnly{false});
-
-        if(loadingStepsDone_ < totalLoadingStepsToDo_)
+        if(!loadingTasks_.empty())
             return {loadingStepsDone_, totalLoadingStepsToDo_};
 
         setupRenderTarget();
@@ -2249,6 +2522,8 @@ auto AtmosphereRenderer::stepDataLoading() -> LoadingStatus
                               .arg(multipleScatteringTextures_.size())};
     }
 
+    if(stackedAltitudeSlices_)
+        loadedAltitudeInterval_ = altitudeSlicePosition(altCoordToLoad_).lowerSliceIndex;
     finalizeLoading();
     return {loadingStepsDone_, totalLoadingStepsToDo_};
 }
@@ -2256,6 +2531,7 @@ auto AtmosphereRenderer::stepDataLoading() -> LoadingStatus
 void AtmosphereRenderer::finalizeLoading()
 {
     currentActivity_.clear();
+    loadingTasks_.clear();
     totalLoadingStepsToDo_=0;
     loadingStepsDone_=0;
     state_ = State::ReadyToRender;
@@ -2263,11 +2539,15 @@ void AtmosphereRenderer::finalizeLoading()
 
 AtmosphereRenderer::~AtmosphereRenderer()
 {
+    // Wait for the preparations in flight, since they use the members destroyed before loadingTasks_
+    loadingTasks_.clear();
     clearResources();
 }
 
 void AtmosphereRenderer::clearResources()
 {
+    eclipsedDoubleScatteringPrecomputer_.reset();
+    eclipsedDoubleScatteringAccumulator_.reset();
     if(vbo_)
     {
         gl.glDeleteBuffers(1, &vbo_);
@@ -2354,8 +2634,9 @@ int AtmosphereRenderer::initShaderReloading()
     state_ = State::ReloadingShaders;
     currentActivity_=QObject::tr("Reloading shaders...");
     loadingStepsDone_=0;
-    totalLoadingStepsToDo_=0;
-    loadShaders(CountStepsOnly{true});
+    loadingTasks_.clear();
+    planShadersLoading();
+    totalLoadingStepsToDo_=loadingTasks_.size();
 
     return totalLoadingStepsToDo_;
 }
@@ -2367,10 +2648,9 @@ auto AtmosphereRenderer::stepShaderReloading() -> LoadingStatus
     if(!totalLoadingStepsToDo_)
         return {0, -1};
 
-    currentLoadingIterationStepCounter_=0;
-    loadShaders(CountStepsOnly{false});
+    runNextLoadingTask();
 
-    if(loadingStepsDone_ == totalLoadingStepsToDo_)
+    if(loadingTasks_.empty())
         finalizeLoading();
 
     return {loadingStepsDone_, totalLoadingStepsToDo_};
@@ -21,18 +21,31 @@
 #define INCLUDE_ONCE_5DB905D2_61C0_44DB_8F35_67B31BD78315
 
 #include <cmath>
+#include <list>
 #include <array>
 #include <deque>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <future>
 #include <memory>
+#include <optional>
 #include <glm/glm.hpp>
+#include <QFile>
 #include <QObject>
 #include <QOpenGLTexture>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLFunctions_3_3_Core>
 #include "../common/types.hpp"
 #include "../common/AtmosphereParameters.hpp"
+#include "../common/ModelManifest.hpp"
 #include "api/ShowMySky/AtmosphereRenderer.hpp"
 
+class CompressedTextureReader;
+class ModelBundle;
+class EclipsedDoubleScatteringPrecomputer;
 class AtmosphereRenderer : public ShowMySky::AtmosphereRenderer
 {
     using ShaderProgPtr=std::unique_ptr<QOpenGLShaderProgram>;
@@ -42,7 +55,7 @@ class AtmosphereRenderer : public ShowMySky::AtmosphereRenderer
 public:
 
     /**
-     * This is the constructor of the renderer. It saves the reference to \p gl, \p tools for later use (so these objects must outlive AtmosphereRenderer), also saves the \p drawSurface callback. Then the model description file `params.atmo` inside the directory pointed to \p pathToData is parsed.
+     * This is the constructor of the renderer. It saves the reference to \p gl, \p tools for later use (so these objects must outlive AtmosphereRenderer), also saves the \p drawSurface callback. Then the model description file `params.atmo` is parsed, either inside the directory pointed to by \p pathToData, or from the model bundle file it points to.
      *
      * If an error occurs while parsing the model description file, ShowMySky::Error is thrown.
      *
@@ -53,7 +66,7 @@ public:
      * To create an instance of ::AtmosphereRenderer indirectly having `dlopen`ed the `ShowMySky` library, use ::ShowMySky_AtmosphereRenderer_create.
      *
      * \param gl QtOpenGL-provided OpenGL 3.3 function resolver;
-     * \param pathToData path to the data directory of the atmosphere model that contains `params.atmo`;
+     * \param pathToData path to the data directory of the atmosphere model that contains `params.atmo`, or to a model bundle file made of such a directory by `calcmysky-bundle`;
      * \param tools pointer to an implementation of the ShowMySky::Settings interface;
      * \param drawSurface a callback function that will be called each time a surface is to be rendered.
      */
@@ -90,6 +103,7 @@ public:
     Direction getViewDirection(QPoint const& pixelPos) override;
 
     void setScattererEnabled(QString const& name, bool enable) override;
+    unsigned long long skippedEclipsePrecomputations() const override { return skippedEclipsePrecomputations_; }
     int initShaderReloading() override;
     LoadingStatus stepShaderReloading() override;
     AtmosphereParameters const& atmosphereParameters() const { return params_; }
@@ -99,7 +113,25 @@ private: // variables
     std::function<void(QOpenGLShaderProgram&)> drawSurfaceCallback;
     AtmosphereParameters params_;
     QString pathToData_;
-    int totalLoadingStepsToDo_=-1, loadingStepsDone_=0, currentLoadingIterationStepCounter_=0;
+    std::unique_ptr<ModelBundle> bundle_; //!< Null if pathToData_ is a directory
+    std::optional<ModelManifest> manifest_; //!< Absent for models computed before the manifest was introduced
+    int totalLoadingStepsToDo_=-1, loadingStepsDone_=0;
+    // Loading is planned as a sequence of tasks when it's initiated, then one task is run per step
+    struct LoadingTask
+    {
+        std::function<void()> prepare; // work that doesn't need the GL context, e.g. reading and preprocessing of the data; run in a worker thread
+        std::function<void()> run;     // work in the GL context, done after prepare() has finished
+        bool preparationBarrier=false; // whether prepare() of the following tasks depends on the results of run() of this one
+        std::future<void> prepared;    // valid since prepare() has been started; destruction waits for it to finish
+    };
+    /* Threads running prepare() of the loading tasks, together with the helper threads that prepare() may start
+     * itself and the thread prefetching altitude slices. They are limited together, so that the nested parallelism
+     * doesn't oversubscribe the CPU of the host application. Declared before loadingTasks_ and prefetch_, because
+     * their destruction waits for the threads to finish.
+     */
+    const unsigned maxLoadingThreads_=std::max(1u, std::thread::hardware_concurrency());
+    std::atomic<unsigned> loadingThreadsInUse_{0};
+    std::deque<LoadingTask> loadingTasks_;
     QString currentActivity_;
 
     QByteArray viewDirVertShaderSrc_, viewDirFragShaderSrc_;
@@ -107,7 +139,6 @@ private: // variables
 
     GLuint vao_=0, vbo_=0, luminanceRadianceFBO_=0, viewDirectionFBO_=0;
     GLuint eclipseSingleScatteringPrecomputationFBO_=0;
-    GLuint eclipseDoubleScatteringPrecomputationFBO_=0;
     // Lower and upper altitude slices from the 4D texture
     std::vector<TexturePtr> eclipsedDoubleScatteringTextures_;
     std::vector<TexturePtr> multipleScatteringTextures_;
@@ -121,8 +152,11 @@ private: // variables
     // Indexed as singleScatteringTextures_[scattererName][wavelengthSetIndex]
     std::map<ScattererName,std::vector<TexturePtr>> singleScatteringTextures_;
     std::map<ScattererName,std::vector<TexturePtr>> eclipsedSingleScatteringPrecomputationTextures_;
-    TexturePtr eclipsedDoubleScatteringPrecomputationScratchTexture_;
     std::vector<TexturePtr> eclipsedDoubleScatteringPrecomputationTargetTextures_;
+    // Reused by all the precomputations to avoid reallocating their buffers and GL resources on every frame.
+    // The accumulator sums luminance over the wavelength sets, swapping roles with the precomputer on the first set.
+    std::unique_ptr<EclipsedDoubleScatteringPrecomputer> eclipsedDoubleScatteringPrecomputer_;
+    std::unique_ptr<EclipsedDoubleScatteringPrecomputer> eclipsedDoubleScatteringAccumulator_;
     QOpenGLTexture luminanceRenderTargetTexture_;
     QSize viewportSize_;
     double altCoordToLoad_=0; //!< Used to load textures for a single altitude slice, even if input altitude changes during the load
@@ -146,7 +180,71 @@ private: // variables
 
     std::vector<QVector4D> solarIrradianceFixup_;
 
+    // Quantized inputs of the eclipsed scattering precomputations. While the inputs of new frames give the
+    // same key as the one the precomputed textures were made for, the precomputation is skipped.
+    struct EclipsePrecomputationKey
+    {
+        // Altitude, Sun and Moon zenith angles, Moon azimuth relative to the Sun, Earth-Moon distance, Sun angular radius
+        std::array<long long, 6> geometry;
+        bool luminance=false; //!< Whether luminance rather than radiance is precomputed
+        bool operator==(EclipsePrecomputationKey const& other) const
+        { return geometry==other.geometry && luminance==other.luminance; }
+    };
+    // Empty if the textures must be recomputed regardless of the key, e.g. after loading or a change of solar spectrum
+    std::optional<EclipsePrecomputationKey> eclipsedSingleScatteringPrecomputedFor_;
+    std::optional<EclipsePrecomputationKey> eclipsedDoubleScatteringPrecomputedFor_;
+    unsigned long long skippedEclipsePrecomputations_=0;
+
     int numAltIntervalsIn4DTexture_;
+    // Whether the shaders of the model can interpolate between two altitude slices stacked in one texture. If they can,
+    // an altitude change within the loaded altitude interval only updates a uniform instead of reloading the textures.
+    bool stackedAltitudeSlices_=false;
+
+    struct MappedFile
+    {
+        std::unique_ptr<QFile> file; //!< Null if the file is a part of the model bundle
+        const uchar* data=nullptr;
+        qint64 size=0;
+        // Layout of the altitude slices, filled in by the texture loaders and used by the prefetcher
+        std::shared_ptr<const CompressedTextureReader> compressedReader;
+        qint64 firstSliceOffset=-1; //!< Offset of uncompressed slices in the file, -1 if unknown
+        qint64 sliceByteSize=0;
+        const ModelManifest::Artifact* manifestEntry=nullptr; //!< Null if the model has no manifest
+        std::vector<bool> verifiedSlices; //!< Altitude slices whose checksums have been checked against the manifest
+    };
+    // Texture files stay mapped while the data are loaded, so that altitude slices are read directly from the
+    // mapping on each altitude change, sharing the OS page cache with other processes rendering the same model.
+    std::map<QString, MappedFile> mappedTextureFiles_;
+
+    // Textures that depend on the altitude interval, i.e. those loaded by planScatteringTexturesReloading()
+    struct AltitudeIntervalTextures
+    {
+        std::vector<TexturePtr> eclipsedDoubleScattering;
+        std::vector<TexturePtr> multipleScattering;
+        std::map<ScattererName,std::vector<TexturePtr>> singleScattering;
+        std::map<ScattererName,std::vector<TexturePtr>> singleScatteringInterpolationGuides01;
+        std::map<ScattererName,std::vector<TexturePtr>> singleScatteringInterpolationGuides02;
+    };
+    // Textures of the recently visited altitude intervals, keyed by the index of the lower slice, most recent first
+    std::list<std::pair<int, AltitudeIntervalTextures>> altitudeIntervalCache_;
+    int loadedAltitudeInterval_=-1; //!< Lower slice index of the completely loaded textures that can be cached, or -1
+
+    // Altitude slices being read from disk in background, before the camera reaches their altitude interval
+    struct AltitudeSlicesPrefetch
+    {
+        int lowerSliceIndex;
+        // Decompressed pairs of slices from compressed texture files, keyed by file path
+        std::map<QString, std::vector<char>> decompressedSlices;
+        // Declared last, so that destruction waits for the job to finish before the data it fills are destroyed
+        std::future<void> done;
+    };
+    std::unique_ptr<AltitudeSlicesPrefetch> prefetch_;
+    double lastAltitudeCoord_=-1;
+    double altitudeCoordVelocity_=0; //!< In units of altitudeUnitRangeTexCoord() per second
+    std::chrono::steady_clock::time_point lastAltitudeChangeTime_;
+    // Guards mappedTextureFiles_ and prefetch_ against concurrent access from the texture preparation workers.
+    // Outside of the loading, while no preparation is running, the GL thread accesses them without locking.
+    std::mutex textureFilesMutex_;
 
     enum class State
     {
@@ -158,31 +256,70 @@ private: // variables
     } state_ = State::NotReady;
 
 private: // methods
-    DEFINE_EXPLICIT_BOOL(CountStepsOnly);
-    void loadTextures(CountStepsOnly countStepsOnly);
-    void reloadScatteringTextures(CountStepsOnly countStepsOnly);
+    void addLoadingTask(std::function<void()> run);
+    void addLoadingTask(std::function<void()> prepare, std::function<void()> run);
+    void startLoadingTasksPreparation();
+    void runNextLoadingTask();
+    void planTexturesLoading();
+    void planScatteringTexturesReloading();
     void setupRenderTarget();
-    void loadShaders(CountStepsOnly countStepsOnly);
+    void planShadersLoading();
     void setupBuffers();
     void clearResources();
     void finalizeLoading();
     void drawSurface(QOpenGLShaderProgram& prog);
 
     double altitudeUnitRangeTexCoord() const;
+    struct AltitudeSlicePosition
+    {
+        int lowerSliceIndex;
+        float fraction; //!< Position between the lower and upper slices, in [0,1]
+    };
+    static AltitudeSlicePosition altitudeSlicePosition(double altitudeCoord, int numAltIntervals);
+    AltitudeSlicePosition altitudeSlicePosition(double altitudeCoord) const;
+    void swapAltitudeIntervalTextures(AltitudeIntervalTextures& textures);
+    bool switchToCachedAltitudeInterval(double altitudeCoord);
+    void prefetchAltitudeSlices(double altitudeCoord);
+    bool takePrefetchedSlices(QString const& path, int lowerSliceIndex, std::vector<char>& output);
     double cameraMoonDistance() const;
     glm::dvec3 sunDirection() const;
     glm::dvec3 moonPosition() const;
     glm::dvec3 moonPositionRelativeToSunAzimuth() const;
     glm::dvec3 cameraPosition() const;
-    glm::ivec2 loadTexture2D(QString const& path);
+    MappedFile& mapTextureFile(QString const& path);
+    // Throws DataLoadError if the checksums of the slices differ from those in the manifest
+    void verifySlices(MappedFile& file, QString const& path, int firstSlice, int sliceCount);
+    void openModel();
+    QString relativeDataPath(QString const& path) const;
+    bool dataExists(QString const& path) const;
+    void addShaderDirectory(QOpenGLShaderProgram& program, QString const& dir);
+    // Texture data read from the file and preprocessed in a worker thread, ready to be uploaded in the GL thread
+    struct PreparedTexture
+    {
+        GLenum target=GL_TEXTURE_2D;
+        GLint internalFormat=0;
+        GLenum format=0, type=0;
+        GLsizei width=0, height=0, depth=1;
+        std::vector<char> buffer;   //!< Holds the pixels, unless they are used directly from the mapped file
+        const void* pixels=nullptr; //!< Points into buffer or into the mapped file
+        int numAltIntervals=-1;     //!< Number of altitude intervals in the 4D texture file, -1 for other textures
+    };
+    PreparedTexture prepareTexture2D(QString const& path);
     enum class Texture4DType
     {
         ScatteringTexture,
         InterpolationGuides,
     };
-    void loadTexture4D(QString const& path, float altitudeCoord, Texture4DType texType = Texture4DType::ScatteringTexture);
-    void loadEclipsedDoubleScatteringTexture(QString const& path, float altitudeCoord);
+    PreparedTexture prepareTexture4D(QString const& path, float altitudeCoord, Texture4DType texType = Texture4DType::ScatteringTexture);
+    PreparedTexture prepareEclipsedDoubleScatteringTexture(QString const& path, float altitudeCoord);
+    void uploadTexture(PreparedTexture const& texture, QString const& path);
+    void addTextureLoadingTask(std::function<PreparedTexture()> prepare, std::function<void(PreparedTexture const&)> upload);
+    // Takes up to maxCount of the loading threads not in use, returns the number taken. They must be returned by
+    // subtracting this number from loadingThreadsInUse_.
+    unsigned takeFreeLoadingThreads(unsigned maxCount);
 
+    EclipsePrecomputationKey eclipsePrecomputationKey(bool luminance) const;
+    void invalidateEclipsePrecomputations();
     void precomputeEclipsedSingleScattering();
     void precomputeEclipsedDoubleScattering();
     void renderZeroOrderScattering();
@@ -298,6 +298,14 @@ public:
      * \param enable whether first-order inscattered light from this species should be rendered.
      */
     virtual void setScattererEnabled(QString const& name, bool enable) = 0;
+    /**
+     * \brief Get the number of skipped eclipse precomputations.
+     *
+     * When rendering a solar eclipse, the renderer precomputes eclipsed single and double scattering for the current positions of the observer, the Sun and the Moon. If these positions haven't changed since the previous frame, e.g. when only the view direction or field of view has changed, the precomputed data are reused. This is a diagnostic method that tells how effective this reuse is.
+     *
+     * \return Number of precomputation passes skipped since the renderer was created. Single and double scattering passes are counted separately.
+     */
+    virtual unsigned long long skippedEclipsePrecomputations() const = 0;
 };
 
 }
@@ -323,7 +331,7 @@ SHOWMYSKY_DLL_PUBLIC ShowMySky::AtmosphereRenderer*
  *
  * If the value of the symbol doesn't match the value of this constant, the library loaded is incompatible with the header against which the binary was compiled. Mixing incompatible header and library leads to undefined behavior.
  */
-#define ShowMySky_ABI_version 15
+#define ShowMySky_ABI_version 17
 
 /**
  * \brief Name of library to be dlopen()-ed
@@ -134,6 +134,17 @@ public:
      */
     virtual bool textureFilteringEnabled() { return true; }
 
+    /**
+     * \brief Number of altitude intervals whose textures are kept in video memory.
+     *
+     * When the camera crosses the boundary between altitude slices of the model's textures, the textures for the interval being left are kept in video memory, so that coming back to this interval doesn't require loading them again. Each cached interval takes as much video memory as the scattering textures currently in use. Zero disables the caching.
+     *
+     * This option only has effect for models whose shaders interpolate between altitude slices on the GPU.
+     *
+     * \returns Maximum number of cached altitude intervals.
+     */
+    virtual unsigned altitudeIntervalCacheSize() { return 4; }
+
     /**
      * \brief Whether to use shader designed to render eclipse atmosphere.
      *
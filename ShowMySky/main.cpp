@@ -31,6 +31,7 @@
 #include "config.h"
 #include "../common/util.hpp"
 #include "../common/AtmosphereParameters.hpp"
+#include "../common/ModelBundle.hpp"
 #include "GLWidget.hpp"
 #include "MainWindow.hpp"
 #include "ToolsWidget.hpp"
@@ -44,7 +45,7 @@ bool frameless=false;
 void handleCmdLine()
 {
     QCommandLineParser parser;
-    parser.addPositionalArgument("path to data", "Path to atmosphere textures");
+    parser.addPositionalArgument("path to data", "Path to atmosphere model: directory or bundle file");
     parser.addVersionOption();
     parser.addHelpOption();
     QCommandLineOption winSizeOpt("win-size", "Window size", "WIDTHxHEIGHT");
@@ -87,13 +88,22 @@ void handleCmdLine()
     {
         while(true)
         {
-            const auto path = QFileDialog::getExistingDirectory(nullptr, QObject::tr("Open atmosphere model"));
-            if(path.isEmpty()) std::exit(0);
+            // A model is either a directory with the description file, selected by that file, or a bundle
             static constexpr char descriptionFileName[] = "params.atmo";
-            if(!QFileInfo(path+"/"+descriptionFileName).exists())
+            const auto path = QFileDialog::getOpenFileName(nullptr, QObject::tr("Open atmosphere model"), {},
+                                                           QObject::tr("Atmosphere models (%1 *.bundle);;All files (*)")
+                                                                .arg(descriptionFileName));
+            if(path.isEmpty()) std::exit(0);
+            const QFileInfo fileInfo(path);
+            if(fileInfo.fileName() == descriptionFileName)
+            {
+                pathToData = fileInfo.absolutePath();
+                break;
+            }
+            if(!isModelBundle(path))
             {
                 QMessageBox::critical(nullptr, QObject::tr("Invalid input path"),
-                                      QObject::tr("The directory doesn't contain atmosphere description file \"%1\".")
+                                      QObject::tr("The file is neither an atmosphere description file \"%1\" nor a model bundle.")
                                                 .arg(descriptionFileName));
                 continue;
             }
@@ -20,6 +20,7 @@
 #include "AtmosphereParameters.hpp"
 #include <optional>
 #include <QDebug>
+#include <QDataStream>
 #include <QRegularExpression>
 #include "Spectrum.hpp"
 #include "const.hpp"
@@ -330,6 +331,27 @@ std::vector<glm::vec4> getWavelengthRange(QString const& line, const GLfloat min
     return values;
 }
 
+void writeSpectrum(QDataStream& out, std::vector<glm::vec4> const& spectrum)
+{
+    out << quint32(spectrum.size());
+    for(const auto& v : spectrum)
+        out << v.x << v.y << v.z << v.w;
+}
+
+void readSpectrum(QDataStream& in, std::vector<glm::vec4>& spectrum)
+{
+    quint32 size=0;
+    in >> size;
+    // Don't trust the size before having read the data: it may be garbage
+    spectrum.clear();
+    for(quint32 n=0; n<size && in.status()==QDataStream::Ok; ++n)
+    {
+        glm::vec4 v;
+        in >> v.x >> v.y >> v.z >> v.w;
+        spectrum.push_back(v);
+    }
+}
+
 AtmosphereParameters::Scatterer parseScatterer(AtmosphereParameters const& atmo, const AtmosphereParameters::SkipSpectra skipSpectrum,
                                                QTextStream& stream, QString const& name, const bool forceGeneralPhaseFunction,
                                                QString const& filename, int& lineNumber)
@@ -655,6 +677,120 @@ void AtmosphereParameters::parse(QString const& atmoDescrFileName, const ForceNo
     }
 }
 
+QByteArray AtmosphereParameters::serialize() const
+{
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_6);
+
+    out << quint32(FORMAT_VERSION);
+    writeSpectrum(out, allWavelengths);
+    writeSpectrum(out, solarIrradianceAtTOA);
+    writeSpectrum(out, lightPollutionRelativeRadiance);
+    out << qint32(transmittanceTexW) << qint32(transmittanceTexH);
+    out << qint32(irradianceTexW) << qint32(irradianceTexH);
+    for(int i=0; i<4; ++i) out << qint32(scatteringTextureSize[i]);
+    for(int i=0; i<2; ++i) out << qint32(eclipsedSingleScatteringTextureSize[i]);
+    for(int i=0; i<4; ++i) out << qint32(eclipsedDoubleScatteringTextureSize[i]);
+    for(int i=0; i<2; ++i) out << qint32(lightPollutionTextureSize[i]);
+    out << quint32(eclipsedDoubleScatteringNumberOfAzimuthPairsToSample)
+        << quint32(eclipsedDoubleScatteringNumberOfElevationPairsToSample)
+        << quint32(scatteringOrdersToCompute);
+    out << qint32(numTransmittanceIntegrationPoints) << qint32(radialIntegrationPoints)
+        << qint32(angularIntegrationPoints) << qint32(eclipseAngularIntegrationPoints)
+        << qint32(lightPollutionAngularIntegrationPoints);
+    out << earthRadius << atmosphereHeight << earthSunDistance << earthMoonDistance
+        << sunAngularRadius << lengthOfHorizRayFromGroundToBorderOfAtmo;
+    writeSpectrum(out, groundAlbedo);
+
+    out << quint32(scatterers.size());
+    for(const auto& scatterer : scatterers)
+    {
+        out << scatterer.name << scatterer.scatteringCrossSectionAt1um << scatterer.angstromExponent;
+        writeSpectrum(out, scatterer.singleScatteringAlbedo);
+        writeSpectrum(out, scatterer.extinctionCrossSection_);
+        writeSpectrum(out, scatterer.scatteringCrossSection_);
+        out << scatterer.numberDensity << scatterer.phaseFunction
+            << qint32(scatterer.phaseFunctionType) << scatterer.needsInterpolationGuides;
+    }
+    out << quint32(absorbers.size());
+    for(const auto& absorber : absorbers)
+    {
+        out << absorber.name << absorber.numberDensity;
+        writeSpectrum(out, absorber.absorptionCrossSection);
+    }
+    out << allTexturesAreRadiance << noEclipsedDoubleScatteringTextures;
+
+    return data;
+}
+
+void AtmosphereParameters::deserialize(QByteArray const& data)
+{
+    QDataStream in(data);
+    in.setVersion(QDataStream::Qt_5_6);
+
+    quint32 version=0;
+    in >> version;
+    if(version != FORMAT_VERSION)
+    {
+        throw DataLoadError{QObject::tr("Unsupported format version of serialized atmosphere parameters: %1, supported is %2")
+                            .arg(version).arg(FORMAT_VERSION)};
+    }
+    const auto readInt=[&in]{ qint32 x=0; in >> x; return x; };
+    const auto readUInt=[&in]{ quint32 x=0; in >> x; return x; };
+
+    readSpectrum(in, allWavelengths);
+    readSpectrum(in, solarIrradianceAtTOA);
+    readSpectrum(in, lightPollutionRelativeRadiance);
+    transmittanceTexW=readInt(); transmittanceTexH=readInt();
+    irradianceTexW=readInt(); irradianceTexH=readInt();
+    for(int i=0; i<4; ++i) scatteringTextureSize[i]=readInt();
+    for(int i=0; i<2; ++i) eclipsedSingleScatteringTextureSize[i]=readInt();
+    for(int i=0; i<4; ++i) eclipsedDoubleScatteringTextureSize[i]=readInt();
+    for(int i=0; i<2; ++i) lightPollutionTextureSize[i]=readInt();
+    eclipsedDoubleScatteringNumberOfAzimuthPairsToSample=readUInt();
+    eclipsedDoubleScatteringNumberOfElevationPairsToSample=readUInt();
+    scatteringOrdersToCompute=readUInt();
+    numTransmittanceIntegrationPoints=readInt();
+    radialIntegrationPoints=readInt();
+    angularIntegrationPoints=readInt();
+    eclipseAngularIntegrationPoints=readInt();
+    lightPollutionAngularIntegrationPoints=readInt();
+    in >> earthRadius >> atmosphereHeight >> earthSunDistance >> earthMoonDistance
+       >> sunAngularRadius >> lengthOfHorizRayFromGroundToBorderOfAtmo;
+    readSpectrum(in, groundAlbedo);
+
+    scatterers.clear();
+    for(quint32 n=readUInt(); n>0 && in.status()==QDataStream::Ok; --n)
+    {
+        QString name;
+        in >> name;
+        auto& scatterer=scatterers.emplace_back(name, *this);
+        in >> scatterer.scatteringCrossSectionAt1um >> scatterer.angstromExponent;
+        readSpectrum(in, scatterer.singleScatteringAlbedo);
+        readSpectrum(in, scatterer.extinctionCrossSection_);
+        readSpectrum(in, scatterer.scatteringCrossSection_);
+        in >> scatterer.numberDensity >> scatterer.phaseFunction;
+        scatterer.phaseFunctionType=PhaseFunctionType(readInt());
+        in >> scatterer.needsInterpolationGuides;
+    }
+    absorbers.clear();
+    for(quint32 n=readUInt(); n>0 && in.status()==QDataStream::Ok; --n)
+    {
+        QString name;
+        in >> name;
+        auto& absorber=absorbers.emplace_back(name, *this);
+        in >> absorber.numberDensity;
+        readSpectrum(in, absorber.absorptionCrossSection);
+    }
+    in >> allTexturesAreRadiance >> noEclipsedDoubleScatteringTextures;
+
+    if(in.status()!=QDataStream::Ok)
+        throw DataLoadError{QObject::tr("Serialized atmosphere parameters are truncated or corrupt")};
+    if(allWavelengths.empty() || solarIrradianceAtTOA.size()!=allWavelengths.size())
+        throw DataLoadError{QObject::tr("Serialized atmosphere parameters lack wavelengths or solar irradiance")};
+}
+
 QString AtmosphereParameters::spectrumToString(std::vector<glm::vec4> const& spectrum)
 {
     QString out;
@@ -138,6 +138,11 @@ struct AtmosphereParameters
     void parse(QString const& atmoDescrFileName,
                ForceNoEDSTextures forceNoEDSTextures=ForceNoEDSTextures{false},
                SkipSpectra skipSpectra=SkipSpectra{false});
+    // Binary form of the parsed parameters, stored in the model manifest so that the renderer doesn't need
+    // to parse the description. The text of the description file is not included.
+    QByteArray serialize() const;
+    // Throws DataLoadError if the data are malformed
+    void deserialize(QByteArray const& data);
     // XXX: keep in sync with those in previewer and renderer
     auto scatTexWidth()  const { return GLsizei(scatteringTextureSize[0]); }
     auto scatTexHeight() const { return GLsizei(scatteringTextureSize[1]*scatteringTextureSize[2]); }
@@ -0,0 +1,225 @@
+/*
+ * CalcMySky - a simulator of light scattering in planetary atmospheres
+ * Copyright © 2025 Ruslan Kabatsayev
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335, USA.
+ */
+
+#include "CompressedTexture.hpp"
+#include <array>
+#include <cstring>
+#include <QIODevice>
+#include "util.hpp"
+
+uint32_t crc32(const char*const data, const size_t size, const uint32_t previousCRC)
+{
+    static const auto table=[]
+    {
+        std::array<uint32_t,256> table;
+        for(uint32_t n=0; n<table.size(); ++n)
+        {
+            uint32_t c=n;
+            for(int k=0; k<8; ++k)
+                c = c&1 ? 0xedb88320u^(c>>1) : c>>1;
+            table[n]=c;
+        }
+        return table;
+    }();
+
+    uint32_t crc=previousCRC^0xffffffffu;
+    for(size_t i=0; i<size; ++i)
+        crc = table[(crc^uint8_t(data[i])) & 0xff] ^ (crc>>8);
+    return crc^0xffffffffu;
+}
+
+namespace
+{
+
+// Groups the bytes of all the elements by significance: first go all bytes #0, then all bytes #1 etc.
+void shuffleBytes(const char*const input, char*const output, const size_t size, const unsigned elementSize)
+{
+    const size_t elementCount=size/elementSize;
+    for(size_t i=0; i<elementCount; ++i)
+        for(unsigned b=0; b<elementSize; ++b)
+            output[b*elementCount+i]=input[i*elementSize+b];
+}
+
+void unshuffleBytes(const char*const input, char*const output, const size_t size, const unsigned elementSize)
+{
+    const size_t elementCount=size/elementSize;
+    for(unsigned b=0; b<elementSize; ++b)
+        for(size_t i=0; i<elementCount; ++i)
+            output[i*elementSize+b]=input[b*elementCount+i];
+}
+
+}
+
+bool isCompressedTexture(QIODevice& file)
+{
+    return file.peek(sizeof compressedTextureMagic) == QByteArray::fromRawData(compressedTextureMagic, sizeof compressedTextureMagic);
+}
+
+bool isCompressedTexture(const uchar*const data, const qint64 size)
+{
+    return size >= qint64(sizeof compressedTextureMagic) &&
+           std::memcmp(data, compressedTextureMagic, sizeof compressedTextureMagic) == 0;
+}
+
+QString writeCompressedTexture(QIODevice& out, const void*const data, std::vector<int> const& sizes,
+                               const unsigned pixelSize, const unsigned elementSize, const uint16_t flags)
+{
+    if(sizes.empty() || !elementSize || pixelSize%elementSize)
+        return QObject::tr("bad texture layout for compression");
+
+    size_t sliceByteSize=pixelSize;
+    for(size_t i=0; i+1<sizes.size(); ++i)
+        sliceByteSize *= sizes[i];
+    const int sliceCount=sizes.back();
+
+    QByteArray header(compressedTextureMagic, sizeof compressedTextureMagic);
+    const auto append=[&header](const auto value)
+    {
+        header.append(reinterpret_cast<const char*>(&value), sizeof value);
+    };
+    append(uint16_t(sizes.size()));
+    for(const auto size : sizes)
+        append(uint16_t(size));
+    append(uint16_t(pixelSize));
+    append(uint16_t(elementSize));
+    append(flags);
+
+    std::vector<QByteArray> slices;
+    slices.reserve(sliceCount);
+    std::vector<char> shuffled(flags & COMPRESSED_TEX_BYTE_SHUFFLE ? sliceByteSize : 0);
+    for(int n=0; n<sliceCount; ++n)
+    {
+        const char* slice=static_cast<const char*>(data)+n*sliceByteSize;
+        if(flags & COMPRESSED_TEX_BYTE_SHUFFLE)
+        {
+            shuffleBytes(slice, shuffled.data(), sliceByteSize, elementSize);
+            slice=shuffled.data();
+        }
+        slices.emplace_back(qCompress(reinterpret_cast<const uchar*>(slice), int(sliceByteSize)));
+        if(slices.back().isEmpty())
+            return QObject::tr("failed to compress slice %1").arg(n);
+    }
+
+    const auto indexEntrySize = sizeof(uint64_t) + 2*sizeof(uint32_t);
+    uint64_t offset = header.size() + sliceCount*indexEntrySize;
+    for(const auto& slice : slices)
+    {
+        append(offset);
+        append(uint32_t(slice.size()));
+        append(crc32(slice.constData(), slice.size()));
+        offset += slice.size();
+    }
+
+    if(out.write(header) != header.size())
+        return out.errorString();
+    for(const auto& slice : slices)
+    {
+        if(out.write(slice) != slice.size())
+            return out.errorString();
+    }
+    return {};
+}
+
+CompressedTextureReader::CompressedTextureReader(const uchar*const data, const qint64 size, QString const& fileName)
+    : data(data)
+    , fileName(fileName)
+{
+    qint64 pos=0;
+    const auto read=[&](void*const dest, const qint64 sizeToRead)
+    {
+        if(pos+sizeToRead > size)
+        {
+            throw DataLoadError{QObject::tr("Failed to read header of compressed texture file \"%1\": unexpected end of file")
+                                .arg(fileName)};
+        }
+        std::memcpy(dest, data+pos, sizeToRead);
+        pos += sizeToRead;
+    };
+    const auto badHeader=[&fileName](QString const& what)
+    {
+        return DataLoadError{QObject::tr("Bad header of compressed texture file \"%1\": %2").arg(fileName).arg(what)};
+    };
+
+    char magic[sizeof compressedTextureMagic];
+    read(magic, sizeof magic);
+    if(std::memcmp(magic, compressedTextureMagic, sizeof magic) != 0)
+        throw badHeader(QObject::tr("wrong signature"));
+
+    uint16_t dimensionCount;
+    read(&dimensionCount, sizeof dimensionCount);
+    if(!dimensionCount)
+        throw badHeader(QObject::tr("zero dimensions"));
+    for(unsigned n=0; n<dimensionCount; ++n)
+    {
+        uint16_t dimSize;
+        read(&dimSize, sizeof dimSize);
+        sizes_.push_back(dimSize);
+    }
+
+    uint16_t pixelSize, elementSize;
+    read(&pixelSize, sizeof pixelSize);
+    read(&elementSize, sizeof elementSize);
+    read(&flags, sizeof flags);
+    if(!elementSize || pixelSize%elementSize)
+        throw badHeader(QObject::tr("pixel size %1 is not a multiple of element size %2").arg(pixelSize).arg(elementSize));
+    if(flags & ~COMPRESSED_TEX_BYTE_SHUFFLE)
+        throw badHeader(QObject::tr("unsupported flags 0x%1").arg(flags, 0, 16));
+    pixelSize_=pixelSize;
+    this->elementSize=elementSize;
+
+    sliceByteSize_=pixelSize;
+    for(size_t i=0; i+1<sizes_.size(); ++i)
+        sliceByteSize_ *= sizes_[i];
+
+    index.resize(sizes_.back());
+    for(auto& entry : index)
+    {
+        read(&entry.offset, sizeof entry.offset);
+        read(&entry.compressedSize, sizeof entry.compressedSize);
+        read(&entry.crc32, sizeof entry.crc32);
+        if(entry.offset+entry.compressedSize > uint64_t(size))
+            throw badHeader(QObject::tr("slice index points beyond the end of file"));
+    }
+}
+
+void CompressedTextureReader::readSlice(const size_t sliceIndex, char*const output) const
+{
+    if(sliceIndex >= index.size())
+    {
+        throw DataLoadError{QObject::tr("Slice %1 requested from file \"%2\", which only has %3 slices")
+                            .arg(sliceIndex).arg(fileName).arg(index.size())};
+    }
+    const auto& entry=index[sliceIndex];
+    const auto compressed=reinterpret_cast<const char*>(data+entry.offset);
+    if(crc32(compressed, entry.compressedSize) != entry.crc32)
+    {
+        throw DataLoadError{QObject::tr("Checksum mismatch in slice %1 of file \"%2\", the file is corrupt")
+                            .arg(sliceIndex).arg(fileName)};
+    }
+    const auto uncompressed=qUncompress(data+entry.offset, entry.compressedSize);
+    if(size_t(uncompressed.size()) != sliceByteSize_)
+    {
+        throw DataLoadError{QObject::tr("Failed to decompress slice %1 of file \"%2\"")
+                            .arg(sliceIndex).arg(fileName)};
+    }
+    if(flags & COMPRESSED_TEX_BYTE_SHUFFLE)
+        unshuffleBytes(uncompressed.constData(), output, sliceByteSize_, elementSize);
+    else
+        std::memcpy(output, uncompressed.constData(), sliceByteSize_);
+}
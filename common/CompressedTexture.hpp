@@ -0,0 +1,102 @@
+/*
+ * CalcMySky - a simulator of light scattering in planetary atmospheres
+ * Copyright © 2025 Ruslan Kabatsayev
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335, USA.
+ */
+
+#ifndef INCLUDE_ONCE_EF4066D4_60D3_40E7_82B4_AB327D41F3AF
+#define INCLUDE_ONCE_EF4066D4_60D3_40E7_82B4_AB327D41F3AF
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <QString>
+
+class QIODevice;
+
+/* Container for textures whose slices along the last dimension (e.g. altitude slices of the 4D scattering
+ * textures) are compressed independently of each other. This lets a reader get the few slices it needs
+ * without reading and decompressing the whole file.
+ *
+ * File layout (native byte order, as in the uncompressed texture files):
+ *   char      magic[8]                 see compressedTextureMagic
+ *   uint16_t  dimensionCount
+ *   uint16_t  sizes[dimensionCount]
+ *   uint16_t  pixelSize                in bytes
+ *   uint16_t  elementSize              size of a pixel component in bytes, the unit of byte shuffling
+ *   uint16_t  flags                    see CompressedTextureFlags
+ *   struct
+ *   {
+ *       uint64_t  offset               from the beginning of the file
+ *       uint32_t  compressedSize
+ *       uint32_t  crc32                of the compressed data
+ *   } index[sizes[dimensionCount-1]]
+ *   compressed slices (zlib)
+ */
+
+constexpr char compressedTextureMagic[8]={'C','M','S','k','y','T','Z','1'};
+
+enum CompressedTextureFlags : uint16_t
+{
+    // Bytes of each element are grouped by significance before compression, which makes
+    // floating-point data much more compressible, especially with reduced precision.
+    COMPRESSED_TEX_BYTE_SHUFFLE = 1<<0,
+};
+
+// CRC-32 as in zlib, used for the slices of the compressed textures and in the model manifest.
+// Passing the CRC of preceding data as previousCRC gives the CRC of the concatenation.
+uint32_t crc32(const char* data, size_t size, uint32_t previousCRC=0);
+// Checks the magic at the beginning of the file. Doesn't change current position in the file.
+bool isCompressedTexture(QIODevice& file);
+// Checks the magic at the beginning of file contents, e.g. as mapped into memory
+bool isCompressedTexture(const uchar* data, qint64 size);
+// Returns empty string on success, error message otherwise
+QString writeCompressedTexture(QIODevice& out, const void* data, std::vector<int> const& sizes,
+                               unsigned pixelSize, unsigned elementSize,
+                               uint16_t flags=COMPRESSED_TEX_BYTE_SHUFFLE);
+
+class CompressedTextureReader
+{
+    struct SliceIndexEntry
+    {
+        uint64_t offset;
+        uint32_t compressedSize;
+        uint32_t crc32;
+    };
+
+    const uchar* data;
+    QString fileName;
+    std::vector<int> sizes_;
+    std::vector<SliceIndexEntry> index;
+    size_t sliceByteSize_;
+    unsigned pixelSize_;
+    unsigned elementSize;
+    uint16_t flags;
+
+public:
+    // Parses the header and the index of the file contents, which are typically mapped into memory, and must
+    // stay valid during the lifetime of the reader. Throws DataLoadError on failure.
+    CompressedTextureReader(const uchar* data, qint64 size, QString const& fileName);
+    std::vector<int> const& sizes() const { return sizes_; }
+    unsigned pixelSize() const { return pixelSize_; }
+    size_t sliceCount() const { return index.size(); }
+    size_t sliceByteSize() const { return sliceByteSize_; }
+    // Decompresses slice number sliceIndex into output, which must have room for sliceByteSize() bytes.
+    // Throws DataLoadError on failure, including checksum mismatch.
+    void readSlice(size_t sliceIndex, char* output) const;
+};
+
+#endif
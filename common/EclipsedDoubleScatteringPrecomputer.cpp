@@ -21,6 +21,7 @@
 
 #include <iostream>
 #include <chrono>
+#include <algorithm>
 
 #include <glm/gtx/transform.hpp>
 
@@ -42,14 +43,6 @@ using std::asin;
 using std::exp;
 using std::log;
 
-static glm::vec4 sumTexels(TextureAverageComputer& averager, const GLuint textureToRead,
-                           const float texW, const float texH, const GLuint unusedTextureUnitNum)
-{
-    const auto average = averager.getTextureAverage(textureToRead, unusedTextureUnitNum);
-    // We need the sum instead of the average
-    return texW*texH * average;
-}
-
 float EclipsedDoubleScatteringPrecomputer::cosZenithAngleOfHorizon(const float altitude) const
 {
     const float R=atmo.earthRadius;
@@ -64,7 +57,7 @@ void EclipsedDoubleScatteringPrecomputer::generateElevationsForEclipsedDoubleSca
     const auto elevationOfHorizon = M_PI/2-trueHorizonToZenith;
     constexpr auto mathHorizonToZenith = M_PI/2;
     constexpr auto mathHorizonToNadir  = M_PI/2;
-    std::vector<float> baseElevations;
+    baseElevations.clear();
     const auto kMax = atmo.eclipsedDoubleScatteringNumberOfElevationPairsToSample;
     for(unsigned k=0; k<kMax; ++k)
     {
@@ -141,25 +134,25 @@ EclipsedDoubleScatteringPrecomputer::EclipsedDoubleScatteringPrecomputer(
           AtmosphereParameters const& atmo,
           const unsigned texSizeByViewAzimuth, const unsigned texSizeByViewElevation,
           const unsigned texSizeBySZA, const unsigned texSizeByAltitude)
-    : gl(gl)
-    , atmo(atmo)
+    : EclipsedDoubleScatteringPrecomputer(atmo, texSizeByViewAzimuth, texSizeByViewElevation, texSizeBySZA, texSizeByAltitude)
+{
+    this->gl=&gl;
+}
+
+EclipsedDoubleScatteringPrecomputer::EclipsedDoubleScatteringPrecomputer(
+          AtmosphereParameters const& atmo,
+          const unsigned texSizeByViewAzimuth, const unsigned texSizeByViewElevation,
+          const unsigned texSizeBySZA, const unsigned texSizeByAltitude)
+    : atmo(atmo)
     , texSizeByViewAzimuth(texSizeByViewAzimuth)
     , texSizeByViewElevation(texSizeByViewElevation)
     , texSizeBySZA(texSizeBySZA)
     , texW(atmo.eclipseAngularIntegrationPoints)
     , texH(atmo.radialIntegrationPoints)
     , texture_(texSizeByViewAzimuth*texSizeByViewElevation*texSizeBySZA*texSizeByAltitude)
-    , fourierIntermediate(texSizeByViewAzimuth)
 {
-    // XXX: keep in sync with its use in GLSL computeDoubleScatteringEclipsedDensitySample() and C++ initTexturesAndFramebuffers()
-
-    GLint viewport[4];
-    gl.glGetIntegerv(GL_VIEWPORT, viewport);
-    origViewportWidth=viewport[2];
-    origViewportHeight=viewport[3];
-    gl.glViewport(0,0, texW,texH);
-
     const auto nAzimuthPairsToSample=atmo.eclipsedDoubleScatteringNumberOfAzimuthPairsToSample;
+    azimuthInterpolator=std::make_unique<FourierInterpolator>(2*nAzimuthPairsToSample, texSizeByViewAzimuth);
     const auto nElevationPairsToSample=atmo.eclipsedDoubleScatteringNumberOfElevationPairsToSample;
     for(auto& s : samplesAboveHorizon)
         s.resize(2*nElevationPairsToSample*nAzimuthPairsToSample);
@@ -168,21 +161,58 @@ EclipsedDoubleScatteringPrecomputer::EclipsedDoubleScatteringPrecomputer(
 
     for(auto& r : radianceInterpolatedOverElevations)
         r.resize(texSizeByViewElevation*2*nAzimuthPairsToSample);
+    for(auto& r : radianceInterpolatedOverAzimuths)
+        r.resize(texSizeByViewElevation*texSizeByViewAzimuth);
+
+    const auto azimuthStep=M_PI/nAzimuthPairsToSample;
+    for(unsigned i=0; i<nAzimuthPairsToSample; ++i)
+        azimuths.push_back(i*azimuthStep);
 }
 
 EclipsedDoubleScatteringPrecomputer::~EclipsedDoubleScatteringPrecomputer()
 {
-    gl.glViewport(0,0, origViewportWidth,origViewportHeight);
+    if(!gl) return;
+    gl->glDeleteFramebuffers(1, &batchFBO);
+    gl->glDeleteTextures(1, &batchTexture);
 }
 
-void EclipsedDoubleScatteringPrecomputer::computeRadianceOnCoarseGrid(QOpenGLShaderProgram& program,
-                                                                      const GLuint intermediateTextureName,
-                                                                      const GLuint intermediateTextureTexUnitNum,
-                                                                      const double cameraAltitude, const double sunZenithAngle,
-                                                                      const double moonZenithAngle, const double moonAzimuthRelativeToSun,
-                                                                      const double earthMoonDistance)
+// Clobbers: GL_TEXTURE_BINDING_2D_ARRAY
+void EclipsedDoubleScatteringPrecomputer::initBatchTarget(const unsigned directionCount, const GLuint unusedTextureUnitNum)
 {
-    const auto nAzimuthPairsToSample=atmo.eclipsedDoubleScatteringNumberOfAzimuthPairsToSample;
+    // The integrands for all the directions would take too much memory with fine integration grids, so they may
+    // have to be computed in several batches. This budget still lets typical models do with a single one.
+    constexpr size_t maxBatchBytes = 256 << 20;
+    GLint maxLayers=-1;
+    gl->glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    const auto layerBytes = size_t(texW*texH*sizeof(glm::vec4));
+    batchSize = std::clamp<size_t>(maxBatchBytes/layerBytes, 1, std::min<size_t>(directionCount, maxLayers));
+
+    gl->glGenTextures(1, &batchTexture);
+    gl->glActiveTexture(GL_TEXTURE0 + unusedTextureUnitNum);
+    gl->glBindTexture(GL_TEXTURE_2D_ARRAY, batchTexture);
+    gl->glTexImage3D(GL_TEXTURE_2D_ARRAY,0,GL_RGBA32F,texW,texH,batchSize,0,GL_RGBA,GL_UNSIGNED_BYTE,nullptr);
+    gl->glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    GLint origFBO=-1;
+    gl->glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &origFBO);
+    gl->glGenFramebuffers(1, &batchFBO);
+    gl->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, batchFBO);
+    gl->glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, batchTexture, 0, 0);
+    [[maybe_unused]] const auto status=gl->glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
+    assert(status==GL_FRAMEBUFFER_COMPLETE);
+    gl->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, origFBO);
+
+    averager=std::make_unique<TextureAverageComputer>(*gl, texW, texH);
+    batchSums.reserve(batchSize);
+}
+
+void EclipsedDoubleScatteringPrecomputer::startComputingRadianceOnCoarseGrid(QOpenGLShaderProgram& program,
+                                                                             const GLuint intermediateTextureTexUnitNum,
+                                                                             const double cameraAltitude, const double sunZenithAngle,
+                                                                             const double moonZenithAngle, const double moonAzimuthRelativeToSun,
+                                                                             const double earthMoonDistance)
+{
+    assert(gl);
 
     const dvec3 sunDir(sin(sunZenithAngle), 0, cos(sunZenithAngle));
     const dvec3 moonDir = dmat3(rotate(moonAzimuthRelativeToSun,dvec3(0,0,1)))*dvec3(sin(moonZenithAngle), 0, cos(moonZenithAngle));
@@ -206,42 +236,96 @@ void EclipsedDoubleScatteringPrecomputer::computeRadianceOnCoarseGrid(QOpenGLSha
     // use spline interpolation to compute the value at the zenith.
     generateElevationsForEclipsedDoubleScattering(cameraAltitude);
 
-    const auto azimuths=[nAzimuthPairsToSample]
-    {
-        const auto step=M_PI/nAzimuthPairsToSample;
-        std::vector<float> azimuths;
-        for(unsigned i=0; i<nAzimuthPairsToSample; ++i)
-            azimuths.push_back(i*step);
-        return azimuths;
-    }();
     assert(elevationsAboveHorizon.size()==2*atmo.eclipsedDoubleScatteringNumberOfElevationPairsToSample);
     assert(elevationsBelowHorizon.size()==2*atmo.eclipsedDoubleScatteringNumberOfElevationPairsToSample);
-    assert(azimuths.size()==nAzimuthPairsToSample);
+    assert(azimuths.size()==atmo.eclipsedDoubleScatteringNumberOfAzimuthPairsToSample);
 
-    TextureAverageComputer averager(gl, texW, texH, GL_RGBA32F, intermediateTextureTexUnitNum);
+    const auto directionCount=coarseGridDirectionCount();
+    if(!batchFBO)
+        initBatchTarget(directionCount, intermediateTextureTexUnitNum);
 
-    const auto elevCount=elevationsAboveHorizon.size(); // for each direction: above and below horizon
-    for(unsigned azimIndex=0; azimIndex<azimuths.size(); ++azimIndex)
+    GLint origFBO=-1;
+    gl->glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &origFBO);
+    gl->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, batchFBO);
+    // XXX: keep in sync with its use in GLSL computeDoubleScatteringEclipsedDensitySample()
+    GLint origViewport[4];
+    gl->glGetIntegerv(GL_VIEWPORT, origViewport);
+    gl->glViewport(0,0, texW,texH);
+
+    for(unsigned firstDirection=0; firstDirection<directionCount; firstDirection+=batchSize)
     {
-        for(const bool aboveHorizon : {true, false})
+        const auto batchDirectionCount=std::min(batchSize, directionCount-firstDirection);
+        for(unsigned layer=0; layer<batchDirectionCount; ++layer)
         {
-            const auto& elevs = aboveHorizon ? elevationsAboveHorizon : elevationsBelowHorizon;
-            const auto azimuth=azimuths[azimIndex];
-            for(unsigned elevIndex=0; elevIndex<elevCount; ++elevIndex)
-            {
-                const auto elev=elevs[elevIndex];
-                const auto viewDir=mat3(rotate(azimuth,vec3(0,0,1)))*vec3(cos(elev),0,sin(elev));
-                program.setUniformValue("cameraViewDir", toQVector(viewDir));
-                gl.glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-
-                // Extracting the pixel containing the sum - the integral over the view direction and scattering directions
-                const auto integral=sumTexels(averager, intermediateTextureName, texW, texH, intermediateTextureTexUnitNum);
-                auto*const samples = aboveHorizon ? samplesAboveHorizon : samplesBelowHorizon;
-                for(unsigned i=0; i<VEC_ELEM_COUNT; ++i)
-                    samples[i][azimIndex*elevCount+elevIndex]=vec2(elev, integral[i]);
-            }
+            const auto dir=coarseGridDirection(firstDirection+layer);
+            const auto viewDir=mat3(rotate(azimuths[dir.azimIndex],vec3(0,0,1)))*vec3(cos(dir.elev),0,sin(dir.elev));
+            program.setUniformValue("cameraViewDir", toQVector(viewDir));
+            gl->glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, batchTexture, 0, layer);
+            gl->glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
         }
+
+        // Reducing all the layers at once, with a single readback for the whole batch. The next batch may
+        // overwrite the layers right away: the GL executes the commands in order.
+        averager->startSumming(batchTexture, GL_TEXTURE_2D_ARRAY, batchDirectionCount, intermediateTextureTexUnitNum);
     }
+    // The elevations will have been regenerated for the next samples by the time these are collected
+    pendingSamples.push_back({elevationsAboveHorizon, elevationsBelowHorizon});
+
+    gl->glViewport(origViewport[0], origViewport[1], origViewport[2], origViewport[3]);
+    gl->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, origFBO);
+}
+
+void EclipsedDoubleScatteringPrecomputer::finishComputingRadianceOnCoarseGrid()
+{
+    assert(!pendingSamples.empty());
+    elevationsAboveHorizon=std::move(pendingSamples.front().elevationsAboveHorizon);
+    elevationsBelowHorizon=std::move(pendingSamples.front().elevationsBelowHorizon);
+    pendingSamples.pop_front();
+
+    const auto elevCount=elevationsAboveHorizon.size();
+    const auto directionCount=coarseGridDirectionCount();
+    for(unsigned firstDirection=0; firstDirection<directionCount; firstDirection+=batchSize)
+    {
+        averager->collectSums(batchSums);
+        const auto batchDirectionCount=std::min(batchSize, directionCount-firstDirection);
+        assert(batchSums.size()==batchDirectionCount);
+        for(unsigned layer=0; layer<batchDirectionCount; ++layer)
+        {
+            const auto dir=coarseGridDirection(firstDirection+layer);
+            // The sum of the texels is the integral over the view direction and scattering directions
+            const auto& integral=batchSums[layer];
+            auto*const samples = dir.aboveHorizon ? samplesAboveHorizon : samplesBelowHorizon;
+            for(unsigned i=0; i<VEC_ELEM_COUNT; ++i)
+                samples[i][dir.azimIndex*elevCount+dir.elevIndex]=vec2(dir.elev, integral[i]);
+        }
+    }
+}
+
+void EclipsedDoubleScatteringPrecomputer::computeRadianceOnCoarseGrid(QOpenGLShaderProgram& program,
+                                                                      const GLuint intermediateTextureTexUnitNum,
+                                                                      const double cameraAltitude, const double sunZenithAngle,
+                                                                      const double moonZenithAngle, const double moonAzimuthRelativeToSun,
+                                                                      const double earthMoonDistance)
+{
+    assert(pendingSamples.empty());
+    startComputingRadianceOnCoarseGrid(program, intermediateTextureTexUnitNum, cameraAltitude, sunZenithAngle,
+                                       moonZenithAngle, moonAzimuthRelativeToSun, earthMoonDistance);
+    finishComputingRadianceOnCoarseGrid();
+}
+
+// The directions are enumerated with azimuth varying slowest and elevation fastest, the same way as the samples are stored
+auto EclipsedDoubleScatteringPrecomputer::coarseGridDirection(const unsigned index) const -> CoarseGridDirection
+{
+    const unsigned elevCount=elevationsAboveHorizon.size(); // for each direction: above and below horizon
+    const bool aboveHorizon = index/elevCount%2==0;
+    const auto elevIndex = index%elevCount;
+    return CoarseGridDirection{index/(2*elevCount), aboveHorizon, elevIndex,
+                               (aboveHorizon ? elevationsAboveHorizon : elevationsBelowHorizon)[elevIndex]};
+}
+
+unsigned EclipsedDoubleScatteringPrecomputer::coarseGridDirectionCount() const
+{
+    return azimuths.size()*2*elevationsAboveHorizon.size();
 }
 
 void EclipsedDoubleScatteringPrecomputer::generateTextureFromCoarseGridData(const unsigned altIndex, const unsigned szaIndex, const double cameraAltitude)
@@ -274,52 +358,87 @@ void EclipsedDoubleScatteringPrecomputer::generateTextureFromCoarseGridData(cons
     }
 
     // 3. Interpolate the samples over the circles of elevations using second order spline interpolation
+    const auto updateInterpolator=[](std::optional<SplineOrder2Interpolator<float>>& interpolator, std::vector<float> const& elevs)
+                                  -> SplineOrder2Interpolator<float>&
+    {
+        if(!interpolator || !interpolator->hasAbscissae(elevs.data(), elevs.size()))
+            interpolator.emplace(elevs.data(), elevs.size());
+        return *interpolator;
+    };
+    auto& interpolatorAboveHorizon=updateInterpolator(elevationInterpolatorAboveHorizon, elevationsAboveHorizon);
+    auto& interpolatorBelowHorizon=updateInterpolator(elevationInterpolatorBelowHorizon, elevationsBelowHorizon);
+    // The elevations to sample are the same for all azimuths, so they are sorted once, remembering where each
+    // sample goes, to let the interpolation functions be sampled in a single pass
+    struct ElevationQuery
+    {
+        float elevation;
+        unsigned texElevIndex;
+        bool oppositeAzimuth;
+    };
+    std::vector<ElevationQuery> queriesAboveHorizon, queriesBelowHorizon;
+    for(unsigned texElevIndex=0; texElevIndex<texSizeByViewElevation; ++texElevIndex)
+    {
+        const auto [cosVZA, viewRayIntersectsGround]=
+            eclipseTexCoordsToTexVars_cosVZA_VRIG(float(texElevIndex)/(texSizeByViewElevation-1), cameraAltitude);
+        for(const bool oppositeAzimuth : {false, true})
+        {
+            auto elevation = oppositeAzimuth ? M_PI-asin(cosVZA) : asin(cosVZA);
+            if(viewRayIntersectsGround && elevation > 0)
+                elevation -= 2*M_PI; // bring it to the negative range to match that of intFuncsBelowHorizon
+            // We've not sampled too close to horizon to avoid rounding errors, so the elevations outside of the
+            // available range are clamped to its edges by sampleMany().
+            (viewRayIntersectsGround ? queriesBelowHorizon : queriesAboveHorizon)
+                .push_back({float(elevation), texElevIndex, oppositeAzimuth});
+        }
+    }
+    std::vector<float> elevationsToSampleAboveHorizon, elevationsToSampleBelowHorizon;
+    for(auto [queries, elevs] : {std::pair{&queriesAboveHorizon, &elevationsToSampleAboveHorizon},
+                                 std::pair{&queriesBelowHorizon, &elevationsToSampleBelowHorizon}})
+    {
+        std::sort(queries->begin(), queries->end(),
+                  [](ElevationQuery const& a, ElevationQuery const& b){ return a.elevation < b.elevation; });
+        for(const auto& query : *queries)
+            elevs->push_back(query.elevation);
+    }
+    std::vector<float> sampled(VEC_ELEM_COUNT*std::max(queriesAboveHorizon.size(), queriesBelowHorizon.size()));
+
+    SplineOrder2InterpolationFunction<float,vec2> intFuncsAboveHorizon[VEC_ELEM_COUNT];
+    SplineOrder2InterpolationFunction<float,vec2> intFuncsBelowHorizon[VEC_ELEM_COUNT];
     for(unsigned azimIndex=0; azimIndex<nAzimuthPairsToSample; ++azimIndex)
     {
-        SplineOrder2InterpolationFunction<float,vec2> intFuncsAboveHorizon[VEC_ELEM_COUNT];
         for(unsigned i=0; i<VEC_ELEM_COUNT; ++i)
-            intFuncsAboveHorizon[i]=splineInterpolationOrder2(&samplesAboveHorizon[i][azimIndex*elevCount], elevCount);
-        SplineOrder2InterpolationFunction<float,vec2> intFuncsBelowHorizon[VEC_ELEM_COUNT];
+            interpolatorAboveHorizon.interpolate(&samplesAboveHorizon[i][azimIndex*elevCount], intFuncsAboveHorizon[i]);
         for(unsigned i=0; i<VEC_ELEM_COUNT; ++i)
-            intFuncsBelowHorizon[i]=splineInterpolationOrder2(&samplesBelowHorizon[i][azimIndex*elevCount], elevCount);
-        for(unsigned texElevIndex=0; texElevIndex<texSizeByViewElevation; ++texElevIndex)
+            interpolatorBelowHorizon.interpolate(&samplesBelowHorizon[i][azimIndex*elevCount], intFuncsBelowHorizon[i]);
+        for(const bool viewRayIntersectsGround : {false, true})
         {
-            const auto [cosVZA, viewRayIntersectsGround]=
-                eclipseTexCoordsToTexVars_cosVZA_VRIG(float(texElevIndex)/(texSizeByViewElevation-1), cameraAltitude);
-            const auto& intFuncs =  viewRayIntersectsGround ?  intFuncsBelowHorizon  : intFuncsAboveHorizon;
-            const double elevMin = (viewRayIntersectsGround ? elevationsBelowHorizon : elevationsAboveHorizon).front();
-            const double elevMax = (viewRayIntersectsGround ? elevationsBelowHorizon : elevationsAboveHorizon).back();
-            for(const bool oppositeAzimuth : {false, true})
+            const auto& intFuncs = viewRayIntersectsGround ? intFuncsBelowHorizon : intFuncsAboveHorizon;
+            const auto& queries = viewRayIntersectsGround ? queriesBelowHorizon : queriesAboveHorizon;
+            const auto& elevs = viewRayIntersectsGround ? elevationsToSampleBelowHorizon : elevationsToSampleAboveHorizon;
+            SplineOrder2InterpolationFunction<float,vec2>::sampleMany(intFuncs, elevs.data(), elevs.size(), sampled.data());
+            for(unsigned k=0; k<queries.size(); ++k)
             {
-                auto elevation = oppositeAzimuth ? M_PI-asin(cosVZA) : asin(cosVZA);
-                if(viewRayIntersectsGround && elevation > 0)
-                    elevation -= 2*M_PI; // bring it to the negative range to match that of intFuncsBelowHorizon
-                // We've not sampled too close to horizon to avoid rounding errors, so let's clamp to the edges of available range
-                elevation = std::clamp(elevation, elevMin, elevMax);
-
-                const auto index = texElevIndex*2*nAzimuthPairsToSample + azimIndex + (oppositeAzimuth ? nAzimuthPairsToSample : 0);
+                const auto& query = queries[k];
+                const auto index = query.texElevIndex*2*nAzimuthPairsToSample + azimIndex +
+                                                                (query.oppositeAzimuth ? nAzimuthPairsToSample : 0);
                 for(unsigned i=0; i<VEC_ELEM_COUNT; ++i)
-                    radianceInterpolatedOverElevations[i][index]=intFuncs[i].sample(elevation);
+                    radianceInterpolatedOverElevations[i][index]=sampled[k*VEC_ELEM_COUNT+i];
             }
         }
     }
 
     // 4. Interpolate the resulting interpolations over azimuths using Fourier interpolation and save into the final texture
-    std::vector<float> interpolated[VEC_ELEM_COUNT];
-    for(auto& in : interpolated)
-        in.resize(texSizeByViewAzimuth);
-    for(unsigned texElevIndex=0; texElevIndex<texSizeByViewElevation; ++texElevIndex)
+    auto& interpolated = radianceInterpolatedOverAzimuths;
+    assert(azimuthInterpolator->inputSize()==2*nAzimuthPairsToSample);
+    for(unsigned i=0; i<VEC_ELEM_COUNT; ++i)
     {
-        const auto indexInPrevStepArray = texElevIndex*2*nAzimuthPairsToSample;
-        const auto indexOfLineInTexture = texSizeByViewAzimuth*(texSizeByViewElevation*(texSizeBySZA*altIndex + szaIndex) +
-                                                                texElevIndex);
-        for(unsigned i=0; i<VEC_ELEM_COUNT; ++i)
-            fourierInterpolate(&radianceInterpolatedOverElevations[i][indexInPrevStepArray], 2*nAzimuthPairsToSample,
-                               fourierIntermediate.data(),
-                               interpolated[i].data(), texSizeByViewAzimuth);
-        for(unsigned i=0; i<texSizeByViewAzimuth; ++i)
-            texture_[indexOfLineInTexture+i] = vec4(interpolated[0][i],interpolated[1][i],interpolated[2][i],interpolated[3][i]);
+        for(unsigned row=0; row<texSizeByViewElevation; ++row)
+            azimuthInterpolator->interpolate(&radianceInterpolatedOverElevations[i][row*azimuthInterpolator->inputSize()],
+                                             &interpolated[i][row*texSizeByViewAzimuth]);
     }
+    const auto indexOfSliceInTexture = texSizeByViewAzimuth*texSizeByViewElevation*(texSizeBySZA*altIndex + szaIndex);
+    for(unsigned i=0; i<texSizeByViewElevation*texSizeByViewAzimuth; ++i)
+        texture_[indexOfSliceInTexture+i] = vec4(interpolated[0][i],interpolated[1][i],interpolated[2][i],interpolated[3][i]);
 }
 
 void EclipsedDoubleScatteringPrecomputer::convertRadianceToLuminance(glm::mat4 const& radianceToLuminance)
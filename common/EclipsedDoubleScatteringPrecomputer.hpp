@@ -20,16 +20,33 @@
 #ifndef INCLUDE_ONCE_9100E17F_B7DD_4CC0_8D2F_9DBB66C7D23D
 #define INCLUDE_ONCE_9100E17F_B7DD_4CC0_8D2F_9DBB66C7D23D
 
+#include <memory>
 #include <vector>
+#include <deque>
+#include <optional>
 #include <utility>
-#include <complex>
 #include <glm/glm.hpp>
 #include <QtOpenGL>
 #include "AtmosphereParameters.hpp"
+#include "spline-interpolation.hpp"
 
+class TextureAverageComputer;
+class FourierInterpolator;
 class EclipsedDoubleScatteringPrecomputer
 {
-    QOpenGLFunctions_3_3_Core& gl;
+    QOpenGLFunctions_3_3_Core* gl=nullptr; // null if the precomputer was created only to reconstruct the texture
+    // Each layer of batchTexture receives the integrand for one view direction, so that the integrals for the whole
+    // batch are computed in one reduction with one readback. These resources are created on first use and kept.
+    GLuint batchFBO=0, batchTexture=0;
+    unsigned batchSize=0; // number of layers in batchTexture
+    std::vector<glm::vec4> batchSums;
+    std::unique_ptr<TextureAverageComputer> averager;
+    // The elevations of the coarse grids whose sums are still being computed, oldest first
+    struct PendingSamples
+    {
+        std::vector<float> elevationsAboveHorizon, elevationsBelowHorizon;
+    };
+    std::deque<PendingSamples> pendingSamples;
     AtmosphereParameters const& atmo;
     const unsigned texSizeByViewAzimuth;
     const unsigned texSizeByViewElevation;
@@ -37,8 +54,10 @@ class EclipsedDoubleScatteringPrecomputer
 
     const double texW, texH; // size of the intermediate texture we are rendering to
     std::vector<glm::vec4> texture_; // output 4D texture data
-    std::vector<std::complex<float>> fourierIntermediate;
+    std::unique_ptr<FourierInterpolator> azimuthInterpolator; // keeps the FFT plans and buffers between slices
     std::vector<float> elevationsAboveHorizon, elevationsBelowHorizon;
+    std::vector<float> baseElevations;
+    std::vector<float> azimuths;
 
     static constexpr unsigned VEC_ELEM_COUNT=4; // number of components in the partial radiance vector
     // The samples of radiance, one container per vec4 component. These containers are re-used for different altitudes and Sun elevations.
@@ -49,29 +68,54 @@ class EclipsedDoubleScatteringPrecomputer
     // The samples of radiance interpolated over view elevations but not yet over view azimuths, one container per vec4 component.
     // These containers are re-used for different altitudes and Sun elevations.
     std::vector<float> radianceInterpolatedOverElevations[VEC_ELEM_COUNT];
-
-    GLint origViewportWidth, origViewportHeight;
+    // Factorized spline systems for the current elevations. All the azimuths and vec4 components share them, and
+    // they are only rebuilt when the elevations change, i.e. for a new altitude.
+    std::optional<SplineOrder2Interpolator<float>> elevationInterpolatorAboveHorizon, elevationInterpolatorBelowHorizon;
+    // The rows of the final texture slice before they are interleaved into texture_, one container per vec4 component
+    std::vector<float> radianceInterpolatedOverAzimuths[VEC_ELEM_COUNT];
 
     float cosZenithAngleOfHorizon(const float altitude) const;
     std::pair<float,bool> eclipseTexCoordsToTexVars_cosVZA_VRIG(float vzaTexCoordInUnitRange, float altitude) const;
     void generateElevationsForEclipsedDoubleScattering(float cameraAltitude);
+    void initBatchTarget(unsigned directionCount, GLuint unusedTextureUnitNum);
+    struct CoarseGridDirection { unsigned azimIndex; bool aboveHorizon; unsigned elevIndex; float elev; };
+    CoarseGridDirection coarseGridDirection(unsigned index) const;
+    unsigned coarseGridDirectionCount() const;
 public:
-    /* Preconditions:
-     *   * Rendering FBO is bound, and the target texture is attached to it
-     *   * program is bound
-     *   * Transmittance texture uniform is set for program
-     *   * VAO for a quad is bound
+    /* The precomputer doesn't depend on any GL state at construction, and can be reused for any number of
+     * computeRadianceOnCoarseGrid() calls. All the buffers are allocated here and are overwritten by each call.
      */
     EclipsedDoubleScatteringPrecomputer(QOpenGLFunctions_3_3_Core& gl,
                                         AtmosphereParameters const& atmo,
                                         unsigned texSizeByViewAzimuth, unsigned texSizeByViewElevation,
                                         unsigned texSizeBySZA, unsigned texSizeByAltitude);
+    /* This constructor creates a precomputer that can only reconstruct the texture from
+     * previously computed coarse grid samples. It doesn't use OpenGL, so it can live in any thread.
+     */
+    EclipsedDoubleScatteringPrecomputer(AtmosphereParameters const& atmo,
+                                        unsigned texSizeByViewAzimuth, unsigned texSizeByViewElevation,
+                                        unsigned texSizeBySZA, unsigned texSizeByAltitude);
     ~EclipsedDoubleScatteringPrecomputer();
 
-    void computeRadianceOnCoarseGrid(QOpenGLShaderProgram& program,
-                                     GLuint intermediateTextureName, GLuint intermediateTextureTexUnitNum,
+    /* Preconditions:
+     *   * program is bound
+     *   * Transmittance texture uniform is set for program
+     *   * VAO for a quad is bound
+     *   * Blending is disabled
+     * The rendering is done into the precomputer's own framebuffer. The draw framebuffer binding and the viewport are restored on return.
+     */
+    void computeRadianceOnCoarseGrid(QOpenGLShaderProgram& program, GLuint intermediateTextureTexUnitNum,
                                      double cameraAltitude, double sunZenithAngle, double moonZenithAngle,
                                      double moonAzimuthRelativeToSun, double earthMoonDistance);
+    /* The two halves of computeRadianceOnCoarseGrid(), with the same preconditions for the first one. The start
+     * only issues the GL commands, so the samples for the next parameters can be started before the previous
+     * ones are finished, and the GPU computes them while the CPU waits for the previous results.
+     * finishComputingRadianceOnCoarseGrid() waits for the oldest samples started and makes them current.
+     */
+    void startComputingRadianceOnCoarseGrid(QOpenGLShaderProgram& program, GLuint intermediateTextureTexUnitNum,
+                                            double cameraAltitude, double sunZenithAngle, double moonZenithAngle,
+                                            double moonAzimuthRelativeToSun, double earthMoonDistance);
+    void finishComputingRadianceOnCoarseGrid();
     void convertRadianceToLuminance(glm::mat4 const& radianceToLuminance);
     void accumulateLuminance(EclipsedDoubleScatteringPrecomputer const& source, glm::mat4 const& sourceRadianceToLuminance);
     void generateTextureFromCoarseGridData(unsigned altIndex, unsigned szaIndex, double cameraAltitude);
@@ -0,0 +1,192 @@
+/*
+ * CalcMySky - a simulator of light scattering in planetary atmospheres
+ * Copyright © 2025 Ruslan Kabatsayev
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335, USA.
+ */
+
+#include "ModelBundle.hpp"
+#include <algorithm>
+#include <cstring>
+#include <QDataStream>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QBuffer>
+#include <QFile>
+#include "ModelManifest.hpp"
+#include "util.hpp"
+
+namespace
+{
+
+QByteArray serializeIndex(std::vector<ModelBundle::Entry> const& entries)
+{
+    QByteArray index(modelBundleMagic, sizeof modelBundleMagic);
+    QBuffer buffer(&index);
+    buffer.open(QIODevice::WriteOnly|QIODevice::Append);
+    QDataStream out(&buffer);
+    out.setVersion(QDataStream::Qt_5_6);
+    out << quint32(ModelBundle::FORMAT_VERSION) << quint32(entries.size());
+    for(const auto& entry : entries)
+        out << entry.path << entry.offset << entry.size;
+    return index;
+}
+
+qint64 alignedOffset(const qint64 offset)
+{
+    return (offset+modelBundleAlignment-1)/modelBundleAlignment*modelBundleAlignment;
+}
+
+bool entryLessThan(ModelBundle::Entry const& entry, QString const& path)
+{
+    return entry.path < path;
+}
+
+}
+
+ModelBundle::ModelBundle(QString const& path)
+    : path_(path)
+    , file_(std::make_unique<QFile>(path))
+{
+    if(!file_->open(QFile::ReadOnly))
+        throw DataLoadError{QObject::tr("Failed to open model bundle \"%1\": %2").arg(path).arg(file_->errorString())};
+    const auto size=file_->size();
+    if(size < qint64(sizeof modelBundleMagic))
+        throw DataLoadError{QObject::tr("Model bundle \"%1\" is too short").arg(path)};
+    data_=file_->map(0, size);
+    if(!data_)
+        throw DataLoadError{QObject::tr("Failed to map model bundle \"%1\" into memory: %2").arg(path).arg(file_->errorString())};
+    if(std::memcmp(data_, modelBundleMagic, sizeof modelBundleMagic) != 0)
+        throw DataLoadError{QObject::tr("File \"%1\" is not a model bundle").arg(path)};
+
+    QDataStream in(QByteArray::fromRawData(reinterpret_cast<const char*>(data_), size));
+    in.setVersion(QDataStream::Qt_5_6);
+    in.skipRawData(sizeof modelBundleMagic);
+    quint32 version=0, entryCount=0;
+    in >> version;
+    if(version != FORMAT_VERSION)
+    {
+        throw DataLoadError{QObject::tr("Unsupported version %1 of model bundle \"%2\", supported is %3")
+                            .arg(version).arg(path).arg(FORMAT_VERSION)};
+    }
+    in >> entryCount;
+    // Don't trust the count before having read the entries: it may be garbage
+    for(quint32 n=0; n<entryCount && in.status()==QDataStream::Ok; ++n)
+    {
+        Entry entry;
+        in >> entry.path >> entry.offset >> entry.size;
+        entries_.emplace_back(std::move(entry));
+    }
+    if(in.status()!=QDataStream::Ok)
+        throw DataLoadError{QObject::tr("Index of model bundle \"%1\" is truncated or corrupt").arg(path)};
+    for(const auto& entry : entries_)
+    {
+        if(entry.offset < 0 || entry.size < 0 || entry.offset > size || entry.size > size-entry.offset)
+            throw DataLoadError{QObject::tr("Entry \"%1\" of model bundle \"%2\" is out of the file bounds").arg(entry.path).arg(path)};
+    }
+    if(!std::is_sorted(entries_.begin(), entries_.end(), [](Entry const& a, Entry const& b){ return a.path < b.path; }))
+        throw DataLoadError{QObject::tr("Index of model bundle \"%1\" is not sorted").arg(path)};
+}
+
+ModelBundle::~ModelBundle() = default;
+
+auto ModelBundle::find(QString const& path) const -> const Entry*
+{
+    const auto it=std::lower_bound(entries_.begin(), entries_.end(), path, entryLessThan);
+    if(it==entries_.end() || it->path!=path)
+        return nullptr;
+    return &*it;
+}
+
+auto ModelBundle::filesInDirectory(QString const& dirPath) const -> std::vector<const Entry*>
+{
+    const auto prefix = dirPath.endsWith('/') ? dirPath : dirPath+'/';
+    std::vector<const Entry*> files;
+    for(auto it=std::lower_bound(entries_.begin(), entries_.end(), prefix, entryLessThan);
+        it!=entries_.end() && it->path.startsWith(prefix); ++it)
+    {
+        if(it->path.indexOf('/', prefix.size()) < 0)
+            files.push_back(&*it);
+    }
+    return files;
+}
+
+bool isModelBundle(QString const& path)
+{
+    QFile file(path);
+    if(!file.open(QFile::ReadOnly))
+        return false;
+    char magic[sizeof modelBundleMagic];
+    return file.read(magic, sizeof magic) == sizeof magic && std::memcmp(magic, modelBundleMagic, sizeof magic) == 0;
+}
+
+QString writeModelBundle(QString const& modelDir, QString const& bundlePath)
+{
+    ModelManifest manifest;
+    try
+    {
+        manifest=readModelManifest(modelDir+"/"+MODEL_MANIFEST_FILENAME);
+    }
+    catch(DataLoadError const& ex)
+    {
+        return ex.what();
+    }
+
+    std::vector<ModelBundle::Entry> entries;
+    for(const auto& artifact : manifest.artifacts)
+        entries.push_back({artifact.path, 0, artifact.size});
+    const auto manifestSize=QFileInfo(modelDir+"/"+MODEL_MANIFEST_FILENAME).size();
+    entries.push_back({MODEL_MANIFEST_FILENAME, 0, manifestSize});
+    std::sort(entries.begin(), entries.end(), [](auto const& a, auto const& b){ return a.path < b.path; });
+
+    // The size of the index doesn't depend on the values of the offsets, so it can be computed before them
+    auto offset=alignedOffset(serializeIndex(entries).size());
+    for(auto& entry : entries)
+    {
+        entry.offset=offset;
+        offset=alignedOffset(offset+entry.size);
+    }
+
+    QSaveFile out(bundlePath);
+    if(!out.open(QFile::WriteOnly))
+        return QString("failed to open \"%1\": %2").arg(bundlePath).arg(out.errorString());
+    out.write(serializeIndex(entries));
+    for(const auto& entry : entries)
+    {
+        const auto path=modelDir+"/"+entry.path;
+        QFile in(path);
+        if(!in.open(QFile::ReadOnly))
+            return QString("failed to open \"%1\": %2").arg(path).arg(in.errorString());
+        if(in.size()!=entry.size)
+            return QString("size of \"%1\" differs from that in the manifest, was the model modified after its computation?").arg(path);
+        // Padding is written explicitly: a seek past the end would leave it undefined
+        if(const auto padding=entry.offset-out.pos(); out.write(QByteArray(int(padding), '\0'))!=padding)
+            return QString("failed to write \"%1\": %2").arg(bundlePath).arg(out.errorString());
+        // Copied in chunks, since the textures may be too large to be read into memory at once
+        constexpr qint64 chunkSize=64<<20;
+        for(qint64 done=0; done<entry.size;)
+        {
+            const auto chunk=in.read(std::min(chunkSize, entry.size-done));
+            if(chunk.isEmpty())
+                return QString("failed to read \"%1\": %2").arg(path).arg(in.errorString());
+            if(out.write(chunk)!=chunk.size())
+                return QString("failed to write \"%1\": %2").arg(bundlePath).arg(out.errorString());
+            done += chunk.size();
+        }
+    }
+    if(!out.commit())
+        return QString("failed to write \"%1\": %2").arg(bundlePath).arg(out.errorString());
+    return {};
+}
@@ -0,0 +1,83 @@
+/*
+ * CalcMySky - a simulator of light scattering in planetary atmospheres
+ * Copyright © 2025 Ruslan Kabatsayev
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335, USA.
+ */
+
+#ifndef INCLUDE_ONCE_6BF3E558_BE54_45C1_ABD4_F70F1D2ECAE2
+#define INCLUDE_ONCE_6BF3E558_BE54_45C1_ABD4_F70F1D2ECAE2
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <QString>
+
+class QFile;
+
+/* Single-file form of a model: all the files of the model directory, including the manifest, concatenated after
+ * an index. The bundle is read through a single mapping, which is faster to open on a cold cache than hundreds of
+ * separate files, and is easier to copy and deploy.
+ *
+ * File layout: char magic[8] (see modelBundleMagic), then QDataStream (version Qt_5_6) of
+ *   quint32     formatVersion
+ *   quint32     entryCount
+ *   entries sorted by path, each as
+ *       QString   path                 relative to the model directory, with '/' as the separator
+ *       qint64    offset               from the beginning of the file, a multiple of modelBundleAlignment
+ *       qint64    size
+ *   contents of the files at their offsets
+ */
+
+constexpr char modelBundleMagic[8]={'C','M','S','k','y','B','N','1'};
+// Keeps the data of each file page-aligned, so that they can be used from the mapping as if the file were mapped alone
+constexpr qint64 modelBundleAlignment=4096;
+
+class ModelBundle
+{
+public:
+    struct Entry
+    {
+        QString path;
+        qint64 offset;
+        qint64 size;
+    };
+    static constexpr uint32_t FORMAT_VERSION=1;
+
+    // Maps the file and parses the index. Throws DataLoadError on failure.
+    explicit ModelBundle(QString const& path);
+    ~ModelBundle();
+    QString const& path() const { return path_; }
+    std::vector<Entry> const& entries() const { return entries_; }
+    // Returns null if there's no such file in the bundle
+    const Entry* find(QString const& path) const;
+    const uchar* data(Entry const& entry) const { return data_+entry.offset; }
+    // Files directly in the directory, not in its subdirectories
+    std::vector<const Entry*> filesInDirectory(QString const& dirPath) const;
+
+private:
+    QString path_;
+    std::unique_ptr<QFile> file_;
+    const uchar* data_=nullptr;
+    std::vector<Entry> entries_;
+};
+
+// Checks the magic at the beginning of the file
+bool isModelBundle(QString const& path);
+// Writes all the files listed in the manifest of the model in modelDir into a bundle.
+// Returns empty string on success, error message otherwise.
+QString writeModelBundle(QString const& modelDir, QString const& bundlePath);
+
+#endif
@@ -0,0 +1,279 @@
+/*
+ * CalcMySky - a simulator of light scattering in planetary atmospheres
+ * Copyright © 2025 Ruslan Kabatsayev
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335, USA.
+ */
+
+#include "ModelManifest.hpp"
+#include <algorithm>
+#include <cstring>
+#include <QDataStream>
+#include <QDirIterator>
+#include <QSaveFile>
+#include <QFile>
+#include <QDir>
+#include "AtmosphereParameters.hpp"
+#include "CompressedTexture.hpp"
+#include "util.hpp"
+
+namespace
+{
+
+using Artifact=ModelManifest::Artifact;
+using ArtifactKind=ModelManifest::ArtifactKind;
+
+ArtifactKind artifactKind(QString const& relativePath)
+{
+    if(relativePath.startsWith("shaders/"))
+        return ArtifactKind::Shader;
+    if(relativePath.endsWith(".guides2d"))
+        return ArtifactKind::InterpolationGuides;
+    if(!relativePath.endsWith(".f32"))
+        return ArtifactKind::Other;
+    if(relativePath.startsWith("eclipsed-double-scattering"))
+        return ArtifactKind::EclipsedDoubleScattering;
+    if(relativePath.startsWith("transmittance") || relativePath.startsWith("irradiance") ||
+       relativePath.startsWith("light-pollution"))
+        return ArtifactKind::Texture2D;
+    return ArtifactKind::Texture4D;
+}
+
+// Fills in the layout of the texture in artifact.path. Returns empty string on success, error message otherwise.
+QString describeTexture(Artifact& artifact, const uchar*const data, AtmosphereParameters const& atmo)
+{
+    if(isCompressedTexture(data, artifact.size))
+    {
+        try
+        {
+            const CompressedTextureReader reader(data, artifact.size, artifact.path);
+            artifact.compressed=true;
+            artifact.sizes=reader.sizes();
+            artifact.pixelSize=reader.pixelSize();
+        }
+        catch(DataLoadError const& ex)
+        {
+            return ex.what();
+        }
+        return {};
+    }
+
+    // Uncompressed textures have a header of uint16 sizes followed by the data
+    const bool guides = artifact.kind==ArtifactKind::InterpolationGuides;
+    const int headerDimCount = artifact.kind==ArtifactKind::EclipsedDoubleScattering ? 1 :
+                               artifact.kind==ArtifactKind::Texture2D ? 2 : 4;
+    const qint64 headerSize = headerDimCount*sizeof(uint16_t);
+    if(artifact.size < headerSize)
+        return QString("file \"%1\" is too short").arg(artifact.path);
+    uint16_t header[4];
+    std::memcpy(header, data, headerSize);
+    artifact.sizes.assign(header, header+headerDimCount);
+    if(artifact.kind==ArtifactKind::EclipsedDoubleScattering)
+    {
+        // The header only has the number of coarse grid points per set, see computeEclipsedDoubleScattering()
+        artifact.sizes.push_back(atmo.eclipsedDoubleScatteringTextureSize[2]);
+        artifact.sizes.push_back(atmo.eclipsedDoubleScatteringTextureSize[3]);
+    }
+
+    uint64_t pixelCount=1;
+    for(const auto size : artifact.sizes)
+        pixelCount *= size;
+    // Textures other than interpolation guides may be stored as half floats, this is detected from the data size
+    if(!guides && headerSize + pixelCount*4*sizeof(uint16_t) == uint64_t(artifact.size))
+        artifact.pixelSize = 4*sizeof(uint16_t);
+    else
+        artifact.pixelSize = guides ? sizeof(int16_t) : 4*sizeof(float);
+    if(const auto expectedSize = headerSize + pixelCount*artifact.pixelSize; expectedSize != uint64_t(artifact.size))
+    {
+        return QString("size of file \"%1\" (%2 bytes) doesn't match its dimensions, the expected size is %3 bytes")
+                    .arg(artifact.path).arg(artifact.size).arg(expectedSize);
+    }
+
+    if(artifact.kind==ArtifactKind::Texture2D)
+        return {};
+
+    // Other textures are sliced by altitude, which is the last dimension
+    const auto sliceCount = artifact.sizes.back();
+    if(sliceCount==0)
+        return {};
+    artifact.firstSliceOffset = headerSize;
+    artifact.sliceByteSize = qint64(pixelCount/sliceCount)*artifact.pixelSize;
+    for(int n=0; n<sliceCount; ++n)
+    {
+        const auto slice = reinterpret_cast<const char*>(data + artifact.firstSliceOffset + n*artifact.sliceByteSize);
+        artifact.sliceChecksums.push_back(crc32(slice, artifact.sliceByteSize));
+    }
+    return {};
+}
+
+}
+
+const ModelManifest::Artifact* ModelManifest::find(QString const& path) const
+{
+    const auto it=std::lower_bound(artifacts.begin(), artifacts.end(), path,
+                                   [](Artifact const& artifact, QString const& path){ return artifact.path < path; });
+    if(it==artifacts.end() || it->path!=path)
+        return nullptr;
+    return &*it;
+}
+
+bool ModelManifest::contains(QString const& path) const
+{
+    if(find(path))
+        return true;
+    const auto dirPrefix = path.endsWith('/') ? path : path+'/';
+    const auto it=std::lower_bound(artifacts.begin(), artifacts.end(), dirPrefix,
+                                   [](Artifact const& artifact, QString const& path){ return artifact.path < path; });
+    return it!=artifacts.end() && it->path.startsWith(dirPrefix);
+}
+
+QString writeModelManifest(QString const& modelDir)
+{
+    ModelManifest manifest;
+    AtmosphereParameters atmo;
+    try
+    {
+        // Parsed as the renderer would parse it, so that it gets exactly the same parameters
+        atmo.parse(modelDir+"/params.atmo", AtmosphereParameters::ForceNoEDSTextures{false}, AtmosphereParameters::SkipSpectra{true});
+    }
+    catch(ShowMySky::Error const& ex)
+    {
+        return ex.what();
+    }
+    manifest.parameters=atmo.serialize();
+
+    const QDir dir(modelDir);
+    for(QDirIterator it(modelDir, QDir::Files, QDirIterator::Subdirectories); it.hasNext();)
+    {
+        const auto path=it.next();
+        const auto relativePath=dir.relativeFilePath(path);
+        if(relativePath==MODEL_MANIFEST_FILENAME)
+            continue;
+
+        QFile file(path);
+        if(!file.open(QFile::ReadOnly))
+            return QString("failed to open \"%1\": %2").arg(path).arg(file.errorString());
+        Artifact artifact;
+        artifact.path=relativePath;
+        artifact.kind=artifactKind(relativePath);
+        artifact.size=file.size();
+        if(artifact.size==0)
+        {
+            manifest.artifacts.emplace_back(std::move(artifact));
+            continue;
+        }
+        const auto data=file.map(0, artifact.size);
+        if(!data)
+            return QString("failed to map \"%1\" into memory: %2").arg(path).arg(file.errorString());
+        artifact.checksum=crc32(reinterpret_cast<const char*>(data), artifact.size);
+        if(artifact.kind!=ArtifactKind::Other && artifact.kind!=ArtifactKind::Shader)
+        {
+            if(const auto error=describeTexture(artifact, data, atmo); !error.isEmpty())
+                return error;
+        }
+        manifest.artifacts.emplace_back(std::move(artifact));
+    }
+    std::sort(manifest.artifacts.begin(), manifest.artifacts.end(),
+              [](Artifact const& a, Artifact const& b){ return a.path < b.path; });
+
+    // Saved atomically, so that a failed run doesn't leave a manifest that doesn't match the files
+    QSaveFile file(modelDir+"/"+MODEL_MANIFEST_FILENAME);
+    if(!file.open(QFile::WriteOnly))
+        return QString("failed to open \"%1\": %2").arg(file.fileName()).arg(file.errorString());
+    file.write(modelManifestMagic, sizeof modelManifestMagic);
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_6);
+    out << quint32(ModelManifest::FORMAT_VERSION) << manifest.parameters << quint32(manifest.artifacts.size());
+    for(const auto& artifact : manifest.artifacts)
+    {
+        out << artifact.path << quint8(artifact.kind) << artifact.compressed;
+        out << quint32(artifact.sizes.size());
+        for(const auto size : artifact.sizes)
+            out << qint32(size);
+        out << quint32(artifact.pixelSize) << artifact.size << artifact.firstSliceOffset << artifact.sliceByteSize;
+        out << quint32(artifact.checksum) << quint32(artifact.sliceChecksums.size());
+        for(const auto checksum : artifact.sliceChecksums)
+            out << quint32(checksum);
+    }
+    if(out.status()!=QDataStream::Ok || !file.commit())
+        return QString("failed to write \"%1\": %2").arg(file.fileName()).arg(file.errorString());
+    return {};
+}
+
+ModelManifest readModelManifest(QString const& path)
+{
+    QFile file(path);
+    if(!file.open(QFile::ReadOnly))
+        throw DataLoadError{QObject::tr("Failed to open model manifest \"%1\": %2").arg(path).arg(file.errorString())};
+    const auto data=file.readAll();
+    if(file.error())
+        throw DataLoadError{QObject::tr("Failed to read model manifest \"%1\": %2").arg(path).arg(file.errorString())};
+    return readModelManifest(data, path);
+}
+
+ModelManifest readModelManifest(QByteArray const& data, QString const& path)
+{
+    if(!data.startsWith(QByteArray::fromRawData(modelManifestMagic, sizeof modelManifestMagic)))
+        throw DataLoadError{QObject::tr("File \"%1\" is not a model manifest").arg(path)};
+
+    QDataStream in(data);
+    in.skipRawData(sizeof modelManifestMagic);
+    in.setVersion(QDataStream::Qt_5_6);
+    quint32 version=0;
+    in >> version;
+    if(version != ModelManifest::FORMAT_VERSION)
+    {
+        throw DataLoadError{QObject::tr("Unsupported version %1 of model manifest \"%2\", supported is %3")
+                            .arg(version).arg(path).arg(ModelManifest::FORMAT_VERSION)};
+    }
+
+    ModelManifest manifest;
+    quint32 artifactCount=0;
+    in >> manifest.parameters >> artifactCount;
+    // Don't trust the counts before having read the data: they may be garbage
+    for(quint32 n=0; n<artifactCount && in.status()==QDataStream::Ok; ++n)
+    {
+        Artifact artifact;
+        quint8 kind=0;
+        in >> artifact.path >> kind >> artifact.compressed;
+        artifact.kind=ArtifactKind(kind);
+        quint32 count=0;
+        in >> count;
+        for(quint32 i=0; i<count && in.status()==QDataStream::Ok; ++i)
+        {
+            qint32 size=0;
+            in >> size;
+            artifact.sizes.push_back(size);
+        }
+        quint32 pixelSize=0, checksum=0;
+        in >> pixelSize >> artifact.size >> artifact.firstSliceOffset >> artifact.sliceByteSize >> checksum >> count;
+        artifact.pixelSize=pixelSize;
+        artifact.checksum=checksum;
+        for(quint32 i=0; i<count && in.status()==QDataStream::Ok; ++i)
+        {
+            quint32 sliceChecksum=0;
+            in >> sliceChecksum;
+            artifact.sliceChecksums.push_back(sliceChecksum);
+        }
+        manifest.artifacts.emplace_back(std::move(artifact));
+    }
+    if(in.status()!=QDataStream::Ok)
+        throw DataLoadError{QObject::tr("Model manifest \"%1\" is truncated or corrupt").arg(path)};
+    if(!std::is_sorted(manifest.artifacts.begin(), manifest.artifacts.end(),
+                       [](Artifact const& a, Artifact const& b){ return a.path < b.path; }))
+        throw DataLoadError{QObject::tr("Artifacts in model manifest \"%1\" are not sorted").arg(path)};
+
+    return manifest;
+}
@@ -0,0 +1,97 @@
+/*
+ * CalcMySky - a simulator of light scattering in planetary atmospheres
+ * Copyright © 2025 Ruslan Kabatsayev
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335, USA.
+ */
+
+#ifndef INCLUDE_ONCE_6A6CDA0C_C5A4_410A_B6C7_6C156463637D
+#define INCLUDE_ONCE_6A6CDA0C_C5A4_410A_B6C7_6C156463637D
+
+#include <vector>
+#include <cstdint>
+#include <QString>
+#include <QByteArray>
+
+/* Manifest of a model computed by calcmysky: the parsed atmosphere parameters and the list of all the files
+ * of the model with their layout and checksums. The renderer plans data loading from this single small file,
+ * instead of parsing the atmosphere description and probing the file system for optional files.
+ *
+ * File layout: char magic[8] (see modelManifestMagic), then QDataStream (version Qt_5_6) of
+ *   quint32     formatVersion
+ *   QByteArray  parameters             see AtmosphereParameters::serialize()
+ *   quint32     artifactCount
+ *   artifacts, each as
+ *       QString           path
+ *       quint8            kind
+ *       bool              compressed
+ *       quint32 count,    qint32 sizes[count]
+ *       quint32           pixelSize
+ *       qint64            size, firstSliceOffset, sliceByteSize
+ *       quint32           checksum
+ *       quint32 count,    quint32 sliceChecksums[count]
+ */
+
+constexpr char MODEL_MANIFEST_FILENAME[]="manifest.bin";
+constexpr char modelManifestMagic[8]={'C','M','S','k','y','M','F','1'};
+
+struct ModelManifest
+{
+    enum class ArtifactKind : uint8_t
+    {
+        Other,
+        Shader,
+        Texture2D,
+        Texture4D,
+        InterpolationGuides,      //!< 4D, signed 16-bit single-channel pixels
+        EclipsedDoubleScattering, //!< Coarse grid samples, reconstructed into a texture by the renderer
+    };
+    struct Artifact
+    {
+        QString path; //!< Relative to the model directory, with '/' as the separator
+        ArtifactKind kind=ArtifactKind::Other;
+        bool compressed=false;
+        std::vector<int> sizes; //!< Dimensions of the texture data, empty for non-textures
+        unsigned pixelSize=0;   //!< In bytes, zero for non-textures
+        qint64 size=0;          //!< Size of the whole file
+        // Position of altitude slice #0 and distance between the slices in uncompressed textures
+        // that are sliced by altitude, zeros for other files
+        qint64 firstSliceOffset=0;
+        qint64 sliceByteSize=0;
+        uint32_t checksum=0;    //!< CRC-32 of the whole file
+        // CRC-32 of each altitude slice, so that the reader can verify the slices it reads without reading
+        // the whole file. Empty for compressed textures, since they have their own per-slice checksums.
+        std::vector<uint32_t> sliceChecksums;
+    };
+
+    static constexpr uint32_t FORMAT_VERSION=1;
+
+    QByteArray parameters;
+    std::vector<Artifact> artifacts; //!< Sorted by path
+
+    const Artifact* find(QString const& path) const;
+    // Checks for a file or, if the path denotes a directory, for any file inside it
+    bool contains(QString const& path) const;
+};
+
+// Scans modelDir, which must contain params.atmo, and writes the manifest of its contents into it.
+// Returns empty string on success, error message otherwise.
+QString writeModelManifest(QString const& modelDir);
+// Throw DataLoadError on failure
+ModelManifest readModelManifest(QString const& path);
+// path is only used in error messages
+ModelManifest readModelManifest(QByteArray const& data, QString const& path);
+
+#endif
@@ -18,179 +18,257 @@
  */
 
 #include "TextureAverageComputer.hpp"
-#include "util.hpp"
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+#include <stdexcept>
 #include <QOpenGLFunctions_3_3_Core>
 
-static bool isPOT(const int x)
+namespace
 {
-    return roundDownToClosestPowerOfTwo(x) == x;
+
+const char vertexShaderSrc[]=1+R"(
+#version 330
+layout(location=0) in vec4 vertex;
+flat out int instanceIndex;
+void main()
+{
+    gl_Position = vertex;
+    instanceIndex = gl_InstanceID;
 }
+)";
 
-glm::vec4 TextureAverageComputer::getTextureAverageSimple(const GLuint texture, const int width, const int height,
-                                                          const GLuint unusedTextureUnitNum)
+// Sends each instance of the quad to its own layer of the render target
+const char geometryShaderSrc[]=1+R"(
+#version 330
+layout(triangles) in;
+layout(triangle_strip, max_vertices=3) out;
+flat in int instanceIndex[];
+flat out int layer;
+void main()
 {
-    // Get average value of the pixels as the value of the deepest mipmap level
-    gl.glActiveTexture(GL_TEXTURE0 + unusedTextureUnitNum);
-    gl.glBindTexture(GL_TEXTURE_2D, texture);
-    gl.glGenerateMipmap(GL_TEXTURE_2D);
-
-    using namespace std;
-    // Formula from the glspec, "Mipmapping" subsection in section 3.8.11 Texture Minification
-    const auto totalMipmapLevels = 1+floor(log2(max(width,height)));
-    const auto deepestLevel=totalMipmapLevels-1;
-
-#ifndef NDEBUG
-    // Sanity check
-    int deepestMipmapLevelWidth=-1, deepestMipmapLevelHeight=-1;
-    gl.glGetTexLevelParameteriv(GL_TEXTURE_2D, deepestLevel, GL_TEXTURE_WIDTH, &deepestMipmapLevelWidth);
-    gl.glGetTexLevelParameteriv(GL_TEXTURE_2D, deepestLevel, GL_TEXTURE_HEIGHT, &deepestMipmapLevelHeight);
-    assert(deepestMipmapLevelWidth==1);
-    assert(deepestMipmapLevelHeight==1);
+    for(int i=0; i<3; ++i)
+    {
+        gl_Position=gl_in[i].gl_Position;
+        gl_Layer=instanceIndex[0];
+        layer=instanceIndex[0];
+        EmitVertex();
+    }
+    EndPrimitive();
+}
+)";
+
+// In the reduction mode each output texel receives the sum of a block of source texels of its
+// layer. In the gathering mode the output is a row of texels, each summing the whole of the layer
+// with the index equal to its x coordinate.
+const char fragmentShaderSrc[]=R"(
+#if SOURCE_IS_ARRAY
+uniform sampler2DArray source;
+vec4 fetch(ivec2 pos, int layer) { return texelFetch(source, ivec3(pos, layer), 0); }
+#else
+uniform sampler2D source;
+vec4 fetch(ivec2 pos, int layer) { return texelFetch(source, pos, 0); }
+#endif
+uniform ivec2 sourceSize;
+#if !GATHER
+flat in int layer;
 #endif
+out vec4 sum;
+void main()
+{
+#if GATHER
+    int layer=int(gl_FragCoord.x);
+    ivec2 first=ivec2(0);
+    ivec2 last=sourceSize;
+#else
+    ivec2 first=ivec2(gl_FragCoord.xy)*REDUCTION_FACTOR;
+    ivec2 last=min(first+REDUCTION_FACTOR, sourceSize);
+#endif
+    vec4 s=vec4(0);
+    for(int y=first.y; y<last.y; ++y)
+        for(int x=first.x; x<last.x; ++x)
+            s+=fetch(ivec2(x,y), layer);
+    sum=s;
+}
+)";
 
-    glm::vec4 pixel;
-    gl.glGetTexImage(GL_TEXTURE_2D, deepestLevel, GL_RGBA, GL_FLOAT, &pixel[0]);
-    return pixel;
+std::unique_ptr<QOpenGLShaderProgram> makeProgram(const bool sourceIsArray, const bool gather, const int reductionFactor)
+{
+    auto program=std::make_unique<QOpenGLShaderProgram>();
+    const auto fragSrc=QString("#version 330\n"
+                               "#define SOURCE_IS_ARRAY %1\n"
+                               "#define GATHER %2\n"
+                               "#define REDUCTION_FACTOR %3\n").arg(int(sourceIsArray)).arg(int(gather)).arg(reductionFactor)
+                       + fragmentShaderSrc;
+    if(!program->addShaderFromSourceCode(QOpenGLShader::Vertex, vertexShaderSrc) ||
+       (!gather && !program->addShaderFromSourceCode(QOpenGLShader::Geometry, geometryShaderSrc)) ||
+       !program->addShaderFromSourceCode(QOpenGLShader::Fragment, fragSrc) ||
+       !program->link())
+    {
+        throw std::runtime_error("Failed to build texture reduction shader program: "+program->log().toStdString());
+    }
+    return program;
+}
+
+}
+
+// Clobbers: GL_TEXTURE_BINDING_2D, GL_TEXTURE_BINDING_2D_ARRAY
+void TextureAverageComputer::allocateIntermediateStorage(const int layerCount)
+{
+    const auto partialWidth  = std::max(1, (width +REDUCTION_FACTOR-1)/REDUCTION_FACTOR);
+    const auto partialHeight = std::max(1, (height+REDUCTION_FACTOR-1)/REDUCTION_FACTOR);
+    for(const auto tex : partialSumsTextures)
+    {
+        gl.glBindTexture(GL_TEXTURE_2D_ARRAY, tex);
+        gl.glTexImage3D(GL_TEXTURE_2D_ARRAY,0,GL_RGBA32F,partialWidth,partialHeight,layerCount,0,GL_RGBA,GL_UNSIGNED_BYTE,nullptr);
+    }
+    gl.glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    gl.glBindTexture(GL_TEXTURE_2D, sumsTexture);
+    gl.glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA32F,layerCount,1,0,GL_RGBA,GL_UNSIGNED_BYTE,nullptr);
+    gl.glBindTexture(GL_TEXTURE_2D, 0);
+
+    allocatedLayerCount=layerCount;
 }
 
-// Clobbers:
-// GL_ACTIVE_TEXTURE, GL_TEXTURE_BINDING_2D,
-// input texture's minification filter
-glm::vec4 TextureAverageComputer::getTextureAverageWithWorkaround(const GLuint texture, const GLuint unusedTextureUnitNum)
+void TextureAverageComputer::startSumming(const GLuint texture, const GLenum target, const int layerCount,
+                                          const GLuint unusedTextureUnitNum)
 {
+    assert(target==GL_TEXTURE_2D_ARRAY || (target==GL_TEXTURE_2D && layerCount==1));
+
     GLint oldVAO=-1;
     gl.glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &oldVAO);
     GLint oldProgram=-1;
     gl.glGetIntegerv(GL_CURRENT_PROGRAM, &oldProgram);
     GLint oldViewport[4];
     gl.glGetIntegerv(GL_VIEWPORT, oldViewport);
-    GLint oldFBO=-1;
-    gl.glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &oldFBO);
-
-    // Play it safe: we don't want to make the GPU struggle with very large textures
-    // if we happen to make them ~4 times larger. Instead round the dimensions down.
-    const auto potWidth  = roundDownToClosestPowerOfTwo(npotWidth);
-    const auto potHeight = roundDownToClosestPowerOfTwo(npotHeight);
+    GLint oldDrawFBO=-1, oldReadFBO=-1;
+    gl.glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &oldDrawFBO);
+    gl.glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &oldReadFBO);
 
     gl.glActiveTexture(GL_TEXTURE0 + unusedTextureUnitNum);
-    gl.glBindTexture(GL_TEXTURE_2D, texture);
-    gl.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
-    blitTexProgram->bind();
-    blitTexProgram->setUniformValue("tex", unusedTextureUnitNum);
+    if(layerCount > allocatedLayerCount)
+        allocateIntermediateStorage(layerCount);
+    // The sampler makes any texture complete for texelFetch, regardless of its own filtering parameters
+    gl.glBindSampler(unusedTextureUnitNum, sampler);
+    gl.glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    gl.glBindVertexArray(vao);
 
-    gl.glBindFramebuffer(GL_DRAW_FRAMEBUFFER, potFBO);
-    gl.glViewport(0,0,potWidth,potHeight);
+    GLuint source=texture;
+    bool sourceIsArray = target==GL_TEXTURE_2D_ARRAY;
+    int sourceWidth=width, sourceHeight=height;
+    for(int pass=0; sourceWidth>REDUCTION_FACTOR || sourceHeight>REDUCTION_FACTOR; ++pass)
+    {
+        const auto outWidth  = (sourceWidth +REDUCTION_FACTOR-1)/REDUCTION_FACTOR;
+        const auto outHeight = (sourceHeight+REDUCTION_FACTOR-1)/REDUCTION_FACTOR;
+        const auto destination=partialSumsTextures[pass%2];
+        gl.glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, destination, 0);
+        gl.glViewport(0,0,outWidth,outHeight);
+
+        auto& program=*reduceProgram[sourceIsArray];
+        program.bind();
+        program.setUniformValue("source", unusedTextureUnitNum);
+        gl.glUniform2i(program.uniformLocation("sourceSize"), sourceWidth, sourceHeight);
+        gl.glBindTexture(sourceIsArray ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D, source);
+        gl.glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, layerCount);
+
+        source=destination;
+        sourceIsArray=true;
+        sourceWidth=outWidth;
+        sourceHeight=outHeight;
+    }
 
-    gl.glBindVertexArray(vao);
+    gl.glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, sumsTexture, 0);
+    gl.glViewport(0,0,layerCount,1);
+    auto& program=*gatherProgram[sourceIsArray];
+    program.bind();
+    program.setUniformValue("source", unusedTextureUnitNum);
+    gl.glUniform2i(program.uniformLocation("sourceSize"), sourceWidth, sourceHeight);
+    gl.glBindTexture(sourceIsArray ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D, source);
     gl.glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-    gl.glBindVertexArray(oldVAO);
 
+    // Asynchronous readback: the data will be waited for only when mapping the buffer. The buffers of the
+    // sums already collected are reused, so there are only as many of them as summations kept in flight.
+    GLuint pbo=0;
+    if(freePBOs.empty())
+    {
+        gl.glGenBuffers(1, &pbo);
+    }
+    else
+    {
+        pbo=freePBOs.back();
+        freePBOs.pop_back();
+    }
+    GLint oldPBO=0;
+    gl.glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &oldPBO);
+    gl.glReadBuffer(GL_COLOR_ATTACHMENT0);
+    gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    gl.glBufferData(GL_PIXEL_PACK_BUFFER, layerCount*sizeof(glm::vec4), nullptr, GL_STREAM_READ);
+    gl.glReadPixels(0,0,layerCount,1,GL_RGBA,GL_FLOAT,nullptr);
+    gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, oldPBO);
+    pendingSums.push_back({pbo, layerCount});
+
+    gl.glBindSampler(unusedTextureUnitNum, 0);
+    gl.glBindVertexArray(oldVAO);
     gl.glViewport(oldViewport[0], oldViewport[1], oldViewport[2], oldViewport[3]);
-    gl.glBindFramebuffer(GL_DRAW_FRAMEBUFFER, oldFBO);
-
+    gl.glBindFramebuffer(GL_DRAW_FRAMEBUFFER, oldDrawFBO);
+    gl.glBindFramebuffer(GL_READ_FRAMEBUFFER, oldReadFBO);
     gl.glUseProgram(oldProgram);
+}
 
-    return getTextureAverageSimple(potTex, potWidth, potHeight, unusedTextureUnitNum);
+void TextureAverageComputer::collectSums(std::vector<glm::vec4>& sums)
+{
+    assert(!pendingSums.empty());
+    const auto pending=pendingSums.front();
+    pendingSums.pop_front();
+    // The buffer is reusable even if mapping fails
+    freePBOs.push_back(pending.pbo);
+
+    const auto size = pending.layerCount*sizeof(glm::vec4);
+    GLint oldPBO=0;
+    gl.glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &oldPBO);
+    gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, pending.pbo);
+    const auto data=gl.glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+    if(!data)
+    {
+        gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, oldPBO);
+        throw std::runtime_error("Failed to map the buffer with texture sums");
+    }
+    sums.resize(pending.layerCount);
+    std::memcpy(sums.data(), data, size);
+    gl.glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, oldPBO);
 }
 
 glm::vec4 TextureAverageComputer::getTextureAverage(const GLuint texture, const GLuint unusedTextureUnitNum)
 {
-    if(workaroundNeeded && !(isPOT(npotWidth) && isPOT(npotHeight)))
-        return getTextureAverageWithWorkaround(texture, unusedTextureUnitNum);
-    return getTextureAverageSimple(texture, npotWidth, npotHeight, unusedTextureUnitNum);
+    assert(pendingSums.empty());
+    startSumming(texture, GL_TEXTURE_2D, 1, unusedTextureUnitNum);
+    collectSums(singleSum);
+    return singleSum[0] / float(width*height);
 }
 
-void TextureAverageComputer::init(const GLuint unusedTextureUnitNum)
+TextureAverageComputer::TextureAverageComputer(QOpenGLFunctions_3_3_Core& gl, const int texWidth, const int texHeight)
+    : gl(gl)
+    , width(texWidth)
+    , height(texHeight)
 {
-    GLuint texture = -1;
-    gl.glGenTextures(1, &texture);
-    assert(texture>0);
-    gl.glActiveTexture(GL_TEXTURE0 + unusedTextureUnitNum);
-    gl.glBindTexture(GL_TEXTURE_2D, texture);
-
-    std::vector<glm::vec4> data;
-    for(int n=0; n<10; ++n)
-        data.emplace_back(1,1,1,1);
-    for(int n=0; n<10; ++n)
-        data.emplace_back(1,1,1,0);
-    for(int n=0; n<10; ++n)
-        data.emplace_back(1,1,0,0);
-    for(int n=0; n<10; ++n)
-        data.emplace_back(1,0,0,0);
-
-    constexpr int width = 63;
-    for(int n=data.size(); n<width; ++n)
-        data.emplace_back(0,0,0,0);
-
-    gl.glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA8,data.size(),1,0,GL_RGBA,GL_FLOAT,&data[0][0]);
-    const auto mipmapAverage = getTextureAverageSimple(texture, width, 1, unusedTextureUnitNum);
-
-    const auto sum = std::accumulate(data.begin(), data.end(), glm::vec4(0,0,0,0));
-    const auto trueAverage = sum / float(data.size());
-    std::cerr << "Test texture true average: "
-              << trueAverage[0] << ", "
-              << trueAverage[1] << ", "
-              << trueAverage[2] << ", "
-              << trueAverage[3] << "\n";
-    std::cerr << "Test texture mipmap average: "
-              << mipmapAverage[0] << ", "
-              << mipmapAverage[1] << ", "
-              << mipmapAverage[2] << ", "
-              << mipmapAverage[3] << "\n";
-
-    const auto diff = mipmapAverage - trueAverage;
-    using std::abs;
-    const auto maxDiff = std::max({abs(diff[0]),abs(diff[1]),abs(diff[2]),abs(diff[3])});
-    workaroundNeeded = maxDiff >= 2./255.;
-
-    if(workaroundNeeded)
+    for(const bool sourceIsArray : {false, true})
     {
-        std::cerr << "WARNING: Mipmap average is unusable, will resize textures to "
-                     "power-of-two size when average value is required.\n";
-    }
-    else
-    {
-        std::cerr << "Mipmap average works correctly\n";
+        reduceProgram[sourceIsArray]=makeProgram(sourceIsArray, false, REDUCTION_FACTOR);
+        gatherProgram[sourceIsArray]=makeProgram(sourceIsArray, true, REDUCTION_FACTOR);
     }
 
-    gl.glBindTexture(GL_TEXTURE_2D, 0);
-    gl.glDeleteTextures(1, &texture);
+    gl.glGenFramebuffers(1, &fbo);
+    gl.glGenTextures(2, partialSumsTextures);
+    gl.glGenTextures(1, &sumsTexture);
 
-    inited = true;
-}
-
-// Clobbers: GL_TEXTURE_BINDING_2D, GL_ARRAY_BUFFER_BINDING
-TextureAverageComputer::TextureAverageComputer(QOpenGLFunctions_3_3_Core& gl, const int texWidth, const int texHeight,
-                                               const GLenum internalFormat, const GLuint unusedTextureUnitNum)
-    : gl(gl)
-    , npotWidth(texWidth)
-    , npotHeight(texHeight)
-{
-    if(!inited) init(unusedTextureUnitNum);
-    if(!workaroundNeeded) return;
-    const auto potWidth  = roundDownToClosestPowerOfTwo(npotWidth);
-    const auto potHeight = roundDownToClosestPowerOfTwo(npotHeight);
-    if(potWidth == npotWidth && potHeight == npotHeight)
-        return;
+    gl.glGenSamplers(1, &sampler);
+    gl.glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    gl.glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
     GLint oldVAO=-1;
     gl.glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &oldVAO);
-    GLint oldFBO=-1;
-    gl.glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &oldFBO);
-
-    gl.glGenFramebuffers(1, &potFBO);
-    gl.glGenTextures(1, &potTex);
-    gl.glActiveTexture(GL_TEXTURE0 + unusedTextureUnitNum);
-    gl.glBindTexture(GL_TEXTURE_2D, potTex);
-    gl.glTexImage2D(GL_TEXTURE_2D,0,internalFormat,potWidth,potHeight,0,GL_RGBA,GL_UNSIGNED_BYTE,nullptr);
-    gl.glBindTexture(GL_TEXTURE_2D,0);
-    gl.glBindFramebuffer(GL_DRAW_FRAMEBUFFER,potFBO);
-    gl.glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,potTex,0);
-    [[maybe_unused]] const auto status=gl.glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
-    assert(status==GL_FRAMEBUFFER_COMPLETE);
-    gl.glBindFramebuffer(GL_DRAW_FRAMEBUFFER,0);
-
     gl.glGenVertexArrays(1, &vao);
     gl.glBindVertexArray(vao);
     gl.glGenBuffers(1, &vbo);
@@ -207,38 +285,18 @@ TextureAverageComputer::TextureAverageComputer(QOpenGLFunctions_3_3_Core& gl, co
     constexpr int coordsPerVertex=2;
     gl.glVertexAttribPointer(attribIndex, coordsPerVertex, GL_FLOAT, false, 0, 0);
     gl.glEnableVertexAttribArray(attribIndex);
-
-    blitTexProgram.reset(new QOpenGLShaderProgram);
-    blitTexProgram->addShaderFromSourceCode(QOpenGLShader::Vertex, 1+R"(
-#version 330
-layout(location=0) in vec4 vertex;
-out vec2 texcoord;
-void main()
-{
-    gl_Position = vertex;
-    texcoord = vertex.st*0.5+vec2(0.5);
-}
-)");
-    blitTexProgram->addShaderFromSourceCode(QOpenGLShader::Fragment, 1+R"(
-#version 330
-in vec2 texcoord;
-out vec4 color;
-uniform sampler2D tex;
-void main()
-{
-    color = texture(tex, texcoord);
-}
-)");
-    blitTexProgram->link();
-
-    gl.glBindFramebuffer(GL_DRAW_FRAMEBUFFER, oldFBO);
     gl.glBindVertexArray(oldVAO);
 }
 
 TextureAverageComputer::~TextureAverageComputer()
 {
-    gl.glDeleteTextures(1, &potTex);
-    gl.glDeleteFramebuffers(1, &potFBO);
+    gl.glDeleteTextures(2, partialSumsTextures);
+    gl.glDeleteTextures(1, &sumsTexture);
+    for(const auto& pending : pendingSums)
+        freePBOs.push_back(pending.pbo);
+    gl.glDeleteBuffers(freePBOs.size(), freePBOs.data());
+    gl.glDeleteSamplers(1, &sampler);
+    gl.glDeleteFramebuffers(1, &fbo);
     gl.glDeleteVertexArrays(1, &vao);
     gl.glDeleteBuffers(1, &vbo);
 }
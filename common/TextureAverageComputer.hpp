@@ -20,31 +20,67 @@
 #ifndef INCLUDE_ONCE_386B7A49_CC0D_40CF_AC50_73493DF4B289
 #define INCLUDE_ONCE_386B7A49_CC0D_40CF_AC50_73493DF4B289
 
+#include <deque>
 #include <memory>
+#include <vector>
 #include <glm/glm.hpp>
 #include <QOpenGLContext>
 #include <QOpenGLShaderProgram>
 
 class QOpenGLFunctions_3_3_Core;
+
+/* Computes sums of texels of 2D textures or of each layer of 2D array textures by multi-pass reduction
+ * on the GPU. Each pass sums blocks of REDUCTION_FACTOR×REDUCTION_FACTOR texels of all the layers in
+ * one instanced draw call, so any texture size is summed exactly, without resampling.
+ *
+ * The sums are read back into pixel buffer objects: startSumming() only issues the commands, and
+ * collectSums() waits for the results. Each summation in flight has its own buffer, and collectSums()
+ * returns the sums of the oldest one, so the caller can start summing the next texture before
+ * collecting the sums of the previous one, keeping the GPU busy while the CPU waits for the results.
+ */
 class TextureAverageComputer
 {
+    static constexpr int REDUCTION_FACTOR = 8;
+
     QOpenGLFunctions_3_3_Core& gl;
-    std::unique_ptr<QOpenGLShaderProgram> blitTexProgram;
-    GLuint potFBO = 0;
-    GLuint potTex = 0;
+    // Indexed by whether the source texture is a 2D array texture
+    std::unique_ptr<QOpenGLShaderProgram> reduceProgram[2];
+    std::unique_ptr<QOpenGLShaderProgram> gatherProgram[2];
+    GLuint fbo = 0;
+    GLuint sampler = 0;
+    GLuint partialSumsTextures[2] = {};
+    GLuint sumsTexture = 0;
     GLuint vbo = 0, vao = 0;
-    GLint npotWidth, npotHeight;
-    static inline bool inited = false;
-    static inline bool workaroundNeeded = false;
+    GLint width, height;
+    int allocatedLayerCount = 0;
+    struct PendingSums
+    {
+        GLuint pbo;
+        int layerCount;
+    };
+    std::deque<PendingSums> pendingSums; // oldest first
+    std::vector<GLuint> freePBOs;
+    std::vector<glm::vec4> singleSum;
 
-    void init(GLuint unusedTextureUnitNum);
-    glm::vec4 getTextureAverageSimple(GLuint texture, int width, int height, GLuint unusedTextureUnitNum);
-    glm::vec4 getTextureAverageWithWorkaround(GLuint texture, GLuint unusedTextureUnitNum);
+    void allocateIntermediateStorage(int layerCount);
 public:
-    glm::vec4 getTextureAverage(GLuint texture, GLuint unusedTextureUnitNum);
-    TextureAverageComputer(QOpenGLFunctions_3_3_Core&, int texW, int texH,
-                           GLenum internalFormat, GLuint unusedTextureUnitNum);
+    // Clobbers: GL_ARRAY_BUFFER_BINDING
+    TextureAverageComputer(QOpenGLFunctions_3_3_Core&, int texW, int texH);
     ~TextureAverageComputer();
+
+    /* Starts summation of the texture of the size given to the constructor. The target is either
+     * GL_TEXTURE_2D, in which case layerCount must be 1, or GL_TEXTURE_2D_ARRAY. In the latter case
+     * the first layerCount layers are summed separately.
+     * The texture may be modified by the following GL commands without waiting for the sums to be collected.
+     * Clobbers: GL_ACTIVE_TEXTURE, texture bindings of the unit
+     */
+    void startSumming(GLuint texture, GLenum target, int layerCount, GLuint unusedTextureUnitNum);
+    // Waits for the sums requested by the oldest startSumming() call not yet collected and puts them into sums, one per layer
+    void collectSums(std::vector<glm::vec4>& sums);
+    int pendingSumCount() const { return pendingSums.size(); }
+
+    // Precondition: no sums are pending collection
+    glm::vec4 getTextureAverage(GLuint texture, GLuint unusedTextureUnitNum);
 };
 
 #endif
@@ -21,12 +21,14 @@
 #define INCLUDE_ONCE_3A48838B_2D1A_4326_9585_2E19F9D300D1
 
 #include <cassert>
+#include <vector>
 #include <algorithm>
 #include <unsupported/Eigen/FFT>
 
-void fourierInterpolate(float const*const points, const std::size_t inPointCount,
-                        std::complex<float>*const intermediate /* must fit interpolationPointCount elements */,
-                        float*const interpolated, std::size_t const interpolationPointCount)
+// Interpolates using the given FFT object, which caches the plans for the sizes it has been used with
+inline void fourierInterpolate(Eigen::FFT<float>& fft, float const*const points, const std::size_t inPointCount,
+                               std::complex<float>*const intermediate /* must fit interpolationPointCount elements */,
+                               float*const interpolated, std::size_t const interpolationPointCount)
 {
     if(inPointCount==interpolationPointCount)
     {
@@ -36,7 +38,6 @@ void fourierInterpolate(float const*const points, const std::size_t inPointCount
 
     assert(interpolationPointCount > inPointCount);
 
-    Eigen::FFT<float> fft;
     fft.fwd(intermediate, points, inPointCount);
     if(inPointCount % 2)
     {
@@ -62,4 +63,40 @@ void fourierInterpolate(float const*const points, const std::size_t inPointCount
         interpolated[i] *= float(interpolationPointCount)/inPointCount;
 }
 
+inline void fourierInterpolate(float const*const points, const std::size_t inPointCount,
+                               std::complex<float>*const intermediate /* must fit interpolationPointCount elements */,
+                               float*const interpolated, std::size_t const interpolationPointCount)
+{
+    Eigen::FFT<float> fft;
+    fourierInterpolate(fft, points, inPointCount, intermediate, interpolated, interpolationPointCount);
+}
+
+/* Fourier interpolation from inPointCount to interpolationPointCount points, for repeated use with these sizes.
+ * The FFT plans for both transform lengths are created on the first use and kept, as is the buffer for the
+ * spectrum, so the calls after the first one don't allocate anything.
+ */
+class FourierInterpolator
+{
+    Eigen::FFT<float> fft;
+    std::vector<std::complex<float>> intermediate;
+    std::size_t inPointCount;
+    std::size_t interpolationPointCount;
+public:
+    FourierInterpolator(const std::size_t inPointCount, const std::size_t interpolationPointCount)
+        : intermediate(interpolationPointCount)
+        , inPointCount(inPointCount)
+        , interpolationPointCount(interpolationPointCount)
+    {
+        assert(interpolationPointCount >= inPointCount);
+    }
+    std::size_t inputSize() const { return inPointCount; }
+    std::size_t outputSize() const { return interpolationPointCount; }
+
+    // points must have inputSize() elements, interpolated must fit outputSize() elements
+    void interpolate(float const*const points, float*const interpolated)
+    {
+        fourierInterpolate(fft, points, inPointCount, intermediate.data(), interpolated, interpolationPointCount);
+    }
+};
+
 #endif
@@ -20,9 +20,14 @@
 #ifndef INCLUDE_ONCE_F820C110_1DC9_40B4_8442_EDD0227CB7E8
 #define INCLUDE_ONCE_F820C110_1DC9_40B4_8442_EDD0227CB7E8
 
-#include <Eigen/Dense>
 #include <cassert>
 #include <vector>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+template<typename Number> class SplineOrder2Interpolator;
 
 template<typename Number, typename Vec2>
 class SplineOrder2InterpolationFunction
@@ -39,6 +44,7 @@ public:
     };
     SplineOrder2InterpolationFunction()=default;
     SplineOrder2InterpolationFunction(std::vector<Chunk>&& chunks) : chunks(chunks) {}
+    SplineOrder2InterpolationFunction(const Number xMin, std::vector<Chunk>&& chunks) : chunks(chunks), xMin(xMin) {}
     Number sample(Number const x) const
     {
         assert(!chunks.empty());
@@ -54,99 +60,211 @@ public:
         const auto c = chunks[chunkIndex].c;
         return a*x*x + b*x + c;
     }
+
+    /* Samples the function at count points, which must be in ascending order. Unlike sample(), the points are
+     * clamped to the domain of definition instead of being rejected. The chunks are found by a single pass
+     * over both the points and the chunks, instead of a search per point.
+     */
+    void sampleMany(Number const*const sortedXs, const std::size_t count, Number*const out) const
+    {
+        sampleMany<1>(this, sortedXs, count, out);
+    }
+
+    /* Samples FuncCount functions at count sorted points like the single-function overload does. The functions
+     * must have been interpolated over the same abscissae, e.g. by the same SplineOrder2Interpolator, so that they
+     * share the chunk borders. The output is interleaved: out[k*FuncCount+f] is the value of function f at point k.
+     *
+     * The chunk search is shared by all the functions, and their coefficients are kept in small arrays, so that
+     * the evaluation for a point is a short fixed-length loop the compiler can vectorize (e.g. the 4 components
+     * of a vec4 evaluated in one SIMD operation).
+     */
+    template<std::size_t FuncCount>
+    static void sampleMany(SplineOrder2InterpolationFunction const (&functions)[FuncCount],
+                           Number const*const sortedXs, const std::size_t count, Number*const out)
+    {
+        sampleMany<FuncCount>(&functions[0], sortedXs, count, out);
+    }
 private:
+    template<std::size_t FuncCount>
+    static void sampleMany(SplineOrder2InterpolationFunction const*const functions,
+                           Number const*const sortedXs, const std::size_t count, Number*const out)
+    {
+        static_assert(FuncCount>0);
+        auto const& chunks0=functions[0].chunks;
+        assert(!chunks0.empty());
+        assert(std::is_sorted(sortedXs, sortedXs+count));
+        for(std::size_t f=1; f<FuncCount; ++f)
+        {
+            assert(functions[f].chunks.size()==chunks0.size());
+            assert(functions[f].xMin==functions[0].xMin);
+        }
+
+        const auto xMin=functions[0].xMin;
+        const auto xMax=chunks0.back().xMax;
+        Number a[FuncCount], b[FuncCount], c[FuncCount];
+        const auto loadChunk=[&](const std::size_t chunkIndex)
+        {
+            for(std::size_t f=0; f<FuncCount; ++f)
+            {
+                auto const& chunk=functions[f].chunks[chunkIndex];
+                a[f]=chunk.a;
+                b[f]=chunk.b;
+                c[f]=chunk.c;
+            }
+        };
+
+        std::size_t chunkIndex=0;
+        loadChunk(chunkIndex);
+        for(std::size_t k=0; k<count; ++k)
+        {
+            const auto x=std::clamp(sortedXs[k], xMin, xMax);
+            if(x > chunks0[chunkIndex].xMax)
+            {
+                do ++chunkIndex;
+                while(x > chunks0[chunkIndex].xMax);
+                loadChunk(chunkIndex);
+            }
+            Number*const values=out+k*FuncCount;
+            for(std::size_t f=0; f<FuncCount; ++f)
+                values[f] = a[f]*x*x + b[f]*x + c[f];
+        }
+    }
+
     std::vector<Chunk> chunks;
+    Number xMin=std::numeric_limits<Number>::lowest(); // left border of the domain of definition of the first chunk
+
+    friend class SplineOrder2Interpolator<Number>;
 };
 
-template<typename Vec2, typename Number=typename std::remove_cv<typename std::remove_reference<decltype(Vec2().x)>::type>::type>
-SplineOrder2InterpolationFunction<Number,Vec2> splineInterpolationOrder2(Vec2 const*const points, const std::size_t pointCount)
+/* Second-order spline through n points. The spline consists of n-2 parabolas, each going through one of the
+ * internal points, with the knots at the midpoints between internal points. The outermost parabolas also go
+ * through the endpoints. The value and the derivative are continuous at the knots.
+ *
+ * The unknowns are the derivatives D[j] at the n-1 knots, including the endpoints. Since the derivative is
+ * linear between the knots, each parabola is determined by the derivatives at its ends and the value at its
+ * internal point. Requiring continuity of value at the knots and passage through the endpoints gives a
+ * tridiagonal, diagonally dominant, system for D[j], which depends only on the abscissae of the points.
+ *
+ * This class factorizes the system once for a given set of abscissae, so that interpolation of any number of
+ * sets of ordinates costs O(n) each.
+ */
+template<typename Number>
+class SplineOrder2Interpolator
 {
-    assert(pointCount>=3);
-    assert(std::is_sorted(points,points+pointCount,[](Vec2 const& a, Vec2 const& b){return a.x<b.x;}));
+    std::vector<Number> xs;
+    std::vector<Number> knots;
+    // Thomas algorithm factorization of the system: the subdiagonal, the modified superdiagonal
+    // and the reciprocals of the modified diagonal
+    std::vector<Number> lower, upper, diagInv;
+    std::vector<Number> derivs; // solution for the current ordinates
 
-    const auto sqr=[](Number x){ return x*x; };
-    enum { A=0, B=1, C=2 };
-
-    const int n=pointCount;
-    const int N=3*(n-2);
-
-    using namespace Eigen;
-    using Matrix=Eigen::Matrix<Number, Dynamic, Dynamic>;
-    using Vector=Eigen::Matrix<Number, Dynamic, 1>;
-    Matrix M=Matrix::Zero(N, N);
-    Vector R=Vector::Zero(N);
-
-    // All indices in the comments are 1-based, the equations are written in Wolfram Language
-
-    // Values of first and last functions at endpoints must equal ordinates of corresponding endpoint.
-    // This gives two equations. First:
-    //  a[1] points[[1, 1]]^2 + b[1] points[[1, 1]] + c[1] == points[[1, 2]]
-    /*a[1]*/M(0, 3*0+A)=sqr(points[0].x);
-    /*b[1]*/M(0, 3*0+B)=    points[0].x ;
-    /*c[1]*/M(0, 3*0+C)=1;
-    /*RHS*/ R(0)=points[0].y;
-    // And second:
-    //  a[n - 2] points[[n, 1]]^2 + b[n - 2] points[[n, 1]] + c[n - 2] == points[[n, 2]]
-    /*a[n-2]*/M(1, 3*(n-2-1)+A)=sqr(points[n-1].x);
-    /*b[n-2]*/M(1, 3*(n-2-1)+B)=    points[n-1].x ;
-    /*c[n-2]*/M(1, 3*(n-2-1)+C)=1;
-    /* RHS */ R(1)=points[n-1].y;
-
-    // Value of ith function at (i + 1)th point must be equal to the point ordinate.
-    // This gives (n-2) equations:
-    //  Table[a[i] points[[i + 1, 1]]^2 + b[i] points[[i + 1, 1]] + c[i] == points[[i + 1, 2]], {i, n - 2}]
-    for(int i=0; i<n-2; ++i)
+    Number leftLength(const std::size_t i) const { return xs[i+1]-knots[i]; }   // from the left knot of parabola i to its internal point
+    Number rightLength(const std::size_t i) const { return knots[i+1]-xs[i+1]; } // from the internal point of parabola i to its right knot
+public:
+    SplineOrder2Interpolator(Number const*const abscissae, const std::size_t pointCount)
+        : xs(abscissae, abscissae+pointCount)
     {
-        /*a[i]*/M(2+i, 3*i+A)=sqr(points[i+1].x);
-        /*b[i]*/M(2+i, 3*i+B)=    points[i+1].x ;
-        /*c[i]*/M(2+i, 3*i+C)=1;
-        /*RHS*/ R(2+i)=points[i+1].y;
-    }
+        assert(pointCount>=3);
+        assert(std::is_sorted(xs.begin(), xs.end()));
 
-    // Value of ith function at midpoint between points (i + 1) and (i + 2) must agree with that of (i + 1)th function
-    // This gives (n-3) equations:
-    //  Table[a[i] ((points[[i + 1, 1]] + points[[i + 2, 1]])/2)^2 + b[i] (points[[i + 1, 1]] + points[[i + 2, 1]])/2 + c[i] == 
-    //          a[i + 1] ((points[[i + 1, 1]] + points[[i + 2, 1]])/2)^2 + b[i + 1] (points[[i + 1, 1]] + points[[i + 2, 1]])/2 + c[i + 1]
-    //        , {i, n - 3}]
-    for(int i=0; i<n-3; ++i)
-    {
-        /*a[i]*/  M(n+i, 3*i+A)     =  sqr(0.5*(points[i+1].x+points[i+2].x));
-        /*b[i]*/  M(n+i, 3*i+B)     =      0.5*(points[i+1].x+points[i+2].x) ;
-        /*c[i]*/  M(n+i, 3*i+C)     =  1;
-        /*a[i+1]*/M(n+i, 3*(i+1)+A) = -sqr(0.5*(points[i+1].x+points[i+2].x));
-        /*b[i+1]*/M(n+i, 3*(i+1)+B) = -    0.5*(points[i+1].x+points[i+2].x) ;
-        /*c[i+1]*/M(n+i, 3*(i+1)+C) = -1;
-    }
+        const auto n=pointCount;
+        // knots[j] is the knot j-1 in the terms of the description above
+        knots.reserve(n-1);
+        knots.push_back(xs[0]);
+        for(std::size_t i=0; i<n-3; ++i)
+            knots.push_back((xs[i+1]+xs[i+2])/2);
+        knots.push_back(xs[n-1]);
 
-    // Same for derivatives at midpoints, giving us another (n-3) equations:
-    //  Table[2 a[i] (points[[i + 1, 1]] + points[[i + 2, 1]])/2 + b[i] == 2 a[i + 1] (points[[i + 1, 1]] + points[[i + 2, 1]])/2 + b[i + 1]
-    //        , {i, n - 3}]
-    for(int i=0; i<n-3; ++i)
-    {
-        /*a[i]*/  M(2*n-3+i, 3*i+A)     =  points[i+1].x+points[i+2].x;
-        /*b[i]*/  M(2*n-3+i, 3*i+B)     =  1;
-        /*a[i+1]*/M(2*n-3+i, 3*(i+1)+A) = -(points[i+1].x+points[i+2].x);
-        /*b[i+1]*/M(2*n-3+i, 3*(i+1)+B) = -1;
+        // Coefficients of the equations for derivatives at the left and right knots of parabola i that come
+        // from the difference between the values at its internal point and at its left or right knot:
+        //   y[i+1]-V_left  = derivLeft*u*(u+2v)/(2w) + derivRight*u^2/(2w)
+        //   V_right-y[i+1] = derivLeft*v^2/(2w)      + derivRight*v*(2u+v)/(2w)
+        // where u and v are the lengths of the left and right parts of the parabola's domain, and w=u+v.
+        const auto m=n-1;
+        lower.resize(m);
+        upper.resize(m);
+        diagInv.resize(m);
+        derivs.resize(m);
+        std::vector<Number> diag(m);
+        for(std::size_t i=0; i<n-2; ++i)
+        {
+            const auto u=leftLength(i), v=rightLength(i), w=u+v;
+            // The left equation of parabola 0 connects its left end with the first point,
+            // and for other parabolas it's summed with the right equation of the previous one.
+            diag[i]  += u*(u+2*v)/(2*w);
+            upper[i]  = u*u/(2*w);
+            lower[i+1]= v*v/(2*w);
+            diag[i+1] = v*(2*u+v)/(2*w);
+        }
+        lower[0]=0;
+        upper[m-1]=0;
+
+        // Forward elimination that doesn't depend on the right-hand side
+        diagInv[0]=1/diag[0];
+        upper[0]*=diagInv[0];
+        for(std::size_t r=1; r<m; ++r)
+        {
+            diagInv[r]=1/(diag[r]-lower[r]*upper[r-1]);
+            upper[r]*=diagInv[r];
+        }
     }
 
-    const Vector ABCs = M.colPivHouseholderQr().solve(R);
+    std::size_t pointCount() const { return xs.size(); }
+    bool hasAbscissae(Number const*const abscissae, const std::size_t count) const
+    { return std::equal(xs.begin(), xs.end(), abscissae, abscissae+count); }
+
+    // Computes the spline through the points whose abscissae must be the same as those given to the constructor.
+    // The function object passed is reused to avoid reallocation when the same one is filled repeatedly.
+    template<typename Vec2, typename Number2>
+    void interpolate(Vec2 const*const points, SplineOrder2InterpolationFunction<Number2,Vec2>& function)
+    {
+        static_assert(std::is_same_v<Number,Number2>);
+        const auto n=xs.size();
+        const auto m=n-1;
+        for(std::size_t k=0; k<n; ++k)
+            assert(points[k].x==xs[k]);
 
-    std::vector<typename SplineOrder2InterpolationFunction<Number,Vec2>::Chunk> coefs;
+        // Right-hand sides of the equations are the differences of ordinates of the adjacent points
+        derivs[0]=(points[1].y-points[0].y)*diagInv[0];
+        for(std::size_t r=1; r<m; ++r)
+            derivs[r]=(points[r+1].y-points[r].y-lower[r]*derivs[r-1])*diagInv[r];
+        for(std::size_t r=m-1; r-->0;)
+            derivs[r]-=upper[r]*derivs[r+1];
 
-    // Left endpoint
-    coefs.emplace_back((points[1].x+points[2].x)/2,
-                       ABCs(A), ABCs(B), ABCs(C));
+        function.xMin=xs[0];
+        auto& chunks=function.chunks;
+        chunks.clear();
+        for(std::size_t i=0; i<n-2; ++i)
+        {
+            const auto u=leftLength(i), w=u+rightLength(i);
+            const auto L=knots[i];
+            const auto dL=derivs[i];
+            // p(x) = vL + dL (x-L) + q (x-L)^2
+            const auto q=(derivs[i+1]-dL)/(2*w);
+            const auto vL=points[i+1].y-dL*u-q*u*u;
+            chunks.emplace_back(knots[i+1], q, dL-2*q*L, vL-dL*L+q*L*L);
+        }
+    }
 
-    // Internal points
-    for(int i=1; i<n-3; ++i)
-        coefs.emplace_back((points[i+1].x+points[i+2].x)/2,
-                           ABCs(3*i+A), ABCs(3*i+B), ABCs(3*i+C));
+    template<typename Vec2>
+    auto interpolate(Vec2 const*const points)
+    {
+        SplineOrder2InterpolationFunction<Number,Vec2> function;
+        interpolate(points, function);
+        return function;
+    }
+};
 
-    // Right endpoint
-    coefs.emplace_back(points[n-1].x,
-                       ABCs(3*(n-3)+A), ABCs(3*(n-3)+B), ABCs(3*(n-3)+C));
+template<typename Vec2, typename Number=typename std::remove_cv<typename std::remove_reference<decltype(Vec2().x)>::type>::type>
+SplineOrder2InterpolationFunction<Number,Vec2> splineInterpolationOrder2(Vec2 const*const points, const std::size_t pointCount)
+{
+    assert(pointCount>=3);
+    assert(std::is_sorted(points,points+pointCount,[](Vec2 const& a, Vec2 const& b){return a.x<b.x;}));
 
-    return coefs;
+    std::vector<Number> xs(pointCount);
+    for(std::size_t k=0; k<pointCount; ++k)
+        xs[k]=points[k].x;
+    return SplineOrder2Interpolator<Number>(xs.data(), pointCount).interpolate(points);
 }
 
 #endif
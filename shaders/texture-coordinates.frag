@@ -8,6 +8,11 @@ const float LENGTH_OF_HORIZ_RAY_FROM_GROUND_TO_TOA=sqrt(atmosphereHeight*(atmosp
 
 uniform sampler2D transmittanceTexture;
 uniform vec3 eclipsedDoubleScatteringTextureSize;
+// If stackedAltitudeSlices is true, the 3D textures sampled by the renderer contain two altitude slices stacked
+// along the third dimension: the lower slice in the first half of the depth, the upper one in the second half.
+// The values are then interpolated between the slices according to altitudeSliceFraction.
+uniform bool stackedAltitudeSlices;
+uniform float altitudeSliceFraction;
 
 struct Scattering4DCoords
 {
@@ -249,10 +254,24 @@ vec3 scattering4DCoordsToTex3DCoords(const Scattering4DCoords coords)
     return vec3(cosVZAtc, dotVStc, cosSZAtc);
 }
 
+vec4 sampleAltitudeSlices(const sampler3D tex, const vec3 coords)
+{
+    if(!stackedAltitudeSlices)
+        return texture(tex, coords);
+
+    // Clamp the coordinate the same way as ClampToEdge would do for a single slice,
+    // so that the filtering doesn't mix texels of different slices.
+    CONST float sliceDepth = textureSize(tex, 0).p / 2.;
+    CONST float coordInSlice = clamp(coords.p, 0.5/sliceDepth, 1-0.5/sliceDepth);
+    CONST vec4 lower = texture(tex, vec3(coords.st, coordInSlice/2));
+    CONST vec4 upper = texture(tex, vec3(coords.st, coordInSlice/2+0.5));
+    return mix(lower, upper, altitudeSliceFraction);
+}
+
 // Sample interpolation guides texture at the given coordinate
 float sampleGuide(const sampler3D guides, const vec3 coords)
 {
-    return texture(guides, coords).r;
+    return sampleAltitudeSlices(guides, coords).r;
 }
 float findGuide01Angle(const sampler3D guides, const vec3 indices)
 {
@@ -317,8 +336,8 @@ vec4 sample3DTextureGuided01_log(const sampler3D tex, const sampler3D interpolat
     CONST vec3 coordsNextRow = indicesToTexCoords(indicesNextRow, scatteringTextureSize.stp);
     CONST vec3 coordsCurrRow = indicesToTexCoords(indicesCurrRow, scatteringTextureSize.stp);
 
-    CONST vec4 valueCurrRow = texture(tex, coordsCurrRow);
-    CONST vec4 valueNextRow = texture(tex, coordsNextRow);
+    CONST vec4 valueCurrRow = sampleAltitudeSlices(tex, coordsCurrRow);
+    CONST vec4 valueNextRow = sampleAltitudeSlices(tex, coordsNextRow);
     CONST float epsilon = 1e-37; // Prevents passing zero to log
     CONST vec4 logValNextRow = log(max(valueNextRow, vec4(epsilon)));
     CONST vec4 logValCurrRow = log(max(valueCurrRow, vec4(epsilon)));
@@ -402,7 +421,7 @@ vec4 sample3DTexture(const sampler3D tex, const float cosSunZenithAngle, const f
     CONST Scattering4DCoords coords4d = scatteringTexVarsTo4DCoords(cosSunZenithAngle,cosViewZenithAngle,
                                                                     dotViewSun,altitude,viewRayIntersectsGround);
     CONST vec3 texCoords=scattering4DCoordsToTex3DCoords(coords4d);
-    return texture(tex, texCoords);
+    return sampleAltitudeSlices(tex, texCoords);
 }
 
 ScatteringTexVars scatteringTex4DCoordsToTexVars(const Scattering4DCoords coords)
@@ -577,7 +596,7 @@ vec4 sampleEclipseDoubleScattering3DTexture(const sampler3D tex, const float cos
     CONST float cosSZACoord=unitRangeToTexCoord(cosSZAToUnitRangeTexCoord(cosSunZenithAngle), eclipsedDoubleScatteringTextureSize[2]);
     CONST vec3 texCoords=vec3(coords2d, cosSZACoord);
 
-    return texture(tex, texCoords);
+    return sampleAltitudeSlices(tex, texCoords);
 }
 
 LightPollutionTexVars scatteringTexIndicesToLightPollutionTexVars(const vec2 texIndices)
@@ -0,0 +1,86 @@
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <iostream>
+#include "../common/spline-interpolation.hpp"
+
+#define FAIL(details) { std::cerr << __FILE__ << ":" << __LINE__  << ": test failed: " << details << "\n"; return 1; }
+
+struct Point
+{
+    float x, y;
+};
+
+// Compares sampleMany() for 4 functions sharing the abscissae against sample() called for each point and function,
+// in a setting similar to that of the eclipsed double scattering texture generation.
+int main()
+{
+    constexpr unsigned funcCount=4;
+    constexpr unsigned pointCount=20;
+    constexpr unsigned queryCount=1024;
+    constexpr unsigned repetitions=2000;
+
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<float> dist(0,1);
+
+    std::vector<float> xs(pointCount);
+    for(unsigned k=0; k<pointCount; ++k)
+        xs[k] = M_PI/2 * std::pow(float(k)/(pointCount-1), 1.5f) + 0.01f*dist(gen);
+    std::sort(xs.begin(), xs.end());
+
+    SplineOrder2Interpolator<float> interpolator(xs.data(), xs.size());
+    SplineOrder2InterpolationFunction<float,Point> functions[funcCount];
+    for(auto& function : functions)
+    {
+        std::vector<Point> points(pointCount);
+        for(unsigned k=0; k<pointCount; ++k)
+            points[k]={xs[k], dist(gen)};
+        interpolator.interpolate(points.data(), function);
+    }
+
+    std::vector<float> queries(queryCount);
+    for(unsigned k=0; k<queryCount; ++k)
+        queries[k] = xs.front() + (xs.back()-xs.front())*k/(queryCount-1);
+
+    using namespace std::chrono;
+    std::vector<float> scalarResults(funcCount*queryCount), batchResults(funcCount*queryCount);
+    volatile float sink; // keeps the repeated computations from being optimized out
+    const auto scalarStart=steady_clock::now();
+    for(unsigned r=0; r<repetitions; ++r)
+    {
+        for(unsigned k=0; k<queryCount; ++k)
+            for(unsigned f=0; f<funcCount; ++f)
+                scalarResults[k*funcCount+f]=functions[f].sample(queries[k]);
+        sink=scalarResults[r%scalarResults.size()];
+    }
+    const auto scalarTime=duration<double>(steady_clock::now()-scalarStart).count();
+
+    const auto batchStart=steady_clock::now();
+    for(unsigned r=0; r<repetitions; ++r)
+    {
+        SplineOrder2InterpolationFunction<float,Point>::sampleMany(functions, queries.data(), queryCount, batchResults.data());
+        sink=batchResults[r%batchResults.size()];
+    }
+    const auto batchTime=duration<double>(steady_clock::now()-batchStart).count();
+    static_cast<void>(sink);
+
+    for(unsigned k=0; k<funcCount*queryCount; ++k)
+    {
+        if(std::abs(batchResults[k]-scalarResults[k]) > 1e-5f*std::max(1.f, std::abs(scalarResults[k])))
+            FAIL("sampleMany() result " << batchResults[k] << " differs from sample() result " << scalarResults[k]
+                 << " for function " << k%funcCount << " at x=" << queries[k/funcCount]);
+    }
+
+    // Out-of-range points must be clamped to the domain
+    const float outOfRange[]={xs.front()-1, xs.back()+1};
+    float clamped[2];
+    functions[0].sampleMany(outOfRange, 2, clamped);
+    if(clamped[0]!=functions[0].sample(xs.front()) || clamped[1]!=functions[0].sample(xs.back()))
+        FAIL("sampleMany() doesn't clamp out-of-range points to the domain");
+
+    std::cout << "Sampling " << funcCount << " functions at " << queryCount << " points, " << repetitions << " times:\n"
+              << "  sample():     " << scalarTime*1e3 << " ms\n"
+              << "  sampleMany(): " << batchTime*1e3 << " ms\n"
+              << "  speedup: " << scalarTime/batchTime << "\n";
+}
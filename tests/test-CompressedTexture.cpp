@@ -0,0 +1,118 @@
+#include <random>
+#include <vector>
+#include <cstring>
+#include <iostream>
+#include <QTemporaryFile>
+#include "../common/CompressedTexture.hpp"
+#include "../common/util.hpp"
+
+#define FAIL(details) { std::cerr << __FILE__ << ":" << __LINE__  << ": test failed: " << details << "\n"; return 1; }
+
+const std::vector<int> sizes{7, 5, 3, 4};
+
+std::vector<float> makeTexture()
+{
+    std::mt19937 gen(17);
+    std::uniform_real_distribution<float> dist(0, 1);
+    std::vector<float> data(4*sizes[0]*sizes[1]*sizes[2]*sizes[3]);
+    for(auto& x : data)
+        x = dist(gen);
+    return data;
+}
+
+int testRoundTrip(const uint16_t flags)
+{
+    const auto data=makeTexture();
+    QTemporaryFile file;
+    if(!file.open())
+        FAIL("failed to create temporary file: " << file.errorString());
+    if(const auto error=writeCompressedTexture(file, data.data(), sizes, 4*sizeof data[0], sizeof data[0], flags); !error.isEmpty())
+        FAIL("failed to write texture: " << error);
+    file.seek(0);
+
+    if(!isCompressedTexture(file))
+        FAIL("written file isn't recognized as a compressed texture");
+    const auto mappedData=file.map(0, file.size());
+    if(!mappedData)
+        FAIL("failed to map the file: " << file.errorString());
+    if(!isCompressedTexture(mappedData, file.size()))
+        FAIL("mapped file isn't recognized as a compressed texture");
+    const CompressedTextureReader reader(mappedData, file.size(), file.fileName());
+    if(reader.sizes()!=sizes)
+        FAIL("sizes read don't match sizes written");
+    if(reader.sliceCount()!=size_t(sizes.back()))
+        FAIL("wrong slice count " << reader.sliceCount());
+    const size_t sliceSubpixelCount=4*sizes[0]*sizes[1]*sizes[2];
+    if(reader.sliceByteSize()!=sliceSubpixelCount*sizeof data[0])
+        FAIL("wrong slice byte size " << reader.sliceByteSize());
+
+    // Read in reverse order to check that slices are really independent
+    std::vector<float> slice(sliceSubpixelCount);
+    for(int n=sizes.back()-1; n>=0; --n)
+    {
+        reader.readSlice(n, reinterpret_cast<char*>(slice.data()));
+        if(std::memcmp(slice.data(), data.data()+n*sliceSubpixelCount, reader.sliceByteSize()) != 0)
+            FAIL("slice " << n << " differs from the original");
+    }
+    return 0;
+}
+
+int testCorruptionDetection()
+{
+    const auto data=makeTexture();
+    QTemporaryFile file;
+    if(!file.open())
+        FAIL("failed to create temporary file: " << file.errorString());
+    if(const auto error=writeCompressedTexture(file, data.data(), sizes, 4*sizeof data[0], sizeof data[0]); !error.isEmpty())
+        FAIL("failed to write texture: " << error);
+
+    // Flip a bit in the last byte of the file, which belongs to the last slice
+    file.seek(file.size()-1);
+    char byte;
+    file.getChar(&byte);
+    file.seek(file.size()-1);
+    file.putChar(byte ^ 1);
+    file.flush();
+
+    const auto mappedData=file.map(0, file.size());
+    if(!mappedData)
+        FAIL("failed to map the file: " << file.errorString());
+    const CompressedTextureReader reader(mappedData, file.size(), file.fileName());
+    std::vector<float> slice(reader.sliceByteSize()/sizeof data[0]);
+    reader.readSlice(0, reinterpret_cast<char*>(slice.data()));
+    try
+    {
+        reader.readSlice(sizes.back()-1, reinterpret_cast<char*>(slice.data()));
+    }
+    catch(DataLoadError const&)
+    {
+        return 0;
+    }
+    FAIL("corrupt slice was read without error");
+}
+
+int main(int argc, char** argv)
+try
+{
+    if(argc!=2)
+    {
+        std::cerr << "Which test to run?\n";
+        return 1;
+    }
+
+    const std::string arg=argv[1];
+    if(arg=="round trip")
+        return testRoundTrip(COMPRESSED_TEX_BYTE_SHUFFLE);
+    if(arg=="round trip without shuffling")
+        return testRoundTrip(0);
+    if(arg=="corruption detection")
+        return testCorruptionDetection();
+
+    std::cerr << "Unknown test " << arg << "\n";
+    return 1;
+}
+catch(ShowMySky::Error const& ex)
+{
+    std::cerr << ex.what() << "\n";
+    return 1;
+}
@@ -126,6 +126,41 @@ int testFractionalUpsampling(const bool oddInputSize)
     return 0;
 }
 
+int testReusedInterpolator(const bool oddInputSize)
+{
+    if(int(oddInputSize) != input.size()%2)
+        input.pop_back();
+
+    // Split the input into rows, and check that the reused interpolator gives the same results as the one-off function
+    const unsigned rowLength = oddInputSize ? 15 : 16;
+    const unsigned rowCount = input.size()/rowLength;
+    const unsigned outRowLength = 5*rowLength+1;
+    FourierInterpolator interpolator(rowLength, outRowLength);
+    std::vector<float> reused(rowCount*outRowLength);
+    // Twice to check that the state left by the first pass doesn't affect the results
+    for(int pass=0; pass<2; ++pass)
+    {
+        for(unsigned row=0; row<rowCount; ++row)
+            interpolator.interpolate(&input[row*rowLength], &reused[row*outRowLength]);
+    }
+
+    std::vector<float> single(outRowLength);
+    std::vector<std::complex<float>> intermediate(single.size());
+    for(unsigned row=0; row<rowCount; ++row)
+    {
+        fourierInterpolate(&input[row*rowLength], rowLength, intermediate.data(), single.data(), single.size());
+        for(unsigned k=0; k<outRowLength; ++k)
+        {
+            const auto diff = single[k]-reused[row*outRowLength+k];
+            if(std::abs(diff) > interpolationAbsoluteTolerance)
+                FAIL("reused interpolator output value at row " << row << ", index " << k << " differs from single-row output by "
+                     << diff << ", which is more than " << interpolationAbsoluteTolerance << "\n");
+        }
+    }
+
+    return 0;
+}
+
 int main(int argc, char** argv)
 {
     std::cerr.precision(std::numeric_limits<float>::max_digits10);
@@ -150,6 +185,8 @@ int main(int argc, char** argv)
         return testIntegralUpsampling(odd);
     if(arg=="fractional upsampling")
         return testFractionalUpsampling(odd);
+    if(arg=="reused interpolator")
+        return testReusedInterpolator(odd);
 
     std::cerr << "Unknown test " << arg << "\n";
     return 1;
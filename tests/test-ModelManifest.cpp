@@ -0,0 +1,193 @@
+#include <vector>
+#include <cstring>
+#include <iostream>
+#include <QTemporaryDir>
+#include <QFile>
+#include <QDir>
+#include "../common/AtmosphereParameters.hpp"
+#include "../common/CompressedTexture.hpp"
+#include "../common/ModelManifest.hpp"
+#include "../common/ModelBundle.hpp"
+#include "../common/util.hpp"
+
+#define FAIL(details) { std::cerr << __FILE__ << ":" << __LINE__  << ": test failed: " << details << "\n"; return 1; }
+
+const std::vector<int> sizes4D{6, 5, 3, 4};
+const std::vector<int> sizes2D{8, 2};
+
+bool writeFile(QString const& path, QByteArray const& contents)
+{
+    QFile file(path);
+    return file.open(QFile::WriteOnly) && file.write(contents)==contents.size();
+}
+
+QByteArray makeTexture(std::vector<int> const& sizes)
+{
+    QByteArray data;
+    size_t pixelCount=1;
+    for(const uint16_t size : sizes)
+    {
+        data.append(reinterpret_cast<const char*>(&size), sizeof size);
+        pixelCount *= size;
+    }
+    for(size_t n=0; n<4*pixelCount; ++n)
+    {
+        const float value=n*0.25f;
+        data.append(reinterpret_cast<const char*>(&value), sizeof value);
+    }
+    return data;
+}
+
+bool makeModel(QString const& dir)
+{
+    const QByteArray params = "version: 6\n"
+                              "wavelengths: min=400nm,max=700nm,count=4\n"
+                              "solar irradiance at toa: 1,2,3,4\n"
+                              "scattering texture size for vza: 6\n"
+                              "scattering texture size for dot(view,sun): 5\n"
+                              "scattering texture size for sza: 3\n"
+                              "scattering texture size for altitude: 4\n"
+                              "earth radius: 6371km\n"
+                              "atmosphere height: 120km\n";
+    return QDir().mkpath(dir+"/shaders/multiple-scattering") &&
+           writeFile(dir+"/params.atmo", params) &&
+           writeFile(dir+"/shaders/multiple-scattering/0.frag", "void main() {}\n") &&
+           writeFile(dir+"/multiple-scattering-xyzw.f32", makeTexture(sizes4D)) &&
+           writeFile(dir+"/transmittance-wlset0.f32", makeTexture(sizes2D));
+}
+
+int testRoundTrip()
+{
+    QTemporaryDir dir;
+    if(!dir.isValid() || !makeModel(dir.path()))
+        FAIL("failed to create the model files");
+    if(const auto error=writeModelManifest(dir.path()); !error.isEmpty())
+        FAIL("failed to write the manifest: " << error);
+    const auto manifest=readModelManifest(dir.path()+"/"+MODEL_MANIFEST_FILENAME);
+
+    if(manifest.artifacts.size()!=4)
+        FAIL("wrong artifact count " << manifest.artifacts.size());
+    if(!manifest.contains("shaders/multiple-scattering") || !manifest.contains("shaders/multiple-scattering/") ||
+       !manifest.contains("shaders") || manifest.contains("shaders/light-pollution") || manifest.contains("shader"))
+        FAIL("directory lookup gives wrong results");
+    if(manifest.find(MODEL_MANIFEST_FILENAME))
+        FAIL("manifest lists itself");
+
+    const auto texture4D=manifest.find("multiple-scattering-xyzw.f32");
+    if(!texture4D || texture4D->kind!=ModelManifest::ArtifactKind::Texture4D)
+        FAIL("4D texture is missing or has wrong kind");
+    if(texture4D->sizes!=sizes4D || texture4D->pixelSize!=4*sizeof(float))
+        FAIL("4D texture has wrong layout");
+    const auto data=makeTexture(sizes4D);
+    if(texture4D->size!=data.size() || texture4D->checksum!=crc32(data.constData(), data.size()))
+        FAIL("4D texture has wrong size or checksum");
+    if(texture4D->sliceChecksums.size()!=size_t(sizes4D.back()))
+        FAIL("wrong count of slice checksums: " << texture4D->sliceChecksums.size());
+    for(int n=0; n<sizes4D.back(); ++n)
+    {
+        const auto slice=data.constData()+texture4D->firstSliceOffset+n*texture4D->sliceByteSize;
+        if(crc32(slice, texture4D->sliceByteSize)!=texture4D->sliceChecksums[n])
+            FAIL("wrong checksum of slice " << n);
+    }
+
+    const auto texture2D=manifest.find("transmittance-wlset0.f32");
+    if(!texture2D || texture2D->kind!=ModelManifest::ArtifactKind::Texture2D || texture2D->sizes!=sizes2D)
+        FAIL("2D texture is missing or has wrong kind or layout");
+    const auto shader=manifest.find("shaders/multiple-scattering/0.frag");
+    if(!shader || shader->kind!=ModelManifest::ArtifactKind::Shader)
+        FAIL("shader is missing or has wrong kind");
+
+    AtmosphereParameters parsed, deserialized;
+    parsed.parse(dir.path()+"/params.atmo", AtmosphereParameters::ForceNoEDSTextures{false}, AtmosphereParameters::SkipSpectra{true});
+    deserialized.deserialize(manifest.parameters);
+    if(deserialized.allWavelengths!=parsed.allWavelengths || deserialized.solarIrradianceAtTOA!=parsed.solarIrradianceAtTOA ||
+       deserialized.scatteringTextureSize!=parsed.scatteringTextureSize || deserialized.earthRadius!=parsed.earthRadius ||
+       deserialized.lengthOfHorizRayFromGroundToBorderOfAtmo!=parsed.lengthOfHorizRayFromGroundToBorderOfAtmo)
+        FAIL("deserialized parameters differ from the parsed ones");
+    return 0;
+}
+
+int testTruncatedManifest()
+{
+    QTemporaryDir dir;
+    if(!dir.isValid() || !makeModel(dir.path()))
+        FAIL("failed to create the model files");
+    if(const auto error=writeModelManifest(dir.path()); !error.isEmpty())
+        FAIL("failed to write the manifest: " << error);
+    const auto path=dir.path()+"/"+MODEL_MANIFEST_FILENAME;
+    QFile file(path);
+    if(!file.resize(file.size()-3))
+        FAIL("failed to truncate the manifest: " << file.errorString());
+    try
+    {
+        readModelManifest(path);
+    }
+    catch(DataLoadError const&)
+    {
+        return 0;
+    }
+    FAIL("truncated manifest was read without error");
+}
+
+int testBundle()
+{
+    QTemporaryDir dir;
+    if(!dir.isValid() || !makeModel(dir.path()+"/model"))
+        FAIL("failed to create the model files");
+    const auto modelDir=dir.path()+"/model";
+    if(const auto error=writeModelManifest(modelDir); !error.isEmpty())
+        FAIL("failed to write the manifest: " << error);
+    const auto bundlePath=dir.path()+"/model.bundle";
+    if(const auto error=writeModelBundle(modelDir, bundlePath); !error.isEmpty())
+        FAIL("failed to write the bundle: " << error);
+    if(!isModelBundle(bundlePath) || isModelBundle(modelDir+"/params.atmo"))
+        FAIL("bundle detection gives wrong results");
+
+    const ModelBundle bundle(bundlePath);
+    const auto manifest=readModelManifest(modelDir+"/"+MODEL_MANIFEST_FILENAME);
+    if(bundle.entries().size()!=manifest.artifacts.size()+1)
+        FAIL("wrong entry count " << bundle.entries().size());
+    for(const auto& entry : bundle.entries())
+    {
+        if(entry.offset % modelBundleAlignment)
+            FAIL("entry \"" << entry.path << "\" is not aligned");
+        QFile file(modelDir+"/"+entry.path);
+        if(!file.open(QFile::ReadOnly))
+            FAIL("failed to open \"" << entry.path << "\": " << file.errorString());
+        const auto original=file.readAll();
+        if(original.size()!=entry.size || std::memcmp(original.constData(), bundle.data(entry), entry.size)!=0)
+            FAIL("contents of \"" << entry.path << "\" differ from the original");
+    }
+    if(!bundle.find(MODEL_MANIFEST_FILENAME) || bundle.find("params"))
+        FAIL("file lookup gives wrong results");
+    const auto shaders=bundle.filesInDirectory("shaders/multiple-scattering");
+    if(shaders.size()!=1 || shaders[0]->path!="shaders/multiple-scattering/0.frag" || !bundle.filesInDirectory("shaders").empty())
+        FAIL("directory listing gives wrong results");
+    return 0;
+}
+
+int main(int argc, char** argv)
+try
+{
+    if(argc!=2)
+    {
+        std::cerr << "Which test to run?\n";
+        return 1;
+    }
+
+    const std::string arg=argv[1];
+    if(arg=="round trip")
+        return testRoundTrip();
+    if(arg=="truncated manifest")
+        return testTruncatedManifest();
+    if(arg=="bundle")
+        return testBundle();
+
+    std::cerr << "Unknown test " << arg << "\n";
+    return 1;
+}
+catch(ShowMySky::Error const& ex)
+{
+    std::cerr << ex.what() << "\n";
+    return 1;
+}
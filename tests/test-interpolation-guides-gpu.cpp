@@ -0,0 +1,164 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <sstream>
+#include <iostream>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QGuiApplication>
+#include <QOpenGLContext>
+#include <QOffscreenSurface>
+#include <QOpenGLFunctions_3_3_Core>
+#include "../CalcMySky/interpolation-guides.hpp"
+#include "../CalcMySky/interpolation-guides-gpu.hpp"
+#include "../CalcMySky/util.hpp"
+
+#define FAIL(details) { std::cerr << __FILE__ << ":" << __LINE__  << ": test failed: " << details << "\n"; return 1; }
+
+// Matches the return code for skipped tests set in CMakeLists.txt
+constexpr int SKIP = 77;
+
+// Returns the angles without the header
+std::vector<int16_t> readGuides(QString const& path)
+{
+    QFile file(path);
+    if(!file.open(QFile::ReadOnly))
+        return {};
+    const auto data = file.readAll();
+    constexpr int headerSize = 4*sizeof(uint16_t);
+    if(data.size() < headerSize)
+        return {};
+    std::vector<int16_t> angles((data.size() - headerSize) / sizeof(int16_t));
+    std::memcpy(angles.data(), data.data()+headerSize, angles.size()*sizeof angles[0]);
+    return angles;
+}
+
+// Returns the warnings about multiple maxima, each with its row data, skipping the rest of the log
+std::vector<std::string> extractWarnings(std::string const& log)
+{
+    std::vector<std::string> warnings;
+    const std::string marker = "warning: ";
+    for(auto pos = log.find(marker); pos != std::string::npos; pos = log.find(marker, pos))
+    {
+        // The warning line, the "Row data:" line and the data line
+        auto end = pos;
+        for(int line = 0; line < 3 && end != std::string::npos; ++line)
+            end = log.find('\n', end+1);
+        warnings.push_back(log.substr(pos, end==std::string::npos ? end : end-pos));
+        pos = end;
+    }
+    return warnings;
+}
+
+// Compares the guides generated on the GPU against those of the reference CPU implementation
+int main(int argc, char** argv)
+{
+    QGuiApplication app(argc, argv);
+
+    QSurfaceFormat format;
+    format.setMajorVersion(3);
+    format.setMinorVersion(3);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+    QOpenGLContext context;
+    context.setFormat(format);
+    QOffscreenSurface surface;
+    surface.setFormat(format);
+    surface.create();
+    if(!context.create() || !context.makeCurrent(&surface))
+    {
+        std::cerr << "OpenGL 3.3 is not available, skipping the test\n";
+        return SKIP;
+    }
+    QOpenGLFunctions_3_3_Core gl;
+    if(!gl.initializeOpenGLFunctions())
+    {
+        std::cerr << "Failed to resolve OpenGL 3.3 functions, skipping the test\n";
+        return SKIP;
+    }
+
+    const int vzaCount = 64, dVSCount = 16, szaCount = 8, altCount = 12;
+    const std::vector<int> sizes{vzaCount, dVSCount, szaCount, altCount};
+    // A ridge shifting with all the coordinates, which the guides are supposed to follow, plus some ripple
+    std::vector<glm::vec4> pixels(vzaCount*dVSCount*szaCount*altCount);
+    for(unsigned i = 0; i < pixels.size(); ++i)
+    {
+        const int vza = i % vzaCount, dVS = i/vzaCount % dVSCount, sza = i/vzaCount/dVSCount % szaCount, alt = i/vzaCount/dVSCount/szaCount;
+        const float x = vza - 0.6f*vzaCount - dVS - 0.7f*sza - 0.3f*alt;
+        pixels[i] = glm::vec4(std::exp(-0.01f*x*x) + 1e-3f*std::sin(0.37f*i));
+        // A second peak in some rows, to check the warnings about multiple maxima
+        if(dVS == 3 && sza % 3 == 0 && vza == vzaCount-4)
+            pixels[i] += glm::vec4(0.5f);
+    }
+
+    QTemporaryDir dir;
+    if(!dir.isValid())
+        FAIL("failed to create temporary directory");
+    std::ostringstream cpuLog;
+    const auto origCerrBuf = std::cerr.rdbuf(cpuLog.rdbuf());
+    try
+    {
+        generateInterpolationGuidesForScatteringTexture(dir.filePath("scattering.f32").toStdString(), pixels, sizes);
+        std::cerr.rdbuf(origCerrBuf);
+    }
+    catch(MustQuit const&)
+    {
+        std::cerr.rdbuf(origCerrBuf);
+        FAIL("CPU implementation failed");
+    }
+    const auto expectedWarnings = extractWarnings(cpuLog.str());
+    if(expectedWarnings.empty())
+        FAIL("CPU implementation didn't warn about multiple maxima");
+
+    GLuint texture = 0;
+    gl.glGenTextures(1, &texture);
+    gl.glBindTexture(GL_TEXTURE_3D, texture);
+    gl.glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F, vzaCount, dVSCount*szaCount, altCount,
+                    0, GL_RGBA, GL_FLOAT, pixels.data());
+
+    if(!InterpolationGuidesGPUGenerator::canGenerate(gl, sizes))
+        FAIL("the texture is reported as too large for the GPU implementation");
+    InterpolationGuidesGPUGenerator generator(gl);
+    using Dimensions = InterpolationGuidesGPUGenerator::Dimensions;
+    for(const auto dimensions : {Dimensions::VZA_dotViewSun, Dimensions::VZA_SZA})
+    try
+    {
+        const auto fileName = dimensions==Dimensions::VZA_SZA ? "scattering-dims02.guides2d" : "scattering-dims01.guides2d";
+        const auto expected = readGuides(dir.filePath(fileName));
+        if(expected.empty())
+            FAIL("failed to read guides generated by CPU from " << fileName);
+        std::ostringstream gpuWarnings;
+        const auto actual = generator.generate(texture, sizes, dimensions, gpuWarnings);
+        if(actual.size() != expected.size())
+            FAIL("GPU generated " << actual.size() << " angles instead of " << expected.size() << " for " << fileName);
+
+        // Some values may differ in rounding due to the different order of operations
+        constexpr int tolerance = 1;
+        int maxDiff = 0;
+        unsigned outlierCount = 0;
+        for(unsigned n = 0; n < actual.size(); ++n)
+        {
+            const auto diff = std::abs(actual[n] - expected[n]);
+            maxDiff = std::max(maxDiff, diff);
+            if(diff > tolerance)
+                ++outlierCount;
+        }
+        std::cerr << fileName << ": max difference " << maxDiff << ", " << outlierCount << " values out of tolerance\n";
+        if(outlierCount)
+            FAIL(outlierCount << " angles generated on GPU differ from the reference by more than " << tolerance << " for " << fileName);
+
+        // The CPU implementation checks the rows only for the VZA-dotViewSun dimensions
+        const auto actualWarnings = extractWarnings(gpuWarnings.str());
+        if(dimensions==Dimensions::VZA_dotViewSun ? actualWarnings != expectedWarnings : !actualWarnings.empty())
+            FAIL("GPU reported " << actualWarnings.size() << " rows with multiple maxima instead of "
+                 << (dimensions==Dimensions::VZA_dotViewSun ? expectedWarnings.size() : 0) << " for " << fileName
+                 << ", or their warnings differ");
+    }
+    catch(std::exception const& ex)
+    {
+        FAIL(ex.what());
+    }
+    gl.glDeleteTextures(1, &texture);
+}